@@ -54,18 +54,28 @@ struct mm_mapping {
 
 typedef unsigned int cbuf_t;
 struct mm_page {
-	void *page;
+	void  *page; /* NULL once the frame is reclaimed */
+	cbuf_t span; /* the span the page is part of */
 	struct mm_mapping mappings[MM_MAPPINGS_MAX];
 };
 
-/* Span of pages, indexed by cbuf_t */
+/*
+ * Span of pages, indexed by cbuf_t. All memory is allocated in spans,
+ * but only shared spans can be mapped by other components.
+ */
 struct mm_span {
 	unsigned int page_off;
 	unsigned int n_pages;
+	unsigned int n_live; /* pages whose frames are not yet reclaimed */
+	int          super;  /* mapped with superpages? */
+	int          shared; /* can other components map the span? */
 };
 
 SS_STATIC_SLAB(comp, struct cm_comp, MAX_NUM_COMPS);
+/* indexed by thread id, so that frees find the thread directly */
 SS_STATIC_SLAB(thd, struct cm_thd, MAX_NUM_THREADS);
+/* components' initial threads are created before their id is known, and are never freed */
+SS_STATIC_SLAB(initthd, struct cm_thd, MAX_NUM_COMPS);
 /* These size values are somewhat arbitrarily chosen */
 SS_STATIC_SLAB(rcv, struct cm_rcv, MAX_NUM_THREADS);
 SS_STATIC_SLAB(asnd, struct cm_asnd, MAX_NUM_THREADS);
@@ -76,6 +86,28 @@ SS_STATIC_SLAB(asnd, struct cm_asnd, MAX_NUM_THREADS);
 SS_STATIC_SLAB(page, struct mm_page, MM_NPAGES);
 SS_STATIC_SLAB(span, struct mm_span, MM_NPAGES);
 
+/*
+ * Frames that no component maps anymore, in the order they were
+ * unmapped. They are still mapped here, at the addresses in the ring,
+ * and can be reused once all TLBs have been flushed since they were
+ * unmapped. As the ring is ordered by unmapping time, that only needs
+ * to be checked for the most recently unmapped frame to be reused.
+ *
+ * The rings start with MM_NPAGES entries (a power of two). That is
+ * more superpages than the address space holds, so the superpage
+ * ring can't fill, but the page ring grows when it does.
+ */
+struct mm_freelist {
+	unsigned long head, tail;
+	unsigned long sz;
+	void        **frames;
+};
+static void              *mm_free_pages_init[MM_NPAGES], *mm_free_superpages_init[MM_NPAGES];
+static struct mm_freelist mm_free_pages      = { .sz = MM_NPAGES, .frames = mm_free_pages_init };
+static struct mm_freelist mm_free_superpages = { .sz = MM_NPAGES, .frames = mm_free_superpages_init };
+/* Protects the freelists, and the unmapping and reclamation of spans */
+static struct ps_lock     mm_lock;
+
 static struct cm_comp *
 cm_self(void)
 {
@@ -132,153 +164,416 @@ cm_rcv_alloc_in(struct crt_comp *c, struct crt_rcv *sched, thdclosure_index_t cl
 struct cm_thd *
 cm_thd_alloc_in(struct cm_comp *c, struct cm_comp *sched, thdclosure_index_t closure_id)
 {
-	struct cm_thd *t = ss_thd_alloc();
+	struct cm_thd *t;
+	struct crt_thd thd;
 	struct crt_thd_resources res = { 0 };
 
-	if (!t) return NULL;
-	if (crt_thd_create_in(&t->thd, &c->comp, closure_id)) {
-		ss_thd_free(t);
+	if (crt_thd_create_in(&thd, &c->comp, closure_id)) {
 		printc("capmgr: couldn't create new thread correctly.\n");
 		return NULL;
 	}
-	ss_thd_activate(t);
+	t = ss_thd_alloc_at_id(thd.tid);
+	if (!t) {
+		printc("capmgr: thread id %lu already tracked.\n", thd.tid);
+		crt_thd_free(&thd);
+		return NULL;
+	}
+	t->thd = thd;
 	if (crt_thd_alias_in(&t->thd, &sched->comp, &res)) {
 		printc("capmgr: couldn't alias correctly.\n");
-		/* FIXME: reclaim the thread */
+		crt_thd_free(&t->thd);
+		ss_thd_free(t);
 		return NULL;
 	}
 	t->sched       = sched;
 	t->aliased_cap = res.cap;
 	t->client      = c;
 	/* FIXME: should take a reference to the scheduler */
+	ss_thd_activate(t);
 
 	return t;
 }
 
-/**
- * Allocate a page from the pool of physical memory into a component.
- *
- * - @c - The component to allocate into.
- * - @return - the allocated and initialized page, or `NULL` if no
- *   page is available.
+/*
+ * Allocate num_pages pages with contiguous ids, thus contiguous
+ * structures, in the constructing state.
  */
 static struct mm_page *
-mm_page_alloc(struct cm_comp *c)
+mm_page_ids_alloc(unsigned long num_pages)
 {
-	struct mm_mapping *m;
-	struct mm_page    *ret = NULL, *p;
-	int    i;
+	struct mm_page *p, *first;
+	unsigned long   id, i, j;
+
+	for (id = 1; id + num_pages <= MM_NPAGES + 1; id += i + 1) {
+		first = NULL;
+		for (i = 0; i < num_pages; i++) {
+			p = ss_page_alloc_at_id(id + i);
+			if (!p) break;
+			if (!first) first = p;
+		}
+		if (i == num_pages) return first;
 
-	p = ss_page_alloc();
-	if (!p) return NULL;
+		/* id + i is taken: undo, and continue the search past it */
+		for (j = 0; j < i; j++) ss_page_free(first + j);
+	}
 
-	m = &p->mappings[0];
-	if (ss_state_alloc(&m->comp)) BUG();
+	return NULL;
+}
 
-	/* Allocate page, map page */
-	p->page = crt_page_allocn(&cm_self()->comp, 1);
-	if (!p->page) ERR_THROW(NULL, free_p);
-	if (crt_page_aliasn_in(p->page, 1, &cm_self()->comp, &c->comp, &m->addr)) BUG();
+/*
+ * Double the size of the page ring, keeping its order. The previous
+ * storage, unless it is the initial static array, is pages of our
+ * own that no one else maps, so they are added to the new ring. Must
+ * hold `mm_lock`.
+ */
+static int
+mm_freelist_grow(struct mm_freelist *fl)
+{
+	unsigned long sz = fl->sz * 2, i;
+	unsigned long old_npages = round_up_to_page(fl->sz * sizeof(void *)) / PAGE_SIZE;
+	void        **frames, **old = fl->frames;
 
-	ss_state_activate_with(&m->comp, (word_t)c);
-	ss_page_activate(p);
-	ret = p;
-done:
-	return ret;
-free_p:
-	ss_page_free(p);
-	goto done;
+	assert(fl == &mm_free_pages);
+	frames = crt_page_allocn(&cm_self()->comp, round_up_to_page(sz * sizeof(void *)) / PAGE_SIZE);
+	if (!frames) return -ENOMEM;
+
+	for (i = fl->head; i != fl->tail; i++) frames[i % sz] = fl->frames[i % fl->sz];
+	fl->frames = frames;
+	fl->sz     = sz;
+	if (old == mm_free_pages_init) return 0;
+
+	/* the ring is half full, and the old storage is fewer pages than that */
+	for (i = 0; i < old_npages; i++) fl->frames[fl->tail++ % fl->sz] = (char *)old + i * PAGE_SIZE;
+
+	return 0;
 }
 
-static struct mm_page *
-mm_page_allocn(struct cm_comp *c, unsigned long num_pages)
+/*
+ * Take the frames for the pages from the freelist, if enough of them
+ * have quiesced, and zero them so that their previous contents don't
+ * leak.
+ *
+ * - @return - `0` on success, `-EAGAIN` if new frames must be
+ *   allocated instead.
+ */
+static int
+mm_frames_reuse(struct mm_page *pages, unsigned long num_pages, int super)
 {
-	struct mm_page *p, *prev, *initial;
+	struct mm_freelist *fl      = super ? &mm_free_superpages : &mm_free_pages;
+	unsigned long       npages  = super ? SUPER_PAGE_NPAGES : 1;
+	unsigned long       nframes = num_pages / npages, i, j;
+	void               *frame;
+
+	ps_lock_take(&mm_lock);
+	if (fl->tail - fl->head < nframes ||
+	    crt_page_quiesced(&cm_self()->comp, fl->frames[(fl->head + nframes - 1) % fl->sz]) != 1) {
+		ps_lock_release(&mm_lock);
+
+		return -EAGAIN;
+	}
+	for (i = 0; i < nframes; i++) {
+		frame = fl->frames[(fl->head + i) % fl->sz];
+		for (j = 0; j < npages; j++) pages[i * npages + j].page = frame + j * PAGE_SIZE;
+	}
+	fl->head += nframes;
+	ps_lock_release(&mm_lock);
+
+	for (i = 0; i < num_pages; i++) memset(pages[i].page, 0, PAGE_SIZE);
+
+	return 0;
+}
+
+/*
+ * Return the frames of pages that no component maps (e.g. as mapping
+ * them failed) to the freelist.
+ */
+static void
+mm_frames_free(struct mm_page *pages, unsigned long num_pages, int super)
+{
+	struct mm_freelist *fl     = super ? &mm_free_superpages : &mm_free_pages;
+	unsigned long       npages = super ? SUPER_PAGE_NPAGES : 1, i;
+
+	ps_lock_take(&mm_lock);
+	for (i = 0; i < num_pages; i += npages) {
+		/* out of memory for the ring: the remaining frames are lost */
+		if (fl->tail - fl->head == fl->sz && (super || mm_freelist_grow(fl))) break;
+		fl->frames[fl->tail++ % fl->sz] = pages[i].page;
+	}
+	ps_lock_release(&mm_lock);
+}
+
+/* Allocate new, contiguous, frames for the pages */
+static int
+mm_frames_alloc(struct mm_page *pages, unsigned long num_pages, int super)
+{
+	void         *mem;
 	unsigned long i;
 
-	initial = prev = p = mm_page_alloc(c);
-	if (!p) return 0;
-	for (i = 1; i < num_pages; i++) {
-		p = mm_page_alloc(c);
-		if (!p) return NULL;
-		if ((prev->page + 4096) != p->page) {
-			BUG(); /* FIXME: handle concurrency */
-		}
-		prev = p;
+	if (super) mem = crt_superpage_allocn(&cm_self()->comp, num_pages / SUPER_PAGE_NPAGES);
+	else       mem = crt_page_allocn(&cm_self()->comp, num_pages);
+	if (!mem) return -ENOMEM;
+
+	for (i = 0; i < num_pages; i++) pages[i].page = mem + i * PAGE_SIZE;
+
+	return 0;
+}
+
+/* Unmap the first num_pages pages of span s, mapped at addr in c */
+static int
+mm_span_unmap(struct mm_span *s, struct cm_comp *c, vaddr_t addr, unsigned long num_pages)
+{
+	if (num_pages == 0) return 0;
+	if (s->super) return crt_superpage_unmapn(&c->comp, addr, num_pages / SUPER_PAGE_NPAGES);
+
+	return crt_page_unmapn(&c->comp, addr, num_pages);
+}
+
+/*
+ * Map the frames of a span contiguously into c, with a range alias
+ * for each run of frames that is contiguous here. On failure, the
+ * frames mapped so far are unmapped (the virtual addresses are not
+ * reclaimed).
+ *
+ * - @return - `0` on success, `-ENOMEM` if the frames are no longer
+ *   mapped into c, and `-EINVAL` if unmapping them failed, thus they
+ *   must not be reused.
+ */
+static int
+mm_span_map(struct mm_span *s, struct mm_page *pages, struct cm_comp *c, vaddr_t *addr)
+{
+	unsigned long i, j, n, step = s->super ? SUPER_PAGE_NPAGES : 1;
+
+	if (s->super) *addr = crt_superpage_vallocn(&c->comp, s->n_pages / SUPER_PAGE_NPAGES);
+	else          *addr = crt_page_vallocn(&c->comp, s->n_pages);
+	if (!*addr) return -ENOMEM;
+
+	for (i = 0; i < s->n_pages; i += n) {
+		for (n = step; i + n < s->n_pages && pages[i + n].page == pages[i].page + n * PAGE_SIZE; n += step) ;
+		if (crt_page_aliasn_at(pages[i].page, n, &cm_self()->comp, &c->comp, *addr + i * PAGE_SIZE)) goto unwind;
 	}
 
-	return initial;
+	return 0;
+unwind:
+	/* the failed alias mapped a prefix of its run: unmap up to the first unmapped page */
+	for (j = i; j < i + n && !mm_span_unmap(s, c, *addr + j * PAGE_SIZE, step); j += step) ;
+	if (mm_span_unmap(s, c, *addr, i)) return -EINVAL;
+	*addr = 0;
+
+	return -ENOMEM;
+}
+
+/**
+ * Allocate a span of pages from the pool of physical memory into a
+ * component. Reclaimed frames are reused if they have quiesced,
+ * otherwise new contiguous memory is allocated. The pages are tracked
+ * by contiguous page ids.
+ *
+ * - @c - The component to allocate into.
+ * - @num_pages - The number of pages (a multiple of
+ *   `SUPER_PAGE_NPAGES` if @super).
+ * - @super - map the memory with superpages, both here and in the
+ *   component? Each superpage is still tracked as `SUPER_PAGE_NPAGES`
+ *   pages.
+ * - @shared - can other components map the span?
+ * - @return - the span, or `NULL` if the memory is not available.
+ */
+static struct mm_span *
+mm_span_allocn(struct cm_comp *c, unsigned long num_pages, int super, int shared)
+{
+	struct mm_span    *s;
+	struct mm_page    *pages;
+	struct mm_mapping *m;
+	unsigned long      i;
+	vaddr_t            addr;
+	int                ret;
+
+	if (num_pages == 0) return NULL;
+	s = ss_span_alloc();
+	if (!s) return NULL;
+	pages = mm_page_ids_alloc(num_pages);
+	if (!pages) goto free_span;
+	if (mm_frames_reuse(pages, num_pages, super) && mm_frames_alloc(pages, num_pages, super)) goto free_pages;
+
+	*s = (struct mm_span) {
+		.page_off = ss_page_id(pages),
+		.n_pages  = num_pages,
+		.n_live   = num_pages,
+		.super    = super,
+		.shared   = shared
+	};
+	ret = mm_span_map(s, pages, c, &addr);
+	if (ret) goto free_frames;
+
+	for (i = 0; i < num_pages; i++) {
+		m = &pages[i].mappings[0];
+		if (ss_state_alloc(&m->comp)) BUG();
+		pages[i].span = ss_span_id(s);
+		m->addr       = addr + i * PAGE_SIZE;
+		ss_state_activate_with(&m->comp, (word_t)c);
+		ss_page_activate(&pages[i]);
+	}
+	ss_span_activate(s);
+
+	return s;
+free_frames:
+	/* frames that c still maps are lost rather than reused */
+	if (ret == -ENOMEM) mm_frames_free(pages, num_pages, super);
+free_pages:
+	for (i = 0; i < num_pages; i++) ss_page_free(&pages[i]);
+free_span:
+	ss_span_free(s);
+
+	return NULL;
 }
 
 vaddr_t
 memmgr_heap_page_allocn(unsigned long num_pages)
 {
 	struct cm_comp *c;
-	struct mm_page *p;
+	struct mm_span *s;
 
 	c = ss_comp_get(cos_inv_token());
 	if (!c) return 0;
-	p = mm_page_allocn(c, num_pages);
-	if (!p) return 0;
+	s = mm_span_allocn(c, num_pages, 0, 0);
+	if (!s) return 0;
 
-	return (vaddr_t)p->mappings[0].addr;
+	return ss_page_get(s->page_off)->mappings[0].addr;
 }
 
-cbuf_t
-memmgr_shared_page_allocn(unsigned long num_pages, vaddr_t *pgaddr)
+vaddr_t
+memmgr_heap_superpage_allocn(unsigned long num_superpages)
 {
 	struct cm_comp *c;
-	struct mm_page *p;
 	struct mm_span *s;
-	cbuf_t ret = 0;
 
 	c = ss_comp_get(cos_inv_token());
 	if (!c) return 0;
-	s = ss_span_alloc();
+	s = mm_span_allocn(c, num_superpages * SUPER_PAGE_NPAGES, 1, 0);
+	if (!s) s = mm_span_allocn(c, num_superpages * SUPER_PAGE_NPAGES, 0, 0);
 	if (!s) return 0;
-	p = mm_page_allocn(c, num_pages);
-	if (!p) ERR_THROW(0, cleanup);
 
-	s->page_off = ss_page_id(p);
-	s->n_pages  = num_pages;
-	ss_span_activate(s);
+	return ss_page_get(s->page_off)->mappings[0].addr;
+}
 
-	ret = ss_span_id(s);
-done:
-	return ret;
-cleanup:
-	ss_span_free(s);
-	goto done;
+static cbuf_t
+mm_shared_allocn(unsigned long num_pages, int super, vaddr_t *pgaddr)
+{
+	struct cm_comp *c;
+	struct mm_span *s = NULL;
+
+	*pgaddr = 0;
+	c = ss_comp_get(cos_inv_token());
+	if (!c) return 0;
+	if (super) s = mm_span_allocn(c, num_pages, 1, 1);
+	if (!s)    s = mm_span_allocn(c, num_pages, 0, 1);
+	if (!s) return 0;
+	*pgaddr = ss_page_get(s->page_off)->mappings[0].addr;
+
+	return ss_span_id(s);
+}
+
+cbuf_t
+memmgr_shared_page_allocn(unsigned long num_pages, vaddr_t *pgaddr)
+{
+	return mm_shared_allocn(num_pages, 0, pgaddr);
+}
+
+cbuf_t
+memmgr_shared_superpage_allocn(unsigned long num_superpages, vaddr_t *pgaddr)
+{
+	*pgaddr = 0;
+	if (num_superpages == 0) return 0;
+
+	return mm_shared_allocn(num_superpages * SUPER_PAGE_NPAGES, 1, pgaddr);
+}
+
+/* The mapping of the page at addr in c, if there is one */
+static struct mm_mapping *
+mm_page_mapping(struct mm_page *p, struct cm_comp *c, vaddr_t addr)
+{
+	struct mm_mapping *m;
+	int i;
+
+	if (!p || !p->page) return NULL;
+	for (i = 0; i < MM_MAPPINGS_MAX; i++) {
+		m = &p->mappings[i];
+		if (ss_state_is_allocated(m->comp) && ss_state_val_get(m->comp) == (word_t)c && m->addr == addr) return m;
+	}
+
+	return NULL;
+}
+
+/* Find, and allocate, an unused mapping of the page */
+static struct mm_mapping *
+mm_mapping_alloc(struct mm_page *p)
+{
+	int i;
+
+	for (i = 1; i < MM_MAPPINGS_MAX; i++) {
+		if (!ss_state_alloc(&p->mappings[i].comp)) return &p->mappings[i];
+	}
+
+	return NULL;
 }
 
 /**
- * Alias a page of memory into another component (i.e., create shared
- * memory). The number of mappings are limited by `MM_MAPPINGS_MAX`.
+ * Alias a span of pages into another component (i.e., create shared
+ * memory), with superpages if the span was allocated with them. The
+ * number of mappings of each page is limited by `MM_MAPPINGS_MAX`.
+ * Must hold `mm_lock`.
  *
- * @p - the page we're going to alias
+ * @s - the span of pages we're going to alias
  * @c - the component to alias into
  * @addr - returns the virtual address mapped into
  * @return - `0` = success, `<0` = error
  */
 static int
-mm_page_alias(struct mm_page *p, struct cm_comp *c, vaddr_t *addr)
+mm_span_alias(struct mm_span *s, struct cm_comp *c, vaddr_t *addr)
 {
 	struct mm_mapping *m;
-	int i;
+	struct mm_page *p, *first;
+	unsigned int i, j;
+	int ret;
 
 	*addr = 0;
-	for (i = 1; i < MM_MAPPINGS_MAX; i++) {
-		m = &p->mappings[i];
+	first = ss_page_get(s->page_off);
+	if (!first) return -EINVAL;
+	/* only spans that are shared, and not partially reclaimed */
+	if (!s->shared || s->n_live != s->n_pages) return -EINVAL;
+
+	ret = mm_span_map(s, first, c, addr);
+	if (ret) {
+		*addr = 0;
+		return ret;
+	}
+	for (i = 0; i < s->n_pages; i++) {
+		p = first + i;
+		m = mm_mapping_alloc(p);
+		if (!m) goto unwind;
 
-		if (ss_state_alloc(&m->comp)) continue;
-		if (crt_page_aliasn_in(p->page, 1, &cm_self()->comp, &c->comp, &m->addr)) BUG();
-		assert(m->addr);
-		*addr = m->addr;
+		m->addr = *addr + i * PAGE_SIZE;
 		ss_state_activate_with(&m->comp, (word_t)c);
+	}
 
-		return 0;
+	return 0;
+unwind:
+	/*
+	 * A page has too many mappings: undo the alias of the span,
+	 * and the mappings made so far. If the span is still mapped
+	 * into c, its mappings are kept so that its frames aren't
+	 * reclaimed.
+	 */
+	ret = mm_span_unmap(s, c, *addr, s->n_pages);
+	if (ret) {
+		*addr = 0;
+		return ret;
 	}
-	assert(i == MM_MAPPINGS_MAX);
+	for (j = 0; j < i; j++) {
+		m = mm_page_mapping(first + j, c, *addr + j * PAGE_SIZE);
+		assert(m);
+		ss_state_free(&m->comp);
+	}
+	*addr = 0;
 
 	return -ENOMEM;
 }
@@ -288,27 +583,162 @@ memmgr_shared_page_map(cbuf_t id, vaddr_t *pgaddr)
 {
 	struct cm_comp *c;
 	struct mm_span *s;
-	struct mm_page *p;
-	unsigned int i;
-	vaddr_t addr;
+	unsigned long   ret = 0;
 
 	*pgaddr = 0;
-	s = ss_span_get(id);
-	if (!s) return 0;
 	c = ss_comp_get(cos_inv_token());
 	if (!c) return 0;
 
-	for (i = 0; i < s->n_pages; i++) {
-		struct mm_page *p;
+	ps_lock_take(&mm_lock);
+	s = ss_span_get(id);
+	if (!s || mm_span_alias(s, c, pgaddr)) goto done;
+	ret = s->n_pages;
+done:
+	ps_lock_release(&mm_lock);
+
+	return ret;
+}
+
+/*
+ * Find the page that c maps at addr, and its mapping. Spans are
+ * mapped contiguously, so the page after prev (if not NULL) is tried
+ * before searching all of the pages.
+ */
+static struct mm_page *
+mm_page_lkup(struct cm_comp *c, vaddr_t addr, struct mm_page *prev, struct mm_mapping **m)
+{
+	struct mm_page *p;
+	unsigned int    id;
+
+	if (prev) {
+		p  = ss_page_get(ss_page_id(prev) + 1);
+		*m = mm_page_mapping(p, c, addr);
+		if (*m) return p;
+	}
+	for (id = 1; id <= MM_NPAGES; id++) {
+		p  = ss_page_get(id);
+		*m = mm_page_mapping(p, c, addr);
+		if (*m) return p;
+	}
+
+	return NULL;
+}
+
+/*
+ * A mapping of the frame starting at page p has been removed. If no
+ * component maps the frame anymore, reclaim it onto the freelist, and
+ * once all of the span's frames are reclaimed, free the span and its
+ * page ids (keeping ids contiguous). Must hold `mm_lock`.
+ */
+static void
+mm_frame_unmapped(struct mm_span *s, struct mm_page *p)
+{
+	struct mm_freelist *fl     = s->super ? &mm_free_superpages : &mm_free_pages;
+	unsigned long       npages = s->super ? SUPER_PAGE_NPAGES : 1, i;
+	struct mm_page     *first;
+	int                 j;
+
+	for (j = 0; j < MM_MAPPINGS_MAX; j++) {
+		if (!ss_state_is_free(p->mappings[j].comp)) return;
+	}
+
+	if (fl->tail - fl->head == fl->sz) {
+		assert(!s->super);
+		/* out of memory for the ring: the frame stays with its span, which is not freed */
+		if (mm_freelist_grow(fl)) return;
+	}
+	fl->frames[fl->tail++ % fl->sz] = p->page;
+	for (i = 0; i < npages; i++) p[i].page = NULL;
+	s->n_live -= npages;
+	if (s->n_live > 0) return;
 
-		p = ss_page_get(s->page_off + i);
-		if (!p) return 0;
+	first = ss_page_get(s->page_off);
+	for (i = 0; i < s->n_pages; i++) ss_page_free(first + i);
+	ss_span_free(s);
+}
 
-		if (mm_page_alias(p, c, &addr)) BUG();
-		if (*pgaddr == 0) *pgaddr = addr;
+/*
+ * Unmap num_pages pages at addr in c. Superpages can only be unmapped
+ * as a whole. Must hold `mm_lock`.
+ */
+static int
+mm_page_unmapn(struct cm_comp *c, vaddr_t addr, unsigned long num_pages)
+{
+	struct mm_page    *p = NULL;
+	struct mm_mapping *m;
+	struct mm_span    *s;
+	unsigned long      i, j, n;
+	int                ret;
+
+	for (i = 0; i < num_pages; i += n, addr += n * PAGE_SIZE) {
+		p = mm_page_lkup(c, addr, p, &m);
+		if (!p) return -EINVAL;
+		s = ss_span_get(p->span);
+		assert(s);
+
+		n = s->super ? SUPER_PAGE_NPAGES : 1;
+		if ((ss_page_id(p) - s->page_off) % n || num_pages - i < n) return -EINVAL;
+
+		/* the frame remains tracked as mapped if this fails */
+		ret = mm_span_unmap(s, c, addr, n);
+		if (ret) return ret;
+		ss_state_free(&m->comp);
+		for (j = 1; j < n; j++) {
+			m = mm_page_mapping(p + j, c, addr + j * PAGE_SIZE);
+			assert(m);
+			ss_state_free(&m->comp);
+		}
+		mm_frame_unmapped(s, p);
+		p += n - 1;
 	}
 
-	return s->n_pages;
+	return 0;
+}
+
+int
+memmgr_heap_page_freen(vaddr_t addr, unsigned long num_pages)
+{
+	struct cm_comp *c;
+	int ret;
+
+	c = ss_comp_get(cos_inv_token());
+	if (!c) return -EINVAL;
+
+	ps_lock_take(&mm_lock);
+	ret = mm_page_unmapn(c, addr, num_pages);
+	ps_lock_release(&mm_lock);
+
+	return ret;
+}
+
+int
+memmgr_shared_page_free(cbuf_t id)
+{
+	struct cm_comp    *c;
+	struct mm_span    *s;
+	struct mm_page    *p;
+	struct mm_mapping *m;
+	int i, ret = -EINVAL;
+
+	c = ss_comp_get(cos_inv_token());
+	if (!c) return -EINVAL;
+
+	ps_lock_take(&mm_lock);
+	s = ss_span_get(id);
+	if (!s || s->n_live != s->n_pages) goto done;
+	p = ss_page_get(s->page_off);
+	assert(p);
+	for (i = 0; i < MM_MAPPINGS_MAX; i++) {
+		m = &p->mappings[i];
+		if (!ss_state_is_allocated(m->comp) || ss_state_val_get(m->comp) != (word_t)c) continue;
+
+		ret = mm_page_unmapn(c, m->addr, s->n_pages);
+		break;
+	}
+done:
+	ps_lock_release(&mm_lock);
+
+	return ret;
 }
 
 static compid_t
@@ -433,11 +863,11 @@ capmgr_comp_init(void)
 			ss_rcv_activate(r);
 			printc("\tCreated scheduling execution for %ld\n", id);
 		} else if (!strcmp(exec_type, "init")) {
-			struct cm_thd *t = ss_thd_alloc();
+			struct cm_thd *t = ss_initthd_alloc();
 
 			assert(t);
 			if (crt_comp_exec(comp, crt_comp_exec_thd_init(&ctxt, &t->thd))) BUG();
-			ss_thd_activate(t);
+			ss_initthd_activate(t);
 			printc("\tCreated thread for %ld\n", id);
 		} else {
 			printc("Error: Found unknown execution schedule type %s.\n", exec_type);
@@ -548,6 +978,28 @@ capmgr_thd_create_thunk(thdclosure_index_t idx, thdid_t *tid)
 	return t->aliased_cap;
 }
 
+int
+capmgr_thd_free(thdid_t tid)
+{
+	compid_t schedid = (compid_t)cos_inv_token();
+	struct cm_comp *s = ss_comp_get(schedid);
+	struct cm_thd *t = ss_thd_get(tid);
+	int ret;
+
+	if (!s || !t || t->sched != s) return -ENOENT;
+	/* initial threads have no kernel memory to free */
+	if (!t->thd.kmem) return -ENOENT;
+
+	/* the scheduler's alias first, so that ours is the last reference */
+	ret = crt_thd_alias_free(&t->thd, &s->comp, t->aliased_cap);
+	if (ret) return ret;
+	ret = crt_thd_free(&t->thd);
+	if (ret) return ret;
+	ss_thd_free(t);
+
+	return 0;
+}
+
 thdcap_t  capmgr_aep_create_thunk(struct cos_aep_info *a, thdclosure_index_t idx, int owntc, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax) { BUG(); return 0; }
 thdcap_t  capmgr_aep_create_ext(spdid_t child, struct cos_aep_info *a, thdclosure_index_t idx, int owntc, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax, arcvcap_t *extrcv) { BUG(); return 0; }
 arcvcap_t capmgr_rcv_create(spdid_t child, thdid_t tid, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax) { BUG(); return 0; }
@@ -565,6 +1017,7 @@ cos_init(void)
 	int ret;
 
 	printc("Starting the capability manager.\n");
+	ps_lock_init(&mm_lock);
 	assert(atol(args_get("captbl_end")) >= BOOT_CAPTBL_FREE);
 
 	/* Get our house in order. Initialize ourself and our data-structures */
@@ -24,6 +24,7 @@ __chanmgr_create(unsigned int item_sz, unsigned int slots, chan_flags_t flags, c
 	struct crt_blkpt empty, full;
 	unsigned int mem_pages;
 
+	if (slots < 2) return 0;
 	if (chanid == 0) {
 		c = ss_channel_alloc();
 	} else {
@@ -43,7 +44,7 @@ __chanmgr_create(unsigned int item_sz, unsigned int slots, chan_flags_t flags, c
 	if (crt_blkpt_init(&full))  ERR_THROW(0, dealloc_empty_blkpt);
 	c->info.blkpt_empty_id = empty.id;
 	c->info.blkpt_full_id  = full.id;
-	mem_pages = round_up_to_page(chan_mem_sz(item_sz, slots)) / PAGE_SIZE;
+	mem_pages = round_up_to_page(chan_mem_sz(item_sz, slots, flags)) / PAGE_SIZE;
 	c->buf_id = memmgr_shared_page_allocn(mem_pages, (vaddr_t *)&c->info.mem);
 	if (c->buf_id == 0) ERR_THROW(0, dealloc_full_blkpt);
 
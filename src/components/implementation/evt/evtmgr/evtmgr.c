@@ -3,27 +3,49 @@
 #include <static_slab.h>
 #include <evt.h>
 #include <crt_blkpt.h>
+#include <crt_lock.h>
 #include <ps_refcnt.h>
-
-#define MAX_NUM_EVT 8
-
+#include <memmgr.h>
+
+/* The maximum number of event resources, across all aggregates */
+#define EVT_MAX_RES 4096
+
+/*
+ * Each aggregate has a ring of the ids of its triggered resources. A
+ * resource is in the ring at most once, so a ring with at least as
+ * many entries as there are resources in the aggregate cannot
+ * overflow. Rings are 2^order pages, sized by evt_init's max_evts,
+ * and are doubled as resources are added past their size, up to
+ * EVT_RING_MAX_ORDER.
+ */
+#define EVT_RING_MAX_ORDER 8
+#define EVT_RING_NENT(order) ((PAGE_SIZE << (order)) / sizeof(evt_res_id_t))
 
 struct ring {
-	int producer, consumer;
-	evt_res_id_t mem[MAX_NUM_EVT];
+	unsigned long producer, consumer;
+	unsigned int  order;
+	evt_res_id_t *mem;
 };
 
 struct evt_agg {
 	compid_t client;
 	struct ring ring;
-	struct ps_refcnt refcnt;
+	struct ps_refcnt refcnt;   /* # of resources, until their last reference is released */
+	struct crt_lock lock;	   /* protects the ring, and the triggered state of the resources */
 	struct crt_blkpt blkpt;
+	cbuf_t notif_id;           /* memory for evt_get_n */
+	struct evt_notif *notifs;
+	cbuf_t shm_id;             /* the ring shared with the client, if evt_init_shared */
+	struct evt_shm *shm;
 };
 
 SS_STATIC_SLAB(evt, struct evt_agg, MAX_NUM_THREADS);
 
 struct evt_res {
-	evt_res_id_t *evt_entry; /* -1 = not resident */
+	unsigned long refs;	/* 1 until removed, + 1 per trigger in progress */
+	int removed;
+	int triggered;		/* in the ring? */
+	unsigned int shm_idx;	/* slot in the shared ring's resources */
 	evt_res_id_t me;
 	evt_res_type_t type;
 	evt_res_data_t data;
@@ -31,7 +53,81 @@ struct evt_res {
 	struct evt_agg *evt;
 };
 
-SS_STATIC_SLAB(evtres, struct evt_res, MAX_NUM_EVT);
+SS_STATIC_SLAB(evtres, struct evt_res, EVT_MAX_RES);
+
+/*
+ * Triggers look resources up by id, and can race with their removal,
+ * and with the reuse of the resource, or its aggregate, for a new
+ * one. Each trigger holds a reference to the resource, which is only
+ * taken if the resource isn't already on its way to being freed. The
+ * last reference frees the resource, and only then releases the
+ * aggregate's reference (thus __evt_free fails until it does).
+ */
+static int
+evtres_take(struct evt_res *res)
+{
+	unsigned long refs;
+
+	do {
+		refs = ps_load(&res->refs);
+		if (refs == 0) return -1;
+	} while (!ps_cas(&res->refs, refs, refs + 1));
+
+	return 0;
+}
+
+static void
+evtres_release(struct evt_res *res)
+{
+	struct evt_agg *e = res->evt;
+
+	if (ps_faa(&res->refs, -1) != 1) return;
+	ss_evtres_free(res);
+	ps_refcnt_release(&e->refcnt);
+}
+
+/*
+ * The heap pages backing the rings cannot be returned to the memmgr,
+ * so rings that are freed, or are replaced by larger rings, are
+ * cached here for reuse.
+ */
+struct ring_mem {
+	struct ring_mem *next;
+};
+static struct ring_mem *ring_mem_free[EVT_RING_MAX_ORDER + 1];
+static struct crt_lock  ring_mem_lock;
+
+static evt_res_id_t *
+ring_mem_alloc(unsigned int order)
+{
+	struct ring_mem *m;
+
+	crt_lock_take(&ring_mem_lock);
+	m = ring_mem_free[order];
+	if (m) ring_mem_free[order] = m->next;
+	crt_lock_release(&ring_mem_lock);
+
+	if (!m) m = (struct ring_mem *)memmgr_heap_page_allocn(1 << order);
+
+	return (evt_res_id_t *)m;
+}
+
+static void
+ring_mem_release(evt_res_id_t *mem, unsigned int order)
+{
+	struct ring_mem *m = (struct ring_mem *)mem;
+
+	crt_lock_take(&ring_mem_lock);
+	m->next = ring_mem_free[order];
+	ring_mem_free[order] = m;
+	crt_lock_release(&ring_mem_lock);
+}
+
+static unsigned long
+ring_size(struct ring *r)
+{
+	return EVT_RING_NENT(r->order);
+}
 
 static int
 ring_empty(struct ring *r)
@@ -42,7 +138,52 @@ ring_empty(struct ring *r)
 static int
 ring_full(struct ring *r)
 {
-	return r->producer + 1 == r->consumer;
+	return r->producer - r->consumer == ring_size(r);
+}
+
+static int
+ring_init(struct ring *r, unsigned long max_evts)
+{
+	unsigned int order = 0;
+
+	if (max_evts > EVT_RING_NENT(EVT_RING_MAX_ORDER)) return -1;
+	while (EVT_RING_NENT(order) < max_evts) order++;
+	*r = (struct ring) { .order = order };
+	r->mem = ring_mem_alloc(order);
+	if (!r->mem) return -1;
+
+	return 0;
+}
+
+static void
+ring_teardown(struct ring *r)
+{
+	if (!r->mem) return; 	/* shared aggregates don't use a private ring */
+	ring_mem_release(r->mem, r->order);
+	r->mem = NULL;
+}
+
+/* Double the size of the ring, retaining its entries */
+static int
+ring_grow(struct ring *r)
+{
+	evt_res_id_t *mem;
+	unsigned long i, n = r->producer - r->consumer;
+
+	if (r->order == EVT_RING_MAX_ORDER) return -1;
+	mem = ring_mem_alloc(r->order + 1);
+	if (!mem) return -1;
+
+	for (i = 0; i < n; i++) mem[i] = r->mem[(r->consumer + i) % ring_size(r)];
+	ring_mem_release(r->mem, r->order);
+	*r = (struct ring) {
+		.producer = n,
+		.consumer = 0,
+		.order    = r->order + 1,
+		.mem      = mem,
+	};
+
+	return 0;
 }
 
 static int
@@ -52,7 +193,7 @@ ring_dequeue(struct ring *r, evt_res_id_t *id)
 
 	if (ring_empty(r)) return 1;
 
-	tmp  = &r->mem[r->consumer % MAX_NUM_EVT];
+	tmp  = &r->mem[r->consumer % ring_size(r)];
 	*id  = *tmp;
 	*tmp = 0;
 	r->consumer++;
@@ -60,32 +201,92 @@ ring_dequeue(struct ring *r, evt_res_id_t *id)
 	return 0;
 }
 
-static evt_res_id_t *
+static int
 ring_enqueue(struct ring *r, evt_res_id_t id)
 {
-	evt_res_id_t *evtres;
-
-	if (ring_full(r)) return NULL;
+	if (ring_full(r)) return -1;
 
-	evtres  = &r->mem[r->producer % MAX_NUM_EVT];
-	*evtres = id;
+	r->mem[r->producer % ring_size(r)] = id;
 	r->producer++;
 
-	return evtres;
+	return 0;
 }
 
-evt_id_t
-__evt_alloc(unsigned long max_evts)
+/* Remove id from the ring, maintaining the order of the other entries */
+static void
+ring_remove(struct ring *r, evt_res_id_t id)
+{
+	unsigned long i, j;
+
+	for (i = j = r->consumer; i != r->producer; i++) {
+		evt_res_id_t e = r->mem[i % ring_size(r)];
+
+		if (e == id) continue;
+		r->mem[j % ring_size(r)] = e;
+		j++;
+	}
+	r->producer = j;
+}
+
+/*
+ * Unmap the memory shared with the client. The memmgr only reclaims
+ * it once the client has unmapped it as well (see evt_teardown).
+ */
+static void
+evt_shm_teardown(struct evt_agg *e)
+{
+	if (e->notif_id) memmgr_shared_page_free(e->notif_id);
+	if (e->shm_id)   memmgr_shared_page_free(e->shm_id);
+	e->notif_id = e->shm_id = 0;
+	e->notifs   = NULL;
+	e->shm      = NULL;
+}
+
+static evt_id_t
+evt_alloc(unsigned long max_evts, int shared)
 {
 	struct evt_agg *em = ss_evt_alloc();
+	vaddr_t mem;
 
 	if (!em) return 0;
-
-	memset(em, 0, sizeof(struct evt));
-	crt_blkpt_init(&em->blkpt);
+	/* no refs or ring until they are set up below */
+	*em = (struct evt_agg) { .client = cos_inv_token() };
+
+	if (shared) {
+		assert(sizeof(struct evt_shm) <= PAGE_SIZE);
+		if (max_evts > EVT_SHM_NRES) goto free;
+		em->shm_id = memmgr_shared_page_alloc(&mem);
+		if (em->shm_id == 0) goto free;
+		em->shm = (struct evt_shm *)mem;
+	} else if (ring_init(&em->ring, max_evts)) {
+		goto free;
+	}
+	if (crt_lock_init(&em->lock)) goto free_ring;
+	if (crt_blkpt_init(&em->blkpt)) goto free_lock;
 	ss_evt_activate(em);
 
 	return ss_evt_id(em);
+free_lock:
+	crt_lock_teardown(&em->lock);
+free_ring:
+	ring_teardown(&em->ring);
+	evt_shm_teardown(em);
+free:
+	ss_evt_free(em);
+
+	return 0;
+}
+
+evt_id_t
+__evt_alloc(unsigned long max_evts)
+{
+	return evt_alloc(max_evts, 0);
+}
+
+evt_id_t
+__evt_alloc_shared(unsigned long max_evts)
+{
+	return evt_alloc(max_evts, 1);
 }
 
 int
@@ -95,65 +296,217 @@ __evt_free(evt_id_t id)
 
 	if (!em || ps_refcnt_get(&em->refcnt) != 0) return -1;
 	crt_blkpt_teardown(&em->blkpt);
+	crt_lock_teardown(&em->lock);
+	ring_teardown(&em->ring);
+	evt_shm_teardown(em);
 	ss_evt_free(em);
 
 	return 0;
 }
 
-int
-__evt_get(evt_id_t id, evt_wait_flags_t flags, evt_res_type_t *src, evt_res_data_t *ret_data)
+/* Dequeue up to max pending events into notifs, and return the number */
+static unsigned long
+evt_dequeue_n(struct evt_agg *e, struct evt_notif *notifs, unsigned long max)
 {
-	struct crt_blkpt_checkpoint chkpt;
-	struct evt_agg *e = ss_evt_get(id);
 	struct evt_res *res;
 	evt_res_id_t rid;
+	unsigned long n = 0;
+
+	crt_lock_take(&e->lock);
+	while (n < max && !ring_dequeue(&e->ring, &rid)) {
+		res = ss_evtres_get(rid);
+		assert(res && res->evt == e);
+		res->triggered = 0;
+		notifs[n++] = (struct evt_notif) {
+			.src  = res->type,
+			.data = res->data,
+		};
+	}
+	crt_lock_release(&e->lock);
 
-	if (!e) return -1;
+	return n;
+}
+
+static unsigned long
+evt_wait_n(struct evt_agg *e, evt_wait_flags_t flags, struct evt_notif *notifs, unsigned long max)
+{
+	struct crt_blkpt_checkpoint chkpt;
+	unsigned long n;
 
 	while (1) {
 		crt_blkpt_checkpoint(&e->blkpt, &chkpt);
 
-		if (!ring_dequeue(&e->ring, &rid)) break;
-		if (flags & EVT_WAIT_NONBLOCKING) return 1;
+		n = evt_dequeue_n(e, notifs, max);
+		if (n > 0) break;
+		if (flags & EVT_WAIT_NONBLOCKING) return 0;
 
 		if (crt_blkpt_blocking(&e->blkpt, 0, &chkpt)) continue;
 		if (!ring_empty(&e->ring)) continue;
 		crt_blkpt_wait(&e->blkpt, 0, &chkpt);
 	}
 
-	res   = ss_evtres_get(rid);
-	assert(res);
-	res->evt_entry = NULL;
-	*src      = res->type;
-	*ret_data = res->data;
+	return n;
+}
+
+int
+__evt_get(evt_id_t id, evt_wait_flags_t flags, evt_res_type_t *src, evt_res_data_t *ret_data)
+{
+	struct evt_agg *e = ss_evt_get(id);
+	struct evt_notif notif;
+
+	if (!e || e->shm) return -1;
+	if (evt_wait_n(e, flags, &notif, 1) == 0) return 1;
+
+	*src      = notif.src;
+	*ret_data = notif.data;
 
 	return 0;
 }
 
+int
+__evt_get_n(evt_id_t id, evt_wait_flags_t flags, unsigned long max)
+{
+	struct evt_agg *e = ss_evt_get(id);
+
+	if (!e || e->shm || !e->notifs || max == 0) return -EINVAL;
+	if (max > EVT_NOTIF_MAX) max = EVT_NOTIF_MAX;
+
+	return evt_wait_n(e, flags, e->notifs, max);
+}
+
+cbuf_t
+__evt_notif_mem(evt_id_t id)
+{
+	struct evt_agg *e = ss_evt_get(id);
+	vaddr_t mem;
+	cbuf_t notif_id;
+
+	if (!e) return 0;
+
+	crt_lock_take(&e->lock);
+	if (!e->notifs) {
+		notif_id = memmgr_shared_page_alloc(&mem);
+		if (notif_id != 0) {
+			e->notif_id = notif_id;
+			e->notifs   = (struct evt_notif *)mem;
+		}
+	}
+	notif_id = e->notif_id;
+	crt_lock_release(&e->lock);
+
+	return notif_id;
+}
+
+cbuf_t
+__evt_shm_mem(evt_id_t id)
+{
+	struct evt_agg *e = ss_evt_get(id);
+
+	if (!e || !e->shm) return 0;
+
+	return e->shm_id;
+}
+
+/*
+ * The shared ring's head is empty either if there are no events, or
+ * if its producer hasn't yet written it, in which case it will
+ * trigger the blockpoint after doing so.
+ */
+static int
+evt_shm_empty(struct evt_shm *shm)
+{
+	return ps_load(&shm->ring[ps_load(&shm->head) % EVT_SHM_NRES]) == 0;
+}
+
+/* The client found its shared ring empty, and wants to block awaiting an event */
+int
+__evt_wait(evt_id_t id)
+{
+	struct evt_agg *e = ss_evt_get(id);
+	struct crt_blkpt_checkpoint chkpt;
+
+	if (!e || !e->shm) return -EINVAL;
+
+	while (1) {
+		crt_blkpt_checkpoint(&e->blkpt, &chkpt);
+		if (!evt_shm_empty(e->shm)) break;
+
+		if (crt_blkpt_blocking(&e->blkpt, 0, &chkpt)) continue;
+		if (!evt_shm_empty(e->shm)) break;
+		crt_blkpt_wait(&e->blkpt, 0, &chkpt);
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate a slot in the shared ring for a resource. Slots are only
+ * reused once a removed resource is no longer in the ring.
+ */
+static int
+evt_shm_res_alloc(struct evt_shm *shm, evt_res_type_t srctype, evt_res_data_t retdata)
+{
+	struct evt_shm_res *r;
+	int i;
+
+	for (i = 0; i < EVT_SHM_NRES; i++) {
+		r = &shm->res[i];
+		if (ps_load(&r->active) || ps_load(&r->triggered)) continue;
+
+		r->src  = srctype;
+		r->data = retdata;
+		ps_cc_barrier();
+		ps_store(&r->active, 1);
+
+		return i;
+	}
+
+	return -1;
+}
+
 evt_res_id_t
 __evt_add(evt_id_t id, evt_res_type_t srctype, evt_res_data_t retdata)
 {
 	struct evt_agg *e = ss_evt_get(id);
 	struct evt_res *res;
 	evt_res_id_t rid;
+	int shm_idx = 0;
 
 	if (!e)  return 0;
 	res = ss_evtres_alloc();
 	if (!res) return 0;
 
-	rid = ss_evtres_id(res);
+	/* make sure that the ring can hold the new resource */
+	crt_lock_take(&e->lock);
+	if (e->shm) {
+		shm_idx = evt_shm_res_alloc(e->shm, srctype, retdata);
+		if (shm_idx < 0) goto err;
+	} else if ((unsigned long)ps_refcnt_get(&e->refcnt) >= ring_size(&e->ring) && ring_grow(&e->ring)) {
+		goto err;
+	}
 	ps_refcnt_take(&e->refcnt);
+	crt_lock_release(&e->lock);
+
+	rid = ss_evtres_id(res);
 	*res = (struct evt_res) {
 		.client    = cos_inv_token(),
 		.type      = srctype,
 		.data      = retdata,
-		.evt_entry = NULL,
+		.triggered = 0,
+		.shm_idx   = shm_idx,
 		.me        = rid,
 		.evt       = e,
 	};
+	/* triggers that looked up the previous resource with this id can only take a reference now */
+	ps_store(&res->refs, 1);
 	ss_evtres_activate(res);
 
 	return rid;
+err:
+	crt_lock_release(&e->lock);
+	ss_evtres_free(res);
+
+	return 0;
 }
 
 int
@@ -164,30 +517,97 @@ __evt_rem(evt_id_t id, evt_res_id_t rid)
 
 	if (!e) return -1;
 	res = ss_evtres_get(rid);
-	if (!res || res->evt != e) return -1;
-	ps_refcnt_release(&e->refcnt);
+	if (!res || evtres_take(res)) return -1;
+	if (res->evt != e) goto err;
+
+	crt_lock_take(&e->lock);
+	if (res->removed) {
+		crt_lock_release(&e->lock);
+		goto err;
+	}
+	/* if it is in the shared ring, the client skips it, and frees the slot */
+	if (e->shm)              ps_store(&e->shm->res[res->shm_idx].active, 0);
+	else if (res->triggered) ring_remove(&e->ring, rid);
+	res->removed = 1;
+	crt_lock_release(&e->lock);
+	/* the resource is freed once the triggers in progress complete */
+	evtres_release(res);
+	evtres_release(res);
+
+	return 0;
+err:
+	evtres_release(res);
+
+	return -1;
+}
+
+/*
+ * Post the resource into the shared ring wait-free: only the first
+ * trigger since the client harvested it reserves, and writes, an
+ * entry, and the blockpoint only invokes the scheduler if the client
+ * is blocked.
+ */
+static int
+evt_shm_trigger(struct evt_agg *e, struct evt_res *res)
+{
+	struct evt_shm *shm = e->shm;
+	unsigned long p;
+
+	if (!ps_cas(&shm->res[res->shm_idx].triggered, 0, 1)) return 0; /* already triggered! */
+	p = ps_faa(&shm->tail, 1);
+	ps_store(&shm->ring[p % EVT_SHM_NRES], res->shm_idx + 1);
+	crt_blkpt_trigger(&e->blkpt, 0);
 
 	return 0;
 }
 
+/*
+ * The trigger's reference to the resource keeps it, and its aggregate,
+ * from being freed (see evtres_take). A trigger that races with the
+ * removal of the resource sees that it is removed, under the
+ * aggregate's lock that __evt_rem holds to remove it. A shared ring
+ * trigger checks without the lock, so it can post the slot after it
+ * is removed, which the client skips, or once it is reused by a
+ * resource added meanwhile, which then has a spurious event.
+ */
 int
 __evt_trigger(evt_res_id_t rid)
 {
 	struct evt_agg *e;
 	struct evt_res  *res;
-	evt_res_id_t   *evt_entry;
+	int ret = 0;
 
 	res = ss_evtres_get(rid);
-	if (!res) return -1;
+	if (!res || evtres_take(res)) return -1;
 	e = res->evt;
-	assert(e);
-	if (res->evt != e) return -1;
+	if (e->shm) {
+		ret = ps_load(&res->removed) ? -1 : evt_shm_trigger(e, res);
+		goto done;
+	}
 
-	if (res->evt_entry != NULL) return 0; /* already triggered! */
-	evt_entry = ring_enqueue(&e->ring, rid);
-	assert(evt_entry);	/* ring should be large enough for all evts */
-	res->evt_entry = evt_entry;
+	crt_lock_take(&e->lock);
+	if (res->removed) {	/* removed before we took the lock */
+		crt_lock_release(&e->lock);
+		ret = -1;
+		goto done;
+	}
+	if (res->triggered) {	/* already triggered! */
+		crt_lock_release(&e->lock);
+		goto done;
+	}
+	ret = ring_enqueue(&e->ring, rid);
+	assert(ret == 0);	/* ring is large enough for all evts */
+	res->triggered = 1;
+	crt_lock_release(&e->lock);
 	crt_blkpt_trigger(&e->blkpt, 0);
+done:
+	evtres_release(res);
 
-	return 0;
+	return ret;
+}
+
+void
+cos_init(void)
+{
+	if (crt_lock_init(&ring_mem_lock)) BUG();
 }
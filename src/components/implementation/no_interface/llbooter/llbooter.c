@@ -9,7 +9,6 @@
 #include <limits.h>
 
 #include <initargs.h>
-#include <barrier.h>
 #include <cos_kernel_api.h>
 #include <cos_defkernel_api.h>
 #include <crt.h>
@@ -43,9 +42,16 @@
  * #endif
  */
 
+/* UNCOMMENT HERE TO PRINT THE CYCLES SPENT IN EACH BOOT PHASE */
+/* #ifndef ENABLE_BOOT_TIMING
+ * #define ENABLE_BOOT_TIMING 1
+ * #endif
+ */
+
 static struct crt_comp boot_comps[MAX_NUM_COMPS];
 static const  compid_t sched_root_id  = 2;
 static        long     boot_id_offset = -1;
+static        unsigned long cycs_per_usec = 1;
 
 SS_STATIC_SLAB(sinv,   struct crt_sinv,   BOOTER_MAX_SINV);
 SS_STATIC_SLAB(thd,    struct crt_thd,    BOOTER_MAX_INITTHD);
@@ -85,13 +91,215 @@ boot_comp_set_idoffset(int off)
 	boot_id_offset = off;
 }
 
+/*
+ * Components are constructed in phases. The components' tables and
+ * images, and their sinvs, are independent of each other, so all
+ * cores construct them in parallel, each core claiming the next entry
+ * in the order the composer lists them (thus dependencies first). The
+ * execution contexts (created on the booter's core, where the
+ * components initialize) and capability manager delegations are made
+ * serially on the booter's core. Barriers separate the phases.
+ */
+typedef enum {
+	BOOT_PHASE_BOOTER,
+	BOOT_PHASE_COMPS,
+	BOOT_PHASE_EXEC,
+	BOOT_PHASE_SINVS,
+	BOOT_PHASE_CAPMGR,
+	BOOT_PHASE_MAX
+} boot_phase_t;
+
+#ifdef ENABLE_BOOT_TIMING
+static const char *boot_phase_names[BOOT_PHASE_MAX] = {
+	[BOOT_PHASE_BOOTER] = "booter",
+	[BOOT_PHASE_COMPS]  = "component tables and images",
+	[BOOT_PHASE_EXEC]   = "execution contexts and delegations",
+	[BOOT_PHASE_SINVS]  = "synchronous invocations",
+	[BOOT_PHASE_CAPMGR] = "capability manager memory",
+};
+static cycles_t              boot_phase_end[BOOT_PHASE_MAX];
+static cycles_t              boot_start;
+#endif /* ENABLE_BOOT_TIMING */
+static coreid_t              boot_core;
+static unsigned long         boot_barriers[BOOT_PHASE_MAX];
+static unsigned long         boot_released[BOOT_PHASE_MAX];
+/* Sends to each core's initial receive end-point to wake the booter there */
+static asndcap_t             boot_wakeups[NUM_CPU];
+
+/* Claims on the entries of the parallel phases, so that each is done by a single core */
+static unsigned long comp_claims[MAX_NUM_COMPS];
+static unsigned long sinv_claims[BOOTER_MAX_SINV];
+#ifdef ENABLE_CHKPT
+static struct ps_lock sinv_lock;
+#endif /* ENABLE_CHKPT */
+
+static int
+boot_claim(unsigned long *claims, int idx)
+{
+	return ps_cas(&claims[idx], 0, 1);
+}
+
+/*
+ * A core that waits on the others (at the end of a phase, or for a
+ * component's initialization to progress) receives on its initial
+ * receive end-point. The core that releases it sends to it, so the
+ * waiter is woken rather than polling shared state. The caller
+ * re-checks the condition it waits for, as events from other sends
+ * also end the receive.
+ */
+static void
+boot_block(void)
+{
+	thdid_t     tid;
+	int         rcvd, blocked;
+	cycles_t    cycles;
+	tcap_time_t timeout;
+
+	cos_sched_rcv(BOOT_CAPTBL_SELF_INITRCV_CPU_BASE, 0, 0, &rcvd, &tid, &blocked, &cycles, &timeout);
+}
+
+static void
+boot_wakeup_all(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_CPU; i++) {
+		if (i == cos_cpuid()) continue;
+		if (cos_asnd(boot_wakeups[i], 0)) BUG();
+	}
+}
+
+/* Wait for all cores to finish phase p, and time it. The last core to arrive releases the rest. */
+static void
+boot_phase_done(boot_phase_t p)
+{
+	if (ps_faa(&boot_barriers[p], 1) == NUM_CPU - 1) {
+		ps_store(&boot_released[p], 1);
+		boot_wakeup_all();
+	} else {
+		while (!ps_load(&boot_released[p])) boot_block();
+	}
+#ifdef ENABLE_BOOT_TIMING
+	if (cos_cpuid() == boot_core) boot_phase_end[p] = ps_tsc();
+#endif /* ENABLE_BOOT_TIMING */
+}
+
+/* Cores waiting in crt_compinit_execute on a component's initialization block the same way */
+void
+crt_compinit_block(void)
+{
+	boot_block();
+}
+
+void
+crt_compinit_wakeup(void)
+{
+	boot_wakeup_all();
+}
+
+#ifdef ENABLE_BOOT_TIMING
+static void
+boot_phases_print(void)
+{
+	cycles_t prev = boot_start;
+	int      p;
+
+	printc("Boot phases (%d cores):\n", init_parallelism());
+	for (p = 0; p < BOOT_PHASE_MAX; p++) {
+		printc("\t%s:\t%llu cycles (%llu us)\n", boot_phase_names[p], boot_phase_end[p] - prev,
+		       (boot_phase_end[p] - prev) / cycs_per_usec);
+		prev = boot_phase_end[p];
+	}
+	printc("\ttotal:\t%llu cycles (%llu us)\n", prev - boot_start, (prev - boot_start) / cycs_per_usec);
+}
+#endif /* ENABLE_BOOT_TIMING */
+
+/* Create the tables and image of the component described by args. */
+static void
+comp_create(struct initargs *curr)
+{
+	struct crt_comp *comp;
+	void *elf_hdr;
+	int   keylen;
+	compid_t id = atoi(args_key(curr, &keylen));
+	char *name  = args_get_from("img", curr);
+	vaddr_t info = atol(args_get_from("info", curr));
+	const char *root = "binaries/";
+	int   len  = strlen(root);
+	char  path[INITARGS_MAX_PATHNAME];
+
+	assert(id < MAX_NUM_COMPS && id > 0 && name);
+
+	memset(path, 0, INITARGS_MAX_PATHNAME);
+	strncat(path, root, len);
+	assert(path[len] == '\0');
+	strncat(path, name, INITARGS_MAX_PATHNAME - len);
+	assert(path[INITARGS_MAX_PATHNAME - 1] == '\0'); /* no truncation allowed */
+
+	comp = boot_comp_get(id);
+	assert(comp);
+	elf_hdr = (void *)args_get(path);
+
+	assert(elf_hdr);
+	if (crt_comp_create(comp, name, id, elf_hdr, info)) {
+		printc("Error constructing the resource tables and image of component %s.\n", comp->name);
+		BUG();
+	}
+	/* components are initialized on the booter's core, regardless of where they are created */
+	comp->init_core = boot_core;
+	assert(comp->refcnt != 0);
+	printc("\t%s: %lu (core %lu)\n", name, id, cos_cpuid());
+}
+
+/* Create the synchronous invocation described by args. */
+static void
+sinv_create(struct initargs *curr)
+{
+	struct crt_sinv *sinv;
+	int serv_id = atoi(args_get_from("server", curr));
+	int cli_id  = atoi(args_get_from("client", curr));
+	struct crt_comp *serv = boot_comp_get(serv_id);
+	struct crt_comp *cli = boot_comp_get(cli_id);
+
+	sinv = ss_sinv_alloc();
+	assert(sinv);
+	crt_sinv_create(sinv, args_get_from("name", curr), serv, cli,
+			strtoul(args_get_from("c_fn_addr", curr), NULL, 10), strtoul(args_get_from("c_ucap_addr", curr), NULL, 10),
+			strtoul(args_get_from("s_fn_addr", curr), NULL, 10));
+	ss_sinv_activate(sinv);
+	printc("\t%s (%lu->%lu):\tclient_fn @ 0x%lx, client_ucap @ 0x%lx, server_fn @ 0x%lx\n",
+	       sinv->name, sinv->client->id, sinv->server->id, sinv->c_fn_addr, sinv->c_ucap_addr, sinv->s_fn_addr);
+#ifdef ENABLE_CHKPT
+	ps_lock_take(&sinv_lock);
+	assert(serv->n_sinvs < CRT_COMP_SINVS_LEN);
+	serv->sinvs[serv->n_sinvs] = *sinv;
+	serv->n_sinvs++;
+	assert(cli->n_sinvs < CRT_COMP_SINVS_LEN);
+	cli->sinvs[cli->n_sinvs] = *sinv;
+	cli->n_sinvs++;
+	ps_lock_release(&sinv_lock);
+#endif /* ENABLE_CHKPT */
+}
+
+/*
+ * Serial initialization on the booter's core, before the other cores
+ * join in comps_parallel_init: find our id, and create our own
+ * crt_comp.
+ */
 static void
 comps_init(void)
 {
 	struct initargs comps, curr;
 	struct initargs_iter i;
-	int cont, ret, j;
-	int comp_idx = 0;
+	int cont, ret;
+
+#ifdef ENABLE_BOOT_TIMING
+	boot_start = ps_tsc();
+#endif /* ENABLE_BOOT_TIMING */
+	boot_core  = cos_cpuid();
+#ifdef ENABLE_CHKPT
+	ps_lock_init(&sinv_lock);
+#endif /* ENABLE_CHKPT */
 
 	/*
 	 * Assume: our component id is the lowest of the ids for all
@@ -108,48 +316,38 @@ comps_init(void)
 
 	ret = args_get_entry("components", &comps);
 	assert(!ret);
-	printc("Components (%d):\n", args_len(&comps));
 	for (cont = args_iter(&comps, &i, &curr) ; cont ; cont = args_iter_next(&i, &curr)) {
 		struct crt_comp *comp;
-		void *elf_hdr;
-		int   keylen;
-		compid_t id = atoi(args_key(&curr, &keylen));
-		char *name  = args_get_from("img", &curr);
-		vaddr_t info = atol(args_get_from("info", &curr));
-		const char *root = "binaries/";
-		int   len  = strlen(root);
-		char  path[INITARGS_MAX_PATHNAME];
-
-		printc("%s: %lu\n", name, id);
-
-		assert(id < MAX_NUM_COMPS && id > 0 && name);
+		int      keylen;
+		compid_t id   = atoi(args_key(&curr, &keylen));
+		char    *name = args_get_from("img", &curr);
+		vaddr_t  info = atol(args_get_from("info", &curr));
 
-		memset(path, 0, INITARGS_MAX_PATHNAME);
-		strncat(path, root, len);
-		assert(path[len] == '\0');
-		strncat(path, name, INITARGS_MAX_PATHNAME - len);
-		assert(path[INITARGS_MAX_PATHNAME - 1] == '\0'); /* no truncation allowed */
+		if (id != cos_compid()) continue;
 
+		/* booter should not have an elf object */
 		comp = boot_comp_get(id);
 		assert(comp);
-		elf_hdr = (void *)args_get(path);
-
-		if (id == cos_compid()) {
-			int ret;
-
-			/* booter should not have an elf object */
-			assert(!elf_hdr);
-			ret = crt_booter_create(comp, name, id, info);
-			assert(ret == 0);
-		} else {
-			assert(elf_hdr);
-			if (crt_comp_create(comp, name, id, elf_hdr, info)) {
-				printc("Error constructing the resource tables and image of component %s.\n", comp->name);
-				BUG();
-			}	
-		}
+		ret = crt_booter_create(comp, name, id, info);
+		assert(ret == 0);
 		assert(comp->refcnt != 0);
 	}
+#ifdef ENABLE_BOOT_TIMING
+	boot_phase_end[BOOT_PHASE_BOOTER] = ps_tsc();
+#endif /* ENABLE_BOOT_TIMING */
+}
+
+/*
+ * Create the execution contexts of the components, and alias the
+ * components' resources into the capability managers. Serial, on the
+ * booter's core.
+ */
+static void
+comps_exec_init(void)
+{
+	struct initargs comps, curr;
+	struct initargs_iter i;
+	int cont, ret;
 
 	ret = args_get_entry("execute", &comps);
 	assert(!ret);
@@ -243,6 +441,59 @@ comps_init(void)
 		}
 		if (crt_comp_alias_in(target, c, &comp_res, alias_flags)) BUG();
 	}
+}
+
+/*
+ * Delegate the untyped memory to the capmgr. This should go *after*
+ * all allocations that use untyped memory, so that we can delegate
+ * away the rest of our memory. FIXME: this might not be the cause
+ * currently, and we rely on a few untyped regions (after the ones we
+ * delegate to the capmgr) for the parallel thread allocations.
+ */
+static void
+comps_capmgr_init(void)
+{
+	struct initargs comps, curr;
+	struct initargs_iter i;
+	int cont, ret;
+
+	ret = args_get_entry("captbl_delegations", &comps);
+	assert(!ret);
+	for (cont = args_iter(&comps, &i, &curr) ; cont ; cont = args_iter_next(&i, &curr)) {
+		struct crt_comp *c;
+		int keylen;
+		struct crt_comp_exec_context ctxt = { 0 };
+
+		c = boot_comp_get(atoi(args_key(&curr, &keylen)));
+		assert(c);
+
+		/* TODO: generalize. Give the capmgr 64MB for now. */
+		if (crt_comp_exec(c, crt_comp_exec_capmgr_init(&ctxt, BOOTER_CAPMGR_MB * 1024 * 1024))) BUG();
+	}
+}
+
+static void
+comps_parallel_init(void)
+{
+	struct initargs comps, curr;
+	struct initargs_iter i;
+	int cont, ret, j;
+	int init_core = cos_cpuid() == boot_core;
+
+	ret = args_get_entry("components", &comps);
+	assert(!ret);
+	if (init_core) printc("Components (%d):\n", args_len(&comps));
+	for (cont = args_iter(&comps, &i, &curr), j = 0 ; cont ; cont = args_iter_next(&i, &curr), j++) {
+		int keylen;
+
+		assert(j < MAX_NUM_COMPS);
+		if (atoi(args_key(&curr, &keylen)) == cos_compid() || !boot_claim(comp_claims, j)) continue;
+		comp_create(&curr);
+	}
+	boot_phase_done(BOOT_PHASE_COMPS);
+
+	if (init_core) comps_exec_init();
+	boot_phase_done(BOOT_PHASE_EXEC);
 
 	/*
 	 * *No static capability slot allocations after this point.*
@@ -266,57 +517,22 @@ comps_init(void)
 	 */
 	ret = args_get_entry("sinvs", &comps);
 	assert(!ret);
-	printc("Synchronous invocations (%d):\n", args_len(&comps));
-	for (cont = args_iter(&comps, &i, &curr) ; cont ; cont = args_iter_next(&i, &curr)) {
-		struct crt_sinv *sinv;
-		int serv_id = atoi(args_get_from("server", &curr));
-		int cli_id  = atoi(args_get_from("client", &curr));
-		struct crt_comp *serv = boot_comp_get(serv_id);
-		struct crt_comp *cli = boot_comp_get(cli_id);
-
-		sinv = ss_sinv_alloc();
-		assert(sinv);
-		crt_sinv_create(sinv, args_get_from("name", &curr), boot_comp_get(serv_id), boot_comp_get(cli_id),
-				strtoul(args_get_from("c_fn_addr", &curr), NULL, 10), strtoul(args_get_from("c_ucap_addr", &curr), NULL, 10),
-				strtoul(args_get_from("s_fn_addr", &curr), NULL, 10));
-		ss_sinv_activate(sinv);
-		printc("\t%s (%lu->%lu):\tclient_fn @ 0x%lx, client_ucap @ 0x%lx, server_fn @ 0x%lx\n",
-		       sinv->name, sinv->client->id, sinv->server->id, sinv->c_fn_addr, sinv->c_ucap_addr, sinv->s_fn_addr);
-	#ifdef ENABLE_CHKPT
-		assert(serv->n_sinvs < CRT_COMP_SINVS_LEN);
-		serv->sinvs[serv->n_sinvs] = *sinv;
-		serv->n_sinvs++;
-		assert(cli->n_sinvs < CRT_COMP_SINVS_LEN);
-		cli->sinvs[cli->n_sinvs] = *sinv;
-		cli->n_sinvs++;
-	#endif /* ENABLE_CHKPT */
+	if (init_core) printc("Synchronous invocations (%d):\n", args_len(&comps));
+	for (cont = args_iter(&comps, &i, &curr), j = 0 ; cont ; cont = args_iter_next(&i, &curr), j++) {
+		assert(j < BOOTER_MAX_SINV);
+		if (!boot_claim(sinv_claims, j)) continue;
+		sinv_create(&curr);
 	}
-	
-	/*
-	 * Delegate the untyped memory to the capmgr. This should go
-	 * *after* all allocations that use untyped memory, so that we
-	 * can delegate away the rest of our memory. FIXME: this might
-	 * not be the cause currently, and we rely on a few untyped
-	 * regions (after the ones we delegate to the capmgr) for the
-	 * parallel thread allocations.
-	 */
-	ret = args_get_entry("captbl_delegations", &comps);
-	assert(!ret);
-	for (cont = args_iter(&comps, &i, &curr) ; cont ; cont = args_iter_next(&i, &curr)) {
-		struct crt_comp *c;
-		int keylen;
-		struct crt_comp_exec_context ctxt = { 0 };
+	boot_phase_done(BOOT_PHASE_SINVS);
 
-		c = boot_comp_get(atoi(args_key(&curr, &keylen)));
-		assert(c);
-
-		/* TODO: generalize. Give the capmgr 64MB for now. */
-		if (crt_comp_exec(c, crt_comp_exec_capmgr_init(&ctxt, BOOTER_CAPMGR_MB * 1024 * 1024))) BUG();
-	}
+	if (init_core) comps_capmgr_init();
+	boot_phase_done(BOOT_PHASE_CAPMGR);
 
+	if (!init_core) return;
 	printc("Kernel resources created, booting components!\n");
-
-	return;
+#ifdef ENABLE_BOOT_TIMING
+	boot_phases_print();
+#endif /* ENABLE_BOOT_TIMING */
 }
 
 /*
@@ -415,11 +631,18 @@ static void
 booter_init(void)
 {
 	struct cos_compinfo *boot_info = cos_compinfo_get(cos_defcompinfo_curr_get());
+	int                  ret, i;
 
 	cos_meminfo_init(&(boot_info->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
 	cos_defcompinfo_init();
 
-	cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
+	ret = cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
+	if (ret > 0) cycs_per_usec = ret;
+
+	for (i = 0; i < NUM_CPU; i++) {
+		boot_wakeups[i] = cos_asnd_alloc(boot_info, BOOT_CAPTBL_SELF_INITRCV_BASE_CPU(i), boot_info->captbl_cap);
+		assert(boot_wakeups[i]);
+	}
 }
 
 void
@@ -428,6 +651,42 @@ execute(void)
 	crt_compinit_execute(boot_comp_get);
 }
 
+/* Number of data and BSS sizes to clone, halving each time */
+#define CHKPT_BENCH_NSIZES 4
+
+/*
+ * Clone the checkpoint again, copying less of its data and BSS each
+ * time, so one run shows how the clone latency scales with their
+ * size. These clones are only timed, and never execute.
+ */
+static void
+chkpt_clone_bench(struct crt_chkpt *chkpt)
+{
+	struct crt_comp  *c    = chkpt->c;
+	struct crt_chkpt  part = *chkpt;
+	size_t            text_sz = round_up_to_page(c->ro_sz);
+	size_t            data_sz = chkpt->tot_sz_mem - text_sz;
+	/* the clone writes its id into the component information in the data */
+	size_t            min_sz  = round_up_to_page(c->info - c->rw_addr + sizeof(struct cos_component_information));
+	size_t            sz;
+	cycles_t          start, end;
+	int               i;
+
+	printc("Clone latency of %s by data+bss size:\n", c->name);
+	for (i = 0; i < CHKPT_BENCH_NSIZES; i++) {
+		compid_t id = crt_ncomp() + 1;
+
+		sz = round_up_to_page(data_sz >> i);
+		if (sz < min_sz || id > MAX_NUM_COMPS) break;
+		part.tot_sz_mem = text_sz + sz;
+
+		start = ps_tsc();
+		if (crt_comp_create_from(boot_comp_get(id), "chkpt_bench", id, &part)) BUG();
+		end = ps_tsc();
+		printc("\t%lu KB:\t%llu cycles (%llu us)\n", sz / 1024, end - start, (end - start) / cycs_per_usec);
+	}
+}
+
 void
 init_done_chkpt(struct crt_comp *c)
 {
@@ -435,6 +694,8 @@ init_done_chkpt(struct crt_comp *c)
 	struct crt_chkpt *chkpt;
 	thdcap_t          thdcap;
 	int               ret;
+	cycles_t          start, chkpt_end, clone_end;
+	unsigned long     text_sz, data_sz;
 	char              name[INITARGS_MAX_PATHNAME];
 	char             *prefix = "chkpt_";
 	int               prefix_sz = strlen("chkpt_");
@@ -456,12 +717,24 @@ init_done_chkpt(struct crt_comp *c)
 		}
 
 		chkpt = ss_chkpt_alloc();
+		start = ps_tsc();
 		if (crt_chkpt_create(chkpt, c) != 0) {
 			BUG();
 		}
+		chkpt_end = ps_tsc();
 
 		ss_chkpt_activate(chkpt);
 		chkpt_comp_init(new_comp, chkpt, name);
+		clone_end = ps_tsc();
+
+		/* the text is shared, so the latencies should scale with the data and BSS */
+		text_sz = round_up_to_page(c->ro_sz);
+		data_sz = c->tot_sz_mem - text_sz;
+		printc("Checkpoint of %s (text %lu KB shared, data+bss %lu KB copied): checkpoint %llu cycles (%llu us), clone %llu cycles (%llu us)\n",
+		       c->name, text_sz / 1024, data_sz / 1024, chkpt_end - start, (chkpt_end - start) / cycs_per_usec,
+		       clone_end - chkpt_end, (clone_end - chkpt_end) / cycs_per_usec);
+		chkpt_clone_bench(chkpt);
+
 		thdcap = crt_comp_thdcap_get(new_comp);
 		assert(thdcap);
 		if ((ret = cos_defswitch(thdcap, TCAP_PRIO_MAX, TCAP_RES_INF, cos_sched_sync()))) {
@@ -504,7 +777,7 @@ init_exit(int retval)
 
 	crt_compinit_exit(c, retval);
 
-	/* TODO: recycle back to a chkpt via chkpt_restore() */
+	/* Checkpoints only create new components; a terminated component is not restored from one */
 
 	while (1) ;
 }
@@ -516,6 +789,12 @@ cos_init(void)
 	comps_init();
 }
 
+void
+cos_parallel_init(coreid_t cid, int init_core, int ncores)
+{
+	comps_parallel_init();
+}
+
 void
 parallel_main(coreid_t cid)
 {
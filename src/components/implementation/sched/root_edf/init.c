@@ -0,0 +1,9 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2018, The George Washington University
+ * Author: Phani Gadepalli, phanikishoreg@gwu.edu & Gabe Parmer, gparmer@gwu.edu
+ */
+
+/* The earliest-deadline-first root scheduler: sl_mod_edf's policy (see the Makefile) */
+#include <sched_root_init.h>
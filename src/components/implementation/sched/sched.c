@@ -45,13 +45,13 @@ sched_thd_block_timeout(thdid_t dep_id, cycles_t abs_timeout)
 sched_blkpt_id_t
 sched_blkpt_alloc(void)
 {
-	return sl_blkpt_alloc();
+	return sl_blkpt_alloc(cos_inv_token());
 }
 
 int
 sched_blkpt_free(sched_blkpt_id_t id)
 {
-	return sl_blkpt_free(id);
+	return sl_blkpt_free(id, cos_inv_token());
 }
 
 int
@@ -50,6 +50,376 @@ receiver(void *d)
 	assert(0);
 }
 
+/*
+ * Multiple senders, and receivers: each of the MULTI_NTHDS senders
+ * sends MULTI_AMNT items tagged with its id, and each receiver
+ * receives its share of them. Every item must be received exactly
+ * once, and each receiver must see a sender's items in the order they
+ * were sent.
+ */
+#define MULTI_NTHDS  2
+#define MULTI_AMNT   1024
+#define MULTI_NSLOTS 16
+
+struct chan_snd multi_s;
+struct chan_rcv multi_r;
+char multi_rcvd[MULTI_NTHDS][MULTI_AMNT];
+unsigned long multi_nrcvers, multi_done;
+int multi_err;
+
+void
+multi_sender(void *d)
+{
+	u32_t id = (u32_t)d, i, item;
+
+	for (i = 0; i < MULTI_AMNT; i++) {
+		item = (id << 16) | i;
+		if (chan_send(&multi_s, &item, 0)) {
+			printc("chan_send error\n");
+			assert(0);
+		}
+	}
+	sched_thd_block(0);
+	assert(0);
+}
+
+void
+multi_receiver(void *d)
+{
+	u32_t item, snd, seq, i;
+	u32_t next[MULTI_NTHDS] = { 0 };
+
+	for (i = 0; i < MULTI_NTHDS * MULTI_AMNT / multi_nrcvers; i++) {
+		if (chan_recv(&multi_r, &item, 0)) {
+			printc("chan_recv error\n");
+			assert(0);
+		}
+		snd = item >> 16;
+		seq = item & 0xFFFF;
+		if (snd >= MULTI_NTHDS || seq >= MULTI_AMNT || seq < next[snd] || multi_rcvd[snd][seq]) {
+			multi_err = 1;
+			continue;
+		}
+		multi_rcvd[snd][seq] = 1;
+		next[snd] = seq + 1;
+	}
+
+	if (ps_faa(&multi_done, 1) == (long)multi_nrcvers - 1) sched_thd_wakeup(init_thd);
+	sched_thd_block(0);
+	assert(0);
+}
+
+void
+test_multi(char *name, chan_flags_t flags, unsigned long nrcvers)
+{
+	struct chan c;
+	thdid_t t;
+	unsigned long i, j;
+
+	memset(multi_rcvd, 0, sizeof(multi_rcvd));
+	multi_err     = 0;
+	multi_done    = 0;
+	multi_nrcvers = nrcvers;
+
+	if (chan_init(&c, sizeof(u32_t), MULTI_NSLOTS, flags) || chan_snd_init(&multi_s, &c) || chan_rcv_init(&multi_r, &c)) {
+		printc("%s chan_init failure.\n", name);
+		assert(0);
+	}
+
+	for (i = 0; i < MULTI_NTHDS + nrcvers; i++) {
+		if (i < MULTI_NTHDS) t = sched_thd_create(multi_sender, (void *)i);
+		else                 t = sched_thd_create(multi_receiver, NULL);
+		if (t == 0 || sched_thd_param_set(t, sched_param_pack(SCHEDP_PRIO, i < MULTI_NTHDS ? 5 : 4))) {
+			printc("%s thread creation failure.\n", name);
+			assert(0);
+		}
+	}
+	sched_thd_block(0);
+
+	for (i = 0; i < MULTI_NTHDS; i++) {
+		for (j = 0; j < MULTI_AMNT; j++) {
+			if (!multi_rcvd[i][j]) multi_err = 1;
+		}
+	}
+	if (multi_err) {
+		printc("%s: items lost, duplicated, or reordered.\n", name);
+		assert(0);
+	}
+	printc("Chan test %s (%d senders, %lu receivers): SUCCESS.\n", name, MULTI_NTHDS, nrcvers);
+}
+
+/*
+ * Batched sends and receives. Non-blocking, a batch is cut short
+ * when the channel fills up (empties), and the items are sent
+ * (received) in order across the ring's wraparound. Blocking, a
+ * sender's batches complete, and a receiver gets them in order,
+ * whatever the sizes of the batches on either side.
+ */
+#define BATCH_NSLOTS 8
+#define BATCH_SND    5
+#define BATCH_RCV    7
+#define BATCH_AMNT   (BATCH_SND * 256)
+
+struct chan_snd batch_s;
+struct chan_rcv batch_r;
+
+void
+batch_sender(void *d)
+{
+	u32_t items[BATCH_SND], i, j;
+
+	for (i = 0; i < BATCH_AMNT; i += BATCH_SND) {
+		for (j = 0; j < BATCH_SND; j++) items[j] = i + j;
+		if (chan_send_n(&batch_s, items, BATCH_SND, 0) != BATCH_SND) {
+			printc("chan_send_n error\n");
+			assert(0);
+		}
+	}
+	sched_thd_block(0);
+	assert(0);
+}
+
+void
+batch_receiver(void *d)
+{
+	u32_t items[BATCH_RCV], i = 0, j;
+	int   n;
+
+	while (i < BATCH_AMNT) {
+		n = chan_recv_n(&batch_r, items, BATCH_RCV, 0);
+		if (n <= 0 || n > BATCH_RCV) {
+			printc("chan_recv_n error\n");
+			assert(0);
+		}
+		for (j = 0; j < (u32_t)n; j++, i++) {
+			if (items[j] != i) {
+				printc("chan_recv_n received %d rather than %d\n", items[j], i);
+				assert(0);
+			}
+		}
+	}
+
+	sched_thd_wakeup(init_thd);
+	sched_thd_block(0);
+	assert(0);
+}
+
+/* Receive n items, expected to be first, first + 1, ... */
+void
+batch_check(struct chan_rcv *r, int n, u32_t first)
+{
+	u32_t items[BATCH_NSLOTS * 2];
+	int   i;
+
+	if (chan_recv_n(r, items, BATCH_NSLOTS * 2, CHAN_NONBLOCKING) != n) {
+		printc("chan_recv_n received the wrong number of items\n");
+		assert(0);
+	}
+	for (i = 0; i < n; i++) {
+		if (items[i] != first + i) {
+			printc("chan_recv_n received items out of order\n");
+			assert(0);
+		}
+	}
+}
+
+void
+test_batch(char *name, chan_flags_t flags)
+{
+	struct chan c;
+	struct chan_snd s;
+	struct chan_rcv r;
+	u32_t items[BATCH_NSLOTS * 2], i;
+	/* the SPSC ring keeps a slot free */
+	int cap = (flags & CHAN_MPMC) ? BATCH_NSLOTS : BATCH_NSLOTS - 1;
+	thdid_t snd, rcv;
+
+	if (chan_init(&c, sizeof(u32_t), BATCH_NSLOTS, flags) || chan_snd_init(&s, &c) || chan_rcv_init(&r, &c)) {
+		printc("%s chan_init failure.\n", name);
+		assert(0);
+	}
+	for (i = 0; i < BATCH_NSLOTS * 2; i++) items[i] = i;
+
+	batch_check(&r, 0, 0);
+	/* only as many items as fit are sent */
+	if (chan_send_n(&s, items, cap + 4, CHAN_NONBLOCKING) != cap ||
+	    chan_send_n(&s, items, 1, CHAN_NONBLOCKING) != 0) {
+		printc("%s chan_send_n sent into a full channel.\n", name);
+		assert(0);
+	}
+	/* partially drain, and fill across the wraparound */
+	if (chan_recv_n(&r, items, 5, CHAN_NONBLOCKING) != 5) {
+		printc("%s chan_recv_n failure.\n", name);
+		assert(0);
+	}
+	for (i = 0; i < BATCH_NSLOTS * 2; i++) items[i] = cap + i;
+	if (chan_send_n(&s, items, 4, CHAN_NONBLOCKING) != 4) {
+		printc("%s chan_send_n failure.\n", name);
+		assert(0);
+	}
+	batch_check(&r, cap - 1, 5);
+	batch_check(&r, 0, 0);
+
+	if (chan_snd_init(&batch_s, &c) || chan_rcv_init(&batch_r, &c)) {
+		printc("%s chan_snd/rcv_init failure.\n", name);
+		assert(0);
+	}
+	snd = sched_thd_create(batch_sender, NULL);
+	rcv = sched_thd_create(batch_receiver, NULL);
+	if (snd == 0 || rcv == 0 ||
+	    sched_thd_param_set(snd, sched_param_pack(SCHEDP_PRIO, 5)) ||
+	    sched_thd_param_set(rcv, sched_param_pack(SCHEDP_PRIO, 4))) {
+		printc("%s thread creation failure.\n", name);
+		assert(0);
+	}
+	sched_thd_block(0);
+
+	printc("Chan test %s batches: SUCCESS.\n", name);
+}
+
+/*
+ * Zero-copy sends and receives. Items are written in place into
+ * reserved slots, and read in place from peeked ones, laps around the
+ * ring, interleaved with copying sends and receives. Blocking, a
+ * sender's reserves wait for a receiver to release slots.
+ */
+#define ZC_NSLOTS 4
+#define ZC_AMNT   1024
+
+struct chan_snd zc_s;
+struct chan_rcv zc_r;
+
+void
+zc_sender(void *d)
+{
+	u32_t i, *slot;
+
+	for (i = 0; i < ZC_AMNT; i++) {
+		slot = chan_send_reserve(&zc_s, 0);
+		if (!slot) {
+			printc("chan_send_reserve error\n");
+			assert(0);
+		}
+		*slot = i;
+		if (chan_send_commit(&zc_s, slot)) {
+			printc("chan_send_commit error\n");
+			assert(0);
+		}
+	}
+	sched_thd_block(0);
+	assert(0);
+}
+
+void
+zc_receiver(void *d)
+{
+	u32_t i, *slot;
+
+	for (i = 0; i < ZC_AMNT; i++) {
+		slot = chan_recv_peek(&zc_r, 0);
+		if (!slot || *slot != i) {
+			printc("chan_recv_peek error\n");
+			assert(0);
+		}
+		chan_recv_release(&zc_r, slot);
+	}
+
+	sched_thd_wakeup(init_thd);
+	sched_thd_block(0);
+	assert(0);
+}
+
+void
+test_zerocopy(char *name, chan_flags_t flags)
+{
+	struct chan c;
+	struct chan_snd s;
+	struct chan_rcv r;
+	u32_t i, item, *slot;
+	/* the SPSC ring keeps a slot free */
+	u32_t cap = (flags & CHAN_MPMC) ? ZC_NSLOTS : ZC_NSLOTS - 1;
+	thdid_t snd, rcv;
+
+	if (chan_init(&c, sizeof(u32_t), ZC_NSLOTS, flags) || chan_snd_init(&s, &c) || chan_rcv_init(&r, &c)) {
+		printc("%s chan_init failure.\n", name);
+		assert(0);
+	}
+	if (chan_recv_peek(&r, CHAN_NONBLOCKING)) {
+		printc("%s chan_recv_peek of an empty channel.\n", name);
+		assert(0);
+	}
+
+	/* laps around the ring, alternating zero-copy and copying sends and receives */
+	for (i = 0; i < ZC_NSLOTS * 4; i++) {
+		if (i % 2) {
+			slot = chan_send_reserve(&s, CHAN_NONBLOCKING);
+			if (!slot) break;
+			*slot = i;
+			if (chan_send_commit(&s, slot)) break;
+			if (chan_recv(&r, &item, CHAN_NONBLOCKING) || item != i) break;
+		} else {
+			if (chan_send(&s, &i, CHAN_NONBLOCKING)) break;
+			slot = chan_recv_peek(&r, CHAN_NONBLOCKING);
+			if (!slot || *slot != i) break;
+			chan_recv_release(&r, slot);
+		}
+	}
+	if (i != ZC_NSLOTS * 4) {
+		printc("%s zero-copy item %d lost.\n", name, i);
+		assert(0);
+	}
+
+	/* fill the channel, then free a slot, and reserve it across the wraparound */
+	for (i = 0; i < cap; i++) {
+		slot = chan_send_reserve(&s, CHAN_NONBLOCKING);
+		if (!slot) break;
+		*slot = i;
+		chan_send_commit(&s, slot);
+	}
+	if (i != cap || chan_send_reserve(&s, CHAN_NONBLOCKING)) {
+		printc("%s chan_send_reserve of a full channel.\n", name);
+		assert(0);
+	}
+	slot = chan_recv_peek(&r, CHAN_NONBLOCKING);
+	if (!slot || *slot != 0) {
+		printc("%s chan_recv_peek failure.\n", name);
+		assert(0);
+	}
+	chan_recv_release(&r, slot);
+	slot = chan_send_reserve(&s, CHAN_NONBLOCKING);
+	if (!slot) {
+		printc("%s chan_send_reserve of a released slot.\n", name);
+		assert(0);
+	}
+	*slot = cap;
+	chan_send_commit(&s, slot);
+	for (i = 1; i <= cap; i++) {
+		slot = chan_recv_peek(&r, CHAN_NONBLOCKING);
+		if (!slot || *slot != i) break;
+		chan_recv_release(&r, slot);
+	}
+	if (i != cap + 1 || chan_recv_peek(&r, CHAN_NONBLOCKING)) {
+		printc("%s zero-copy items out of order.\n", name);
+		assert(0);
+	}
+
+	if (chan_snd_init(&zc_s, &c) || chan_rcv_init(&zc_r, &c)) {
+		printc("%s chan_snd/rcv_init failure.\n", name);
+		assert(0);
+	}
+	snd = sched_thd_create(zc_sender, NULL);
+	rcv = sched_thd_create(zc_receiver, NULL);
+	if (snd == 0 || rcv == 0 ||
+	    sched_thd_param_set(snd, sched_param_pack(SCHEDP_PRIO, 4)) ||
+	    sched_thd_param_set(rcv, sched_param_pack(SCHEDP_PRIO, 5))) {
+		printc("%s thread creation failure.\n", name);
+		assert(0);
+	}
+	sched_thd_block(0);
+
+	printc("Chan test %s zero-copy: SUCCESS.\n", name);
+}
+
 int
 main(void)
 {
@@ -93,5 +463,17 @@ main(void)
 	sched_thd_block(0);
 	printc("Chan test: SUCCESS.\n");
 
+	/* a single slot can't tell a full channel from an empty one */
+	if (chan_init(&c, sizeof(u32_t), 1, CHAN_MPMC) != -CHAN_ERR_INVAL_ARG) {
+		printc("chan_init accepted a single slot.\n");
+		assert(0);
+	}
+	test_multi("MPSC", CHAN_MPSC, 1);
+	test_multi("MPMC", CHAN_MPMC, MULTI_NTHDS);
+	test_batch("SPSC", CHAN_DEFAULT);
+	test_batch("MPMC", CHAN_MPMC);
+	test_zerocopy("SPSC", CHAN_DEFAULT);
+	test_zerocopy("MPMC", CHAN_MPMC);
+
 	return 0;
 }
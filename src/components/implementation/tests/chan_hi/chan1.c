@@ -1,6 +1,7 @@
 #include <cos_component.h>
 #include <llprint.h>
 #include <chan.h>
+#include <evt.h>
 #include <ps.h>
 
 struct chan_snd s;
@@ -61,10 +62,141 @@ ipc(void)
 	       rcvcost/COMM_AMNT, sendcost/COMM_AMNT, rtt/COMM_AMNT, l2h/COMM_AMNT);
 }
 
+#define EVT_BENCH_NRES  64
+#define EVT_BENCH_ITERS 256
+
+/*
+ * Event throughput: trigger all of the resources in an event, then
+ * harvest all of their events, either with an invocation per
+ * evt_get, or from the ring shared with the evtmgr.
+ */
+void
+evt_bench(int shared)
+{
+	struct evt e;
+	evt_res_id_t rids[EVT_BENCH_NRES];
+	evt_res_type_t src;
+	evt_res_data_t data;
+	ps_tsc_t start, trig = 0, get = 0;
+	long long nevts = EVT_BENCH_NRES * EVT_BENCH_ITERS;
+	int i, j;
+
+	if (shared ? evt_init_shared(&e, EVT_BENCH_NRES) : evt_init(&e, EVT_BENCH_NRES)) {
+		printc("evt_init error\n");
+		BUG();
+	}
+	for (i = 0; i < EVT_BENCH_NRES; i++) {
+		rids[i] = evt_add(&e, 1, i);
+		if (rids[i] == 0) {
+			printc("evt_add error\n");
+			BUG();
+		}
+	}
+
+	for (i = 0; i < EVT_BENCH_ITERS; i++) {
+		start = ps_tsc();
+		for (j = 0; j < EVT_BENCH_NRES; j++) {
+			if (evt_trigger(rids[j])) {
+				printc("evt_trigger error\n");
+				BUG();
+			}
+		}
+		trig += ps_tsc() - start;
+
+		start = ps_tsc();
+		for (j = 0; j < EVT_BENCH_NRES; j++) {
+			if (evt_get(&e, EVT_WAIT_NONBLOCKING, &src, &data)) {
+				printc("evt_get error\n");
+				BUG();
+			}
+			assert(src == 1 && data < EVT_BENCH_NRES);
+		}
+		get += ps_tsc() - start;
+	}
+
+	printc("Events (%s):\n\ttrigger %lld\n\tget     %lld\n\tevents/Mcycle %lld\n",
+	       shared ? "shared ring" : "invocation", trig / nevts, get / nevts,
+	       (nevts * 1000000) / (trig + get));
+
+	for (i = 0; i < EVT_BENCH_NRES; i++) evt_rem(&e, rids[i]);
+	evt_teardown(&e);
+}
+
+#define EVT_TEST_NRES 16
+#define EVT_TEST_MAX  5
+
+static void
+evt_test_fail(const char *msg)
+{
+	printc("evt_get_n test error: %s\n", msg);
+	BUG();
+}
+
+/*
+ * Harvest with evt_get_n: events are returned at most once however
+ * many times their resources are triggered, in batches of at most
+ * max, and removed resources neither return events, nor can be
+ * triggered. Run twice, so that the memory shared with the manager is
+ * also used after being reclaimed by the first teardown.
+ */
+void
+evt_test_get_n(int shared)
+{
+	struct evt e;
+	struct evt_notif notifs[EVT_TEST_NRES];
+	evt_res_id_t rids[EVT_TEST_NRES];
+	unsigned long seen = 0;
+	int i, n, tot;
+
+	if (evt_init(&e, ~0UL) == 0) evt_test_fail("evt_init of an oversized ring");
+	if (shared ? evt_init_shared(&e, EVT_TEST_NRES) : evt_init(&e, EVT_TEST_NRES)) evt_test_fail("evt_init");
+	for (i = 0; i < EVT_TEST_NRES; i++) {
+		rids[i] = evt_add(&e, 2, i);
+		if (rids[i] == 0) evt_test_fail("evt_add");
+	}
+	if (evt_get_n(&e, EVT_WAIT_NONBLOCKING, notifs, EVT_TEST_MAX) != 0) evt_test_fail("events before triggers");
+
+	for (i = 0; i < EVT_TEST_NRES; i++) {
+		if (evt_trigger(rids[i]) || evt_trigger(rids[i])) evt_test_fail("evt_trigger");
+	}
+	/* the last resource is triggered, but removed before it is harvested */
+	if (evt_rem(&e, rids[EVT_TEST_NRES - 1])) evt_test_fail("evt_rem");
+	if (evt_trigger(rids[EVT_TEST_NRES - 1]) == 0) evt_test_fail("evt_trigger of a removed resource");
+
+	for (tot = 0; tot < EVT_TEST_NRES - 1; tot += n) {
+		n = evt_get_n(&e, EVT_WAIT_NONBLOCKING, notifs, EVT_TEST_MAX);
+		if (n <= 0 || n > EVT_TEST_MAX) evt_test_fail("batch size");
+		for (i = 0; i < n; i++) {
+			if (notifs[i].src != 2 || notifs[i].data >= EVT_TEST_NRES - 1) evt_test_fail("event data");
+			if (seen & (1UL << notifs[i].data)) evt_test_fail("duplicate event");
+			seen |= 1UL << notifs[i].data;
+		}
+	}
+	if (tot != EVT_TEST_NRES - 1) evt_test_fail("too many events");
+	if (evt_get_n(&e, EVT_WAIT_NONBLOCKING, notifs, EVT_TEST_NRES) != 0) evt_test_fail("events after harvest");
+
+	/* the events are pending again after they are harvested */
+	if (evt_trigger(rids[0])) evt_test_fail("evt_trigger");
+	n = evt_get_n(&e, EVT_WAIT_NONBLOCKING, notifs, EVT_TEST_NRES);
+	if (n != 1 || notifs[0].data != 0) evt_test_fail("retrigger");
+
+	if (evt_teardown(&e) == 0) evt_test_fail("evt_teardown with resources");
+	for (i = 0; i < EVT_TEST_NRES - 1; i++) evt_rem(&e, rids[i]);
+	if (evt_teardown(&e)) evt_test_fail("evt_teardown");
+
+	printc("Events (%s): evt_get_n SUCCESS\n", shared ? "shared ring" : "invocation");
+}
+
 int
 main(void)
 {
 	printc("Component chan hi: executing main.\n");
+	evt_test_get_n(0);
+	evt_test_get_n(0);
+	evt_test_get_n(1);
+	evt_test_get_n(1);
+	evt_bench(0);
+	evt_bench(1);
 	receiver();
 	ipc();
 
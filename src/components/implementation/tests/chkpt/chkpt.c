@@ -14,12 +14,23 @@ static compid_t chkpt_compid = 3;
 
 static u32_t test_var = 2;
 
+/*
+ * The checkpoint and clone latencies (printed by the booter) scale
+ * with the size of the data and BSS. The booter also times clones
+ * that copy fractions of it, so this is the largest size measured.
+ */
+#ifndef CHKPT_TEST_BSS_PAGES
+#define CHKPT_TEST_BSS_PAGES 64
+#endif
+static char test_bss[CHKPT_TEST_BSS_PAGES * PAGE_SIZE];
+
 void
 cos_init(void)
 {
 	assert(cos_compid() == test_compid);
 	assert(test_var == 2);
 	test_var = 5;
+	for (int i = 0; i < CHKPT_TEST_BSS_PAGES; i++) test_bss[i * PAGE_SIZE] = (char)i;
 }
 
 void
@@ -35,6 +46,7 @@ parallel_main(coreid_t cid)
 {
 	assert(cos_compid() == chkpt_compid);
 	assert(test_var == 5);
+	for (int i = 0; i < CHKPT_TEST_BSS_PAGES; i++) assert(test_bss[i * PAGE_SIZE] == (char)i);
 
 	printc("Success: Checkpoint created and executed\n");
 }
@@ -5,6 +5,9 @@ static struct perfdata pd[NUM_CPU] CACHE_ALIGNED;
 extern struct results  result_test_timer;
 extern struct results  result_budgets_single;
 extern struct results  result_sinv;
+extern struct results  result_sinv_cache[INVSTK_CACHE_NMODES];
+extern struct results  result_sinv_pgtbl[SINV_PGTBL_NTYPES];
+extern struct results  result_sinv_tlb[SINV_PGTBL_NTYPES];
 
 #define ARRAY_SIZE 10000
 static cycles_t test_results[ARRAY_SIZE] = { 0 };
@@ -77,6 +80,67 @@ test_thds_create_switch(void)
                         perfdata_sd(&pd[cos_cpuid()]),perfdata_90ptile(&pd[cos_cpuid()]), perfdata_95ptile(&pd[cos_cpuid()]), perfdata_99ptile(&pd[cos_cpuid()]));
 }
 
+/*
+ * Cost of COS_THD_SWITCH when the threads use the FPU: the FPU state
+ * is switched lazily, so threads that don't use it (FP-idle) pay
+ * nothing, and those that do (FP-heavy) pay for the device-not-available
+ * trap, and the save/restore of their state on their first FPU use.
+ */
+
+static volatile double fpu_val[NUM_CPU];
+
+static void
+bounceback_fpu(void *d)
+{
+        while (1) {
+                fpu_val[cos_cpuid()] *= 1.000001;
+                rdtscll(side_thd);
+                cos_thd_switch(BOOT_CAPTBL_SELF_INITTHD_CPU_BASE);
+        }
+}
+
+static void
+test_thds_fpu_switch_perf(const char *name, cos_thd_fn_t fn, int use_fpu)
+{
+        thdcap_t ts;
+        int      ret, i;
+
+        perfdata_init(&pd[cos_cpuid()], name, test_results, ARRAY_SIZE);
+
+        ts = cos_thd_alloc(&booter_info, booter_info.comp_cap, fn, NULL);
+        if (EXPECT_LL_LT(1, ts, "Thread Creation: Cannot Allocate")) {
+                return;
+        }
+
+        fpu_val[cos_cpuid()] = 1.0;
+        for (i = 0; i < ITER; i++) {
+                if (use_fpu) fpu_val[cos_cpuid()] *= 1.000001;
+                rdtscll(main_thd);
+                ret = cos_thd_switch(ts);
+                EXPECT_LL_NEQ(0, ret, "COS Switch Error");
+
+                perfdata_add(&pd[cos_cpuid()], (side_thd - main_thd));
+        }
+
+        perfdata_calc(&pd[cos_cpuid()]);
+
+        PRINTC("\t%s:\t\tAVG:%llu, MAX:%llu, MIN:%llu, ITER:%d\n", name,
+                        perfdata_avg(&pd[cos_cpuid()]), perfdata_max(&pd[cos_cpuid()]), perfdata_min(&pd[cos_cpuid()]), perfdata_sz(&pd[cos_cpuid()]));
+
+        printc("\t\t\t\t\t\t\tSD:%llu, 90%%:%llu, 95%%:%llu, 99%%:%llu\n",
+                        perfdata_sd(&pd[cos_cpuid()]),perfdata_90ptile(&pd[cos_cpuid()]), perfdata_95ptile(&pd[cos_cpuid()]), perfdata_99ptile(&pd[cos_cpuid()]));
+}
+
+static void
+test_thds_fpu_switch(void)
+{
+        test_thds_fpu_switch_perf("COS THD => FP-IDLE SWITCH", bounceback, 0);
+#ifdef FPU_ENABLED
+        /* without lazy switching in the kernel, the threads would share the FPU state */
+        test_thds_fpu_switch_perf("COS THD => FP-HEAVY SWITCH", bounceback_fpu, 1);
+#endif
+}
+
 /*
  * Asychronous RCV and SND:
  *   * Roundtrip: 2 Thd that bounce between eachother through cos_rcv() and cos_asnd()
@@ -209,6 +273,38 @@ test_async_endpoints_perf(void)
         while (async_test_flag_[cos_cpuid()]) cos_thd_switch(tcp);
 }
 
+static void
+test_print_sinv_cache(void)
+{
+        const char *names[INVSTK_CACHE_NMODES] = { "Uncached", "Top Cached", "Full Cached" };
+        int         mode;
+
+        PRINTC("\tSINV Roundtrip (invstk cache):\t\tAVG\tMAX\tMIN\t99%%\n");
+        for (mode = INVSTK_CACHE_NONE; mode < INVSTK_CACHE_NMODES; mode++) {
+                printc("\t\t%-12s\t\t\t%llu\t%llu\t%llu\t%llu\n", names[mode],
+                       result_sinv_cache[mode].avg, result_sinv_cache[mode].max, result_sinv_cache[mode].min,
+                       result_sinv_cache[mode].p99tile);
+        }
+}
+
+static void
+test_print_sinv_pgtbl(void)
+{
+        const char *names[SINV_PGTBL_NTYPES] = { "Same pgtbl", "Diff pgtbl" };
+        int         t;
+
+        PRINTC("\tSINV Roundtrip (page-table):\t\tAVG\tMAX\tMIN\t99%%\n");
+        for (t = SINV_PGTBL_SAME; t < SINV_PGTBL_NTYPES; t++) {
+                printc("\t\t%-12s\t\t\t%llu\t%llu\t%llu\t%llu\n", names[t], result_sinv_pgtbl[t].avg,
+                       result_sinv_pgtbl[t].max, result_sinv_pgtbl[t].min, result_sinv_pgtbl[t].p99tile);
+        }
+        PRINTC("\tSINV TLB refill (%d pages):\t\tAVG\tMAX\tMIN\t99%%\n", TEST_TLB_PAGES);
+        for (t = SINV_PGTBL_SAME; t < SINV_PGTBL_NTYPES; t++) {
+                printc("\t\t%-12s\t\t\t%llu\t%llu\t%llu\t%llu\n", names[t], result_sinv_tlb[t].avg,
+                       result_sinv_tlb[t].max, result_sinv_tlb[t].min, result_sinv_tlb[t].p99tile);
+        }
+}
+
 void
 test_print_ubench(void)
 {
@@ -220,6 +316,9 @@ test_print_ubench(void)
                         result_sinv.sd, result_sinv.p90tile, result_sinv.p95tile,
                         result_sinv.p99tile);
 
+        test_print_sinv_cache();
+        test_print_sinv_pgtbl();
+
         PRINTC("\tTimer => Timeout Overhead: \t\tAVG:%llu, MAX:%llu, MIN:%llu, ITER:%d\n",
                         result_test_timer.avg, result_test_timer.max, result_test_timer.min,
                         result_test_timer.sz);
@@ -242,6 +341,10 @@ test_run_perf_kernel(void)
 {
         cyc_per_usec = cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
         test_thds_create_switch();
+        test_thds_fpu_switch();
         test_async_endpoints_perf();
+        test_tcap_prio_perf();
+        test_mem_alias_perf();
+        test_mem_superpage_perf();
         test_print_ubench();
 }
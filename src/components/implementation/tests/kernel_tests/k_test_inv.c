@@ -9,10 +9,20 @@
 static int      failure = 0;
 struct perfdata result;
 struct results  result_sinv;
+struct results  result_sinv_cache[INVSTK_CACHE_NMODES];
+struct results  result_sinv_pgtbl[SINV_PGTBL_NTYPES];
+struct results  result_sinv_tlb[SINV_PGTBL_NTYPES];
 
 #define ARRAY_SIZE 10000
 static cycles_t test_results[ARRAY_SIZE] = { 0 };
 
+#define TEST_BATCH_SZ 8
+static struct cos_sinv_batch_ent batch[TEST_BATCH_SZ] PAGE_ALIGNED;
+/* __inv_test_serverfn executes on the stack passed in the 4th argument */
+static char batch_stk[PAGE_SIZE] PAGE_ALIGNED;
+
+static char tlb_ws[TEST_TLB_PAGES][PAGE_SIZE] PAGE_ALIGNED;
+
 int
 test_serverfn(int a, int b, int c)
 {
@@ -48,6 +58,163 @@ call_cap_mb(u32_t cap_no, int arg1, int arg2, int arg3)
         return ret;
 }
 
+/*
+ * Measure the invocation roundtrip with each of the kernel's
+ * invocation stack caching modes, then restore the original mode.
+ */
+static void
+test_inv_cache_modes(sinvcap_t ic)
+{
+        cycles_t start_cycles = 0LL, end_cycles = 0LL;
+        int      mode, prev, i;
+
+        prev = cos_hw_invstk_cache(BOOT_CAPTBL_SELF_INITHW_BASE, INVSTK_CACHE_NONE);
+        if (EXPECT_LL_LT(0, prev, "Invocation: Cannot set invstk cache mode")) return;
+
+        for (mode = INVSTK_CACHE_NONE; mode < INVSTK_CACHE_NMODES; mode++) {
+                if (EXPECT_LL_LT(0, cos_hw_invstk_cache(BOOT_CAPTBL_SELF_INITHW_BASE, mode),
+                                 "Invocation: Cannot set invstk cache mode")) break;
+
+                perfdata_init(&result, "SINV invstk cache", test_results, ARRAY_SIZE);
+                for (i = 0; i < ITER; i++) {
+                        rdtscll(start_cycles);
+                        call_cap_mb(ic, 1, 2, 3);
+                        rdtscll(end_cycles);
+
+                        perfdata_add(&result, end_cycles - start_cycles);
+                }
+                perfdata_calc(&result);
+
+                result_sinv_cache[mode].avg     = perfdata_avg(&result);
+                result_sinv_cache[mode].max     = perfdata_max(&result);
+                result_sinv_cache[mode].min     = perfdata_min(&result);
+                result_sinv_cache[mode].sz      = perfdata_sz(&result);
+                result_sinv_cache[mode].sd      = perfdata_sd(&result);
+                result_sinv_cache[mode].p90tile = perfdata_90ptile(&result);
+                result_sinv_cache[mode].p95tile = perfdata_95ptile(&result);
+                result_sinv_cache[mode].p99tile = perfdata_99ptile(&result);
+        }
+
+        cos_hw_invstk_cache(BOOT_CAPTBL_SELF_INITHW_BASE, prev);
+}
+
+static void
+results_save(struct results *r, struct perfdata *pd)
+{
+        perfdata_calc(pd);
+        r->avg     = perfdata_avg(pd);
+        r->max     = perfdata_max(pd);
+        r->min     = perfdata_min(pd);
+        r->sz      = perfdata_sz(pd);
+        r->sd      = perfdata_sd(pd);
+        r->p90tile = perfdata_90ptile(pd);
+        r->p95tile = perfdata_95ptile(pd);
+        r->p99tile = perfdata_99ptile(pd);
+}
+
+/*
+ * Alias the page containing addr at the same address in the
+ * page-table of dst.  Returns the pgd-aligned address, so that
+ * consecutive calls within the same pgd only expand the page-table
+ * once.
+ */
+static vaddr_t
+inv_pgtbl_alias(struct cos_compinfo *dst, vaddr_t addr, vaddr_t prev_pgd)
+{
+        addr = round_to_page(addr);
+        if (round_to_pgd_page(addr) != prev_pgd) cos_pgtbl_intern_alloc(&booter_info, dst->pgtbl_cap, addr, PAGE_SIZE);
+        cos_mem_alias_at(dst, addr, &booter_info, addr);
+
+        return round_to_pgd_page(addr);
+}
+
+/*
+ * Invocation cost into a server that shares the client's page-table
+ * (no cr3 load), and into one with its own page-table (cr3 load, and
+ * TLB flush).  The cost of the subsequent TLB misses is measured as
+ * the time the client takes to touch TEST_TLB_PAGES pages after the
+ * return.
+ */
+static void
+test_inv_pgtbl(sinvcap_t ic_same)
+{
+        struct cos_compinfo pt_info;
+        pgtblcap_t          pt;
+        compcap_t           cc;
+        sinvcap_t           ics[SINV_PGTBL_NTYPES];
+        vaddr_t             pages[4], pgd = 0;
+        cycles_t            start_cycles = 0LL, end_cycles = 0LL;
+        int                 local, t, i, j, k;
+
+        pt = cos_pgtbl_alloc(&booter_info);
+        if (EXPECT_LL_LT(1, pt, "Invocation: Cannot Allocate Page-Table")) return;
+        cos_compinfo_init(&pt_info, pt, booter_info.captbl_cap, 0, BOOT_MEM_VM_BASE, BOOT_CAPTBL_FREE, &booter_info);
+
+        /* the server needs its code, and the client's stack it executes on */
+        pages[0] = round_to_page((vaddr_t)__inv_test_serverfn);
+        pages[1] = round_to_page((vaddr_t)test_serverfn);
+        pages[2] = round_to_page((vaddr_t)&local) - PAGE_SIZE;
+        pages[3] = round_to_page((vaddr_t)&local);
+        for (i = 0; i < 4; i++) {
+                for (j = 0; j < i && pages[j] != pages[i]; j++)
+                        ;
+                if (j == i) pgd = inv_pgtbl_alias(&pt_info, pages[i], pgd);
+        }
+
+        cc = cos_comp_alloc(&booter_info, booter_info.captbl_cap, pt, (vaddr_t)NULL);
+        if (EXPECT_LL_LT(1, cc, "Invocation: Cannot Allocate")) return;
+        ics[SINV_PGTBL_SAME] = ic_same;
+        ics[SINV_PGTBL_DIFF] = cos_sinv_alloc(&booter_info, cc, (vaddr_t)__inv_test_serverfn, 0);
+        if (EXPECT_LL_LT(1, ics[SINV_PGTBL_DIFF], "Invocation: Cannot Allocate")) return;
+        if (EXPECT_LLU_NEQ(0xDEADBEEF, (unsigned int)call_cap_mb(ics[SINV_PGTBL_DIFF], 1, 2, 3),
+                           "Invocation: Separate Page-Table")) return;
+
+        for (t = 0; t < SINV_PGTBL_NTYPES; t++) {
+                perfdata_init(&result, "SINV page-table", test_results, ARRAY_SIZE);
+                for (i = 0; i < ITER; i++) {
+                        rdtscll(start_cycles);
+                        call_cap_mb(ics[t], 1, 2, 3);
+                        rdtscll(end_cycles);
+
+                        perfdata_add(&result, end_cycles - start_cycles);
+                }
+                results_save(&result_sinv_pgtbl[t], &result);
+
+                perfdata_init(&result, "SINV TLB refill", test_results, ARRAY_SIZE);
+                for (i = 0; i < ITER; i++) {
+                        call_cap_mb(ics[t], 1, 2, 3);
+                        rdtscll(start_cycles);
+                        for (k = 0; k < TEST_TLB_PAGES; k++) tlb_ws[k][0]++;
+                        rdtscll(end_cycles);
+
+                        perfdata_add(&result, end_cycles - start_cycles);
+                }
+                results_save(&result_sinv_tlb[t], &result);
+        }
+}
+
+static void
+test_inv_batch(sinvcap_t ic)
+{
+        word_t stk = (word_t)&batch_stk[PAGE_SIZE - sizeof(word_t)];
+        int    i, ret;
+
+        for (i = 0; i < TEST_BATCH_SZ; i++) {
+                batch[i] = (struct cos_sinv_batch_ent){ .sinv = ic, .args = { i, 2, 3, stk } };
+        }
+
+        ret = cos_sinv_batch(&booter_info, batch, TEST_BATCH_SZ);
+        if (EXPECT_LL_NEQ(TEST_BATCH_SZ, ret, "Batched Invocation")) return;
+        for (i = 0; i < TEST_BATCH_SZ; i++) {
+                if (EXPECT_LLU_NEQ(0xDEADBEEF, (unsigned int)batch[i].rets[0], "Batched Invocation")) return;
+        }
+
+        /* an invalid capability terminates the batch */
+        batch[TEST_BATCH_SZ / 2].sinv = 0;
+        ret = cos_sinv_batch(&booter_info, batch, TEST_BATCH_SZ);
+        EXPECT_LL_NEQ(TEST_BATCH_SZ / 2, ret, "Batched Invocation: Invalid Capability");
+}
+
 void
 test_inv(void)
 {
@@ -85,6 +252,10 @@ test_inv(void)
         result_sinv.p95tile = perfdata_avg(&result);
         result_sinv.p99tile = perfdata_avg(&result);
 
+        test_inv_cache_modes(ic);
+        test_inv_pgtbl(ic);
+        test_inv_batch(ic);
+
         CHECK_STATUS_FLAG();
         PRINTC("\t%s: \t\tSuccess\n", "Synchronous Invocations");
         EXIT_FN();
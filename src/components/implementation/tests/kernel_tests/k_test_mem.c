@@ -6,6 +6,7 @@
 
 #include <stdint.h>
 #include "kernel_tests.h"
+#include <barrier.h>
 
 #define TEST_NPAGES (1024 * 2)          /* Testing with 8MB for now */
 
@@ -58,3 +59,237 @@ test_mem_alloc(void)
         memset(t, 0, TEST_NPAGES * PAGE_SIZE);
         PRINTC("\t%s: \t\t\tSuccess\n", "Memory => R & W");
 }
+
+#define TEST_QUIESCE_ITERS 100
+
+static struct simple_barrier mem_unmapped = SIMPLE_BARRIER_INITVAL;
+static unsigned long         mem_quiesced;
+
+static void
+mem_spinner(void *d)
+{
+        while (1) ;
+}
+
+/* Take a timer interrupt, which flushes the TLB periodically */
+static void
+mem_timer_wait(thdcap_t spinner)
+{
+        cycles_t now;
+
+        rdtscll(now);
+        cos_switch(spinner, BOOT_CAPTBL_SELF_INITTCAP_CPU_BASE, 0, tcap_cyc2time(now + GRANULARITY * cyc_per_usec),
+                   BOOT_CAPTBL_SELF_INITRCV_CPU_BASE, cos_sched_sync());
+        sched_events_clear();
+}
+
+/*
+ * Unmap an alias of a page, wait for the frame (still mapped at the
+ * original address) to quiesce, and reuse it. The frame quiesces
+ * once all cores have flushed their TLBs, so each core keeps taking
+ * timer interrupts until all of them have seen their frames quiesce.
+ */
+void
+test_mem_remove(void)
+{
+        char    *p;
+        vaddr_t  alias;
+        thdcap_t spinner;
+        int      ret, i, quiesced = 0;
+
+        p = cos_page_bump_alloc(&booter_info);
+        if (EXPECT_LL_NEQ(1, p != NULL, "Memory Remove: Cannot Allocate")) return;
+        alias = cos_mem_alias(&booter_info, &booter_info, (vaddr_t)p);
+        if (EXPECT_LL_NEQ(1, alias != 0, "Memory Remove: Cannot Alias")) return;
+
+        strcpy(p, "SUCCESS");
+        if (EXPECT_LL_NEQ(0, strcmp(p, (char *)alias), "Memory Remove: Alias maps the wrong page")) return;
+
+        ret = cos_mem_remove(booter_info.pgtbl_cap, alias);
+        if (EXPECT_LL_NEQ(0, ret, "Memory Remove: Cannot Unmap")) return;
+        ret = cos_mem_remove(booter_info.pgtbl_cap, alias);
+        if (EXPECT_LL_EQ(0, ret, "Memory Remove: Unmapped twice")) return;
+
+        ret = cos_mem_quiesced(booter_info.pgtbl_cap, alias);
+        if (EXPECT_LL_EQ(0, ret, "Memory Remove: Quiescence check of an unmapped page")) return;
+
+        spinner = cos_thd_alloc(&booter_info, booter_info.comp_cap, mem_spinner, NULL);
+        if (EXPECT_LL_LT(1, spinner, "Memory Remove: Cannot Allocate Thread")) return;
+        simple_barrier(&mem_unmapped);
+
+        for (i = 0; i < TEST_QUIESCE_ITERS && ps_load(&mem_quiesced) < NUM_CPU; i++) {
+                mem_timer_wait(spinner);
+                if (quiesced) continue;
+
+                ret = cos_mem_quiesced(booter_info.pgtbl_cap, (vaddr_t)p);
+                if (EXPECT_LL_LT(0, ret, "Memory Remove: Quiescence check failed")) return;
+                if (ret == 1) {
+                        quiesced = 1;
+                        ps_faa(&mem_quiesced, 1);
+                }
+        }
+        if (EXPECT_LL_NEQ(1, quiesced, "Memory Remove: Frame never quiesced")) return;
+
+        /* the virtual address and the frame can be reused */
+        ret = cos_mem_alias_at(&booter_info, alias, &booter_info, (vaddr_t)p);
+        if (EXPECT_LL_NEQ(0, ret, "Memory Remove: Cannot Reuse")) return;
+        if (EXPECT_LL_NEQ(0, strcmp(p, (char *)alias), "Memory Remove: Reuse maps the wrong page")) return;
+
+        PRINTC("\t%s: \t\t\tSuccess\n", "Memory => Remove");
+}
+
+/* The x86 PTE flags (PGTBL_PRESENT and PGTBL_WRITABLE in the kernel) */
+#define TEST_PTE_PRESENT  (1 << 0)
+#define TEST_PTE_WRITABLE (1 << 1)
+
+/* Introspect the PTE of the page at addr, and return its present and writable flags */
+static unsigned long
+test_mem_pte_flags(char *addr)
+{
+        unsigned long pte = (unsigned long)cos_introspect(&booter_info, booter_info.pgtbl_cap, (vaddr_t)addr);
+
+        return pte & (TEST_PTE_PRESENT | TEST_PTE_WRITABLE);
+}
+
+/*
+ * Alias pages read-only (as text shared between components is), and
+ * check that the aliases' PTEs are not writable, that the alias sees
+ * writes through the original mapping, and that a read-only alias can
+ * itself be aliased.
+ */
+void
+test_mem_alias_ro(void)
+{
+        char   *p, *ro, *ro2;
+        int     ret, i;
+
+        p = cos_page_bump_allocn(&booter_info, 2 * PAGE_SIZE);
+        if (EXPECT_LL_NEQ(1, p != NULL, "Memory RO Alias: Cannot Allocate")) return;
+        ro  = (char *)cos_page_bump_vallocn(&booter_info, 2 * PAGE_SIZE);
+        ro2 = (char *)cos_page_bump_vallocn(&booter_info, 2 * PAGE_SIZE);
+        if (EXPECT_LL_NEQ(1, ro != NULL && ro2 != NULL, "Memory RO Alias: Cannot Allocate VAS")) return;
+
+        ret = cos_mem_aliasn_ro_at(&booter_info, (vaddr_t)ro, &booter_info, (vaddr_t)p, 2 * PAGE_SIZE);
+        if (EXPECT_LL_NEQ(0, ret, "Memory RO Alias: Cannot Alias")) return;
+        ret = cos_mem_aliasn_ro_at(&booter_info, (vaddr_t)ro2, &booter_info, (vaddr_t)ro, 2 * PAGE_SIZE);
+        if (EXPECT_LL_NEQ(0, ret, "Memory RO Alias: Cannot Alias an Alias")) return;
+
+        for (i = 0; i < 2; i++) {
+                if (EXPECT_LL_NEQ(TEST_PTE_PRESENT | TEST_PTE_WRITABLE, test_mem_pte_flags(p + i * PAGE_SIZE),
+                                  "Memory RO Alias: Original not writable") ||
+                    EXPECT_LL_NEQ(TEST_PTE_PRESENT, test_mem_pte_flags(ro + i * PAGE_SIZE),
+                                  "Memory RO Alias: Alias is writable") ||
+                    EXPECT_LL_NEQ(TEST_PTE_PRESENT, test_mem_pte_flags(ro2 + i * PAGE_SIZE),
+                                  "Memory RO Alias: Alias of an alias is writable")) return;
+        }
+
+        strcpy(p, "SUCCESS");
+        strcpy(p + PAGE_SIZE, "SUCCESS");
+        if (EXPECT_LL_NEQ(0, strcmp(p, ro) || strcmp(p + PAGE_SIZE, ro2 + PAGE_SIZE),
+                          "Memory RO Alias: Alias maps the wrong page")) return;
+
+        PRINTC("\t%s: \t\tSuccess\n", "Memory => RO Alias");
+}
+
+/*
+ * Alias TEST_NPAGES pages into our own page-table page by page (an
+ * invocation per page), and then as a range (an invocation per
+ * PGTBL_CPY_RANGE_MAX pages), and compare the pages mapped per usec.
+ */
+void
+test_mem_alias_perf(void)
+{
+        char         *src, *dst;
+        cycles_t      start, end, perpage, range;
+        int           i;
+
+        src = cos_page_bump_allocn(&booter_info, TEST_NPAGES * PAGE_SIZE);
+        if (EXPECT_LL_NEQ(1, src != NULL, "Memory Alias: Cannot Allocate")) return;
+        for (i = 0; i < TEST_NPAGES; i++) src[i * PAGE_SIZE] = (char)i;
+
+        rdtscll(start);
+        dst = (char *)cos_mem_alias(&booter_info, &booter_info, (vaddr_t)src);
+        for (i = 1; i < TEST_NPAGES; i++) {
+                if (cos_mem_alias(&booter_info, &booter_info, (vaddr_t)&src[i * PAGE_SIZE]) == 0) break;
+        }
+        rdtscll(end);
+        if (EXPECT_LL_NEQ(TEST_NPAGES, i, "Memory Alias: Per-page alias failed")) return;
+        perpage = end - start;
+
+        rdtscll(start);
+        dst = (char *)cos_mem_aliasn(&booter_info, &booter_info, (vaddr_t)src, TEST_NPAGES * PAGE_SIZE);
+        rdtscll(end);
+        if (EXPECT_LL_NEQ(1, dst != NULL, "Memory Alias: Range alias failed")) return;
+        range = end - start;
+
+        for (i = 0; i < TEST_NPAGES; i++) {
+                if (dst[i * PAGE_SIZE] != (char)i) break;
+        }
+        if (EXPECT_LL_NEQ(TEST_NPAGES, i, "Memory Alias: Range alias maps the wrong pages")) return;
+
+        /* pages per usec, with three decimal places */
+        perpage = (cycles_t)TEST_NPAGES * cyc_per_usec * 1000 / perpage;
+        range   = (cycles_t)TEST_NPAGES * cyc_per_usec * 1000 / range;
+        PRINTC("\tMemory Alias (%d pages):\t\tPER-PAGE:%llu.%03llu pages/usec, RANGE:%llu.%03llu pages/usec\n",
+               TEST_NPAGES, perpage / 1000, perpage % 1000, range / 1000, range % 1000);
+}
+
+#define TEST_SUPER_NPAGES (TEST_NPAGES / SUPER_PAGE_NPAGES)
+#define TEST_SUPER_ITERS  16
+
+/* Touch each page of the range, ITERS times, and return the cycles per touch */
+static cycles_t
+test_mem_touch(char *p)
+{
+        cycles_t start, end;
+        int      i, j;
+
+        rdtscll(start);
+        for (j = 0; j < TEST_SUPER_ITERS; j++) {
+                for (i = 0; i < TEST_NPAGES; i++) p[i * PAGE_SIZE]++;
+        }
+        rdtscll(end);
+
+        return (end - start) / (TEST_NPAGES * TEST_SUPER_ITERS);
+}
+
+/*
+ * Allocate TEST_NPAGES pages of memory with superpages, alias them
+ * with superpages, and compare the cost of touching each page (which
+ * mostly measures TLB misses) to that of memory mapped with pages.
+ */
+void
+test_mem_superpage_perf(void)
+{
+        char     *pages, *super, *alias;
+        cycles_t  pagecyc, supercyc;
+        int       i;
+
+        super = cos_page_bump_allocn_super(&booter_info, TEST_SUPER_NPAGES * SUPER_PAGE_SIZE);
+        if (super == NULL) {
+                PRINTC("\tMemory Superpages:\t\tNo aligned untyped memory, skipping\n");
+                return;
+        }
+        if (EXPECT_LL_NEQ(0, (unsigned long)super % SUPER_PAGE_SIZE, "Memory Superpages: Unaligned")) return;
+        for (i = 0; i < TEST_NPAGES; i++) super[i * PAGE_SIZE] = (char)i;
+
+        alias = (char *)cos_mem_aliasn_super(&booter_info, &booter_info, (vaddr_t)super,
+                                             TEST_SUPER_NPAGES * SUPER_PAGE_SIZE);
+        if (EXPECT_LL_NEQ(1, alias != NULL, "Memory Superpages: Alias failed")) return;
+        for (i = 0; i < TEST_NPAGES; i++) {
+                if (alias[i * PAGE_SIZE] != (char)i) break;
+        }
+        if (EXPECT_LL_NEQ(TEST_NPAGES, i, "Memory Superpages: Alias maps the wrong memory")) return;
+
+        pages = cos_page_bump_allocn(&booter_info, TEST_NPAGES * PAGE_SIZE);
+        if (EXPECT_LL_NEQ(1, pages != NULL, "Memory Superpages: Cannot Allocate")) return;
+
+        /* warm the caches, then measure */
+        test_mem_touch(pages);
+        pagecyc  = test_mem_touch(pages);
+        test_mem_touch(super);
+        supercyc = test_mem_touch(super);
+
+        PRINTC("\tMemory Superpages (%d pages):\tPAGES:%llu cycles/page, SUPERPAGES:%llu cycles/page\n",
+               TEST_NPAGES, pagecyc, supercyc);
+}
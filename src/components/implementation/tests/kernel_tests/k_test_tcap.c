@@ -391,3 +391,67 @@ test_tcap_budgets(void)
         /* multi-level budgets test */
         test_tcap_budgets_multi();
 }
+
+/*
+ * The latency of the preemption decision on the asnd (and interrupt)
+ * path: an asnd to a thread whose tcap was delegated through a chain
+ * of schedulers, from the root scheduler. The decision compares the
+ * receiver's tcap against the root's, so it should not grow with the
+ * depth of the hierarchy.
+ */
+
+#define TCAP_PRIO_DEPTH 8
+
+static struct exec_cluster prio_chain[NUM_CPU][TCAP_PRIO_DEPTH];
+
+static void
+test_tcap_prio_asnd(const char *name, int depth)
+{
+        struct exec_cluster *e = &prio_chain[cos_cpuid()][depth - 1];
+        cycles_t             s = 0, en = 0;
+        int                  i, ret;
+
+        perfdata_init(&result, name, test_results, ARRAY_SIZE);
+
+        for (i = 0; i < ITER; i++) {
+                rdtscll(s);
+                ret = cos_asnd(e->sc, 0);
+                rdtscll(en);
+                if (EXPECT_LL_NEQ(0, ret, "TCAP Prio: ASND")) return;
+
+                perfdata_add(&result, en - s);
+        }
+        sched_events_clear();
+
+        perfdata_calc(&result);
+        PRINTC("\t%s (depth %d):\t\tAVG:%llu, MAX:%llu, MIN:%llu, ITER:%d\n", name, depth,
+                        perfdata_avg(&result), perfdata_max(&result), perfdata_min(&result), perfdata_sz(&result));
+
+        printc("\t\t\t\t\t\t\tSD:%llu, 90%%:%llu, 95%%:%llu, 99%%:%llu\n",
+                        perfdata_sd(&result), perfdata_90ptile(&result), perfdata_95ptile(&result), perfdata_99ptile(&result));
+}
+
+void
+test_tcap_prio_perf(void)
+{
+        tcap_t tcc = BOOT_CAPTBL_SELF_INITTCAP_CPU_BASE;
+        int    i;
+
+        for (i = 0; i < TCAP_PRIO_DEPTH; i++) {
+                struct exec_cluster *e = &prio_chain[cos_cpuid()][i];
+
+                if (EXPECT_LL_NEQ(0, exec_cluster_alloc(e, spinner, e, BOOT_CAPTBL_SELF_INITRCV_CPU_BASE),
+                                  "TCAP Prio: Cannot Allocate")) {
+                        return;
+                }
+                /* each level delegates to the next, so the last has TCAP_PRIO_DEPTH schedulers */
+                if (EXPECT_LL_NEQ(0, cos_tcap_transfer(e->rc, tcc, TCAP_RES_INF, TCAP_PRIO_MAX + 2 + i),
+                                  "TCAP Prio: TCAP Transfer")) {
+                        return;
+                }
+                tcc = e->tcc;
+        }
+
+        test_tcap_prio_asnd("ASND => TCAP PRIO", 1);
+        test_tcap_prio_asnd("ASND => TCAP PRIO", TCAP_PRIO_DEPTH);
+}
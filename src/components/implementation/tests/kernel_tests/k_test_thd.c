@@ -162,11 +162,54 @@ test_thds_tls(void)
         EXIT_FN();
 }
 
+static void
+thd_recycle(void *d)
+{
+        while (1) cos_thd_switch(BOOT_CAPTBL_SELF_INITTHD_CPU_BASE);
+}
+
+/*
+ * Create and free more threads than there are thread ids: the ids of
+ * the freed threads must be reused, and stay within the namespace.
+ * Nothing else frees ids on this core meanwhile, so its pool hands
+ * the id just freed to the next thread. Freeing the threads also
+ * returns the stacks they hold here.
+ */
+static void
+test_thds_recycle(void)
+{
+        thdcap_t ts;
+        thdid_t  tid, prev = 0;
+        vaddr_t  kmem;
+        int      i, ret;
+
+        for (i = 0; i < MAX_NUM_THREADS; i++) {
+                ts = cos_thd_alloc_kmem(&booter_info, booter_info.comp_cap, thd_recycle, NULL, &kmem);
+                if (EXPECT_LL_LT(1, ts, "Thread Recycle: Cannot Allocate")) return;
+                tid = cos_introspect(&booter_info, ts, THD_GET_TID);
+                if (EXPECT_LL_LT(1, tid, "Thread Recycle: No Id") ||
+                    EXPECT_LL_LT(tid, MAX_NUM_THREADS - 1, "Thread Recycle: Id Out of Range")) return;
+                if (prev && EXPECT_LL_NEQ(prev, tid, "Thread Recycle: Id Not Reused")) return;
+                prev = tid;
+
+                /* run it, so that it releases its closure */
+                ret = cos_thd_switch(ts);
+                if (EXPECT_LL_NEQ(0, ret, "Thread Recycle: COS Switch Error")) return;
+                ret = cos_thd_free(&booter_info, ts, kmem);
+                if (EXPECT_LL_NEQ(0, ret, "Thread Recycle: Cannot Free")) return;
+        }
+
+        CHECK_STATUS_FLAG();
+        PRINTC("\t%s: \t\t\tSuccess\n", "THD => Id Recycling");
+        EXIT_FN();
+}
+
 void
 test_thds(void)
 {
         test_thds_create_switch();
         test_thds_tls();
+        test_thds_recycle();
         test_mthds_classic();
         test_mthds_ring();
 }
@@ -49,6 +49,8 @@ main(void)
         test_2timers();
         test_thds();
         test_mem_alloc();
+        test_mem_remove();
+        test_mem_alias_ro();
         test_async_endpoints();
         test_inv();
         test_captbl_expands();
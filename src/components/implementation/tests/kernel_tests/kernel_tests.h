@@ -65,6 +65,15 @@ struct results {
         long long unsigned p99tile;
 };
 
+/* Invocation servers that share the client's page-table, or have their own */
+typedef enum {
+        SINV_PGTBL_SAME = 0,
+        SINV_PGTBL_DIFF,
+        SINV_PGTBL_NTYPES
+} sinv_pgtbl_t;
+/* Pages touched by the client after each invocation to measure the TLB refill cost */
+#define TEST_TLB_PAGES 32
+
 static unsigned long
 tls_get(size_t off)
 {
@@ -82,11 +91,17 @@ tls_set(size_t off, unsigned long val)
 }
 
 extern void test_run_perf_kernel(void);
+extern void sched_events_clear(void);
 extern void test_timer(void);
 extern void test_tcap_budgets(void);
 extern void test_2timers(void);
+extern void test_tcap_prio_perf(void);
 extern void test_thds(void);
 extern void test_mem_alloc(void);
+extern void test_mem_remove(void);
+extern void test_mem_alias_ro(void);
+extern void test_mem_alias_perf(void);
+extern void test_mem_superpage_perf(void);
 extern void test_async_endpoints(void);
 extern void test_inv(void);
 extern void test_captbl_expands(void);
@@ -43,7 +43,12 @@ cos_init(void)
         // Ipi Test
         test_ipi_switch();
         test_ipi_interference();
+        test_ipi_ratelimit();
         test_ipi_roundtrip();
+        test_ipi_burst();
+
+        // Parallel allocation
+        test_par_alloc();
 
         // Ipi N to N
         //test_ipi_full();
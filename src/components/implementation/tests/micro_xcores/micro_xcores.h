@@ -39,7 +39,10 @@ extern thdcap_t            termthd[]; /* switch to this to shutdown */
 
 extern void test_ipi_n_n(void);
 extern void test_ipi_interference(void);
+extern void test_ipi_ratelimit(void);
 extern void test_ipi_switch(void);
 extern void test_ipi_roundtrip(void);
+extern void test_ipi_burst(void);
+extern void test_par_alloc(void);
 
 #endif /* MICRO_XCORES_H */
@@ -0,0 +1,175 @@
+#include <stdint.h>
+
+#include "micro_xcores.h"
+
+extern void sched_events_clear(int* rcvd, thdid_t* tid, int* blocked, cycles_t* cycles, tcap_time_t* thd_timeout);
+
+/*
+ * Test Bursts of Asnds: the sender core sends bursts of asnds
+ * back-to-back to a thread on the receiver core. An IPI is only sent
+ * when the ring is empty, so most of a burst should be coalesced into
+ * the IPIs in flight, and handled by a few interrupts.
+ */
+
+static volatile asndcap_t asnd = 0;
+static volatile arcvcap_t rcv  = 0;
+static volatile thdcap_t  thd  = 0;
+static volatile thdid_t   tid  = 0;
+static volatile int       blkd = 0;
+
+static volatile unsigned long long total_rcvd   = 0;
+static volatile unsigned long long total_acts   = 0;
+static volatile unsigned long long total_sent   = 0;
+static volatile unsigned long long total_failed = 0;
+
+static volatile int       done_test = 0;
+
+#define IPI_BURST 64
+#define ARRAY_SIZE (TEST_IPI_ITERS / IPI_BURST)
+static cycles_t           results[ARRAY_SIZE];
+static struct             perfdata pd;
+
+static void
+test_rcv_fn(void *d)
+{
+        while (1) {
+                int pending = 0, rcvd = 0;
+
+                pending = cos_rcv(rcv, RCV_ALL_PENDING, &rcvd);
+                assert(pending == 0);
+
+                total_rcvd += rcvd;
+                total_acts++;
+        }
+}
+
+static void
+test_sched_loop(void)
+{
+        int         blocked, rcvd, pending, ret;
+        cycles_t    cycles;
+        tcap_time_t thd_timeout;
+        thdid_t     thdid;
+
+        /* Clear Scheduler */
+        sched_events_clear(&rcvd, &thdid, &blocked, &cycles, &thd_timeout);
+
+        while (1) {
+                /*
+                 * While the thread is blocked, poll rather than block:
+                 * the sender might be done, with no asnd left to
+                 * wake us up.
+                 */
+                while ((pending = cos_sched_rcv(BOOT_CAPTBL_SELF_INITRCV_CPU_BASE,
+                                                RCV_ALL_PENDING | (blkd ? RCV_NON_BLOCKING : 0), 0,
+                                                &rcvd, &thdid, &blocked, &cycles, &thd_timeout)) >= 0) {
+                        if (!thdid) goto done;
+                        assert(thdid == tid);
+                        blkd = blocked;
+done:
+                        if (!pending) break;
+                }
+
+                /* exit once the thread has received all asnds, and is blocked */
+                if (blkd && done_test && total_rcvd == total_sent) return;
+                if (blkd) continue;
+
+                do {
+                        ret = cos_switch(thd, BOOT_CAPTBL_SELF_INITTCAP_CPU_BASE, 0, 0, 0, 0);
+                } while (ret == -EAGAIN);
+        }
+}
+
+static void
+test_asnd_bursts(void)
+{
+        cycles_t      st = 0, en = 0;
+        unsigned long sent, coalesced, failed;
+        int           i, j, ret;
+
+        sent      = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_SENT);
+        coalesced = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_COALESCED);
+        failed    = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_ENQ_FAIL);
+        perfdata_init(&pd, "Test IPI Burst: SEND TIME", results, ARRAY_SIZE);
+
+        for (i = 0; i < ARRAY_SIZE; i++) {
+                rdtscll(st);
+                for (j = 0; j < IPI_BURST; j++) {
+                        ret = cos_asnd(asnd, 1);
+                        assert(ret == 0 || ret == -EBUSY);
+                        if (ret) total_failed++;
+                        else     total_sent++;
+                }
+                rdtscll(en);
+
+                perfdata_add(&pd, (en - st) / IPI_BURST);
+        }
+
+        sent      = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_SENT) - sent;
+        coalesced = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_COALESCED) - coalesced;
+        failed    = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_ENQ_FAIL) - failed;
+
+        perfdata_calc(&pd);
+        PRINTC("Test IPI Burst (%d asnds):\t SEND TIME AVG:%llu, MAX:%llu, MIN:%llu, ITER:%d\n", IPI_BURST,
+                perfdata_avg(&pd), perfdata_max(&pd), perfdata_min(&pd), perfdata_sz(&pd));
+        printc("\t\t\t\t\t SD:%llu, 90%%:%llu, 95%%:%llu, 99%%:%llu\n",
+                perfdata_sd(&pd), perfdata_90ptile(&pd), perfdata_95ptile(&pd), perfdata_99ptile(&pd));
+        PRINTC("Test IPI Burst:\t\t\t ASNDS:%llu, FAILED:%llu, IPIS:%lu, COALESCED:%lu, RING FULL:%lu\n",
+                total_sent, total_failed, sent, coalesced, failed);
+
+        done_test = 1;
+}
+
+void
+test_ipi_burst(void)
+{
+        arcvcap_t r = 0;
+        asndcap_t s = 0;
+        thdcap_t  t = 0;
+        tcap_t    tcc = 0;
+        unsigned long ipis, dequeued;
+
+        if (NUM_CPU == 1) return;
+
+        if (cos_cpuid() == TEST_RCV_CORE) {
+                tcc = cos_tcap_alloc(&booter_info);
+                if (EXPECT_LL_LT(1, tcc, "IPI BURST: TCAP Allocation"))
+                        return;
+
+                t = cos_thd_alloc(&booter_info, booter_info.comp_cap, test_rcv_fn, NULL);
+                if (EXPECT_LL_LT(1, t, "IPI BURST: Thread Allocation"))
+                        return;
+
+                r = cos_arcv_alloc(&booter_info, t, tcc, booter_info.comp_cap, BOOT_CAPTBL_SELF_INITRCV_CPU_BASE);
+                if (EXPECT_LL_LT(1, r, "IPI BURST: ARCV Allocation"))
+                        return;
+
+                cos_tcap_transfer(r, BOOT_CAPTBL_SELF_INITTCAP_CPU_BASE, TCAP_RES_INF, TCAP_PRIO_MAX);
+
+                ipis     = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_RCVD);
+                dequeued = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_DEQUEUED);
+
+                thd = t;
+                tid = cos_introspect(&booter_info, t, THD_GET_TID);
+                rcv = r;
+
+                test_sched_loop();
+
+                ipis     = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_RCVD) - ipis;
+                dequeued = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_DEQUEUED) - dequeued;
+                PRINTC("Test IPI Burst:\t\t\t INTERRUPTS:%lu, DEQUEUED:%lu, RCVD:%llu, ACTIVATIONS:%llu\n",
+                        ipis, dequeued, total_rcvd, total_acts);
+        } else {
+                if (cos_cpuid() != TEST_SND_CORE) return;
+
+                while (!rcv) ;
+                s = cos_asnd_alloc(&booter_info, rcv, booter_info.captbl_cap);
+                if (EXPECT_LL_LT(1, s, "IPI BURST: ASND Allocation")) {
+                        done_test = 1;
+                        return;
+                }
+                asnd = s;
+
+                test_asnd_bursts();
+        }
+}
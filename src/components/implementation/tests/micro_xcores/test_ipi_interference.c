@@ -253,3 +253,163 @@ test_ipi_interference(void)
                 test_sched_loop();
         }
 }
+
+/*
+ * Test Rate-Limited Interference: the sender core floods the receiver
+ * core with asnds through a rate-limited asnd capability, while the
+ * receiver core measures the cycles stolen from it. The IPIs, and
+ * thus the interference, are bounded by the asnd's budget per
+ * period, however fast the sender is. Asnds beyond the budget are
+ * coalesced, not dropped: once the sender stops, the ones still
+ * pending are delivered by its timer, and the receiver must have
+ * received every asnd sent.
+ */
+
+#define RL_BUDGET    4
+#define RL_PERIOD_US 100
+#define RL_TIME_US   100000
+#define RL_GAP       700
+#define RL_DRAIN_ITERS 100
+
+static volatile arcvcap_t rl_rcv   = 0;
+static volatile asndcap_t rl_asnd  = 0;
+static volatile int       rl_start = 0;
+static volatile int       rl_done  = 0;
+static volatile int       rl_drained = 0;
+
+static volatile unsigned long long rl_sent = 0, rl_rcvd = 0;
+
+static void
+rl_rcv_fn(void *d)
+{
+        int rcvd;
+
+        while (1) {
+                rcvd = 0;
+                cos_rcv(rl_rcv, RCV_ALL_PENDING, &rcvd);
+                rl_rcvd += rcvd;
+        }
+}
+
+static void
+rl_spin_fn(void *d)
+{
+        while (1) ;
+}
+
+static void
+test_ipi_ratelimit_rcv(void)
+{
+        thdcap_t      t;
+        arcvcap_t     r;
+        tcap_t        tcc;
+        cycles_t      st = 0, now = 0, prev = 0, stolen = 0;
+        unsigned long ipis;
+        unsigned long long bound;
+        int           blocked, rcvd;
+        cycles_t      cycles;
+        tcap_time_t   thd_timeout;
+        thdid_t       thdid;
+
+        tcc = cos_tcap_alloc(&booter_info);
+        if (EXPECT_LL_LT(1, tcc, "IPI Rate Limit: TCAP Allocation"))
+                return;
+
+        t = cos_thd_alloc(&booter_info, booter_info.comp_cap, rl_rcv_fn, NULL);
+        if (EXPECT_LL_LT(1, t, "IPI Rate Limit: Thread Allocation"))
+                return;
+
+        r = cos_arcv_alloc(&booter_info, t, tcc, booter_info.comp_cap, BOOT_CAPTBL_SELF_INITRCV_CPU_BASE);
+        if (EXPECT_LL_LT(1, r, "IPI Rate Limit: ARCV Allocation"))
+                return;
+
+        /* lower priority than us: the IPIs interrupt, but don't switch */
+        cos_tcap_transfer(r, BOOT_CAPTBL_SELF_INITTCAP_CPU_BASE, TCAP_RES_INF, TCAP_PRIO_MAX + 5);
+        rl_rcv = r;
+        while (!rl_asnd) ;
+
+        ipis = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_RCVD);
+        rdtscll(st);
+        prev     = st;
+        rl_start = 1;
+        while (!rl_done) {
+                rdtscll(now);
+                if (now - prev > RL_GAP) stolen += now - prev;
+                prev = now;
+        }
+        ipis  = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_RCVD) - ipis;
+        bound = ((now - st) / (RL_PERIOD_US * cyc_per_usec) + 1) * RL_BUDGET;
+
+        PRINTC("Test IPI Rate Limit (%d per %dus):\t ASNDS:%llu, IPIS:%lu, BOUND:%llu, STOLEN:%llu of %llu\n",
+               RL_BUDGET, RL_PERIOD_US, rl_sent, ipis, bound, stolen, now - st);
+        EXPECT_LLU_LT((unsigned long long)ipis, bound, "IPI Rate Limit: Unbounded Interference");
+
+        /* receive the asnds delivered so far, and while the sender's timer delivers the rest */
+        do {
+                cos_thd_switch(t);
+                sched_events_clear(&rcvd, &thdid, &blocked, &cycles, &thd_timeout);
+        } while (!rl_drained);
+        cos_thd_switch(t);
+        sched_events_clear(&rcvd, &thdid, &blocked, &cycles, &thd_timeout);
+
+        PRINTC("Test IPI Rate Limit:\t\t\t SENT:%llu, RECEIVED:%llu\n", rl_sent, rl_rcvd);
+        EXPECT_LLU_NEQ(rl_sent, rl_rcvd, "IPI Rate Limit: Coalesced ASNDs Lost");
+}
+
+static void
+test_ipi_ratelimit_snd(void)
+{
+        asndcap_t     s;
+        thdcap_t      spinner;
+        cycles_t      st = 0, now = 0;
+        unsigned long limited;
+        int           ret, i;
+        int           blocked, rcvd;
+        cycles_t      cycles;
+        tcap_time_t   thd_timeout;
+        thdid_t       thdid;
+
+        while (!rl_rcv) ;
+        s = cos_asnd_alloc_ratelimit(&booter_info, rl_rcv, booter_info.captbl_cap, RL_BUDGET,
+                                     RL_PERIOD_US * cyc_per_usec);
+        spinner = cos_thd_alloc(&booter_info, booter_info.comp_cap, rl_spin_fn, NULL);
+        if (EXPECT_LL_LT(1, s, "IPI Rate Limit: ASND Allocation") ||
+            EXPECT_LL_LT(1, spinner, "IPI Rate Limit: Thread Allocation")) {
+                rl_done = rl_drained = 1;
+                return;
+        }
+        limited = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_RATELIMIT);
+        rl_asnd = s;
+        while (!rl_start) ;
+
+        rdtscll(st);
+        do {
+                ret = cos_asnd(s, 0);
+                assert(ret == 0 || ret == -EBUSY);
+                if (!ret) rl_sent++;
+                rdtscll(now);
+        } while (now - st < (cycles_t)RL_TIME_US * cyc_per_usec);
+        rl_done = 1;
+
+        limited = cos_hw_ipi_stat(BOOT_CAPTBL_SELF_INITHW_BASE, IPI_STAT_RATELIMIT) - limited;
+        PRINTC("Test IPI Rate Limit:\t\t\t COALESCED BY RATE LIMIT:%lu\n", limited);
+
+        /* the timer delivers the asnds still pending once the budget is replenished */
+        for (i = 0; i < RL_DRAIN_ITERS && rl_rcvd < rl_sent; i++) {
+                rdtscll(now);
+                cos_switch(spinner, BOOT_CAPTBL_SELF_INITTCAP_CPU_BASE, 0,
+                           tcap_cyc2time(now + RL_PERIOD_US * cyc_per_usec), BOOT_CAPTBL_SELF_INITRCV_CPU_BASE,
+                           cos_sched_sync());
+                sched_events_clear(&rcvd, &thdid, &blocked, &cycles, &thd_timeout);
+        }
+        rl_drained = 1;
+}
+
+void
+test_ipi_ratelimit(void)
+{
+        if (NUM_CPU == 1) return;
+
+        if (cos_cpuid() == TEST_RCV_CORE)      test_ipi_ratelimit_rcv();
+        else if (cos_cpuid() == TEST_SND_CORE) test_ipi_ratelimit_snd();
+}
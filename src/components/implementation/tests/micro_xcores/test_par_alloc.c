@@ -0,0 +1,123 @@
+#include <stdint.h>
+
+#include "micro_xcores.h"
+
+/*
+ * Test Parallel Allocation: the cost of creating threads (kernel
+ * memory and capabilities) and mapping pages (user memory), first on
+ * a single core, then on all cores at once. Allocations come from
+ * per-core magazines, so the parallel costs should be close to the
+ * serial. Each thread is freed once it is timed, and its id reused,
+ * so the test uses a single thread id per core however many
+ * iterations it runs.
+ *
+ * Test Parallel Boot: the cost of constructing a component (its
+ * tables, and an image of TEST_BOOT_PAGES pages mapped into it), on a
+ * single core, then on all cores at once, as the booter does. Each
+ * component is torn down once it is timed: its image is unmapped, and
+ * the component deactivated (its tables can't be freed without
+ * waiting for quiescence).
+ */
+
+#define TEST_PAR_ITERS  128
+#define TEST_BOOT_ITERS 8
+#define TEST_BOOT_PAGES 8
+
+static cycles_t           results[NUM_CPU][TEST_PAR_ITERS];
+static struct perfdata    pd[NUM_CPU];
+static volatile unsigned long par_ready = 0, boot_ready = 0;
+
+static void
+test_par_fn(void *d)
+{
+        while (1) cos_thd_switch(BOOT_CAPTBL_SELF_INITTHD_CPU_BASE);
+}
+
+static void
+test_par_allocs(const char *name)
+{
+        cycles_t st = 0, en = 0;
+        thdcap_t t;
+        vaddr_t  kmem;
+        void    *p;
+        int      i;
+
+        perfdata_init(&pd[cos_cpuid()], name, results[cos_cpuid()], TEST_PAR_ITERS);
+        for (i = 0; i < TEST_PAR_ITERS; i++) {
+                rdtscll(st);
+                t = cos_thd_alloc_kmem(&booter_info, booter_info.comp_cap, test_par_fn, NULL, &kmem);
+                p = cos_page_bump_alloc(&booter_info);
+                rdtscll(en);
+                if (EXPECT_LL_LT(1, t, "PAR ALLOC: Thread Allocation") ||
+                    EXPECT_LL_NEQ(1, p != NULL, "PAR ALLOC: Page Allocation")) return;
+
+                perfdata_add(&pd[cos_cpuid()], en - st);
+
+                /* run it, so that it releases its closure */
+                if (EXPECT_LL_NEQ(0, cos_thd_switch(t), "PAR ALLOC: Thread Switch") ||
+                    EXPECT_LL_NEQ(0, cos_thd_free(&booter_info, t, kmem), "PAR ALLOC: Thread Free")) return;
+        }
+        perfdata_calc(&pd[cos_cpuid()]);
+}
+
+static void
+test_par_boots(const char *name)
+{
+        struct cos_compinfo ci;
+        cycles_t            st = 0, en = 0;
+        vaddr_t             img, alias;
+        int                 i;
+
+        perfdata_init(&pd[cos_cpuid()], name, results[cos_cpuid()], TEST_BOOT_ITERS);
+        for (i = 0; i < TEST_BOOT_ITERS; i++) {
+                rdtscll(st);
+                if (EXPECT_LL_NEQ(0, cos_compinfo_alloc(&ci, COS_MEM_COMP_START_VA, BOOT_CAPTBL_FREE, 0, &booter_info),
+                                  "PAR BOOT: Component Allocation")) return;
+                img = (vaddr_t)cos_page_bump_allocn(&booter_info, TEST_BOOT_PAGES * PAGE_SIZE);
+                if (EXPECT_LL_NEQ(1, img != 0, "PAR BOOT: Image Allocation")) return;
+                alias = cos_mem_aliasn(&ci, &booter_info, img, TEST_BOOT_PAGES * PAGE_SIZE);
+                rdtscll(en);
+                if (EXPECT_LL_NEQ(1, alias != 0, "PAR BOOT: Image Mapping")) return;
+
+                perfdata_add(&pd[cos_cpuid()], en - st);
+
+                if (EXPECT_LL_NEQ(0, cos_mem_removen(ci.pgtbl_cap, alias, TEST_BOOT_PAGES * PAGE_SIZE),
+                                  "PAR BOOT: Image Unmapping") ||
+                    EXPECT_LL_NEQ(0, cos_mem_removen(booter_info.pgtbl_cap, img, TEST_BOOT_PAGES * PAGE_SIZE),
+                                  "PAR BOOT: Image Free") ||
+                    EXPECT_LL_NEQ(0, cos_comp_deactivate(&booter_info, ci.comp_cap), "PAR BOOT: Component Free")) return;
+        }
+        perfdata_calc(&pd[cos_cpuid()]);
+}
+
+static void
+test_par_print(const char *name, int ncores)
+{
+        PRINTC("Test Parallel %s (%d cores):\t AVG:%llu, MAX:%llu, MIN:%llu, ITER:%d\n", name, ncores,
+                perfdata_avg(&pd[cos_cpuid()]), perfdata_max(&pd[cos_cpuid()]),
+                perfdata_min(&pd[cos_cpuid()]), perfdata_sz(&pd[cos_cpuid()]));
+}
+
+/* Run fn on TEST_RCV_CORE, then on all cores at once */
+static void
+test_par_run(void (*fn)(const char *), const char *name, volatile unsigned long *ready)
+{
+        if (cos_cpuid() == TEST_RCV_CORE) {
+                fn("SERIAL");
+                test_par_print(name, 1);
+        }
+        if (NUM_CPU == 1) return;
+
+        ps_faa((unsigned long *)ready, 1);
+        while (*ready < NUM_CPU) ;
+
+        fn("PARALLEL");
+        test_par_print(name, NUM_CPU);
+}
+
+void
+test_par_alloc(void)
+{
+        test_par_run(test_par_allocs, "Alloc THD+PAGE", &par_ready);
+        test_par_run(test_par_boots, "Boot COMP+IMG", &boot_ready);
+}
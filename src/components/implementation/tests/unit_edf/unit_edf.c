@@ -0,0 +1,144 @@
+/*
+ * Copyright 2020, The George Washington University
+ *
+ * This uses a two clause BSD License.
+ */
+
+#include <cos_defkernel_api.h>
+#include <llprint.h>
+#include <res_spec.h>
+#include <sl.h>
+
+/*
+ * Unit-tests for the EDF-specific behavior of the sl_mod_edf policy
+ * (unit_fprr tests the rest of sl). The testing thread has the
+ * shortest window, so it has the earliest deadline whenever it wakes
+ * up, and the threads it creates only run when it blocks.
+ */
+#define TEST_WINDOW_US  SL_MIN_PERIOD_US
+#define ORDER_NTHDS     3
+#define ORDER_WINDOW_US (10 * 1000)
+
+static int order[NUM_CPU][ORDER_NTHDS];
+static int order_n[NUM_CPU] = { 0 };
+
+static void
+order_fn(void *d)
+{
+	order[cos_cpuid()][order_n[cos_cpuid()]++] = (int)d;
+	sl_thd_exit();
+}
+
+/* Threads with earlier deadlines run first, whatever their creation order */
+static int
+test_deadline_order(void)
+{
+	int windows[ORDER_NTHDS] = { 3, 1, 2 };
+	struct sl_thd *t;
+	int i;
+
+	for (i = 0; i < ORDER_NTHDS; i++) {
+		t = sl_thd_alloc(order_fn, (void *)windows[i]);
+		if (!t) return 1;
+		sl_thd_param_set(t, sched_param_pack(SCHEDP_WINDOW, windows[i] * ORDER_WINDOW_US));
+	}
+	sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(ORDER_NTHDS * ORDER_WINDOW_US));
+
+	if (order_n[cos_cpuid()] != ORDER_NTHDS) return 1;
+	for (i = 0; i < ORDER_NTHDS; i++) {
+		if (order[cos_cpuid()][i] != i + 1) return 1;
+	}
+
+	return 0;
+}
+
+#define OVERRUN_SPIN_US      (50 * 1000)
+#define OVERRUN_HOG_WINDOW_US (2 * 1000)
+#define OVERRUN_WINDOW_US     (10 * 1000)
+
+static volatile int overrun_ran[NUM_CPU] = { 0 }, overrun_starved[NUM_CPU] = { 0 }, hog_done[NUM_CPU] = { 0 };
+
+static void
+overrun_fn(void *d)
+{
+	overrun_ran[cos_cpuid()] = 1;
+	sl_thd_exit();
+}
+
+static void
+hog_fn(void *d)
+{
+	cycles_t end = sl_now() + sl_usec2cyc(OVERRUN_SPIN_US);
+
+	while (sl_now() < end && !overrun_ran[cos_cpuid()]) ;
+	overrun_starved[cos_cpuid()] = !overrun_ran[cos_cpuid()];
+	hog_done[cos_cpuid()]        = 1;
+	sl_thd_exit();
+}
+
+/*
+ * A periodic thread that overruns its deadline without blocking moves
+ * on to its next periods' deadlines, so a thread with a later
+ * deadline still runs.
+ */
+static int
+test_overrun(void)
+{
+	struct sl_thd *hog, *t;
+
+	hog = sl_thd_alloc(hog_fn, NULL);
+	t   = sl_thd_alloc(overrun_fn, NULL);
+	if (!hog || !t) return 1;
+	sl_thd_param_set(hog, sched_param_pack(SCHEDP_WINDOW, OVERRUN_HOG_WINDOW_US));
+	sl_thd_param_set(t, sched_param_pack(SCHEDP_WINDOW, OVERRUN_WINDOW_US));
+
+	sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(OVERRUN_SPIN_US + OVERRUN_WINDOW_US));
+
+	return !hog_done[cos_cpuid()] || overrun_starved[cos_cpuid()];
+}
+
+static void
+run_tests()
+{
+	PRINTC("%s: Schedule by earliest deadline!\n", test_deadline_order() ? "FAILURE" : "SUCCESS");
+	PRINTC("%s: Postpone overrun deadlines!\n", test_overrun() ? "FAILURE" : "SUCCESS");
+
+	PRINTC("Unit-test done!\n");
+	sl_thd_exit();
+}
+
+void
+cos_init(void)
+{
+	int i;
+	static unsigned long first = NUM_CPU + 1, init_done[NUM_CPU] = { 0 };
+	struct sl_thd *testing_thread;
+	struct cos_defcompinfo *defci = cos_defcompinfo_curr_get();
+	struct cos_compinfo    *ci    = cos_compinfo_get(defci);
+
+	PRINTC("Unit-test for the EDF scheduling policy (sl_mod_edf)\n");
+
+	if (ps_cas(&first, NUM_CPU + 1, cos_cpuid())) {
+		cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
+		cos_defcompinfo_init();
+	} else {
+		while (!ps_load(&init_done[first])) ;
+
+		cos_defcompinfo_sched_init();
+	}
+	ps_faa(&init_done[cos_cpuid()], 1);
+	for (i = 0; i < NUM_CPU; i++) {
+		while (!ps_load(&init_done[i])) ;
+	}
+
+	sl_init(SL_MIN_PERIOD_US);
+
+	testing_thread = sl_thd_alloc(run_tests, NULL);
+	sl_thd_param_set(testing_thread, sched_param_pack(SCHEDP_WINDOW, TEST_WINDOW_US));
+
+	sl_sched_loop();
+
+	assert(0);
+
+	return;
+}
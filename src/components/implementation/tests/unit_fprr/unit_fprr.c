@@ -9,9 +9,6 @@
 #include <res_spec.h>
 #include <sl.h>
 
-/* Ensure this is the same as what is in sl_mod_fprr.c */
-#define SL_FPRR_NPRIOS 32
-
 #define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
 
 #define LOW_PRIORITY (LOWEST_PRIORITY - 1)
@@ -153,6 +150,52 @@ run_xcpu_tests()
 	while (xcpu_thd_counter[cos_cpuid()] != XCPU_THDS) ;
 }
 
+/*
+ * Scheduling decision latency with many runnable threads spread
+ * across the priorities below that of the benchmarking thread
+ * (which is thus the highest priority runnable thread).
+ */
+#define BENCH_NTHDS (SL_MAX_NUM_THDS / 2)
+#define BENCH_ITERS 10000
+
+static void
+bench_thd_fn()
+{
+	assert(0); /* never scheduled: lower priority than the benchmark */
+}
+
+static void
+bench_schedule(void)
+{
+	struct sl_thd *thds[BENCH_NTHDS];
+	cycles_t start, end, tot = 0, max = 0;
+	int i, n;
+
+	sl_thd_param_set(sl_thd_curr(), sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY));
+	for (n = 0; n < BENCH_NTHDS; n++) {
+		thds[n] = sl_thd_alloc(bench_thd_fn, NULL);
+		if (!thds[n]) break;
+		sl_thd_param_set(thds[n], sched_param_pack(SCHEDP_PRIO, HIGH_PRIORITY + 1 + n % (LOWEST_PRIORITY - HIGH_PRIORITY)));
+	}
+
+	sl_cs_enter();
+	for (i = 0; i < BENCH_ITERS; i++) {
+		rdtscll(start);
+		sl_mod_schedule();
+		rdtscll(end);
+
+		tot += end - start;
+		if (end - start > max) max = end - start;
+	}
+	sl_cs_exit();
+
+	PRINTC("Scheduling decision with %d threads over %d priorities: AVG:%llu, MAX:%llu\n", n,
+	       LOWEST_PRIORITY - HIGH_PRIORITY, tot / BENCH_ITERS, max);
+
+	for (i = 0; i < n; i++) sl_thd_free(thds[i]);
+	sl_thd_param_set(sl_thd_curr(), sched_param_pack(SCHEDP_PRIO, LOWEST_PRIORITY));
+}
+
 static void
 run_tests()
 {
@@ -163,6 +206,8 @@ run_tests()
 
 	run_xcpu_tests();
 
+	bench_schedule();
+
 	PRINTC("Unit-test done!\n");
 	sl_thd_exit();
 }
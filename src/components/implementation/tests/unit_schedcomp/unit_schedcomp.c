@@ -9,8 +9,6 @@
 #include <sched.h>
 #include <cos_time.h>
 
-#define SL_FPRR_NPRIOS 32
-
 #define LOWEST_PRIORITY (SL_FPRR_NPRIOS - 1)
 
 #define LOW_PRIORITY (LOWEST_PRIORITY - 1)
@@ -12,6 +12,7 @@
 #include <cos_defkernel_api.h>
 #include <llprint.h>
 #include <sl.h>
+#include <sl_blkpt.h>
 
 /* sl also defines a SPIN macro */
 #undef SPIN
@@ -139,6 +140,180 @@ test_timeout_wakeup(void)
 	sl_thd_param_set(high, spw);
 }
 
+/*
+ * Wakeup latency of timeouts: how late, after its timeout, a thread
+ * runs again, with a periodic timer, then tickless. With
+ * SL_TICKLESS, the timer is programmed for the earliest timeout, so
+ * the latency isn't quantized to a period, and the timer doesn't wake
+ * the idle core otherwise.
+ */
+#define TEST_LATENCY_US 150
+
+static void
+test_latency_measure(microsec_t period)
+{
+	unsigned int  iters = 0;
+	cycles_t      max = 0, total = 0;
+	unsigned long wakeups, idle_wakeups, prev_wakeups, prev_idle_wakeups;
+
+	sl_cs_enter();
+	sl_timeout_period(period);
+	sl_cs_exit();
+	sl_timeout_stats(&prev_wakeups, &prev_idle_wakeups);
+
+	while (iters < TEST_ITERS) {
+		cycles_t timeout = sl_now() + sl_usec2cyc(TEST_LATENCY_US), late;
+
+		sl_thd_block_timeout(0, timeout);
+		late   = sl_now() - timeout;
+		total += late;
+		if (late > max) max = late;
+		iters++;
+	}
+	sl_timeout_stats(&wakeups, &idle_wakeups);
+	printc("\nWakeup latency (%s): AVG:%llu, MAX:%llu cycles, ITER:%u\n",
+	       period ? "periodic" : "tickless", total / TEST_ITERS, max, iters);
+	printc("Timer wakeups: %lu, idle (no thread woken): %lu\n", wakeups - prev_wakeups,
+	       idle_wakeups - prev_idle_wakeups);
+}
+
+/*
+ * Equal-priority threads that never yield must still share the core
+ * when tickless: the scheduler arms a quantum timeout while a thread
+ * has runnable peers.
+ */
+#define TEST_RR_US 10000
+
+static volatile unsigned long rr_progress[2];
+
+void
+test_rr_spin(void *data)
+{
+	while (1) rr_progress[(int)data]++;
+}
+
+static void
+test_tickless_rr(void)
+{
+	struct sl_thd *spinners[2];
+	sched_param_t  sp = sched_param_cons(SCHEDP_PRIO, 9);
+	int            i;
+
+	for (i = 0; i < 2; i++) {
+		spinners[i] = sl_thd_alloc(test_rr_spin, (void *)(intptr_t)i);
+		assert(spinners[i]);
+		sl_thd_param_set(spinners[i], sp);
+	}
+	sl_thd_block_timeout(0, sl_now() + sl_usec2cyc(TEST_RR_US));
+	printc("Round-robin (tickless): %lu, %lu iterations\n", rr_progress[0], rr_progress[1]);
+	assert(rr_progress[0] && rr_progress[1]);
+
+	for (i = 0; i < 2; i++) sl_thd_free(spinners[i]);
+}
+
+void
+test_latency_wakeup(void *data)
+{
+	test_latency_measure(SL_MIN_PERIOD_US);
+	test_latency_measure(SL_TICKLESS);
+	test_tickless_rr();
+
+	sl_thd_free(sl_thd_curr());
+	/* should not be scheduled. */
+	assert(0);
+}
+
+void
+test_timeout_latency(void)
+{
+	struct sl_thd *t;
+	sched_param_t  sp = sched_param_cons(SCHEDP_PRIO, 4);
+
+	t = sl_thd_alloc(test_latency_wakeup, NULL);
+	assert(t);
+	sl_thd_param_set(t, sp);
+}
+
+/*
+ * Blockpoints: ids are recycled across more blockpoints than fit in a
+ * chunk, only the owner can free them, and a single trigger wakes
+ * exactly one blocked thread, and reports if others remain.
+ */
+#define TEST_BLKPT_N       600
+#define TEST_BLKPT_OWNER   1
+#define TEST_BLKPT_WAITERS 3
+
+static sched_blkpt_id_t blkpts[TEST_BLKPT_N];
+static volatile int     blkpt_woken;
+
+void
+test_blkpt_waiter(void *data)
+{
+	sl_blkpt_block((sched_blkpt_id_t)(intptr_t)data, 0, 0);
+	blkpt_woken++;
+
+	sl_thd_free(sl_thd_curr());
+	/* should not be scheduled. */
+	assert(0);
+}
+
+void
+test_blkpt_fn(void *data)
+{
+	struct sl_thd   *waiters[TEST_BLKPT_WAITERS];
+	sched_param_t    sp = sched_param_cons(SCHEDP_PRIO, 2);
+	sched_blkpt_id_t id, max = 0;
+	int              i;
+
+	for (i = 0; i < TEST_BLKPT_N; i++) {
+		blkpts[i] = sl_blkpt_alloc(TEST_BLKPT_OWNER);
+		assert(blkpts[i] != SCHED_BLKPT_NULL);
+		if (blkpts[i] > max) max = blkpts[i];
+	}
+	assert(sl_blkpt_free(blkpts[0], TEST_BLKPT_OWNER + 1) != 0);
+	for (i = 0; i < TEST_BLKPT_N; i++) assert(sl_blkpt_free(blkpts[i], TEST_BLKPT_OWNER) == 0);
+	assert(sl_blkpt_free(blkpts[0], TEST_BLKPT_OWNER) != 0);
+	for (i = 0; i < TEST_BLKPT_N; i++) {
+		blkpts[i] = sl_blkpt_alloc(TEST_BLKPT_OWNER);
+		assert(blkpts[i] != SCHED_BLKPT_NULL && blkpts[i] <= max);
+	}
+
+	/* the waiters have a higher priority, so they block right away */
+	id = blkpts[0];
+	for (i = 0; i < TEST_BLKPT_WAITERS; i++) {
+		waiters[i] = sl_thd_alloc(test_blkpt_waiter, (void *)(intptr_t)id);
+		assert(waiters[i]);
+		sl_thd_param_set(waiters[i], sp);
+	}
+	sl_thd_yield(0);
+	assert(blkpt_woken == 0);
+	assert(sl_blkpt_free(id, TEST_BLKPT_OWNER) != 0);
+	for (i = 1; i <= TEST_BLKPT_WAITERS; i++) {
+		assert(sl_blkpt_trigger(id, i, 1) == (i < TEST_BLKPT_WAITERS));
+		assert(blkpt_woken == i);
+	}
+	assert(sl_blkpt_trigger(id, i, 1) == 0);
+	assert(blkpt_woken == TEST_BLKPT_WAITERS);
+
+	for (i = 0; i < TEST_BLKPT_N; i++) assert(sl_blkpt_free(blkpts[i], TEST_BLKPT_OWNER) == 0);
+	printc("Blockpoints: SUCCESS\n");
+
+	sl_thd_free(sl_thd_curr());
+	/* should not be scheduled. */
+	assert(0);
+}
+
+void
+test_blkpt(void)
+{
+	struct sl_thd *t;
+	sched_param_t  sp = sched_param_cons(SCHEDP_PRIO, 3);
+
+	t = sl_thd_alloc(test_blkpt_fn, NULL);
+	assert(t);
+	sl_thd_param_set(t, sp);
+}
+
 void
 cos_init(void)
 {
@@ -148,11 +323,13 @@ cos_init(void)
 	printc("Unit-test for the scheduling library (sl)\n");
 	cos_meminfo_init(&(ci->mi), BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
 	cos_defcompinfo_init();
-	sl_init(SL_MIN_PERIOD_US);
+	sl_init(SL_TICKLESS);
 
 	//	test_yields();
 	//	test_blocking_directed_yield();
 	test_timeout_wakeup();
+	test_timeout_latency();
+	test_blkpt();
 
 	sl_sched_loop_nonblock();
 
@@ -43,6 +43,14 @@ thdcap_t  COS_STUB_DECL(capmgr_thd_create_ext)(spdid_t child, thdclosure_index_t
 thdcap_t  capmgr_aep_create_ext(spdid_t child, struct cos_aep_info *a, thdclosure_index_t idx, int owntc, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax, arcvcap_t *extrcv);
 thdcap_t  COS_STUB_DECL(capmgr_aep_create_ext)(spdid_t child, struct cos_aep_info *a, thdclosure_index_t idx, int owntc, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax, arcvcap_t *extrcv);
 
+/*
+ * Free a thread created for the calling scheduler (through one of
+ * the capmgr_thd_create* functions), which releases its id for reuse.
+ * The thread capability the scheduler has for it is removed. Returns
+ * -ENOENT if the thread isn't one the scheduler can free this way.
+ */
+int capmgr_thd_free(thdid_t tid);
+
 arcvcap_t capmgr_rcv_create(spdid_t child, thdid_t tid, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax);
 arcvcap_t COS_STUB_DECL(capmgr_rcv_create)(spdid_t child, thdid_t tid, cos_channelkey_t key, microsec_t ipiwin, u32_t ipimax);
 
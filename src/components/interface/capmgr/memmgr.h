@@ -24,4 +24,14 @@ cbuf_t  COS_STUB_DECL(memmgr_shared_page_allocn)(unsigned long num_pages, vaddr_
 unsigned long memmgr_shared_page_map(cbuf_t id, vaddr_t *pgaddr);
 unsigned long COS_STUB_DECL(memmgr_shared_page_map)(cbuf_t id, vaddr_t *pgaddr);
 
+vaddr_t memmgr_heap_superpage_allocn(unsigned long num_superpages);
+vaddr_t COS_STUB_DECL(memmgr_heap_superpage_allocn)(unsigned long num_superpages);
+cbuf_t  memmgr_shared_superpage_allocn(unsigned long num_superpages, vaddr_t *pgaddr);
+cbuf_t  COS_STUB_DECL(memmgr_shared_superpage_allocn)(unsigned long num_superpages, vaddr_t *pgaddr);
+
+int memmgr_heap_page_freen(vaddr_t addr, unsigned long num_pages);
+int COS_STUB_DECL(memmgr_heap_page_freen)(vaddr_t addr, unsigned long num_pages);
+int memmgr_shared_page_free(cbuf_t id);
+int COS_STUB_DECL(memmgr_shared_page_free)(cbuf_t id);
+
 #endif /* MEMMGR_H */
@@ -86,6 +86,12 @@ typedef enum {
 	EVT_WAIT_NONBLOCKING = 1
 } evt_wait_flags_t;
 
+/* An event notification, as returned by `evt_get_n` */
+struct evt_notif {
+	evt_res_type_t src;
+	evt_res_data_t data;
+};
+
 #include <evt_private.h>
 
 /**
@@ -93,15 +99,35 @@ typedef enum {
  * memory, and only initializes an existing structure.
  *
  * - @evt - The event structure
- * - @max_evts - the maximum number of event sources that can be added
- *               to the event.
+ * - @max_evts - the expected number of event sources that will be
+ *               added to the event. This sizes the event's ring of
+ *               pending events, which grows if more are added.
  * - @return -
  *
  *     - `0` on success, and
- *     - `!0` if an event channel cannot be created.
+ *     - `!0` if an event channel cannot be created, or `max_evts`
+ *       exceeds the largest ring the manager supports.
  */
 int evt_init(struct evt *evt, unsigned long max_evts);
 
+/**
+ * Initialize an event resource whose ring of pending events is in
+ * memory shared with the event manager. Pending events are harvested
+ * by `evt_get` and `evt_get_n` without invoking the manager, which is
+ * only invoked to block when there are none. Adding, removing, and
+ * triggering resources still invoke the manager.
+ *
+ * - @evt - The event structure
+ * - @max_evts - the expected number of event sources that will be
+ *               added to the event. At most `EVT_SHM_NRES` can be
+ *               added, and the ring does not grow.
+ * - @return -
+ *
+ *     - `0` on success, and
+ *     - `!0` if an event channel cannot be created, or mapped.
+ */
+int evt_init_shared(struct evt *evt, unsigned long max_evts);
+
 /**
  * Teardown an event resource. Teardown does *not* free
  * memory, and only removes the backing resources.
@@ -129,6 +155,28 @@ int evt_teardown(struct evt *evt);
  */
 int evt_get(struct evt *evt, evt_wait_flags_t flags, evt_res_type_t *src, evt_res_data_t *ret_data);
 
+/**
+ * Get up to `max` of the pending events from the event resource with
+ * a single invocation of the event manager, akin to `epoll_wait`
+ * with `maxevents`. It blocks (unless nonblocking) only if there are
+ * no pending events. The events are returned through memory shared
+ * with the manager, which is mapped on the first call. Only one
+ * thread at a time should use `evt_get_n` on an event, unless it was
+ * created with `evt_init_shared`, in which case the events are
+ * harvested directly from the shared ring.
+ *
+ * - @evt - the event
+ * - @flags - options for retrieving the events
+ * - @notifs - the array the events are returned in
+ * - @max - the size of `notifs` (at most `EVT_NOTIF_MAX` are returned)
+ * - @return -
+ *
+ *     - `> 0`, the number of events returned in `notifs`,
+ *     - `0` if nonblocking, and no events are available
+ *     - `< 0` if there is an error, interpret as -errno
+ */
+int evt_get_n(struct evt *evt, evt_wait_flags_t flags, struct evt_notif *notifs, unsigned long max);
+
 /**
  * Client API for generating and using `evt_res_id_t`s. This is the
  * *second* resource provided by the event manager. Each of these
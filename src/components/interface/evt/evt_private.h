@@ -9,12 +9,57 @@ typedef word_t evt_id_t;
  * events.
  */
 struct evt {
-	evt_id_t id;
+	evt_id_t          id;
+	struct evt_notif *notifs; /* shared with the manager for evt_get_n, mapped on demand */
+	struct evt_shm   *shm;    /* the shared event ring, if created with evt_init_shared */
+};
+
+/* The number of events that evt_get_n can return per invocation */
+#define EVT_NOTIF_MAX (PAGE_SIZE / sizeof(struct evt_notif))
+
+/*
+ * The shared-memory event ring (see evt_init_shared). The manager
+ * posts triggered resources into it, and the client harvests them
+ * without invoking the manager. Each resource has a slot holding its
+ * (client-visible) type and data, and a triggered flag that is set by
+ * the manager when it posts the slot, and cleared by the client when
+ * it harvests it. Thus a slot is in the ring at most once, and a ring
+ * with an entry per slot cannot overflow.
+ *
+ * The manager reserves ring entries with a fetch-and-add on tail, and
+ * writes the slot's index + 1 into it. Consumers claim the entry at
+ * head with a cas, and zero it. An entry of 0 at head means that the
+ * ring is empty, or that a producer has reserved, but not yet
+ * written, it; either way the consumer must block, and the producer
+ * wakes it up after writing the entry.
+ *
+ * Only the client's own events are in this memory, so the manager
+ * does not trust anything it reads from it.
+ */
+#define EVT_SHM_NRES 128
+
+struct evt_shm_res {
+	word_t         active;	  /* allocated to a resource? */
+	word_t         triggered; /* in the ring? */
+	evt_res_type_t src;
+	evt_res_data_t data;
+};
+
+struct evt_shm {
+	unsigned long      head CACHE_ALIGNED;
+	unsigned long      tail CACHE_ALIGNED;
+	struct evt_shm_res res[EVT_SHM_NRES] CACHE_ALIGNED;
+	word_t             ring[EVT_SHM_NRES];
 };
 
 evt_id_t __evt_alloc(unsigned long max_evts);
+evt_id_t __evt_alloc_shared(unsigned long max_evts);
+cbuf_t __evt_shm_mem(evt_id_t id);
+int __evt_wait(evt_id_t id);
 int __evt_free(evt_id_t id);
 int __evt_get(evt_id_t id, evt_wait_flags_t flags, evt_res_type_t *src, evt_res_data_t *ret_data);
+int __evt_get_n(evt_id_t id, evt_wait_flags_t flags, unsigned long max);
+cbuf_t __evt_notif_mem(evt_id_t id);
 evt_res_id_t __evt_add(evt_id_t id, evt_res_type_t srctype, evt_res_data_t ret_data);
 int __evt_rem(evt_id_t id, evt_res_id_t rid);
 int __evt_trigger(evt_res_id_t rid);
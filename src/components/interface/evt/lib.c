@@ -1,4 +1,6 @@
 #include <evt.h>
+#include <memmgr.h>
+#include <ps.h>
 
 int
 evt_init(struct evt *evt, unsigned long max_evts)
@@ -6,7 +8,32 @@ evt_init(struct evt *evt, unsigned long max_evts)
 	evt_id_t eid = __evt_alloc(max_evts);
 
 	if (eid == 0) return -1;
-	evt->id = eid;
+	evt->id     = eid;
+	evt->notifs = NULL;
+	evt->shm    = NULL;
+
+	return 0;
+}
+
+int
+evt_init_shared(struct evt *evt, unsigned long max_evts)
+{
+	evt_id_t eid;
+	cbuf_t   id;
+	vaddr_t  mem;
+
+	if (max_evts > EVT_SHM_NRES) return -1;
+	eid = __evt_alloc_shared(max_evts);
+	if (eid == 0) return -1;
+
+	id = __evt_shm_mem(eid);
+	if (id == 0 || memmgr_shared_page_map(id, &mem) == 0) {
+		__evt_free(eid);
+		return -1;
+	}
+	evt->id     = eid;
+	evt->notifs = NULL;
+	evt->shm    = (struct evt_shm *)mem;
 
 	return 0;
 }
@@ -15,15 +42,103 @@ int
 evt_teardown(struct evt *evt)
 {
 	if (__evt_free(evt->id)) return -1;
-	evt->id = 0;
+	/* the manager has unmapped the shared memory, so once we do, it is reclaimed */
+	if (evt->notifs) memmgr_heap_page_freen((vaddr_t)evt->notifs, 1);
+	if (evt->shm)    memmgr_heap_page_freen((vaddr_t)evt->shm, 1);
+	evt->id     = 0;
+	evt->notifs = NULL;
+	evt->shm    = NULL;
 
 	return 0;
 }
 
+/*
+ * Harvest a pending event from the shared ring. Resources removed
+ * after they were triggered are skipped.
+ *
+ * - @return - `0` if an event is returned, `1` if the ring is empty
+ */
+static int
+evt_shm_dequeue(struct evt_shm *shm, struct evt_notif *notif)
+{
+	struct evt_shm_res *res;
+	unsigned long head;
+	word_t ent;
+
+	while (1) {
+		head = ps_load(&shm->head);
+		ent  = ps_load(&shm->ring[head % EVT_SHM_NRES]);
+		if (ent == 0) return 1;
+		if (!ps_cas(&shm->head, head, head + 1)) continue;
+		/* the entry is ours; until we clear triggered, noone can reuse it */
+		ps_store(&shm->ring[head % EVT_SHM_NRES], 0);
+
+		assert(ent <= EVT_SHM_NRES);
+		res    = &shm->res[ent - 1];
+		*notif = (struct evt_notif) {
+			.src  = res->src,
+			.data = res->data,
+		};
+		ps_cc_barrier();
+		if (ps_load(&res->active)) {
+			ps_store(&res->triggered, 0);
+			return 0;
+		}
+		ps_store(&res->triggered, 0);
+	}
+}
+
+static int
+evt_shm_get_n(struct evt *evt, evt_wait_flags_t flags, struct evt_notif *notifs, unsigned long max)
+{
+	unsigned long n;
+
+	while (1) {
+		for (n = 0; n < max && !evt_shm_dequeue(evt->shm, &notifs[n]); n++) ;
+		if (n > 0 || (flags & EVT_WAIT_NONBLOCKING)) break;
+		/* only invoke the manager to block awaiting an event */
+		if (__evt_wait(evt->id)) return -EINVAL;
+	}
+
+	return n;
+}
+
 int
 evt_get(struct evt *evt, evt_wait_flags_t flags, evt_res_type_t *src, evt_res_data_t *ret_data)
 {
-	return __evt_get(evt->id, flags, src, ret_data);
+	struct evt_notif notif;
+	int ret;
+
+	if (!evt->shm) return __evt_get(evt->id, flags, src, ret_data);
+
+	ret = evt_shm_get_n(evt, flags, &notif, 1);
+	if (ret <= 0) return ret == 0 ? 1 : ret;
+	*src      = notif.src;
+	*ret_data = notif.data;
+
+	return 0;
+}
+
+int
+evt_get_n(struct evt *evt, evt_wait_flags_t flags, struct evt_notif *notifs, unsigned long max)
+{
+	int n;
+
+	if (unlikely(max == 0)) return -EINVAL;
+	if (evt->shm) return evt_shm_get_n(evt, flags, notifs, max);
+	if (unlikely(!evt->notifs)) {
+		cbuf_t  id = __evt_notif_mem(evt->id);
+		vaddr_t mem;
+
+		if (id == 0 || memmgr_shared_page_map(id, &mem) == 0) return -ENOMEM;
+		evt->notifs = (struct evt_notif *)mem;
+	}
+	if (max > EVT_NOTIF_MAX) max = EVT_NOTIF_MAX;
+
+	n = __evt_get_n(evt->id, flags, max);
+	if (n > 0) memcpy(notifs, evt->notifs, n * sizeof(struct evt_notif));
+
+	return n;
 }
 
 evt_res_id_t
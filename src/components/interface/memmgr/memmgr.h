@@ -24,4 +24,31 @@ cbuf_t        COS_STUB_DECL(memmgr_shared_page_allocn)(unsigned long num_pages,
 unsigned long memmgr_shared_page_map(cbuf_t id, vaddr_t *pgaddr);
 unsigned long COS_STUB_DECL(memmgr_shared_page_map)(cbuf_t id, vaddr_t *pgaddr);
 
+/*
+ * Allocate memory mapped with superpages (SUPER_PAGE_SIZE each),
+ * avoiding TLB misses for large heaps and buffers. If superpages are
+ * not available, the memory is mapped with normal pages. Shared
+ * superpages are mapped with memmgr_shared_page_map, which returns
+ * the number of (normal) pages.
+ */
+vaddr_t memmgr_heap_superpage_allocn(unsigned long num_superpages);
+vaddr_t COS_STUB_DECL(memmgr_heap_superpage_allocn)(unsigned long num_superpages);
+cbuf_t  memmgr_shared_superpage_allocn(unsigned long num_superpages, vaddr_t *pgaddr);
+cbuf_t  COS_STUB_DECL(memmgr_shared_superpage_allocn)(unsigned long num_superpages, vaddr_t *pgaddr);
+
+/*
+ * Unmap memory from the calling component. Frames that no component
+ * maps anymore are reclaimed by the memory manager, and reused for
+ * later allocations once they are no longer in any TLB. Superpages
+ * can only be freed as a whole. memmgr_heap_page_freen can also unmap
+ * (parts of) shared memory, and memmgr_shared_page_free unmaps all
+ * of a span. Both return 0 on success, and -EINVAL if some of the
+ * memory isn't mapped in the component (pages before it are still
+ * unmapped).
+ */
+int memmgr_heap_page_freen(vaddr_t addr, unsigned long num_pages);
+int COS_STUB_DECL(memmgr_heap_page_freen)(vaddr_t addr, unsigned long num_pages);
+int memmgr_shared_page_free(cbuf_t id);
+int COS_STUB_DECL(memmgr_shared_page_free)(cbuf_t id);
+
 #endif /* MEMMGR_H */
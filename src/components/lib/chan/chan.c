@@ -43,11 +43,14 @@ __chan_gather_resources(struct __chan_meta *m, chan_id_t id, unsigned int item_s
 	if ((ret = chanmgr_mem_resources(id, &cb, &mem)))      return ret;
 	if ((ret = chanmgr_sync_resources(id, &full, &empty))) return ret;
 	assert(mem != NULL && full > 0 && empty > 0);
+	/* a single slot can't distinguish full and empty (see __chan_slot) */
+	if (nslots < 2 || (nslots & (nslots - 1))) return -CHAN_ERR_INVAL_ARG;
 
 	*m = (struct __chan_meta) {
 		.nslots          = nslots,
 		.item_sz         = item_sz,
 		.wraparound_mask = (1 << log32(nslots)) - 1,
+		.flags           = flags,
 		.id              = id,
 		.cbuf_id         = cb,
 		.blkpt_full_id   = full,
@@ -66,7 +69,7 @@ chan_init(struct chan *c, unsigned int item_sz, unsigned int nslots, chan_flags_
 	int ret;
 
 	assert((flags & CHAN_EXACT_SIZE) == 0);
-	assert((flags & CHAN_MPSC) == 0);
+	if (nslots < 2) return -CHAN_ERR_INVAL_ARG;
 	nslots = (unsigned int)nlepow2((u32_t)nslots);
 
 	id = chanmgr_create(item_sz, nslots, flags);
@@ -146,9 +149,9 @@ chan_rcv_get_chan(struct chan_rcv *r)
 }
 
 unsigned int
-chan_mem_sz(unsigned int item_sz, unsigned int slots)
+chan_mem_sz(unsigned int item_sz, unsigned int slots, chan_flags_t flags)
 {
-	return sizeof(struct __chan_mem) + item_sz * slots;
+	return sizeof(struct __chan_mem) + __chan_slot_sz(item_sz, flags) * slots;
 }
 
 int
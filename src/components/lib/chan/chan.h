@@ -9,8 +9,10 @@
 
 /***
  * Channel implementation that enables intra- and inter-core
- * communication. Currently, we assume only single-producer,
- * single-consumer communication (SPSC).
+ * communication. By default, channels assume single-producer,
+ * single-consumer communication (SPSC). Channels created with
+ * `CHAN_MPSC`, `CHAN_SPMC`, or `CHAN_MPMC` support multiple
+ * concurrent senders and/or receivers.
  */
 
 /* Internal implementation details of the channel */
@@ -40,7 +42,7 @@ chan_send(struct chan_snd *c, void *item, chan_comm_t flags)
 {
 	int ret;
 
-	ret = __chan_send_pow2(c, item, c->meta.wraparound_mask, c->meta.item_sz, !(flags & CHAN_NONBLOCKING));
+	ret = __chan_send_pow2(c, item, c->meta.wraparound_mask, c->meta.item_sz, c->meta.flags, !(flags & CHAN_NONBLOCKING));
 	if (likely(ret == 0)) {
 		return 0;
 	} else if (ret > 0) {
@@ -54,9 +56,11 @@ chan_send(struct chan_snd *c, void *item, chan_comm_t flags)
 /**
  * `chan_recv` reads an item off of the channel. The size of the item
  * is provided by the channel creation APIs. The flags indicate if
- * we're just trying to peak (and not remove the time), or if we want
- * to make this call nonblocking. Note: this is inlined to avoid the
- * branch overheads as the compiler inlines the flags.
+ * we're just trying to peek (`CHAN_PEEK`: copy the item, but do not
+ * remove it), or if we want to make this call nonblocking. Note: this
+ * is inlined to avoid the branch overheads as the compiler inlines
+ * the flags. With multiple consumers, a peeked item might be
+ * concurrently received by another consumer.
  *
  * - @c      - Channel to receive from.
  * - @item   - The memory to copy the item into.
@@ -73,7 +77,7 @@ chan_recv(struct chan_rcv *c, void *item, chan_comm_t flags)
 {
 	int ret;
 
-	ret = __chan_recv_pow2(c, item, c->meta.wraparound_mask, c->meta.item_sz, !(flags & CHAN_NONBLOCKING));
+	ret = __chan_recv_pow2(c, item, c->meta.wraparound_mask, c->meta.item_sz, c->meta.flags, !(flags & CHAN_NONBLOCKING), flags & CHAN_PEEK);
 	if (likely(ret == 0)) {
 		return 0;
 	} else if (ret > 0) {
@@ -84,12 +88,113 @@ chan_recv(struct chan_rcv *c, void *item, chan_comm_t flags)
 	}
 }
 
+/**
+ * Zero-copy access to the channel's slots. `chan_send_reserve`
+ * returns a pointer to the next free slot in the channel's (shared)
+ * memory. The caller writes the item in place, and `chan_send_commit`
+ * makes it available to the receiver. Symmetrically,
+ * `chan_recv_peek` returns a pointer to the next filled slot, and
+ * `chan_recv_release` returns it to senders once the caller is done
+ * reading it. This avoids copying the item into and out of the
+ * channel.
+ *
+ * Each SPSC end-point can have only a single reserved/peeked slot at
+ * a time, and it must be committed/released before the next
+ * reserve/peek. With multiple senders (receivers), each of them can
+ * hold a slot, but note that receivers (senders) will block behind a
+ * slot that has not yet been committed (released).
+ *
+ * - @c      - Channel to send to/receive from.
+ * - @flags  - The flags (`CHAN_NONBLOCKING`).
+ * - @slot   - The slot returned by the reserve/peek.
+ * - @return - The slot (of the channel's `item_sz`), or `NULL` if
+ *             `CHAN_NONBLOCKING` was passed in, and the channel is
+ *             full/empty. `chan_send_commit` returns `0` on success,
+ *             and `-CHAN_ERR_*` on error.
+ */
+static inline void *
+chan_send_reserve(struct chan_snd *c, chan_comm_t flags)
+{
+	return __chan_reserve_pow2(c, c->meta.wraparound_mask, c->meta.item_sz, c->meta.flags, !(flags & CHAN_NONBLOCKING));
+}
+
+static inline int
+chan_send_commit(struct chan_snd *c, void *slot)
+{
+	__chan_commit(c->meta.mem, slot, c->meta.flags);
+	crt_blkpt_id_trigger(&c->meta.mem->empty, c->meta.blkpt_empty_id, 0);
+	if (__chan_snd_evt_trigger(c)) return -CHAN_ERR_INVAL_ARG;
+
+	return 0;
+}
+
+static inline void *
+chan_recv_peek(struct chan_rcv *c, chan_comm_t flags)
+{
+	return __chan_peek_pow2(c, c->meta.wraparound_mask, c->meta.item_sz, c->meta.flags, !(flags & CHAN_NONBLOCKING));
+}
+
+static inline void
+chan_recv_release(struct chan_rcv *c, void *slot)
+{
+	__chan_release(c->meta.mem, slot, c->meta.wraparound_mask, c->meta.flags);
+	crt_blkpt_id_trigger_one(&c->meta.mem->full, c->meta.blkpt_full_id, 0);
+}
+
+/**
+ * `chan_send_n` and `chan_recv_n` send or receive up to `n` items in
+ * a single operation. Compared to calling `chan_send`/`chan_recv`
+ * `n` times, the channel's index is updated once per batch, and the
+ * other side is woken up (including triggering the receiver's
+ * `evt`) at most once per batch, and only if the channel was empty
+ * (send) or full (recv). Thus receivers that use `evt`s should drain
+ * the channel before waiting on the event again.
+ *
+ * A blocking `chan_send_n` returns only once all `n` items are
+ * sent. A blocking `chan_recv_n` blocks only until at least one item
+ * is available, then receives up to `n` of them.
+ *
+ * - @c      - Channel to send to/receive from.
+ * - @items  - Array of `n` items to copy into/out of the channel.
+ * - @n      - The number of items in the array.
+ * - @flags  - The flags (`CHAN_NONBLOCKING`).
+ * - @return - One of these values:
+ *
+ *     - `>0`, the number of items sent/received. A blocking send
+ *       only sends fewer than `n` if the receiver's `evt` couldn't
+ *       be triggered.
+ *     - `0` if `CHAN_NONBLOCKING` was passed in, and the channel
+ *       is full/empty.
+ *     - `-CHAN_ERR_*` if an error occurred.
+ */
+static inline int
+chan_send_n(struct chan_snd *c, void *items, unsigned int n, chan_comm_t flags)
+{
+	int ret;
+
+	ret = __chan_send_n_pow2(c, items, n, c->meta.wraparound_mask, c->meta.item_sz, c->meta.flags, !(flags & CHAN_NONBLOCKING));
+	if (unlikely(ret < 0)) return -CHAN_ERR_INVAL_ARG;
+
+	return ret;
+}
+
+static inline int
+chan_recv_n(struct chan_rcv *c, void *items, unsigned int n, chan_comm_t flags)
+{
+	int ret;
+
+	ret = __chan_recv_n_pow2(c, items, n, c->meta.wraparound_mask, c->meta.item_sz, c->meta.flags, !(flags & CHAN_NONBLOCKING));
+	if (unlikely(ret < 0)) return -CHAN_ERR_INVAL_ARG;
+
+	return ret;
+}
+
 /**
  * `chan_init` initializes a channel data-structure, and creates a new
  * channel with `slots` items each of maximum size `item_sz`.
  *
  * - @item_sz - The number of bytes in each item.
- * - @nslots  - The number of items the channel can buffer.
+ * - @nslots  - The number of items the channel can buffer (at least 2).
  * - @flags   - requested invariants and usage patterns on the channel
  * - @return  - `0` on success, `-errval` where `errval` is one of the above `CHAN_ERR_*` values.
  */
@@ -144,9 +249,10 @@ int  chan_teardown(struct chan *c);
  *
  * - @item_sz - size of each item
  * - @slots   - number of items
+ * - @flags   - the channel's flags (multi-producer/consumer channels require more memory)
  * - @return  - number of bytes required for the channel's memory
  */
-unsigned int chan_mem_sz(unsigned int item_sz, unsigned int slots);
+unsigned int chan_mem_sz(unsigned int item_sz, unsigned int slots, chan_flags_t flags);
 
 /**
  * Add the event resource id into the channel so that when a send
@@ -100,6 +100,143 @@ static inline int
 __chan_empty_pow2(struct __chan_mem *m, u32_t wraparound_mask)
 { return m->producer == m->consumer; }
 
+/*
+ * Multi-producer and/or multi-consumer channels (CHAN_MPSC,
+ * CHAN_SPMC, CHAN_MPMC) use ticketed slots. The producer and
+ * consumer indices are tickets that are claimed with a cas (or a
+ * simple increment on the single side), and each slot is prefixed
+ * with a sequence number that publishes the slot's state to the
+ * other side. For the ticket t, and base = t & ~wraparound_mask, the
+ * slot's sequence number is:
+ *
+ * - base:           empty, and ready to be produced into,
+ * - base + 1:       produced into, and ready to be consumed, and
+ * - base + nslots:  consumed, and ready for the next lap's producer.
+ *
+ * Zeroed memory is thus a valid, empty channel. Unlike the SPSC
+ * ring, all nslots slots can be used.
+ */
+struct __chan_slot {
+	u32_t seq;
+	char  mem[0];
+};
+
+static inline int
+__chan_ticketed(chan_flags_t flags)
+{ return flags & CHAN_MPMC; }
+
+/* The size of each slot in the channel's memory */
+static inline u32_t
+__chan_slot_sz(u32_t item_sz, chan_flags_t flags)
+{
+	if (!__chan_ticketed(flags)) return item_sz;
+
+	return round_up_to_pow2(sizeof(struct __chan_slot) + item_sz, sizeof(u32_t));
+}
+
+static inline struct __chan_slot *
+__chan_slot_pow2(struct __chan_mem *m, u32_t ticket, u32_t wraparound_mask, u32_t item_sz)
+{ return (struct __chan_slot *)(m->mem + __chan_buff_idx_pow2(ticket, wraparound_mask) * __chan_slot_sz(item_sz, CHAN_MPMC)); }
+
+/* The difference between the slot's sequence number, and the one expected for a ticket, offset by off */
+static inline s32_t
+__chan_slot_seqdiff(struct __chan_slot *slot, u32_t ticket, u32_t wraparound_mask, u32_t off)
+{ return (s32_t)(*(volatile u32_t *)&slot->seq - ((ticket & ~wraparound_mask) + off)); }
+
+static inline int
+__chan_full_ticket_pow2(struct __chan_mem *m, u32_t wraparound_mask, u32_t item_sz)
+{
+	u32_t p = *(volatile u32_t *)&m->producer;
+
+	return __chan_slot_seqdiff(__chan_slot_pow2(m, p, wraparound_mask, item_sz), p, wraparound_mask, 0) < 0;
+}
+
+static inline int
+__chan_empty_ticket_pow2(struct __chan_mem *m, u32_t wraparound_mask, u32_t item_sz)
+{
+	u32_t c = *(volatile u32_t *)&m->consumer;
+
+	return __chan_slot_seqdiff(__chan_slot_pow2(m, c, wraparound_mask, item_sz), c, wraparound_mask, 1) < 0;
+}
+
+/*
+ * Claim the ticket in *idx whose slot holds the sequence number
+ * expected with offset off. Returns NULL if the channel is full
+ * (off = 0) or empty (off = 1). multi denotes that there might be
+ * other threads using idx concurrently.
+ */
+static inline struct __chan_slot *
+__chan_ticket_claim_pow2(struct __chan_mem *m, u32_t *idx, u32_t *ticket, u32_t wraparound_mask, u32_t item_sz, u32_t off, int multi)
+{
+	while (1) {
+		u32_t               t    = *(volatile u32_t *)idx;
+		struct __chan_slot *slot = __chan_slot_pow2(m, t, wraparound_mask, item_sz);
+		s32_t               diff = __chan_slot_seqdiff(slot, t, wraparound_mask, off);
+
+		/* the slot is still in use from the previous lap */
+		if (diff < 0) return NULL;
+		/* another thread claimed t, and we have a stale ticket */
+		if (diff > 0) continue;
+		if (!multi) {
+			*idx = t + 1;
+		} else if (!ps_cas((unsigned long *)idx, t, t + 1)) {
+			continue;
+		}
+		*ticket = t;
+
+		return slot;
+	}
+}
+
+static inline int
+__chan_produce_ticket_pow2(struct __chan_mem *m, void *d, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	struct __chan_slot *slot;
+	u32_t               t;
+
+	slot = __chan_ticket_claim_pow2(m, &m->producer, &t, wraparound_mask, item_sz, 0, flags & CHAN_MPSC);
+	if (!slot) return 1;
+	memcpy(slot->mem, d, item_sz);
+	/* publish the item only after it is written */
+	ps_cc_barrier();
+	slot->seq = (t & ~wraparound_mask) + 1;
+
+	return 0;
+}
+
+static inline int
+__chan_consume_ticket_pow2(struct __chan_mem *m, void *d, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	struct __chan_slot *slot;
+	u32_t               t;
+
+	slot = __chan_ticket_claim_pow2(m, &m->consumer, &t, wraparound_mask, item_sz, 1, flags & CHAN_SPMC);
+	if (!slot) return 1;
+	ps_cc_barrier();
+	memcpy(d, slot->mem, item_sz);
+	/* release the slot only after it is read */
+	ps_cc_barrier();
+	slot->seq = (t & ~wraparound_mask) + wraparound_mask + 1;
+
+	return 0;
+}
+
+static inline int
+__chan_full(struct __chan_mem *m, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	if (__chan_ticketed(flags)) return __chan_full_ticket_pow2(m, wraparound_mask, item_sz);
+
+	return __chan_full_pow2(m, wraparound_mask);
+}
+
+static inline int
+__chan_empty(struct __chan_mem *m, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	if (__chan_ticketed(flags)) return __chan_empty_ticket_pow2(m, wraparound_mask, item_sz);
+
+	return __chan_empty_pow2(m, wraparound_mask);
+}
+
 static inline int
 __chan_produce_pow2(struct __chan_mem *m, void *d, u32_t wraparound_mask, u32_t item_sz)
 {
@@ -122,12 +259,261 @@ __chan_consume_pow2(struct __chan_mem *m, void *d, u32_t wraparound_mask, u32_t
 	return 0;
 }
 
+static inline int
+__chan_produce(struct __chan_mem *m, void *d, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	if (__chan_ticketed(flags)) return __chan_produce_ticket_pow2(m, d, wraparound_mask, item_sz, flags);
+
+	return __chan_produce_pow2(m, d, wraparound_mask, item_sz);
+}
+
+static inline int
+__chan_consume(struct __chan_mem *m, void *d, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	if (__chan_ticketed(flags)) return __chan_consume_ticket_pow2(m, d, wraparound_mask, item_sz, flags);
+
+	return __chan_consume_pow2(m, d, wraparound_mask, item_sz);
+}
+
+/*
+ * Batched production/consumption of up to n items. The producer or
+ * consumer index is published (or claimed) once for the entire
+ * batch. Returns the number of items produced/consumed, and sets
+ * *transition if the ring might have been empty (produce) or full
+ * (consume) before the batch, thus there might be blocked threads on
+ * the other side. This is evaluated after the index publication (and
+ * a fence) so that it cannot race with a thread that is checking the
+ * ring before blocking.
+ */
+static inline u32_t
+__chan_produce_n_pow2(struct __chan_mem *m, char *d, u32_t n, u32_t wraparound_mask, u32_t item_sz, int *transition)
+{
+	u32_t p = m->producer, i, k;
+
+	k = wraparound_mask - (p - ps_load(&m->consumer));
+	if (k > n) k = n;
+	if (k == 0) return 0;
+	for (i = 0; i < k; i++) {
+		memcpy(m->mem + (__chan_buff_idx_pow2(p + i, wraparound_mask) * item_sz), d + i * item_sz, item_sz);
+	}
+	ps_cc_barrier();
+	m->producer = p + k;
+	ps_mem_fence();
+	*transition = (s32_t)(ps_load(&m->consumer) - p) >= 0;
+
+	return k;
+}
+
+static inline u32_t
+__chan_consume_n_pow2(struct __chan_mem *m, char *d, u32_t n, u32_t wraparound_mask, u32_t item_sz, int *transition)
+{
+	u32_t c = m->consumer, i, k;
+
+	k = ps_load(&m->producer) - c;
+	if (k > n) k = n;
+	if (k == 0) return 0;
+	ps_cc_barrier();
+	for (i = 0; i < k; i++) {
+		memcpy(d + i * item_sz, m->mem + (__chan_buff_idx_pow2(c + i, wraparound_mask) * item_sz), item_sz);
+	}
+	ps_cc_barrier();
+	m->consumer = c + k;
+	ps_mem_fence();
+	*transition = ps_load(&m->producer) - c >= wraparound_mask;
+
+	return k;
+}
+
+/*
+ * Claim up to n consecutive tickets with the sequence number offset
+ * off (see __chan_ticket_claim_pow2) with a single update of *idx.
+ * Returns the number claimed, with the first in *ticket.
+ */
+static inline u32_t
+__chan_ticket_claim_n_pow2(struct __chan_mem *m, u32_t *idx, u32_t *ticket, u32_t n, u32_t wraparound_mask, u32_t item_sz, u32_t off, int multi)
+{
+	while (1) {
+		u32_t t = *(volatile u32_t *)idx, k;
+		s32_t diff = __chan_slot_seqdiff(__chan_slot_pow2(m, t, wraparound_mask, item_sz), t, wraparound_mask, off);
+
+		if (diff < 0) return 0;
+		if (diff > 0) continue;
+		if (n > wraparound_mask + 1) n = wraparound_mask + 1;
+		for (k = 1; k < n; k++) {
+			if (__chan_slot_seqdiff(__chan_slot_pow2(m, t + k, wraparound_mask, item_sz), t + k, wraparound_mask, off)) break;
+		}
+		if (!multi) {
+			*idx = t + k;
+		} else if (!ps_cas((unsigned long *)idx, t, t + k)) {
+			continue;
+		}
+		*ticket = t;
+
+		return k;
+	}
+}
+
+static inline u32_t
+__chan_produce_n_ticket_pow2(struct __chan_mem *m, char *d, u32_t n, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int *transition)
+{
+	u32_t t, i, k;
+
+	k = __chan_ticket_claim_n_pow2(m, &m->producer, &t, n, wraparound_mask, item_sz, 0, flags & CHAN_MPSC);
+	if (k == 0) return 0;
+	for (i = 0; i < k; i++) {
+		struct __chan_slot *slot = __chan_slot_pow2(m, t + i, wraparound_mask, item_sz);
+
+		memcpy(slot->mem, d + i * item_sz, item_sz);
+		ps_cc_barrier();
+		slot->seq = ((t + i) & ~wraparound_mask) + 1;
+	}
+	ps_mem_fence();
+	*transition = (s32_t)(ps_load(&m->consumer) - t) >= 0;
+
+	return k;
+}
+
+static inline u32_t
+__chan_consume_n_ticket_pow2(struct __chan_mem *m, char *d, u32_t n, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int *transition)
+{
+	u32_t t, i, k;
+
+	k = __chan_ticket_claim_n_pow2(m, &m->consumer, &t, n, wraparound_mask, item_sz, 1, flags & CHAN_SPMC);
+	if (k == 0) return 0;
+	ps_cc_barrier();
+	for (i = 0; i < k; i++) {
+		struct __chan_slot *slot = __chan_slot_pow2(m, t + i, wraparound_mask, item_sz);
+
+		memcpy(d + i * item_sz, slot->mem, item_sz);
+		ps_cc_barrier();
+		slot->seq = ((t + i) & ~wraparound_mask) + wraparound_mask + 1;
+	}
+	ps_mem_fence();
+	*transition = (s32_t)(ps_load(&m->producer) - t) >= (s32_t)wraparound_mask + 1;
+
+	return k;
+}
+
+static inline u32_t
+__chan_produce_n(struct __chan_mem *m, void *d, u32_t n, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int *transition)
+{
+	if (__chan_ticketed(flags)) return __chan_produce_n_ticket_pow2(m, d, n, wraparound_mask, item_sz, flags, transition);
+
+	return __chan_produce_n_pow2(m, d, n, wraparound_mask, item_sz, transition);
+}
+
+static inline u32_t
+__chan_consume_n(struct __chan_mem *m, void *d, u32_t n, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int *transition)
+{
+	if (__chan_ticketed(flags)) return __chan_consume_n_ticket_pow2(m, d, n, wraparound_mask, item_sz, flags, transition);
+
+	return __chan_consume_n_pow2(m, d, n, wraparound_mask, item_sz, transition);
+}
+
+/*
+ * Zero-copy access to the slots. __chan_reserve returns the next
+ * free slot (or NULL if full), which is published to the consumer
+ * by __chan_commit. __chan_peek returns the next filled slot (or
+ * NULL if empty) which is given back to producers by
+ * __chan_release. Only a single slot can be reserved (or peeked) at
+ * a time by each end-point of a SPSC channel. For ticketed
+ * channels, the slot is claimed by __chan_reserve (or by __chan_peek
+ * if claim), thus other producers (consumers) proceed past it, and
+ * the slot's sequence number is simply advanced when it is
+ * committed (released).
+ */
+static inline void *
+__chan_reserve(struct __chan_mem *m, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags)
+{
+	struct __chan_slot *slot;
+	u32_t               t;
+
+	if (!__chan_ticketed(flags)) {
+		if (__chan_full_pow2(m, wraparound_mask)) return NULL;
+
+		return m->mem + (__chan_buff_idx_pow2(m->producer, wraparound_mask) * item_sz);
+	}
+	slot = __chan_ticket_claim_pow2(m, &m->producer, &t, wraparound_mask, item_sz, 0, flags & CHAN_MPSC);
+	if (!slot) return NULL;
+
+	return slot->mem;
+}
+
+static inline void
+__chan_commit(struct __chan_mem *m, void *d, chan_flags_t flags)
+{
+	ps_cc_barrier();
+	if (!__chan_ticketed(flags)) {
+		m->producer++;
+	} else {
+		struct __chan_slot *slot = ps_container(d, struct __chan_slot, mem);
+
+		slot->seq = slot->seq + 1;
+	}
+}
+
+static inline void *
+__chan_peek(struct __chan_mem *m, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int claim)
+{
+	struct __chan_slot *slot;
+	u32_t               t;
+
+	if (!__chan_ticketed(flags)) {
+		if (__chan_empty_pow2(m, wraparound_mask)) return NULL;
+		ps_cc_barrier();
+
+		return m->mem + (__chan_buff_idx_pow2(m->consumer, wraparound_mask) * item_sz);
+	}
+	if (!claim) {
+		t    = ps_load(&m->consumer);
+		slot = __chan_slot_pow2(m, t, wraparound_mask, item_sz);
+		if (__chan_slot_seqdiff(slot, t, wraparound_mask, 1) != 0) return NULL;
+	} else {
+		slot = __chan_ticket_claim_pow2(m, &m->consumer, &t, wraparound_mask, item_sz, 1, flags & CHAN_SPMC);
+		if (!slot) return NULL;
+	}
+	ps_cc_barrier();
+
+	return slot->mem;
+}
+
+static inline void
+__chan_release(struct __chan_mem *m, void *d, u32_t wraparound_mask, chan_flags_t flags)
+{
+	ps_cc_barrier();
+	if (!__chan_ticketed(flags)) {
+		m->consumer++;
+	} else {
+		struct __chan_slot *slot = ps_container(d, struct __chan_slot, mem);
+
+		slot->seq = slot->seq + wraparound_mask;
+	}
+}
+
 evt_res_id_t chan_evt_associated(struct chan *c);
 
+/* Trigger the receiver's event, if one is associated with the channel. */
+static inline int
+__chan_snd_evt_trigger(struct chan_snd *s)
+{
+	struct __chan_meta *meta = &s->meta;
+
+	if (unlikely(meta->mem->producer_update)) {
+		meta->mem->producer_update = 0;
+		meta->evt_id = chan_evt_associated(s->c);
+	}
+	if (meta->evt_id) {
+		if (evt_trigger(meta->evt_id)) return -1;
+	}
+
+	return 0;
+}
+
 /**
  * The next two functions pass all of the variables in via arguments,
  * so that we can use them for constant propagation along with
- * inlining to get rid of the general memcpy code.
+ * inlining to get rid of the general memcpy code, and of the
+ * multi-producer/consumer logic when it isn't used.
  *
  * - @return -
  *
@@ -136,7 +522,7 @@ evt_res_id_t chan_evt_associated(struct chan *c);
  *     - `0` on "send/recv complete".
  */
 static inline int
-__chan_send_pow2(struct chan_snd *s, void *item, u32_t wraparound_mask, u32_t item_sz, int blking)
+__chan_send_pow2(struct chan_snd *s, void *item, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int blking)
 {
 	struct __chan_mem *m = s->meta.mem;
 
@@ -144,18 +530,10 @@ __chan_send_pow2(struct chan_snd *s, void *item, u32_t wraparound_mask, u32_t it
 		struct crt_blkpt_checkpoint chkpt;
 
 		crt_blkpt_checkpoint(&m->full, &chkpt);
-		if (!__chan_produce_pow2(m, item, wraparound_mask, item_sz)) {
-			struct __chan_meta *meta = &s->meta;
-
+		if (!__chan_produce(m, item, wraparound_mask, item_sz, flags)) {
 			/* success! */
 			crt_blkpt_id_trigger(&m->empty, s->meta.blkpt_empty_id, 0);
-			if (unlikely(meta->mem->producer_update)) {
-				meta->mem->producer_update = 0;
-				meta->evt_id = chan_evt_associated(s->c);
-			}
-			if (meta->evt_id) {
-				if (evt_trigger(meta->evt_id)) return -1;
-			}
+			if (__chan_snd_evt_trigger(s)) return -1;
 			break;
 		}
 		if (!blking) return 1;
@@ -163,7 +541,7 @@ __chan_send_pow2(struct chan_snd *s, void *item, u32_t wraparound_mask, u32_t it
 		/* Post that we want to block */
 		if (crt_blkpt_id_blocking(&m->full, s->meta.blkpt_full_id, 0, &chkpt)) continue;
 		/* has a preemption before wait opened an empty slot? */
-		if (!__chan_full_pow2(m, wraparound_mask)) continue;
+		if (!__chan_full(m, wraparound_mask, item_sz, flags)) continue;
 		crt_blkpt_id_wait(&m->full, s->meta.blkpt_full_id, 0, &chkpt);
 	}
 
@@ -171,7 +549,7 @@ __chan_send_pow2(struct chan_snd *s, void *item, u32_t wraparound_mask, u32_t it
 }
 
 static inline int
-__chan_recv_pow2(struct chan_rcv *r, void *item, u32_t wraparound_mask, u32_t item_sz, int blking)
+__chan_recv_pow2(struct chan_rcv *r, void *item, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int blking, int peek)
 {
 	struct __chan_mem *m = r->meta.mem;
 
@@ -179,27 +557,146 @@ __chan_recv_pow2(struct chan_rcv *r, void *item, u32_t wraparound_mask, u32_t it
 		struct crt_blkpt_checkpoint chkpt;
 
 		crt_blkpt_checkpoint(&m->empty, &chkpt);
-		if (!__chan_consume_pow2(m, item, wraparound_mask, item_sz)) {
-			/* success! */
-			crt_blkpt_id_trigger(&m->full, r->meta.blkpt_full_id, 0);
+		if (peek) {
+			void *d = __chan_peek(m, wraparound_mask, item_sz, flags, 0);
+
+			if (d) {
+				memcpy(item, d, item_sz);
+				break;
+			}
+		} else if (!__chan_consume(m, item, wraparound_mask, item_sz, flags)) {
+			/* success! A single slot is free, so wake a single sender */
+			crt_blkpt_id_trigger_one(&m->full, r->meta.blkpt_full_id, 0);
 			break;
 		}
 		if (!blking) return 1;
 		/* Post that we want to block */
 		if (crt_blkpt_id_blocking(&m->empty, r->meta.blkpt_empty_id, 0, &chkpt)) continue;
 		/* has a preemption before wait added data into a slot? */
-		if (!__chan_empty_pow2(m, wraparound_mask)) continue;
+		if (!__chan_empty(m, wraparound_mask, item_sz, flags)) continue;
 		crt_blkpt_id_wait(&m->empty, r->meta.blkpt_empty_id, 0, &chkpt);
 	}
 
 	return 0;
 }
 
+/**
+ * Zero-copy versions of the previous functions: wait for a free
+ * (reserve) or filled (peek) slot in the channel, and return a
+ * pointer to it, or NULL if non-blocking and the channel is full
+ * (empty).
+ */
+static inline void *
+__chan_reserve_pow2(struct chan_snd *s, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int blking)
+{
+	struct __chan_mem *m = s->meta.mem;
+
+	while (1) {
+		struct crt_blkpt_checkpoint chkpt;
+		void *d;
+
+		crt_blkpt_checkpoint(&m->full, &chkpt);
+		d = __chan_reserve(m, wraparound_mask, item_sz, flags);
+		if (d) return d;
+		if (!blking) return NULL;
+
+		if (crt_blkpt_id_blocking(&m->full, s->meta.blkpt_full_id, 0, &chkpt)) continue;
+		if (!__chan_full(m, wraparound_mask, item_sz, flags)) continue;
+		crt_blkpt_id_wait(&m->full, s->meta.blkpt_full_id, 0, &chkpt);
+	}
+}
+
+static inline void *
+__chan_peek_pow2(struct chan_rcv *r, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int blking)
+{
+	struct __chan_mem *m = r->meta.mem;
+
+	while (1) {
+		struct crt_blkpt_checkpoint chkpt;
+		void *d;
+
+		crt_blkpt_checkpoint(&m->empty, &chkpt);
+		d = __chan_peek(m, wraparound_mask, item_sz, flags, 1);
+		if (d) return d;
+		if (!blking) return NULL;
+
+		if (crt_blkpt_id_blocking(&m->empty, r->meta.blkpt_empty_id, 0, &chkpt)) continue;
+		if (!__chan_empty(m, wraparound_mask, item_sz, flags)) continue;
+		crt_blkpt_id_wait(&m->empty, r->meta.blkpt_empty_id, 0, &chkpt);
+	}
+}
+
+/**
+ * Batched versions of the previous functions. At most one wakeup of
+ * the other side is made per batch, and only if the ring was empty
+ * (send) or full (recv) beforehand. Sends complete all n items if
+ * blking, and receives block only until at least one item is
+ * available.
+ *
+ * - @return - the number of items sent/received (`0` if non-blocking,
+ *   and the ring is full/empty). Items that are in the ring are
+ *   counted as sent even if the receiver's event couldn't be
+ *   triggered, in which case the send stops there.
+ */
+static inline int
+__chan_send_n_pow2(struct chan_snd *s, void *items, u32_t n, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int blking)
+{
+	struct __chan_mem *m    = s->meta.mem;
+	u32_t              sent = 0;
+
+	while (sent < n) {
+		struct crt_blkpt_checkpoint chkpt;
+		int transition = 0;
+		u32_t k;
+
+		crt_blkpt_checkpoint(&m->full, &chkpt);
+		k = __chan_produce_n(m, (char *)items + sent * item_sz, n - sent, wraparound_mask, item_sz, flags, &transition);
+		if (k > 0) {
+			sent += k;
+			if (!transition) continue;
+			crt_blkpt_id_trigger(&m->empty, s->meta.blkpt_empty_id, 0);
+			if (__chan_snd_evt_trigger(s)) break;
+			continue;
+		}
+		if (!blking) break;
+
+		if (crt_blkpt_id_blocking(&m->full, s->meta.blkpt_full_id, 0, &chkpt)) continue;
+		if (!__chan_full(m, wraparound_mask, item_sz, flags)) continue;
+		crt_blkpt_id_wait(&m->full, s->meta.blkpt_full_id, 0, &chkpt);
+	}
+
+	return sent;
+}
+
+static inline int
+__chan_recv_n_pow2(struct chan_rcv *r, void *items, u32_t n, u32_t wraparound_mask, u32_t item_sz, chan_flags_t flags, int blking)
+{
+	struct __chan_mem *m = r->meta.mem;
+
+	while (1) {
+		struct crt_blkpt_checkpoint chkpt;
+		int transition = 0;
+		u32_t k;
+
+		crt_blkpt_checkpoint(&m->empty, &chkpt);
+		k = __chan_consume_n(m, items, n, wraparound_mask, item_sz, flags, &transition);
+		if (k > 0) {
+			if (transition) crt_blkpt_id_trigger(&m->full, r->meta.blkpt_full_id, 0);
+			return k;
+		}
+		if (!blking) return 0;
+
+		if (crt_blkpt_id_blocking(&m->empty, r->meta.blkpt_empty_id, 0, &chkpt)) continue;
+		if (!__chan_empty(m, wraparound_mask, item_sz, flags)) continue;
+		crt_blkpt_id_wait(&m->empty, r->meta.blkpt_empty_id, 0, &chkpt);
+	}
+}
+
 /* How many slots can we fit into an allocation of a specific mem_sz */
 static inline int
-chan_nslots(int item_sz, int mem_sz)
+chan_nslots(int item_sz, int mem_sz, chan_flags_t flags)
 {
-	return leqpow2((mem_sz - sizeof(struct __chan_mem)) / item_sz);
+	return leqpow2((mem_sz - sizeof(struct __chan_mem)) / __chan_slot_sz(item_sz, flags));
 }
 
 #endif /* CHAN_PRIVATE_H */
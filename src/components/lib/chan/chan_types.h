@@ -34,9 +34,11 @@ typedef word_t chan_id_t;
 /* Values for channel initialization */
 typedef enum {
 	CHAN_DEFAULT    = 0,
-	CHAN_MPSC       = 1,	  /* !CHAN_MPSC == SPSC */
+	CHAN_MPSC       = 1,	  /* multiple producers; !CHAN_MPSC && !CHAN_SPMC == SPSC */
 	CHAN_EXACT_SIZE = 1 << 1, /* The channel size cannot be higher than its initialization size */
-	CHAN_DEALLOCATE = 1 << 2  /* used internally for the `_alloc` APIs */
+	CHAN_DEALLOCATE = 1 << 2, /* used internally for the `_alloc` APIs */
+	CHAN_SPMC       = 1 << 3, /* multiple consumers */
+	CHAN_MPMC       = CHAN_MPSC | CHAN_SPMC
 } chan_flags_t;
 
 #endif	/* CHAN_TYPES_H */
@@ -1,36 +1,107 @@
 #ifndef COS_ASM_SIMPLE_STACKS_H
 #define COS_ASM_SIMPLE_STACKS_H
 
-#define MAX_STACK_SZ_BYTE_ORDER 12
+/* The server stubs include this without consts.h, which sizes the pool */
+#ifndef __ASM__
+#define __ASM__
+#endif
+#include <consts.h>
+#include <cos_errno.h>
 
-#ifndef MAX_STACK_SZ_BYTE_ORDER
-#error "Missing MAX_STACK_SZ_BYTE_ORDER, try including consts.h"
+#if COS_STACK_POOL_NSTACKS % (32 * NUM_CPU) != 0
+#error "The stack pool must have a multiple of 32 stacks (a bitmap word) per core"
 #endif
 
+/*
+ * Execution stacks are pooled per component: COS_STACK_POOL_NSTACKS
+ * stacks in cos_stack_pool, and a bitmap of the free ones in
+ * cos_stack_freemap. A stack is taken (lock btr) when a thread enters
+ * the component, and returned (lock bts) right before it leaves, so
+ * only threads that are in the component have stacks. Each core
+ * starts its search in its own COS_STACK_POOL_CORE_WORDS words of the
+ * bitmap, and wraps around into the other cores' words when those are
+ * empty, so a core can use the whole pool. Bitmaps, unlike a linked
+ * freelist, can't suffer from ABA when preempted mid-update, and we
+ * have a single free register (%edx) and %esp to do it with.
+ *
+ * Stacks are aligned to their size, so the ids we push on top of the
+ * stack can be found from %esp (see get_stk_data). A thread that
+ * never leaves the component (e.g. one created in it, as its
+ * cos_upcall_fn never returns) keeps its stack until it is freed (see
+ * cos_stack_release), so the thread id is cleared when a stack is
+ * returned, to identify the stacks still held by a thread.
+ *
+ * %eax holds the core id (high 16 bits) and the thread id (low 16
+ * bits) on entry. When the pool is empty, an invocation returns
+ * -ENOMEM to its client without running the server function (the
+ * return to the kernel doesn't need a stack), but an upcall has no
+ * client to return to, so it faults.
+ */
+
 /* clang-format off */
 
-#define COS_ASM_GET_STACK_BASIC             \
-	movl $cos_static_stack, %esp;	    \
+#define COS_ASM_STACK_HOME(reg)                                 \
+	movl %eax, reg;                                         \
+	shrl $16, reg;                                          \
+	imull $(COS_STACK_POOL_CORE_WORDS * 4), reg, reg;       \
+	addl $cos_stack_freemap, reg;
+
+#define COS_ASM_REQUEST_STACK(empty)                            \
+	COS_ASM_STACK_HOME(%edx)                                \
+1:	movl (%edx), %esp;                                      \
+	bsfl %esp, %esp;                                        \
+	jz 2f;                                                  \
+	lock btrl %esp, (%edx);                                 \
+	jnc 1b;                                                 \
+	subl $cos_stack_freemap, %edx;                          \
+	shll $3, %edx;                                          \
+	leal 1(%esp, %edx), %esp;                               \
+	shll $MAX_STACK_SZ_BYTE_ORDER, %esp;                    \
+	addl $cos_stack_pool, %esp;                             \
+	jmp 4f;                                                 \
+2:	addl $4, %edx;                                          \
+	cmpl $(cos_stack_freemap + COS_STACK_POOL_WORDS * 4), %edx; \
+	jne 3f;                                                 \
+	movl $cos_stack_freemap, %edx;                          \
+3:	COS_ASM_STACK_HOME(%esp)                                \
+	cmpl %esp, %edx;                                        \
+	jne 1b;                                                 \
+	empty()                                                 \
+4:
+
+#define COS_ASM_STACK_EMPTY_FAULT()                             \
+	xorl %esp, %esp;                                        \
+	movl (%esp), %esp;
+
+#define COS_ASM_STACK_EMPTY_RET()                               \
+	movl $(-ENOMEM), %ecx;                                  \
+	movl $RET_CAP, %eax;                                    \
+	sysenter;
+
+#define COS_ASM_GET_STACK_BASIC(empty)      \
+	COS_ASM_REQUEST_STACK(empty)        \
 	movl %eax, %edx;		    \
 	andl $0xffff, %eax;		    \
-	shl $MAX_STACK_SZ_BYTE_ORDER, %eax; \
-	addl %eax, %esp;		    \
-	shr $MAX_STACK_SZ_BYTE_ORDER, %eax; \
 	shr $16, %edx;			    \
 	pushl %edx;			    \
 	pushl %eax;
 
-#define COS_ASM_GET_STACK       \
-	COS_ASM_GET_STACK_BASIC \
+#define COS_ASM_GET_STACK                                  \
+	COS_ASM_GET_STACK_BASIC(COS_ASM_STACK_EMPTY_FAULT) \
 	pushl $0;
 
-#define COS_ASM_GET_STACK_INVTOKEN \
-	COS_ASM_GET_STACK_BASIC    \
+#define COS_ASM_GET_STACK_INVTOKEN                       \
+	COS_ASM_GET_STACK_BASIC(COS_ASM_STACK_EMPTY_RET) \
 	pushl %ecx;
 
-#define COS_ASM_RET_STACK
-
-#define COS_ASM_REQUEST_STACK
+/* Return the stack we're on, clobbering only %edx */
+#define COS_ASM_RET_STACK                                                       \
+	movl %esp, %edx;                                                        \
+	subl $cos_stack_pool, %edx;                                             \
+	andl $(~(COS_STACK_SZ - 1)), %edx;                                      \
+	movl $0, (cos_stack_pool + COS_STACK_SZ - THDID_OFFSET * 4)(%edx);      \
+	shrl $MAX_STACK_SZ_BYTE_ORDER, %edx;                                    \
+	lock btsl %edx, cos_stack_freemap;
 
 /* clang-format on */
 
@@ -343,6 +343,32 @@ cos_release_vas_page(void *p)
 	cos_set_heap_ptr_conditional(p + PAGE_SIZE, p);
 }
 
+extern unsigned long cos_stack_freemap[COS_STACK_POOL_WORDS];
+extern char          cos_stack_pool[];
+
+int
+cos_stack_release(thdid_t tid)
+{
+	unsigned long *stk_tid, *w, old;
+	int            i, n = 0;
+
+	assert(tid);
+	for (i = 0; i < COS_STACK_POOL_NSTACKS; i++) {
+		w = &cos_stack_freemap[i / 32];
+		if (ps_load(w) & (1UL << (i % 32))) continue;
+		stk_tid = (unsigned long *)(cos_stack_pool + (i + 1) * COS_STACK_SZ - THDID_OFFSET * sizeof(u32_t));
+		if (*stk_tid != tid) continue;
+
+		*stk_tid = 0;
+		do {
+			old = ps_load(w);
+		} while (!ps_cas(w, old, old | (1UL << (i % 32))));
+		n++;
+	}
+
+	return n;
+}
+
 extern const vaddr_t cos_atomic_cmpxchg, cos_atomic_cmpxchg_end, cos_atomic_user1, cos_atomic_user1_end,
   cos_atomic_user2, cos_atomic_user2_end, cos_atomic_user3, cos_atomic_user3_end, cos_atomic_user4,
   cos_atomic_user4_end;
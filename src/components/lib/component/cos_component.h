@@ -339,6 +339,15 @@ cos_get_prealloc_page(void)
 extern void *cos_get_vas_page(void);
 extern void  cos_release_vas_page(void *p);
 
+/*
+ * Return the stacks of this component still held by thread tid to the
+ * pool (see cos_asm_simple_stacks.h). Threads created in the component
+ * never leave it, so they keep their stack until they are freed, and
+ * this must be called then. The thread must not be executing. Returns
+ * the number of stacks released.
+ */
+extern int cos_stack_release(thdid_t tid);
+
 /* only if the heap pointer is pre_addr, set it to post_addr */
 static inline void
 cos_set_heap_ptr_conditional(void *pre_addr, void *post_addr)
@@ -58,6 +58,20 @@
 static unsigned long nchkpt = 0;
 static unsigned long ncomp = 1;
 
+/*
+ * The read-only segment of each ELF image is copied out of the image
+ * once, and its pages are aliased read-only into every component
+ * created from that image. Only the data and BSS are per-component.
+ */
+#define CRT_RO_IMGS_MAX MAX_NUM_COMPS
+
+struct crt_ro_img {
+	void          *elf_hdr;
+	char *volatile mem;
+	volatile int   ready;
+};
+static struct crt_ro_img ro_imgs[CRT_RO_IMGS_MAX];
+
 unsigned long
 crt_ncomp()
 {
@@ -70,41 +84,142 @@ crt_nchkpt()
 	return nchkpt;
 }
 
+/*
+ * Find the shared copy of the read-only segment of elf_hdr, making it
+ * if this is the first component created from the image. Returns NULL
+ * on allocation failure. The entry is only published once the copy is
+ * made; if its allocation fails, the entry is released instead, and
+ * the components waiting on it retry.
+ */
+static char *
+crt_ro_img_get(void *elf_hdr, char *ro_src, size_t ro_sz)
+{
+	struct cos_compinfo *root_ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct crt_ro_img   *img;
+	char                *mem;
+	int                  i;
+
+retry:
+	for (i = 0; i < CRT_RO_IMGS_MAX; i++) {
+		img = &ro_imgs[i];
+		if (img->elf_hdr == elf_hdr) goto found;
+		if (!img->elf_hdr && ps_cas((unsigned long *)&img->elf_hdr, 0, (unsigned long)elf_hdr)) break;
+		/* someone else might have just claimed the entry for this image */
+		if (img->elf_hdr == elf_hdr) goto found;
+	}
+
+	mem = cos_page_bump_allocn(root_ci, round_up_to_page(ro_sz));
+	if (mem) memcpy(mem, ro_src, ro_sz);
+	/* out of entries: the component gets a private copy */
+	if (i == CRT_RO_IMGS_MAX) return mem;
+	if (!mem) {
+		ps_store((unsigned long *)&img->elf_hdr, 0);
+
+		return NULL;
+	}
+
+	img->mem   = mem;
+	img->ready = 1;
+
+	return mem;
+found:
+	while (!img->ready) {
+		/* the entry was released after a failed allocation */
+		if (ps_load(&img->elf_hdr) != elf_hdr) goto retry;
+	}
+
+	return img->mem;
+}
+
+/*
+ * Lay out an image in this component: the (shared) read-only pages at
+ * ro_mem are aliased read-only, followed by fresh pages for the data
+ * and BSS, initialized from rw_src if it is non-NULL. The returned
+ * view is contiguous, as the component sees it. If rw_ro, the copy of
+ * the data and BSS is also mapped read-only, so that it can only be
+ * copied from (as checkpoints are).
+ */
+static char *
+crt_img_create(char *ro_mem, size_t ro_sz, char *rw_src, size_t rw_sz, int rw_ro)
+{
+	struct cos_compinfo *root_ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	size_t ro_pgsz = round_up_to_page(ro_sz), rw_pgsz = round_up_to_page(rw_sz);
+	char  *mem, *rw;
+	int    ret;
+
+	mem = (char *)cos_page_bump_vallocn(root_ci, ro_pgsz + rw_pgsz);
+	rw  = cos_page_bump_allocn(root_ci, rw_pgsz);
+	if (!mem || !rw) return NULL;
+	if (rw_src) memcpy(rw, rw_src, rw_sz);
+
+	if (cos_mem_aliasn_ro_at(root_ci, (vaddr_t)mem, root_ci, (vaddr_t)ro_mem, ro_pgsz)) return NULL;
+	if (rw_ro)  ret = cos_mem_aliasn_ro_at(root_ci, (vaddr_t)mem + ro_pgsz, root_ci, (vaddr_t)rw, rw_pgsz);
+	else        ret = cos_mem_aliasn_at(root_ci, (vaddr_t)mem + ro_pgsz, root_ci, (vaddr_t)rw, rw_pgsz);
+	if (ret) return NULL;
+
+	return mem;
+}
+
+/* Create the image memory of c, see crt_img_create. */
+static int
+crt_comp_mem_alloc(struct crt_comp *c, char *ro_mem, size_t ro_sz, char *rw_src, size_t rw_sz)
+{
+	char *mem;
+
+	mem = crt_img_create(ro_mem, ro_sz, rw_src, rw_sz, 0);
+	if (!mem) return -ENOMEM;
+
+	c->mem        = mem;
+	c->tot_sz_mem = round_up_to_page(ro_sz) + round_up_to_page(rw_sz);
+	c->ro_sz      = ro_sz;
+
+	return 0;
+}
+
+/* Map the image memory into c: read-only text, and writable data and BSS. */
+static int
+crt_comp_mem_map(struct crt_comp *c)
+{
+	struct cos_compinfo *ci      = cos_compinfo_get(c->comp_res);
+	struct cos_compinfo *root_ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	size_t ro_pgsz = round_up_to_page(c->ro_sz);
+
+	if (c->ro_addr != cos_page_bump_vallocn(ci, c->tot_sz_mem)) return -ENOMEM;
+	if (cos_mem_aliasn_ro_at(ci, c->ro_addr, root_ci, (vaddr_t)c->mem, ro_pgsz)) return -ENOMEM;
+	if (cos_mem_aliasn_at(ci, c->ro_addr + ro_pgsz, root_ci, (vaddr_t)c->mem + ro_pgsz, c->tot_sz_mem - ro_pgsz)) return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * Checkpoint c by copying its data and BSS. Its text is shared with c
+ * (and with the image it was created from), and the copy is
+ * read-only, so all components created from the checkpoint copy from
+ * the same pages.
+ */
 int
 crt_chkpt_create(struct crt_chkpt *chkpt, struct crt_comp *c)
 {
-	char *mem;
-	struct cos_compinfo *root_ci;
+	size_t ro_pgsz = round_up_to_page(c->ro_sz);
+	char  *mem;
 
 	chkpt->c = c;
 	ps_faa(&nchkpt, 1);
 
-	/* allocate space for saving the component's memory */
-	root_ci = cos_compinfo_get(cos_defcompinfo_curr_get());
-	mem = cos_page_bump_allocn(root_ci, c->tot_sz_mem);
+	mem = crt_img_create(c->mem, c->ro_sz, c->mem + ro_pgsz, c->tot_sz_mem - ro_pgsz, 1);
 	if (!mem) return -ENOMEM;
 
 	chkpt->mem = mem;
 	chkpt->tot_sz_mem = c->tot_sz_mem;
-
-	memcpy(mem, c->mem, c->tot_sz_mem);	
-	/* 
+	/*
 	 * TODO: capabilities aren't copied, so components that could modify their capabilities
-	 * while running (schedulers/cap mgrs) shouldn't be checkpointed 
+	 * while running (schedulers/cap mgrs) shouldn't be checkpointed
 	 * TODO: copy dynamically allocated memory into the checkpoint
 	 */
 
 	return 0;
 }
 
-int
-crt_chkpt_restore(struct crt_chkpt *chkpt, struct crt_comp *c)
-{
-	/* turning c, a terminated component, back into a chkpt */
-	/* TODO: return memory to a previous saved state */
-	return 0;
-}
-
 static inline int
 crt_refcnt_alive(crt_refcnt_t *r)
 {
@@ -269,13 +384,11 @@ crt_comp_create_from(struct crt_comp *c, char *name, compid_t id, struct crt_chk
 	ret = cos_compinfo_alloc(ci, c->ro_addr, BOOT_CAPTBL_FREE, c->entry_addr, root_ci);
 	assert(!ret);
 
-	mem = cos_page_bump_allocn(root_ci, chkpt->tot_sz_mem);
-	if (!mem) return -ENOMEM;
-	c->mem = mem;
-	c->tot_sz_mem = chkpt->tot_sz_mem;
-	c->ro_sz = chkpt->c->ro_sz;
-
-	memcpy(mem, chkpt->mem, round_up_to_page(chkpt->tot_sz_mem));
+	/* the text is shared with the checkpoint, only the data and BSS are copied */
+	ro_sz = round_up_to_page(chkpt->c->ro_sz);
+	rw_sz = chkpt->tot_sz_mem - ro_sz;
+	if (crt_comp_mem_alloc(c, chkpt->mem, chkpt->c->ro_sz, chkpt->mem + ro_sz, rw_sz)) return -ENOMEM;
+	mem = c->mem;
 
 	info_offset = info - c->rw_addr;
 	comp_info   = (struct cos_component_information *)(mem + round_up_to_page(c->ro_sz) + info_offset);
@@ -283,8 +396,7 @@ crt_comp_create_from(struct crt_comp *c, char *name, compid_t id, struct crt_chk
 	assert(comp_info->cos_this_spd_id == 0);
 	comp_info->cos_this_spd_id = id;
 
-	/* FIXME: separate map of RO and RW */
-	if (c->ro_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem, c->tot_sz_mem)) return -ENOMEM;
+	if (crt_comp_mem_map(c)) return -ENOMEM;
 
 	/* FIXME: cos_time.h assumes we have access to this... */
 	ret = cos_cap_cpy_at(ci, BOOT_CAPTBL_SELF_INITHW_BASE, root_ci, BOOT_CAPTBL_SELF_INITHW_BASE);
@@ -318,8 +430,8 @@ crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vadd
 	struct cos_compinfo *ci, *root_ci;
 	struct cos_component_information *comp_info;
 	unsigned long info_offset;
-	size_t  ro_sz,   rw_sz, data_sz, bss_sz, tot_sz;
-	char   *ro_src, *data_src, *mem;
+	size_t  ro_sz,   data_sz, bss_sz;
+	char   *ro_src, *data_src, *ro_mem, *mem;
 	int     ret;
 
 	assert(c && name);
@@ -336,14 +448,11 @@ crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vadd
 	ret = cos_compinfo_alloc(ci, c->ro_addr, BOOT_CAPTBL_FREE, c->entry_addr, root_ci);
 	assert(!ret);
 
-	tot_sz = round_up_to_page(round_up_to_page(ro_sz) + data_sz + bss_sz);
-	mem    = cos_page_bump_allocn(root_ci, tot_sz);
-	if (!mem) return -ENOMEM;
-	c->mem = mem;
-	c->tot_sz_mem = tot_sz;
-	c->ro_sz = ro_sz;
+	ro_mem = crt_ro_img_get(c->elf_hdr, ro_src, ro_sz);
+	if (!ro_mem) return -ENOMEM;
+	if (crt_comp_mem_alloc(c, ro_mem, ro_sz, NULL, data_sz + bss_sz)) return -ENOMEM;
+	mem = c->mem;
 
-	memcpy(mem, ro_src, ro_sz);
 	memcpy(mem + round_up_to_page(ro_sz), data_src, data_sz);
 	memset(mem + round_up_to_page(ro_sz) + data_sz, 0, bss_sz);
 
@@ -356,8 +465,7 @@ crt_comp_create(struct crt_comp *c, char *name, compid_t id, void *elf_hdr, vadd
 	c->n_sinvs = 0;
 	memset(c->sinvs, 0, sizeof(c->sinvs));
 
-	/* FIXME: separate map of RO and RW */
-	if (c->ro_addr != cos_mem_aliasn(ci, root_ci, (vaddr_t)mem, tot_sz)) return -ENOMEM;
+	if (crt_comp_mem_map(c)) return -ENOMEM;
 
 	/* FIXME: cos_time.h assumes we have access to this... */
 	ret = cos_cap_cpy_at(ci, BOOT_CAPTBL_SELF_INITHW_BASE, root_ci, BOOT_CAPTBL_SELF_INITHW_BASE);
@@ -643,6 +751,7 @@ crt_thd_create_in(struct crt_thd *t, struct crt_comp *c, thdclosure_index_t clos
 	struct cos_compinfo    *target_ci;
 	struct cos_aep_info    *target_aep;
 	thdcap_t thdcap;
+	vaddr_t  kmem = 0;
 	struct crt_thd_resources rs;
 
 	assert(t && c);
@@ -660,13 +769,14 @@ crt_thd_create_in(struct crt_thd *t, struct crt_comp *c, thdclosure_index_t clos
 		assert(target_aep->thd);
 	} else {
 		crt_refcnt_take(&c->refcnt);
-		thdcap = cos_thd_alloc_ext(ci, target_ci->comp_cap, closure_id);
+		thdcap = cos_thd_alloc_ext_kmem(ci, target_ci->comp_cap, closure_id, &kmem);
 		assert(thdcap);
 	}
 
 	rs = (struct crt_thd_resources) { .cap = thdcap };
 	if (crt_thd_create_with(t, c, &rs)) BUG();
-	t->tid = cos_introspect(ci, thdcap, THD_GET_TID);
+	t->tid  = cos_introspect(ci, thdcap, THD_GET_TID);
+	t->kmem = kmem;
 
 	return 0;
 }
@@ -703,6 +813,39 @@ crt_thd_alias_in(struct crt_thd *t, struct crt_comp *c, struct crt_thd_resources
 	return 0;
 }
 
+/*
+ * Remove the @alias of the thread in component @c (see
+ * crt_thd_alias_in). Must be done for all aliases before the thread
+ * can be freed.
+ */
+int
+crt_thd_alias_free(struct crt_thd *t, struct crt_comp *c, thdcap_t alias)
+{
+	assert(t && c && alias);
+
+	return cos_thd_deactivate(cos_compinfo_get(c->comp_res), alias);
+}
+
+/*
+ * Free a thread created with crt_thd_create_in, which releases its id
+ * for reuse. Initial threads (closure_id 0) can't be freed.
+ */
+int
+crt_thd_free(struct crt_thd *t)
+{
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	int ret;
+
+	assert(t);
+	if (!t->kmem) return -EINVAL;
+
+	ret = cos_thd_free(ci, t->cap, t->kmem);
+	if (ret) return ret;
+	crt_refcnt_release(&t->c->refcnt);
+
+	return 0;
+}
+
 int
 crt_rcv_create_with(struct crt_rcv *r, struct crt_comp *c, struct crt_rcv_resources *rs)
 {
@@ -941,6 +1084,7 @@ crt_comp_exec_capmgr_init(struct crt_comp_exec_context *ctxt, size_t untyped_mem
 {
 	assert(ctxt);
 	assert(!(ctxt->flags & CRT_COMP_INITIALIZE)); /* capmgrs cannot be normal threads */
+	assert(untyped_memsz % SUPER_PAGE_SIZE == 0); /* see cos_meminfo_alloc */
 
 	ctxt->flags |= CRT_COMP_CAPMGR;
 	ctxt->memsz = untyped_memsz;
@@ -1113,10 +1257,123 @@ crt_page_aliasn_in(void *pages, u32_t n_pages, struct crt_comp *self, struct crt
 	return 0;
 }
 
+/*
+ * Superpages are SUPER_PAGE_SIZE, and mapped by a single pgd entry.
+ * Allocation fails (returning NULL) if no physically aligned memory
+ * is available, so callers should fall back to crt_page_allocn.
+ */
+void *
+crt_superpage_allocn(struct crt_comp *c, u32_t n_superpages)
+{
+	assert(c);
+
+	return cos_page_bump_allocn_super(cos_compinfo_get(c->comp_res), n_superpages * SUPER_PAGE_SIZE);
+}
+
+int
+crt_superpage_aliasn_in(void *pages, u32_t n_superpages, struct crt_comp *self, struct crt_comp *c_in, vaddr_t *map_addr)
+{
+	*map_addr = cos_mem_aliasn_super(cos_compinfo_get(c_in->comp_res), cos_compinfo_get(self->comp_res), (vaddr_t)pages, n_superpages * SUPER_PAGE_SIZE);
+	if (!*map_addr) return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Allocate a range of virtual addresses in c, without any memory
+ * backing it. Memory can be aliased into it with crt_page_aliasn_at.
+ */
+vaddr_t
+crt_page_vallocn(struct crt_comp *c, u32_t n_pages)
+{
+	assert(c);
+
+	return cos_page_bump_vallocn(cos_compinfo_get(c->comp_res), n_pages * PAGE_SIZE);
+}
+
+vaddr_t
+crt_superpage_vallocn(struct crt_comp *c, u32_t n_superpages)
+{
+	assert(c);
+
+	return cos_page_bump_vallocn_super(cos_compinfo_get(c->comp_res), n_superpages * SUPER_PAGE_SIZE);
+}
+
+int
+crt_page_aliasn_at(void *pages, u32_t n_pages, struct crt_comp *self, struct crt_comp *c_in, vaddr_t map_addr)
+{
+	return cos_mem_aliasn_at(cos_compinfo_get(c_in->comp_res), map_addr, cos_compinfo_get(self->comp_res), (vaddr_t)pages, n_pages * PAGE_SIZE);
+}
+
+/*
+ * Unmap n_pages at addr in c. Unmapping the first page of a
+ * superpage unmaps the whole superpage, so ranges of superpages are
+ * unmapped with crt_superpage_unmapn.
+ */
+int
+crt_page_unmapn(struct crt_comp *c, vaddr_t addr, u32_t n_pages)
+{
+	assert(c);
+
+	return cos_mem_removen(cos_compinfo_get(c->comp_res)->pgtbl_cap, addr, n_pages * PAGE_SIZE);
+}
+
+int
+crt_superpage_unmapn(struct crt_comp *c, vaddr_t addr, u32_t n_superpages)
+{
+	assert(c);
+
+	return cos_mem_removen_super(cos_compinfo_get(c->comp_res)->pgtbl_cap, addr, n_superpages * SUPER_PAGE_SIZE);
+}
+
+/*
+ * Have all TLBs been flushed since the frame, mapped at page in self,
+ * was last unmapped? If so (1 is returned) it can be reused.
+ */
+int
+crt_page_quiesced(struct crt_comp *self, void *page)
+{
+	assert(self);
+
+	return cos_mem_quiesced(cos_compinfo_get(self->comp_res)->pgtbl_cap, (vaddr_t)page);
+}
+
 /*
  * The functions to automate much of the component initialization
  * logic follow.
  */
+/*
+ * A core waiting for another to change a component's init_state
+ * calls crt_compinit_block, and each change calls
+ * crt_compinit_wakeup. The initializer can override these to block
+ * the waiting cores (see the llbooter); by default, waiting polls.
+ */
+CWEAKSYMB void
+crt_compinit_block(void)
+{
+	return;
+}
+
+CWEAKSYMB void
+crt_compinit_wakeup(void)
+{
+	return;
+}
+
+/*
+ * On a core other than c's init core, wait for c to leave the
+ * states up to and including state.
+ */
+static crt_comp_init_state_t
+crt_compinit_await(struct crt_comp *c, crt_comp_init_state_t state)
+{
+	crt_comp_init_state_t s;
+
+	while ((s = ps_load(&c->init_state)) <= state) crt_compinit_block();
+
+	return s;
+}
+
 void
 crt_compinit_execute(comp_get_fn_t comp_get)
 {
@@ -1146,8 +1403,7 @@ crt_compinit_execute(comp_get_fn_t comp_get)
 			printc("Initializing component %lu (executing cos_init).\n", comp->id);
 		} else {
 			/* wait for the init core's thread to initialize */
-			while (ps_load(&comp->init_state) == CRT_COMP_INIT_COS_INIT) ;
-			if (ps_load(&comp->init_state) != CRT_COMP_INIT_PAR_INIT) continue;
+			if (crt_compinit_await(comp, CRT_COMP_INIT_COS_INIT) != CRT_COMP_INIT_PAR_INIT) continue;
 
 			/* Lazily allocate parallel threads only when they are required. */
 			if (!thdcap) {
@@ -1191,7 +1447,7 @@ crt_compinit_execute(comp_get_fn_t comp_get)
 		thdcap   = crt_comp_thdcap_get(comp);
 
 		/* wait for the initcore to change the state... */
-		while (ps_load(&comp->init_state) == CRT_COMP_INIT_COS_INIT || ps_load(&comp->init_state) == CRT_COMP_INIT_PAR_INIT) ;
+		crt_compinit_await(comp, CRT_COMP_INIT_PAR_INIT);
 		/* If we don't need to continue persistent computation... */
 		if (ps_load(&comp->init_state) == CRT_COMP_INIT_PASSIVE ||
 		    (comp->main_type == INIT_MAIN_SINGLE && !initcore)) continue;
@@ -1238,11 +1494,13 @@ crt_compinit_done(struct crt_comp *c, int parallel_init, init_main_t main_type)
 		if (parallel_init) {
 			/* This will activate any parallel threads */
 			ps_store(&c->init_state, CRT_COMP_INIT_PAR_INIT);
+			crt_compinit_wakeup();
 			return; /* we're continuing with initialization, return! */
 		}
 
 		if (c->main_type == INIT_MAIN_NONE) ps_store(&c->init_state, CRT_COMP_INIT_PASSIVE);
 		else                                ps_store(&c->init_state, CRT_COMP_INIT_MAIN);
+		crt_compinit_wakeup();
 
 		break;
 	}
@@ -1252,6 +1510,7 @@ crt_compinit_done(struct crt_comp *c, int parallel_init, init_main_t main_type)
 
 		if (c->main_type == INIT_MAIN_NONE) ps_store(&c->init_state, CRT_COMP_INIT_PASSIVE);
 		else                                ps_store(&c->init_state, CRT_COMP_INIT_MAIN);
+		crt_compinit_wakeup();
 
 		break;
 	}
@@ -115,6 +115,7 @@ typedef enum {
 struct crt_thd {
 	thdcap_t cap;
 	thdid_t  tid;
+	vaddr_t  kmem; /* to free the thread, or 0 if it can't be */
 	struct crt_comp *c;
 };
 
@@ -196,9 +197,19 @@ int crt_thd_create(struct crt_thd *t, struct crt_comp *self, crt_thd_fn_t fn, vo
 int crt_thd_create_in(struct crt_thd *t, struct crt_comp *c, thdclosure_index_t closure_id);
 int crt_thd_create_with(struct crt_thd *t, struct crt_comp *c, struct crt_thd_resources *rs);
 int crt_thd_alias_in(struct crt_thd *t, struct crt_comp *c, struct crt_thd_resources *res);
+int crt_thd_alias_free(struct crt_thd *t, struct crt_comp *c, thdcap_t alias);
+int crt_thd_free(struct crt_thd *t);
 
 void *crt_page_allocn(struct crt_comp *c, u32_t n_pages);
 int crt_page_aliasn_in(void *pages, u32_t n_pages, struct crt_comp *self, struct crt_comp *c_in, vaddr_t *map_addr);
+void *crt_superpage_allocn(struct crt_comp *c, u32_t n_superpages);
+int crt_superpage_aliasn_in(void *pages, u32_t n_superpages, struct crt_comp *self, struct crt_comp *c_in, vaddr_t *map_addr);
+vaddr_t crt_page_vallocn(struct crt_comp *c, u32_t n_pages);
+vaddr_t crt_superpage_vallocn(struct crt_comp *c, u32_t n_superpages);
+int crt_page_aliasn_at(void *pages, u32_t n_pages, struct crt_comp *self, struct crt_comp *c_in, vaddr_t map_addr);
+int crt_page_unmapn(struct crt_comp *c, vaddr_t addr, u32_t n_pages);
+int crt_superpage_unmapn(struct crt_comp *c, vaddr_t addr, u32_t n_superpages);
+int crt_page_quiesced(struct crt_comp *self, void *page);
 
 /**
  * Initialization API to automate the coordination necessary for
@@ -209,9 +220,11 @@ typedef struct crt_comp *(*comp_get_fn_t)(compid_t id);
 void crt_compinit_execute(comp_get_fn_t comp_get);
 void crt_compinit_done(struct crt_comp *c, int parallel_init, init_main_t main_type);
 void crt_compinit_exit(struct crt_comp *c, int retval);
+/* Block while waiting on another core's initialization, and wake such waiters; weak, polling by default */
+void crt_compinit_block(void);
+void crt_compinit_wakeup(void);
 
 int crt_chkpt_create(struct crt_chkpt *chkpt, struct crt_comp *c);
-int crt_chkpt_restore(struct crt_chkpt *chkpt, struct crt_comp *c);
 
 
 #endif /* CRT_H */
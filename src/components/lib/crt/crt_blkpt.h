@@ -333,8 +333,43 @@ crt_blkpt_wake(struct crt_blkpt *blkpt, crt_blkpt_flags_t flags)
 	crt_blkpt_id_wake(blkpt, blkpt->id, flags);
 }
 
-/* Wake only a single, specified thread (tracked manually in the data-structure) */
-/* void crt_blkpt_trigger_one(struct crt_blkpt *blkpt, crt_blkpt_flags_t flags, cos_thdid_t thdid); */
+/**
+ * Trigger an event that only a single blocked thread can consume
+ * (e.g. a single freed slot), thus waking only one of them. The
+ * blocked bit stays set while the scheduler reports blocked threads,
+ * so the next trigger wakes the next one. Each trigger advances the
+ * epoch, so we retry on races with other triggers rather than
+ * helping them. Once no thread remains, a normal trigger clears the
+ * blocked bit, and wakes any thread that blocked in the mean time.
+ */
+static inline void
+crt_blkpt_id_trigger_one(struct crt_blkpt *blkpt, sched_blkpt_id_t id, crt_blkpt_flags_t flags)
+{
+	sched_blkpt_epoch_t saved, new;
+	int ret;
+
+	do {
+		saved = ps_load(&blkpt->epoch_blocked);
+		/* The optimization: don't increment events if noone's listening */
+		if (likely(!CRT_BLKPT_BLKED(saved))) return;
+		new = CRT_BLKPT_EPOCH(saved + 1) | CRT_BLKPT_BLKED_MASK;
+
+		/* inlined so that constant propagation will get rid of condition */
+		if (flags == CRT_BLKPT_UNIPROC) {
+			ret = ps_upcas(&blkpt->epoch_blocked, saved, new);
+		} else {
+			ret = ps_cas(&blkpt->epoch_blocked, saved, new);
+		}
+	} while (!ret);
+
+	if (sched_blkpt_trigger(id, CRT_BLKPT_EPOCH(new), 1) == 0) crt_blkpt_id_trigger(blkpt, id, flags);
+}
+
+static inline void
+crt_blkpt_trigger_one(struct crt_blkpt *blkpt, crt_blkpt_flags_t flags)
+{
+	crt_blkpt_id_trigger_one(blkpt, blkpt->id, flags);
+}
 
 /**
  * Checkpoint the state of the current event counter. This checkpoint
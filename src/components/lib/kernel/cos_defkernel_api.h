@@ -37,6 +37,7 @@ struct cos_aep_info {
 	arcvcap_t       rcv;
 	cos_aepthd_fn_t fn;
 	void *          data;
+	vaddr_t         kmem; /* if known, to free the thread (see cos_thd_alloc_kmem) */
 };
 
 /* Default Component information */
@@ -17,12 +17,28 @@
 #define printd(...)
 #endif
 
+static void
+__meminfo_mags_init(struct cos_meminfo *mi)
+{
+	int i;
+
+	for (i = 0; i < NUM_CPU; i++) {
+		struct cos_mem_magazine *mag = &mi->mags[i];
+
+		mag->umem_ptr = mag->kmem_ptr = mag->umem_frontier = mag->kmem_frontier = 0;
+		mag->umem_end = mag->kmem_end = 0;
+		ps_lock_init(&mag->lock);
+	}
+}
+
 void
 cos_meminfo_init(struct cos_meminfo *mi, vaddr_t untyped_ptr, unsigned long untyped_sz, pgtblcap_t pgtbl_cap)
 {
-	mi->untyped_ptr = mi->umem_ptr = mi->kmem_ptr = mi->umem_frontier = mi->kmem_frontier = untyped_ptr;
+	mi->untyped_ptr      = untyped_ptr;
 	mi->untyped_frontier = untyped_ptr + untyped_sz;
 	mi->pgtbl_cap        = pgtbl_cap;
+	mi->untyped_tail_ptr = mi->untyped_tail_frontier = 0;
+	__meminfo_mags_init(mi);
 }
 
 static inline struct cos_compinfo *
@@ -98,64 +114,149 @@ cos_compinfo_init(struct cos_compinfo *ci, pgtblcap_t pgtbl_cap, captblcap_t cap
 
 /**************** [Memory Capability Allocation Functions] ***************/
 
-static vaddr_t
-__mem_bump_alloc(struct cos_compinfo *__ci, int km, int retype)
+/*
+ * Refill the magazine range [*ptr, *frontier) by retyping, with op,
+ * the rest of its batch, [*frontier, *end), or a new batch of untyped
+ * memory if that is empty. Only carving the batch out of the untyped
+ * memory is serialized across cores; the retypes are not. The tail
+ * left above the frontier by superpage alignment is used first.
+ *
+ * If a retype fails after some frames were retyped, the magazine
+ * keeps the rest of the batch for the next refill. A frame that fails
+ * to retype first in a refill can't be retyped, and is skipped.
+ */
+static int
+__mem_mag_refill(struct cos_compinfo *ci, vaddr_t *ptr, vaddr_t *frontier, vaddr_t *end, syscall_op_t op)
 {
-	vaddr_t              ret = 0;
-	struct cos_compinfo *ci;
-	vaddr_t *            ptr, *frontier;
+	vaddr_t batch, sz, *untyped, untyped_end;
 
-	printd("__mem_bump_alloc\n");
+	if (*frontier == *end) {
+		ps_lock_take(&ci->mem_lock);
+		/* TODO: expand frontier if introspection says there is more memory */
+		if (ci->mi.untyped_tail_ptr != ci->mi.untyped_tail_frontier) {
+			untyped     = &ci->mi.untyped_tail_ptr;
+			untyped_end = ci->mi.untyped_tail_frontier;
+		} else {
+			untyped     = &ci->mi.untyped_ptr;
+			untyped_end = ci->mi.untyped_frontier;
+		}
+		batch = *untyped;
+		sz    = untyped_end - batch;
+		if (sz > COS_MEM_MAG_BATCH * PAGE_SIZE) sz = COS_MEM_MAG_BATCH * PAGE_SIZE;
+		*untyped += sz;
+		ps_lock_release(&ci->mem_lock);
+		if (sz == 0) return -ENOMEM;
+		assert(batch % RETYPE_MEM_SIZE == 0 && sz % RETYPE_MEM_SIZE == 0);
+
+		*frontier = batch;
+		*end      = batch + sz;
+	}
 
-	assert(__ci);
-	ci = __compinfo_metacap(__ci);
-	assert(ci && ci == __compinfo_metacap(__ci));
+	for (*ptr = *frontier; *frontier < *end; *frontier += RETYPE_MEM_SIZE) {
+		if (!call_cap_op(ci->mi.pgtbl_cap, op, *frontier, 0, 0, 0)) continue;
+		if (*ptr != *frontier) break;
+		*ptr += RETYPE_MEM_SIZE;
+	}
+	if (*ptr == *frontier) return -EINVAL;
 
-	ps_lock_take(&ci->mem_lock);
+	return 0;
+}
 
+static inline void
+__mem_mag_ranges(struct cos_mem_magazine *mag, int km, vaddr_t **ptr, vaddr_t **frontier, vaddr_t **end)
+{
 	if (km) {
-		ptr      = &ci->mi.kmem_ptr;
-		frontier = &ci->mi.kmem_frontier;
+		*ptr      = &mag->kmem_ptr;
+		*frontier = &mag->kmem_frontier;
+		*end      = &mag->kmem_end;
 	} else {
-		ptr      = &ci->mi.umem_ptr;
-		frontier = &ci->mi.umem_frontier;
+		*ptr      = &mag->umem_ptr;
+		*frontier = &mag->umem_frontier;
+		*end      = &mag->umem_end;
 	}
+}
 
-	ret = ps_faa(ptr, PAGE_SIZE);
-
-	if (ret >= *frontier || *frontier - ret > RETYPE_MEM_SIZE) {
-		vaddr_t ptr_tmp = *ptr, front_tmp = *frontier;
-
-		/* TODO: expand frontier if introspection says there is more memory */
-		if (ci->mi.untyped_ptr == ci->mi.untyped_frontier) goto error;
-		/* this is the overall frontier, so we know we can use this value... */
-		ret = ps_faa(&ci->mi.untyped_ptr, RETYPE_MEM_SIZE);
-		/* failure here means that someone else already advanced the frontier/ptr */
-		if (ps_cas(ptr, ptr_tmp, ret + PAGE_SIZE)) {
-			ps_cas(frontier, front_tmp, ret + RETYPE_MEM_SIZE);
+/*
+ * The untyped memory is exhausted, but the magazines can still hold
+ * up to two batches each. Take a retyped page of the right type from
+ * any magazine, or else retype, with op, a frame from the top of the
+ * rest of any magazine's batch (leaving its [ptr, frontier) intact).
+ * The caller can't hold a magazine's lock, so that cores taking from
+ * each other don't deadlock.
+ */
+static vaddr_t
+__mem_mag_steal(struct cos_compinfo *ci, int km, syscall_op_t op)
+{
+	struct cos_mem_magazine *mag;
+	vaddr_t                  ret = 0, *ptr, *frontier, *end;
+	int                      i;
+
+	for (i = 0; i < NUM_CPU && !ret; i++) {
+		mag = &ci->mi.mags[(cos_cpuid() + i) % NUM_CPU];
+		ps_lock_take(&mag->lock);
+		__mem_mag_ranges(mag, km, &ptr, &frontier, &end);
+		if (*ptr != *frontier) {
+			ret   = *ptr;
+			*ptr += PAGE_SIZE;
+		}
+		ps_lock_release(&mag->lock);
+	}
+	for (i = 0; i < 2 * NUM_CPU && !ret; i++) {
+		mag = &ci->mi.mags[(cos_cpuid() + i / 2) % NUM_CPU];
+		ps_lock_take(&mag->lock);
+		__mem_mag_ranges(mag, i % 2, &ptr, &frontier, &end);
+		/* a frame that fails to retype stays in the batch, for the magazine's own refill */
+		if (*end != *frontier && !call_cap_op(ci->mi.pgtbl_cap, op, *end - RETYPE_MEM_SIZE, 0, 0, 0)) {
+			*end -= RETYPE_MEM_SIZE;
+			ret   = *end;
 		}
+		ps_lock_release(&mag->lock);
 	}
 
-	if (retype && (ret % RETYPE_MEM_SIZE == 0)) {
+	return ret;
+}
+
+static vaddr_t
+__mem_bump_alloc(struct cos_compinfo *__ci, int km)
+{
+	vaddr_t                  ret = 0;
+	struct cos_compinfo     *ci;
+	struct cos_mem_magazine *mag;
+	vaddr_t *                ptr, *frontier, *end;
+
+	printd("__mem_bump_alloc\n");
+
+	assert(__ci);
+	ci = __compinfo_metacap(__ci);
+	assert(ci && ci == __compinfo_metacap(__ci));
+
+	mag = &ci->mi.mags[cos_cpuid()];
+	ps_lock_take(&mag->lock);
+	__mem_mag_ranges(mag, km, &ptr, &frontier, &end);
+
+	if (*ptr == *frontier) {
 		/* are we dealing with a kernel memory allocation? */
 		syscall_op_t op = km ? CAPTBL_OP_MEM_RETYPE2KERN : CAPTBL_OP_MEM_RETYPE2USER;
-		if (call_cap_op(ci->mi.pgtbl_cap, op, ret, 0, 0, 0)) goto error;
+
+		if (__mem_mag_refill(ci, ptr, frontier, end, op)) {
+			ps_lock_release(&mag->lock);
+
+			return __mem_mag_steal(ci, km, op);
+		}
 	}
+	ret   = *ptr;
+	*ptr += PAGE_SIZE;
 
-	ps_lock_release(&ci->mem_lock);
+	ps_lock_release(&mag->lock);
 
 	return ret;
-error:
-	ps_lock_release(&ci->mem_lock);
-
-	return 0;
 }
 
 static vaddr_t
 __kmem_bump_alloc(struct cos_compinfo *ci)
 {
 	printd("__kmem_bump_alloc\n");
-	return __mem_bump_alloc(ci, 1, 1);
+	return __mem_bump_alloc(ci, 1);
 }
 
 /* this should back-up to using untyped memory... */
@@ -163,14 +264,60 @@ static vaddr_t
 __umem_bump_alloc(struct cos_compinfo *ci)
 {
 	printd("__umem_bump_alloc\n");
-	return __mem_bump_alloc(ci, 0, 1);
+	return __mem_bump_alloc(ci, 0);
 }
 
+/*
+ * Take sz (a multiple of superpages) of superpage-aligned untyped
+ * memory: the untyped memory is mapped such that superpage-aligned
+ * frames are at superpage-aligned offsets. It is taken from the
+ * frontier down, so the frontier only needs to be aligned once, and
+ * the memory above the aligned frontier is left to the pages (see
+ * __mem_mag_refill). The kernel validates the alignment when the
+ * memory is activated. The caller holds the mem_lock.
+ */
 static vaddr_t
-__untyped_bump_alloc(struct cos_compinfo *ci)
+__untyped_super_take(struct cos_meminfo *mi, unsigned long sz)
 {
-	printd("__umem_bump_alloc\n");
-	return __mem_bump_alloc(ci, 1, 0);
+	vaddr_t top = round_to_pow2(mi->untyped_frontier, SUPER_PAGE_SIZE);
+
+	assert(sz % SUPER_PAGE_SIZE == 0);
+	if (top < mi->untyped_ptr || top - mi->untyped_ptr < sz) return 0;
+	if (top != mi->untyped_frontier) {
+		assert(mi->untyped_tail_ptr == mi->untyped_tail_frontier);
+		mi->untyped_tail_ptr      = top;
+		mi->untyped_tail_frontier = mi->untyped_frontier;
+	}
+	mi->untyped_frontier = top - sz;
+
+	return mi->untyped_frontier;
+}
+
+/*
+ * Return superpage-aligned untyped memory taken at addr, unless more
+ * was taken since. The caller holds the mem_lock.
+ */
+static int
+__untyped_super_return(struct cos_meminfo *mi, vaddr_t addr, unsigned long sz)
+{
+	if (mi->untyped_frontier != addr) return -1;
+	mi->untyped_frontier = addr + sz;
+
+	return 0;
+}
+
+/* Allocate a superpage of untyped memory */
+static vaddr_t
+__untyped_super_bump_alloc(struct cos_compinfo *__ci)
+{
+	vaddr_t              ret;
+	struct cos_compinfo *ci = __compinfo_metacap(__ci);
+
+	ps_lock_take(&ci->mem_lock);
+	ret = __untyped_super_take(&ci->mi, SUPER_PAGE_SIZE);
+	ps_lock_release(&ci->mem_lock);
+
+	return ret;
 }
 
 /**************** [Capability Allocation Functions] ****************/
@@ -449,17 +596,14 @@ __cos_meminfo_populate(struct cos_compinfo *ci, vaddr_t untyped_ptr, unsigned lo
 	vaddr_t              addr, start_addr, retaddr;
 	struct cos_compinfo *meta = __compinfo_metacap(ci);
 
-	assert(untyped_ptr == round_up_to_pgd_page(untyped_ptr));
-	assert(untyped_sz == round_up_to_pgd_page(untyped_sz));
-
 	retaddr = __bump_mem_expand_range(ci, ci->mi.pgtbl_cap, untyped_ptr, untyped_sz);
 	assert(retaddr == untyped_ptr);
 
-	ps_lock_take(&ci->mem_lock);
-	/* untyped mem from current bump pointer */
-	start_addr = ps_faa(&(meta->mi.untyped_ptr), untyped_sz);
-	ps_faa(&(meta->mi.untyped_frontier), untyped_sz);
-	ps_lock_release(&ci->mem_lock);
+	ps_lock_take(&meta->mem_lock);
+	/* superpage aligned, so that the component can allocate superpages from it */
+	start_addr = __untyped_super_take(&meta->mi, untyped_sz);
+	ps_lock_release(&meta->mem_lock);
+	if (!start_addr) BUG();
 
 	for (addr = untyped_ptr; addr < untyped_ptr + untyped_sz; addr += PAGE_SIZE, start_addr += PAGE_SIZE) {
 		if (call_cap_op(meta->mi.pgtbl_cap, CAPTBL_OP_MEMMOVE, start_addr, ci->mi.pgtbl_cap, addr, 0)) BUG();
@@ -469,11 +613,14 @@ __cos_meminfo_populate(struct cos_compinfo *ci, vaddr_t untyped_ptr, unsigned lo
 void
 cos_meminfo_alloc(struct cos_compinfo *ci, vaddr_t untyped_ptr, unsigned long untyped_sz)
 {
+	/* The memory is taken from meta in superpages, with no 4K remainder */
+	assert(untyped_ptr % SUPER_PAGE_SIZE == 0 && untyped_sz % SUPER_PAGE_SIZE == 0);
 	__cos_meminfo_populate(ci, untyped_ptr, untyped_sz);
 
-	ci->mi.untyped_ptr = ci->mi.umem_ptr = ci->mi.kmem_ptr = ci->mi.umem_frontier = ci->mi.kmem_frontier =
-	  untyped_ptr;
+	ci->mi.untyped_ptr      = untyped_ptr;
 	ci->mi.untyped_frontier = untyped_ptr + untyped_sz;
+	ci->mi.untyped_tail_ptr = ci->mi.untyped_tail_frontier = 0;
+	__meminfo_mags_init(&ci->mi);
 }
 
 static vaddr_t
@@ -521,6 +668,81 @@ __page_bump_valloc(struct cos_compinfo *ci, size_t sz)
 	return ret_addr;
 }
 
+/*
+ * Superpages are mapped by pgd entries, thus the virtual range must
+ * be superpage aligned, and not have any PTEs: allocate it past the
+ * range with PTEs. The previous frontiers are returned in prev (if
+ * not NULL), to undo the allocation with __page_bump_vfree_super.
+ */
+static vaddr_t
+__page_bump_valloc_super(struct cos_compinfo *ci, size_t sz, vaddr_t prev[2])
+{
+	vaddr_t ret_addr;
+
+	assert(sz % SUPER_PAGE_SIZE == 0);
+
+	ps_lock_take(&ci->va_lock);
+	if (prev) {
+		prev[0] = ci->vas_frontier;
+		prev[1] = ci->vasrange_frontier;
+	}
+	ret_addr = round_up_to_pgd_page(ci->vasrange_frontier);
+	ci->vas_frontier = ci->vasrange_frontier = ret_addr + sz;
+	ps_lock_release(&ci->va_lock);
+
+	return ret_addr;
+}
+
+/* Undo the allocation of the range at addr, unless addresses were allocated past it since */
+static void
+__page_bump_vfree_super(struct cos_compinfo *ci, vaddr_t addr, size_t sz, vaddr_t prev[2])
+{
+	ps_lock_take(&ci->va_lock);
+	if (ci->vas_frontier == addr + sz && ci->vasrange_frontier == addr + sz) {
+		ci->vas_frontier      = prev[0];
+		ci->vasrange_frontier = prev[1];
+	}
+	ps_lock_release(&ci->va_lock);
+}
+
+static vaddr_t
+__page_bump_alloc_super(struct cos_compinfo *ci, size_t sz)
+{
+	struct cos_compinfo *meta = __compinfo_metacap(ci);
+	vaddr_t              heap_vaddr, heap_cursor, umem, prev[2];
+
+	heap_vaddr = __page_bump_valloc_super(ci, sz, prev);
+	if (unlikely(!heap_vaddr)) return 0;
+
+	for (heap_cursor = heap_vaddr; heap_cursor < heap_vaddr + sz; heap_cursor += SUPER_PAGE_SIZE) {
+		umem = __untyped_super_bump_alloc(ci);
+		if (!umem) goto unwind;
+
+		/* retype and map the superpage in a single operation */
+		if (call_cap_op(meta->mi.pgtbl_cap, CAPTBL_OP_MEMACTIVATE_SUPER, umem, ci->pgtbl_cap, heap_cursor, 0)) {
+			ps_lock_take(&meta->mem_lock);
+			__untyped_super_return(&meta->mi, umem, SUPER_PAGE_SIZE);
+			ps_lock_release(&meta->mem_lock);
+			goto unwind;
+		}
+	}
+
+	return heap_vaddr;
+unwind:
+	/*
+	 * The superpages mapped so far are retyped, so they can't go
+	 * back to the untyped memory and are lost, but if they can be
+	 * unmapped, the virtual range is reused.
+	 */
+	while (heap_cursor > heap_vaddr) {
+		heap_cursor -= SUPER_PAGE_SIZE;
+		if (cos_mem_remove(ci->pgtbl_cap, heap_cursor)) return 0;
+	}
+	__page_bump_vfree_super(ci, heap_vaddr, sz, prev);
+
+	return 0;
+}
+
 static vaddr_t
 __page_bump_alloc(struct cos_compinfo *ci, size_t sz)
 {
@@ -589,7 +811,7 @@ __alloc_mem_cap(struct cos_compinfo *ci, cap_t ct, vaddr_t *kmem, capid_t *cap)
 }
 
 static thdcap_t
-__cos_thd_alloc(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t init_data)
+__cos_thd_alloc(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t init_data, vaddr_t *kmem_ret)
 {
 	vaddr_t kmem;
 	capid_t cap;
@@ -604,7 +826,9 @@ __cos_thd_alloc(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t init
 	/* TODO: Add cap size checking */
 	ret = call_cap_op(ci->captbl_cap, CAPTBL_OP_THDACTIVATE, (init_data << 16) | cap,
 			  __compinfo_metacap(ci)->mi.pgtbl_cap, kmem, comp);
-	if (ret) BUG();
+	/* e.g. out of thread ids; the capability slot and memory are not reused */
+	if (ret) return 0;
+	if (kmem_ret) *kmem_ret = kmem;
 
 	return cap;
 }
@@ -616,26 +840,71 @@ cos_thd_alloc_ext(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t id
 {
 	if (idx < 1) return 0;
 
-	return __cos_thd_alloc(ci, comp, idx);
+	return __cos_thd_alloc(ci, comp, idx, NULL);
 }
 
 thdcap_t
-cos_thd_alloc(struct cos_compinfo *ci, compcap_t comp, cos_thd_fn_t fn, void *data)
+cos_thd_alloc_ext_kmem(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t idx, vaddr_t *kmem)
+{
+	if (idx < 1) return 0;
+
+	return __cos_thd_alloc(ci, comp, idx, kmem);
+}
+
+thdcap_t
+cos_thd_alloc_kmem(struct cos_compinfo *ci, compcap_t comp, cos_thd_fn_t fn, void *data, vaddr_t *kmem)
 {
 	int      idx = cos_thd_init_alloc(fn, data);
 	thdcap_t ret;
 
 	if (idx < 1) return 0;
-	ret = __cos_thd_alloc(ci, comp, idx);
+	ret = __cos_thd_alloc(ci, comp, idx, kmem);
 	if (!ret) cos_thd_init_free(idx);
 
 	return ret;
 }
 
+thdcap_t
+cos_thd_alloc(struct cos_compinfo *ci, compcap_t comp, cos_thd_fn_t fn, void *data)
+{
+	return cos_thd_alloc_kmem(ci, comp, fn, data, NULL);
+}
+
 thdcap_t
 cos_initthd_alloc(struct cos_compinfo *ci, compcap_t comp)
 {
-	return __cos_thd_alloc(ci, comp, 0);
+	return __cos_thd_alloc(ci, comp, 0, NULL);
+}
+
+int
+cos_thd_free(struct cos_compinfo *ci, thdcap_t tc, vaddr_t kmem)
+{
+	thdid_t tid;
+	int     ret;
+
+	assert(ci && tc && kmem);
+
+	tid = cos_introspect(ci, tc, THD_GET_TID);
+	if (tid <= 0) return -EINVAL;
+	/*
+	 * Release the stacks it holds in this component (e.g. if it was
+	 * created in it) while we still own its id: once deactivated, the
+	 * id can be recycled to a new thread whose stacks share the tid.
+	 */
+	cos_stack_release(tid);
+	/* as with unmappings, a shared liveness id only makes quiescence more conservative */
+	ret = call_cap_op(ci->captbl_cap, CAPTBL_OP_THDDEACTIVATE_ROOT, tc, MEM_UNMAP_LIVENESS_ID,
+	                  __compinfo_metacap(ci)->mi.pgtbl_cap, kmem);
+
+	return ret;
+}
+
+int
+cos_thd_deactivate(struct cos_compinfo *ci, thdcap_t tc)
+{
+	assert(ci && tc);
+
+	return call_cap_op(ci->captbl_cap, CAPTBL_OP_THDDEACTIVATE, tc, MEM_UNMAP_LIVENESS_ID, 0, 0);
 }
 
 captblcap_t
@@ -697,6 +966,14 @@ cos_comp_alloc(struct cos_compinfo *ci, captblcap_t ctc, pgtblcap_t ptc, vaddr_t
 	return cap;
 }
 
+int
+cos_comp_deactivate(struct cos_compinfo *ci, compcap_t comp)
+{
+	assert(ci && comp);
+
+	return call_cap_op(ci->captbl_cap, CAPTBL_OP_COMPDEACTIVATE, comp, MEM_UNMAP_LIVENESS_ID, 0, 0);
+}
+
 int
 cos_compinfo_alloc(struct cos_compinfo *ci, vaddr_t heap_ptr, capid_t cap_frontier, vaddr_t entry,
                    struct cos_compinfo *ci_resources)
@@ -753,6 +1030,21 @@ cos_sinv_2rets(sinvcap_t sinv, word_t arg1, word_t arg2, word_t arg3, word_t arg
 	return call_cap_2retvals_asm(sinv, 0, arg1, arg2, arg3, arg4, ret1, ret2);
 }
 
+/*
+ * Make n synchronous invocations with a single kernel entry.  The
+ * return values of each invocation are written into its descriptor,
+ * and the number of invocations that completed is returned.  The
+ * descriptors must be within a single page.
+ */
+int
+cos_sinv_batch(struct cos_compinfo *ci, struct cos_sinv_batch_ent *ents, unsigned int n)
+{
+	assert(ci && ents && n > 0 && n <= COS_SINV_BATCH_MAX);
+	assert(round_to_page(ents) == round_to_page((char *)&ents[n] - 1));
+
+	return call_cap_op(ci->captbl_cap, CAPTBL_OP_SINV_BATCH, (word_t)ents, n, 0, 0);
+}
+
 /*
  * Arguments:
  * thdcap:  the thread to activate on snds to the rcv endpoint.
@@ -778,19 +1070,28 @@ cos_arcv_alloc(struct cos_compinfo *ci, thdcap_t thdcap, tcap_t tcapcap, compcap
 }
 
 asndcap_t
-cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap)
+cos_asnd_alloc_ratelimit(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap, u32_t budget, u32_t period)
 {
 	capid_t cap;
 
 	assert(ci && arcvcap && ctcap);
+	assert(budget <= 0xFFFF && (!period || budget));
+	/* both are passed in a single register */
+	if (ctcap >= (1 << 16) || arcvcap >= (1 << 16)) return 0;
 
 	cap = __capid_bump_alloc(ci, CAP_ASND);
 	if (!cap) return 0;
-	if (call_cap_op(ci->captbl_cap, CAPTBL_OP_ASNDACTIVATE, cap, ctcap, arcvcap, 0)) BUG();
+	if (call_cap_op(ci->captbl_cap, CAPTBL_OP_ASNDACTIVATE, cap, ctcap | (arcvcap << 16), budget, period)) BUG();
 
 	return cap;
 }
 
+asndcap_t
+cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap)
+{
+	return cos_asnd_alloc_ratelimit(ci, arcvcap, ctcap, 0, 0);
+}
+
 /*
  * TODO: bitmap must be a subset of existing one.
  *       but there is no such check now, violates access control policy.
@@ -823,6 +1124,30 @@ cos_page_bump_allocn(struct cos_compinfo *ci, size_t sz)
 	return (void *)__page_bump_alloc(ci, sz);
 }
 
+void *
+cos_page_bump_allocn_super(struct cos_compinfo *ci, size_t sz)
+{
+	assert(sz && sz % SUPER_PAGE_SIZE == 0);
+
+	return (void *)__page_bump_alloc_super(ci, sz);
+}
+
+vaddr_t
+cos_page_bump_vallocn(struct cos_compinfo *ci, size_t sz)
+{
+	assert(sz % PAGE_SIZE == 0);
+
+	return __page_bump_valloc(ci, sz);
+}
+
+vaddr_t
+cos_page_bump_vallocn_super(struct cos_compinfo *ci, size_t sz)
+{
+	assert(sz && sz % SUPER_PAGE_SIZE == 0);
+
+	return __page_bump_valloc_super(ci, sz, NULL);
+}
+
 capid_t
 cos_cap_cpy(struct cos_compinfo *dstci, struct cos_compinfo *srcci, cap_t srcctype, capid_t srccap)
 {
@@ -928,24 +1253,70 @@ cos_rcv(arcvcap_t rcv, rcv_flags_t flags, int *rcvd)
 	return ret;
 }
 
+static int
+__mem_aliasn_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src, size_t sz,
+                syscall_op_t op)
+{
+	unsigned long npages;
+	int ret;
+
+	assert(srcci && dstci);
+	assert(sz && (sz % PAGE_SIZE == 0));
+
+	/* the kernel copies a bounded number of pages per call */
+	for (npages = sz / PAGE_SIZE; npages > 0; npages -= ret) {
+		ret = call_cap_op(srcci->pgtbl_cap, op, src, dstci->pgtbl_cap, dst, npages);
+		if (ret <= 0) return ret ? ret : -EINVAL;
+		assert((unsigned long)ret <= npages);
+
+		src += ret * PAGE_SIZE;
+		dst += ret * PAGE_SIZE;
+	}
+
+	return 0;
+}
+
+int
+cos_mem_aliasn_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src, size_t sz)
+{
+	return __mem_aliasn_at(dstci, dst, srcci, src, sz, CAPTBL_OP_CPY_RANGE);
+}
+
+/* Alias the range without write access, e.g. to share text between components */
+int
+cos_mem_aliasn_ro_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src, size_t sz)
+{
+	return __mem_aliasn_at(dstci, dst, srcci, src, sz, CAPTBL_OP_CPY_RANGE_RO);
+}
+
 vaddr_t
 cos_mem_aliasn(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src, size_t sz)
 {
-	size_t i;
-	vaddr_t dst, first_dst;
+	vaddr_t dst;
 
 	assert(srcci && dstci);
 	assert(sz && (sz % PAGE_SIZE == 0));
 
 	dst = __page_bump_valloc(dstci, sz);
 	if (unlikely(!dst)) return 0;
-	first_dst = dst;
+	if (cos_mem_aliasn_at(dstci, dst, srcci, src, sz)) return 0;
 
-	for (i = 0; i < sz; i += PAGE_SIZE, src += PAGE_SIZE, dst += PAGE_SIZE) {
-		if (call_cap_op(srcci->pgtbl_cap, CAPTBL_OP_CPY, src, dstci->pgtbl_cap, dst, 0)) return 0;
-	}
+	return dst;
+}
 
-	return first_dst;
+vaddr_t
+cos_mem_aliasn_super(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src, size_t sz)
+{
+	vaddr_t dst;
+
+	assert(srcci && dstci);
+	assert(sz && (sz % SUPER_PAGE_SIZE == 0) && (src % SUPER_PAGE_SIZE == 0));
+
+	dst = __page_bump_valloc_super(dstci, sz, NULL);
+	if (unlikely(!dst)) return 0;
+	if (cos_mem_aliasn_at(dstci, dst, srcci, src, sz)) return 0;
+
+	return dst;
 }
 
 vaddr_t
@@ -967,10 +1338,46 @@ cos_mem_alias_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *s
 int
 cos_mem_remove(pgtblcap_t pt, vaddr_t addr)
 {
-	assert(0);
+	return call_cap_op(pt, CAPTBL_OP_MEMDEACTIVATE, addr, MEM_UNMAP_LIVENESS_ID, 0, 0);
+}
+
+int
+cos_mem_removen(pgtblcap_t pt, vaddr_t addr, size_t sz)
+{
+	int ret;
+
+	assert(sz && (sz % PAGE_SIZE == 0));
+
+	for (; sz > 0; sz -= PAGE_SIZE, addr += PAGE_SIZE) {
+		ret = cos_mem_remove(pt, addr);
+		if (ret) return ret;
+	}
+
+	return 0;
+}
+
+/* removing a superpage's first page removes all of it, thus only those are removed */
+int
+cos_mem_removen_super(pgtblcap_t pt, vaddr_t addr, size_t sz)
+{
+	int ret;
+
+	assert(sz && (sz % SUPER_PAGE_SIZE == 0) && (addr % SUPER_PAGE_SIZE == 0));
+
+	for (; sz > 0; sz -= SUPER_PAGE_SIZE, addr += SUPER_PAGE_SIZE) {
+		ret = cos_mem_remove(pt, addr);
+		if (ret) return ret;
+	}
+
 	return 0;
 }
 
+int
+cos_mem_quiesced(pgtblcap_t pt, vaddr_t addr)
+{
+	return call_cap_op(pt, CAPTBL_OP_MEM_QUIESCED, addr, 0, 0, 0);
+}
+
 vaddr_t
 cos_mem_move(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src)
 {
@@ -1091,6 +1498,18 @@ cos_hw_shutdown(hwcap_t hwc)
 	call_cap_op(hwc, CAPTBL_OP_HW_SHUTDOWN, 0, 0, 0, 0);
 }
 
+int
+cos_hw_invstk_cache(hwcap_t hwc, invstk_cache_t mode)
+{
+	return call_cap_op(hwc, CAPTBL_OP_HW_INVSTK_CACHE, mode, 0, 0, 0);
+}
+
+unsigned long
+cos_hw_ipi_stat(hwcap_t hwc, ipi_stat_t stat)
+{
+	return (unsigned int)call_cap_op(hwc, CAPTBL_OP_HW_IPI_STATS, stat, 0, 0, 0);
+}
+
 void *
 cos_hw_map(struct cos_compinfo *ci, hwcap_t hwc, paddr_t pa, unsigned int len)
 {
@@ -56,10 +56,30 @@ typedef capid_t pgtblcap_t;
 typedef capid_t hwcap_t;
 
 /* Memory source information */
+/* The number of pages each core's magazines are refilled with */
+#define COS_MEM_MAG_BATCH 32
+
+/*
+ * Per-core magazines of retyped kernel and user memory. They are
+ * refilled in batches from the untyped memory, so most allocations
+ * only touch the core's own magazine. [ptr, frontier) is retyped,
+ * and [frontier, end) is the rest of the batch, not yet retyped.
+ * Once the untyped memory is exhausted, cores take pages from each
+ * other's magazines.
+ */
+struct cos_mem_magazine {
+	struct ps_lock lock;
+	vaddr_t        umem_ptr, kmem_ptr;
+	vaddr_t        umem_frontier, kmem_frontier;
+	vaddr_t        umem_end, kmem_end;
+} CACHE_ALIGNED;
+
 struct cos_meminfo {
-	vaddr_t    untyped_ptr, umem_ptr, kmem_ptr;
-	vaddr_t    untyped_frontier, umem_frontier, kmem_frontier;
+	vaddr_t    untyped_ptr, untyped_frontier;
+	/* untyped memory above the superpage-aligned frontier, for pages */
+	vaddr_t    untyped_tail_ptr, untyped_tail_frontier;
 	pgtblcap_t pgtbl_cap;
+	struct cos_mem_magazine mags[NUM_CPU];
 };
 
 /* Component captbl/pgtbl allocation information */
@@ -87,6 +107,11 @@ void cos_compinfo_init(struct cos_compinfo *ci, pgtblcap_t pgtbl_cap, captblcap_
  * to this component's captbls.
  */
 void cos_meminfo_init(struct cos_meminfo *mi, vaddr_t untyped_ptr, unsigned long untyped_sz, pgtblcap_t pgtbl_cap);
+/*
+ * Give ci untyped_sz bytes of its meta's untyped memory at
+ * untyped_ptr. Both must be superpage multiples (the memory is taken
+ * from the meta's superpage-aligned untyped memory).
+ */
 void cos_meminfo_alloc(struct cos_compinfo *ci, vaddr_t untyped_ptr, unsigned long untyped_sz);
 /* expand *only* the pgtbl-internal nodes */
 vaddr_t cos_pgtbl_intern_alloc(struct cos_compinfo *ci, pgtblcap_t cipgtbl, vaddr_t mem_ptr, unsigned long mem_sz);
@@ -111,19 +136,55 @@ int         cos_compinfo_alloc(struct cos_compinfo *ci, vaddr_t heap_ptr, capid_
 captblcap_t cos_captbl_alloc(struct cos_compinfo *ci);
 pgtblcap_t  cos_pgtbl_alloc(struct cos_compinfo *ci);
 compcap_t   cos_comp_alloc(struct cos_compinfo *ci, captblcap_t ctc, pgtblcap_t ptc, vaddr_t entry);
+/* the component's tables are not freed: their kernel memory must be frozen and quiesce first */
+int         cos_comp_deactivate(struct cos_compinfo *ci, compcap_t comp);
 void cos_comp_capfrontier_update(struct cos_compinfo *ci, capid_t cap_frontier);
 
 typedef void (*cos_thd_fn_t)(void *);
 thdcap_t cos_thd_alloc(struct cos_compinfo *ci, compcap_t comp, cos_thd_fn_t fn, void *data);
 thdcap_t cos_thd_alloc_ext(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t idx);
+/*
+ * Threads can only be freed if the kernel memory backing them is
+ * known, so those that will be are allocated with cos_thd_alloc_kmem.
+ * Freeing the last capability to a thread releases its id for reuse
+ * (see thdid_alloc in the kernel); its kernel memory is not reused.
+ * A thread freed before it ever executed leaks its closure. The
+ * stacks the thread holds in the calling component are returned to
+ * its pool; if it was created in another component, that component
+ * must call cos_stack_release.
+ */
+thdcap_t cos_thd_alloc_kmem(struct cos_compinfo *ci, compcap_t comp, cos_thd_fn_t fn, void *data, vaddr_t *kmem);
+thdcap_t cos_thd_alloc_ext_kmem(struct cos_compinfo *ci, compcap_t comp, thdclosure_index_t idx, vaddr_t *kmem);
+int      cos_thd_free(struct cos_compinfo *ci, thdcap_t tc, vaddr_t kmem);
+/* Remove a capability to a thread from ci's captbl, other than the last one */
+int      cos_thd_deactivate(struct cos_compinfo *ci, thdcap_t tc);
 /* Create the initial (cos_init) thread */
 thdcap_t  cos_initthd_alloc(struct cos_compinfo *ci, compcap_t comp);
 sinvcap_t cos_sinv_alloc(struct cos_compinfo *srcci, compcap_t dstcomp, vaddr_t entry, invtoken_t token);
 arcvcap_t cos_arcv_alloc(struct cos_compinfo *ci, thdcap_t thdcap, tcap_t tcapcap, compcap_t compcap, arcvcap_t enotif);
 asndcap_t cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap);
+/*
+ * Cross-core asnds through the returned capability are limited to
+ * @budget IPIs every @period cycles. Asnds beyond that are coalesced,
+ * and delivered with the next asnd within budget, or by the sending
+ * core's timer once the budget is replenished. A 0 @period disables
+ * the limit. The budget must be below 2^16 (and non-zero if limited),
+ * and 0 is returned if the capabilities are not below 2^16.
+ */
+asndcap_t cos_asnd_alloc_ratelimit(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap, u32_t budget,
+                                   u32_t period);
 
 void *cos_page_bump_alloc(struct cos_compinfo *ci);
 void *cos_page_bump_allocn(struct cos_compinfo *ci, size_t sz);
+/*
+ * Allocate sz (a multiple of SUPER_PAGE_SIZE) of memory mapped with
+ * superpages. Returns NULL if there is no physically aligned untyped
+ * memory; callers should fall back to cos_page_bump_allocn.
+ */
+void *cos_page_bump_allocn_super(struct cos_compinfo *ci, size_t sz);
+/* Allocate only the virtual addresses, e.g. to alias memory into */
+vaddr_t cos_page_bump_vallocn(struct cos_compinfo *ci, size_t sz);
+vaddr_t cos_page_bump_vallocn_super(struct cos_compinfo *ci, size_t sz);
 
 capid_t cos_cap_cpy(struct cos_compinfo *dstci, struct cos_compinfo *srcci, cap_t srcctype, capid_t srccap);
 int     cos_cap_cpy_at(struct cos_compinfo *dstci, capid_t dstcap, struct cos_compinfo *srcci, capid_t srccap);
@@ -162,13 +223,30 @@ int cos_introspect(struct cos_compinfo *ci, capid_t cap, unsigned long op);
 int cos_sinv(sinvcap_t sinv, word_t arg1, word_t arg2, word_t arg3, word_t arg4);
 int cos_sinv_rets(sinvcap_t sinv, word_t arg1, word_t arg2, word_t arg3, word_t arg4, word_t *ret1, word_t *ret2, word_t *ret3);
 int cos_sinv_2rets(sinvcap_t sinv, word_t arg1, word_t arg2, word_t arg3, word_t arg4, word_t *ret1, word_t *ret2);
+int cos_sinv_batch(struct cos_compinfo *ci, struct cos_sinv_batch_ent *ents, unsigned int n);
 
 vaddr_t cos_mem_alias(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 vaddr_t cos_mem_aliasn(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src, size_t sz);
 int     cos_mem_alias_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
+int     cos_mem_aliasn_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src, size_t sz);
+int     cos_mem_aliasn_ro_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src, size_t sz);
+/* alias a range that was allocated with cos_page_bump_allocn_super */
+vaddr_t cos_mem_aliasn_super(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src, size_t sz);
 vaddr_t cos_mem_move(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 int     cos_mem_move_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
+/*
+ * Unmap memory. Removing the first page of a superpage removes the
+ * whole superpage. The frames cannot be reused until all of the TLBs
+ * have been flushed since they were unmapped (timer interrupts flush
+ * them periodically), which is when cos_mem_quiesced, given a mapping
+ * of the frame (e.g. the memory manager's), returns 1 (0 if not yet,
+ * or a negative error).
+ */
 int     cos_mem_remove(pgtblcap_t pt, vaddr_t addr);
+int     cos_mem_removen(pgtblcap_t pt, vaddr_t addr, size_t sz);
+/* unmap a range mapped with superpages */
+int     cos_mem_removen_super(pgtblcap_t pt, vaddr_t addr, size_t sz);
+int     cos_mem_quiesced(pgtblcap_t pt, vaddr_t addr);
 
 /* Tcap operations */
 tcap_t cos_tcap_alloc(struct cos_compinfo *ci);
@@ -194,6 +272,10 @@ void   *cos_hw_map(struct cos_compinfo *ci, hwcap_t hwc, paddr_t pa, unsigned in
 int     cos_hw_cycles_per_usec(hwcap_t hwc);
 int     cos_hw_cycles_thresh(hwcap_t hwc);
 void    cos_hw_shutdown(hwcap_t hwc);
+/* set this core's invocation stack caching mode, and return the previous one */
+int     cos_hw_invstk_cache(hwcap_t hwc, invstk_cache_t mode);
+/* this core's cross-core asnd counter (wraps at 32 bits) */
+unsigned long cos_hw_ipi_stat(hwcap_t hwc, ipi_stat_t stat);
 
 
 capid_t cos_capid_bump_alloc(struct cos_compinfo *ci, cap_t cap);
@@ -2,6 +2,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syscall.h>
 #include <time.h>
 
@@ -12,6 +13,7 @@
 #include <cos_component.h>
 #include <cos_defkernel_api.h>
 #include <llprint.h>
+#include <memmgr.h>
 #include <sl.h>
 #include <sl_lock.h>
 #include <sl_thd.h>
@@ -111,7 +113,8 @@ cos_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 		return MAP_FAILED;
 	}
 
-	addr = (void *)cos_page_bump_allocn(&cos_defcompinfo_curr_get()->ci, length);
+	/* The memory manager can reclaim the memory on munmap */
+	addr = (void *)memmgr_heap_page_allocn(round_up_to_page(length) / PAGE_SIZE);
 	if (!addr){
 		ret = (void *) -1;
 	} else {
@@ -129,15 +132,34 @@ cos_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 int
 cos_munmap(void *start, size_t length)
 {
-	printc("munmap not implemented\n");
-	errno = ENOSYS;
-	return -1;
+	if ((vaddr_t)start % PAGE_SIZE || length == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* the memory is reclaimed by the memory manager, and reused once it has quiesced */
+	if (memmgr_heap_page_freen((vaddr_t)start, round_up_to_page(length) / PAGE_SIZE)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
 }
 
 int
 cos_madvise(void *start, size_t length, int advice)
 {
-	/* We don't do anything with the advice from madvise, but that isn't really a problem */
+	if ((vaddr_t)start % PAGE_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	/*
+	 * Anonymous memory reads as zeros after MADV_DONTNEED. We
+	 * cannot unmap it, as we don't fault memory back in on access,
+	 * so zero it instead. Other advice is ignored, which isn't
+	 * really a problem.
+	 */
+	if (advice == MADV_DONTNEED) memset(start, 0, round_up_to_page(length));
+
 	return 0;
 }
 
@@ -64,8 +64,11 @@ struct sl_global_cpu {
 	cycles_t    period;
 	cycles_t    timer_next;
 	tcap_time_t timeout_next;
+	/* timer expiries, and those that didn't wake any thread */
+	unsigned long timer_wakeups, timer_idle_wakeups;
 
 	struct ps_list_head event_head; /* all pending events for sched end-point */
+	struct sl_thd      *graveyard;  /* threads that freed themselves, to be reaped */
 };
 
 extern struct sl_global_cpu sl_global_cpu_data[];
@@ -98,13 +101,17 @@ sl_thd_lkup(thdid_t tid)
 static inline struct sl_thd *
 sl_thd_try_lkup(thdid_t tid)
 {
-	struct sl_thd *t = NULL;
+	struct sl_thd_policy *tp;
+	struct sl_thd        *t = NULL;
 
 	assert(tid != 0);
 	if (unlikely(tid > MAX_NUM_THREADS)) return NULL;
 
-	t = sl_mod_thd_get(sl_thd_lookup_backend(tid));
-	if (!sl_thd_aepinfo(t)) return NULL;
+	tp = sl_thd_lookup_backend(tid);
+	if (!tp) return NULL;
+	t = sl_mod_thd_get(tp);
+	/* ids are recycled, so the slot of a freed thread may be stale */
+	if (!sl_thd_aepinfo(t) || t->state == SL_THD_FREE) return NULL;
 
 	return t;
 }
@@ -363,11 +370,13 @@ sl_timeout_expended(microsec_t now, microsec_t oldtimeout)
 /* to get timeout heap. not a public api */
 struct heap *sl_timeout_heap(void);
 
-/* wakeup any blocked threads! */
-static inline void
+/* wakeup any blocked threads! Returns the number woken up. */
+static inline int
 sl_timeout_wakeup_expired(cycles_t now)
 {
-	if (!heap_size(sl_timeout_heap())) return;
+	int woken = 0;
+
+	if (!heap_size(sl_timeout_heap())) return 0;
 
 	do {
 		struct sl_thd *tp, *th;
@@ -385,7 +394,54 @@ sl_timeout_wakeup_expired(cycles_t now)
 		assert(th->wakeup_cycs == 0);
 		th->wakeup_cycs = now;
 		sl_thd_wakeup_no_cs_rm(th);
+		woken++;
 	} while (heap_size(sl_timeout_heap()));
+
+	return woken;
+}
+
+/*
+ * In tickless mode (sl_init(SL_TICKLESS)), there are no periodic
+ * timeouts: the next timeout is that of the thread first in the
+ * timeout heap, if any. Idle cores thus aren't woken up, and thread
+ * timeouts aren't quantized to a period.
+ */
+static inline void
+sl_timeout_tickless_update(void)
+{
+	struct sl_global_cpu *g = sl__globals_cpu();
+	struct sl_thd        *tp;
+
+	if (sl_timeout_period_get()) return;
+
+	tp = heap_peek(sl_timeout_heap());
+	if (!tp) {
+		g->timer_next   = 0;
+		g->timeout_next = TCAP_TIME_NIL;
+		return;
+	}
+	sl_timeout_oneshot(tp->timeout_cycs);
+}
+
+/*
+ * Without periodic timeouts, a thread that shares its priority with
+ * other runnable threads would run until it blocks or yields, so
+ * tickless mode preempts it after a quantum of SL_MIN_PERIOD_US.
+ */
+static inline void
+sl_timeout_tickless_quantum(cycles_t now)
+{
+	struct sl_global_cpu *g = sl__globals_cpu();
+	cycles_t              q = now + sl_usec2cyc(SL_MIN_PERIOD_US);
+
+	if (!g->timer_next || q < g->timer_next) sl_timeout_oneshot(q);
+}
+
+static inline void
+sl_timeout_stats(unsigned long *wakeups, unsigned long *idle_wakeups)
+{
+	*wakeups      = sl__globals_cpu()->timer_wakeups;
+	*idle_wakeups = sl__globals_cpu()->timer_idle_wakeups;
 }
 
 static inline int
@@ -464,8 +520,14 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 	tok    = cos_sched_sync();
 	now    = sl_now();
 	offset = (s64_t)(globals->timer_next - now);
-	if (globals->timer_next && offset <= 0) sl_timeout_expended(now, globals->timer_next);
-	sl_timeout_wakeup_expired(now);
+	if (globals->timer_next && offset <= 0) {
+		globals->timer_wakeups++;
+		if (sl_timeout_period_get()) sl_timeout_expended(now, globals->timer_next);
+		if (!sl_timeout_wakeup_expired(now)) globals->timer_idle_wakeups++;
+	} else {
+		sl_timeout_wakeup_expired(now);
+	}
+	sl_timeout_tickless_update();
 
 	/*
 	 * Once we exit, we can't trust t's memory as it could be
@@ -485,6 +547,10 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 		else
 			t = sl_mod_thd_get(pt);
 	}
+	if (!sl_timeout_period_get() && t != globals->idle_thd && t != globals->sched_thd &&
+	    sl_mod_thd_peers(sl_mod_thd_policy_get(t))) {
+		sl_timeout_tickless_quantum(now);
+	}
 
 	if (t->properties & SL_THD_PROPERTY_OWN_TCAP && t->budget) {
 		assert(t->period);
@@ -561,7 +627,8 @@ sl_cs_exit_switchto(struct sl_thd *to)
  * library-internal data-structures, and then the ability for the
  * scheduler thread to start its scheduling loop.
  *
- * sl_init(period); <- using `period` for scheduler periodic timeouts
+ * sl_init(period); <- using `period` for scheduler periodic timeouts,
+ *                     or SL_TICKLESS for only the threads' timeouts
  * sl_*;            <- use the sl_api here
  * ...
  * sl_sched_loop(); <- loop here. or using sl_sched_loop_nonblock();
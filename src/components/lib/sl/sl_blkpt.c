@@ -2,14 +2,44 @@
 #include <sl_blkpt.h>
 #include <stacklist.h>
 
-#define NBLKPTS 64
+/*
+ * The blockpoints are allocated in page-sized chunks of
+ * BLKPT_CHUNK_NENT entries that are added to the namespace on
+ * demand, and indexed by a chunk directory. The id of a blockpoint
+ * encodes its chunk and offset, thus lookups are O(1). Free
+ * blockpoints are tracked in per-core freelists (protected by the
+ * core's scheduler critical section) linked through their ids, so
+ * alloc and free are O(1) and only touch the global namespace when
+ * a core's freelist is empty. A blockpoint can only be freed by the
+ * component it was allocated for, and goes back to the core it was
+ * allocated on. Frees from other cores can't take that core's
+ * critical section, so they claim the blockpoint with a cas on its
+ * id, and push it onto the core's remote freelist, which the core
+ * takes whole when its own freelist is empty.
+ */
 struct blkpt_mem {
-	sched_blkpt_id_t      id;
+	unsigned long         id;   /* SCHED_BLKPT_NULL if free, word-sized for cas */
+	union {
+		sched_blkpt_id_t next;  /* next free blockpoint */
+		spdid_t          owner; /* if allocated */
+	};
+	coreid_t              core; /* that it was allocated on */
 	sched_blkpt_epoch_t   epoch;
 	struct stacklist_head blocked;
 };
-static struct blkpt_mem __blkpts[NBLKPTS];
-static int __blkpt_offset = 1;
+
+#define BLKPT_CHUNK_ORDER  8
+#define BLKPT_CHUNK_NENT   (1 << BLKPT_CHUNK_ORDER)
+#define BLKPT_MAX_CHUNKS   64 /* 16K blockpoints */
+
+static struct blkpt_mem *__blkpt_chunks[BLKPT_MAX_CHUNKS];
+static unsigned long     __blkpt_nchunks = 0;
+
+struct blkpt_freelist {
+	sched_blkpt_id_t head;
+	unsigned long    remote; /* freed from other cores, word-sized for cas */
+} CACHE_ALIGNED;
+static struct blkpt_freelist __blkpt_free[NUM_CPU] CACHE_ALIGNED;
 
 #define BLKPT_EPOCH_BLKED_BITS ((sizeof(sched_blkpt_epoch_t) * 8)
 #define BLKPT_EPOCH_DIFF       (BLKPT_EPOCH_BLKED_BITS - 2)/2)
@@ -25,32 +55,92 @@ blkpt_epoch_is_higher(sched_blkpt_epoch_t e, sched_blkpt_epoch_t cmp)
 	return (e > cmp && (e - cmp) > BLKPT_EPOCH_DIFF) || (e < cmp && (cmp - e) < BLKPT_EPOCH_DIFF);
 }
 
+/* Get the blockpoint's memory, whether or not it is allocated */
+static struct blkpt_mem *
+__blkpt_mem(sched_blkpt_id_t id)
+{
+	struct blkpt_mem *chunk;
+
+	if (unlikely(id == SCHED_BLKPT_NULL || ((id - 1) >> BLKPT_CHUNK_ORDER) >= BLKPT_MAX_CHUNKS)) return NULL;
+	chunk = ps_load(&__blkpt_chunks[(id - 1) >> BLKPT_CHUNK_ORDER]);
+	if (unlikely(!chunk)) return NULL;
+
+	return &chunk[(id - 1) & (BLKPT_CHUNK_NENT - 1)];
+}
+
+/* Get an allocated blockpoint */
 static struct blkpt_mem *
 blkpt_get(sched_blkpt_id_t id)
 {
-	if (id - 1 == NBLKPTS) return NULL;
+	struct blkpt_mem *m = __blkpt_mem(id);
+
+	if (unlikely(!m || m->id != id)) return NULL;
+
+	return m;
+}
+
+/*
+ * Add a new chunk of blockpoints into the namespace, and onto this
+ * core's freelist. Must be called within the critical section.
+ */
+static int
+blkpt_expand(struct blkpt_freelist *fl)
+{
+	struct blkpt_mem *chunk;
+	unsigned long     c;
+	int               i;
+
+	assert(sizeof(struct blkpt_mem) * BLKPT_CHUNK_NENT <= PAGE_SIZE);
+	if (ps_load(&__blkpt_nchunks) >= BLKPT_MAX_CHUNKS) return -1;
+	chunk = cos_page_bump_alloc(cos_compinfo_get(cos_defcompinfo_curr_get()));
+	if (!chunk) return -1;
+	/* only claim a chunk index once we have its memory, so failures don't waste it */
+	do {
+		c = ps_load(&__blkpt_nchunks);
+		/* the last index was claimed meanwhile: the page is lost, but the namespace is full anyway */
+		if (c >= BLKPT_MAX_CHUNKS) return -1;
+	} while (!ps_cas(&__blkpt_nchunks, c, c + 1));
+
+	for (i = 0; i < BLKPT_CHUNK_NENT; i++) {
+		chunk[i] = (struct blkpt_mem) {
+			.id   = SCHED_BLKPT_NULL,
+			.next = (i == BLKPT_CHUNK_NENT - 1) ? fl->head : (c << BLKPT_CHUNK_ORDER) + i + 2,
+		};
+	}
+	ps_store(&__blkpt_chunks[c], chunk);
+	fl->head = (c << BLKPT_CHUNK_ORDER) + 1;
 
-	return &__blkpts[id-1];
+	return 0;
 }
 
 sched_blkpt_id_t
-sl_blkpt_alloc(void)
+sl_blkpt_alloc(spdid_t owner)
 {
-	sched_blkpt_id_t id;
+	struct blkpt_freelist *fl = &__blkpt_free[cos_cpuid()];
 	struct blkpt_mem *m;
-	sched_blkpt_id_t ret = SCHED_BLKPT_NULL;
+	sched_blkpt_id_t ret = SCHED_BLKPT_NULL, head;
 
 	sl_cs_enter();
 
-	id = (sched_blkpt_id_t)__blkpt_offset;
-	m  = blkpt_get(id);
-	if (!m) ERR_THROW(SCHED_BLKPT_NULL, unlock);
+	if (fl->head == SCHED_BLKPT_NULL) {
+		/* take the blockpoints other cores freed */
+		do {
+			head = ps_load(&fl->remote);
+		} while (head != SCHED_BLKPT_NULL && !ps_cas(&fl->remote, head, SCHED_BLKPT_NULL));
+		fl->head = head;
+	}
+	if (fl->head == SCHED_BLKPT_NULL && blkpt_expand(fl)) ERR_THROW(SCHED_BLKPT_NULL, unlock);
+	m = __blkpt_mem(fl->head);
+	assert(m && m->id == SCHED_BLKPT_NULL);
 
-	m->id    = id;
-	ret      = id;
+	ret      = fl->head;
+	fl->head = m->next;
+	m->owner = owner;
+	m->core  = cos_cpuid();
 	m->epoch = 0;
 	stacklist_init(&m->blocked);
-	__blkpt_offset++;
+	/* published last, as lookups from other cores check the id */
+	ps_store(&m->id, ret);
 unlock:
 	sl_cs_exit();
 
@@ -58,10 +148,36 @@ unlock:
 }
 
 int
-sl_blkpt_free(sched_blkpt_id_t id)
+sl_blkpt_free(sched_blkpt_id_t id, spdid_t owner)
 {
-	/* alloc only for now */
-	return 0;
+	struct blkpt_freelist *fl;
+	struct blkpt_mem *m;
+	sched_blkpt_id_t head;
+	int ret = 0;
+
+	sl_cs_enter();
+
+	m = blkpt_get(id);
+	if (!m || m->owner != owner) ERR_THROW(-1, unlock);
+	/* cannot free a blockpoint with blocked threads */
+	if (ps_load(&m->blocked.head)) ERR_THROW(-1, unlock);
+	/* only one of concurrent frees can claim it */
+	if (!ps_cas(&m->id, id, SCHED_BLKPT_NULL)) ERR_THROW(-1, unlock);
+
+	fl = &__blkpt_free[m->core];
+	if (m->core == cos_cpuid()) {
+		m->next  = fl->head;
+		fl->head = id;
+	} else {
+		do {
+			head    = ps_load(&fl->remote);
+			m->next = head;
+		} while (!ps_cas(&fl->remote, head, id));
+	}
+unlock:
+	sl_cs_exit();
+
+	return ret;
 }
 
 int
@@ -77,6 +193,29 @@ sl_blkpt_trigger(sched_blkpt_id_t blkpt, sched_blkpt_epoch_t epoch, int single)
 	m = blkpt_get(blkpt);
 	if (!m) ERR_THROW(-1, unlock);
 
+	if (single) {
+		/*
+		 * Each single trigger is a separate event (the caller
+		 * advanced the epoch for it), so it wakes a thread
+		 * even if a racing trigger passed a later epoch. The
+		 * epoch still only moves forward, so threads that
+		 * checkpointed before it won't block, and re-check the
+		 * data-structure.
+		 */
+		if (blkpt_epoch_is_higher(m->epoch, epoch)) m->epoch = epoch;
+		tid = stacklist_dequeue(&m->blocked);
+		/* the caller keeps the blockpoint armed while threads remain */
+		ret = ps_load(&m->blocked.head) != NULL;
+		if (!tid) ERR_THROW(ret, unlock);
+
+		t = sl_thd_lkup(tid);
+		assert(t);
+		sl_thd_wakeup_no_cs(t);
+		sl_cs_exit_schedule();
+
+		return ret;
+	}
+
 	/* is the new epoch more recent than the existing? */
 	if (!blkpt_epoch_is_higher(m->epoch, epoch)) ERR_THROW(0, unlock);
 
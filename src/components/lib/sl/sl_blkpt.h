@@ -7,8 +7,14 @@ typedef u32_t sched_blkpt_id_t;
 #define SCHED_BLKPT_NULL 0
 typedef word_t sched_blkpt_epoch_t;
 
-sched_blkpt_id_t sl_blkpt_alloc(void);
-int sl_blkpt_free(sched_blkpt_id_t id);
+/* owner is the component the blockpoint is for, which alone can free it (on any core) */
+sched_blkpt_id_t sl_blkpt_alloc(spdid_t owner);
+int sl_blkpt_free(sched_blkpt_id_t id, spdid_t owner);
+/*
+ * Wake all threads blocked before the epoch, or if single, only one
+ * of them. Returns -1 on error, and for single triggers, 1 if blocked
+ * threads remain and 0 otherwise.
+ */
 int sl_blkpt_trigger(sched_blkpt_id_t blkpt, sched_blkpt_epoch_t epoch, int single);
 int sl_blkpt_block(sched_blkpt_id_t blkpt, sched_blkpt_epoch_t epoch, thdid_t dependency);
 
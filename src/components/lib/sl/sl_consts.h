@@ -2,7 +2,11 @@
 #define SL_CONSTS
 
 #define SL_MIN_PERIOD_US 1000
+#define SL_TICKLESS      0 /* sl_init period: no periodic timeouts, only the threads' */
 #define SL_MAX_NUM_THDS  MAX_NUM_THREADS
 #define SL_CYCS_DIFF     (1<<14)
 
+/* Priority levels of the fixed-priority policy (a multiple of 32, <= 1024) */
+#define SL_FPRR_NPRIOS   256
+
 #endif /* SL_CONSTS */
@@ -3,13 +3,53 @@
 #include <sl_mod_policy.h>
 #include <sl_plugins.h>
 
-#define SL_FPRR_NPRIOS         32
 #define SL_FPRR_PRIO_HIGHEST   TCAP_PRIO_MAX
 #define SL_FPRR_PRIO_LOWEST    SL_FPRR_NPRIOS
 
 #define SL_FPRR_PERIOD_US_MIN  SL_MIN_PERIOD_US
 
-struct ps_list_head threads[NUM_CPU][SL_FPRR_NPRIOS] CACHE_ALIGNED;
+/*
+ * The run-queue is a list of threads per priority, and a two-level
+ * bitmap of the non-empty lists: bit i of summary is set iff
+ * prios[i] != 0, and bit j of prios[i] is set iff the list at
+ * priority index i * 32 + j is non-empty. Finding the highest
+ * priority thread is thus two find-first-set operations.
+ */
+#define SL_FPRR_NWORDS (SL_FPRR_NPRIOS / 32)
+
+struct fprr_runqueue {
+	u32_t               summary;
+	u32_t               prios[SL_FPRR_NWORDS];
+	struct ps_list_head threads[SL_FPRR_NPRIOS];
+} CACHE_ALIGNED;
+
+static struct fprr_runqueue runqueues[NUM_CPU] CACHE_ALIGNED;
+
+static inline struct fprr_runqueue *
+fprr_runqueue(void)
+{ return &runqueues[cos_cpuid()]; }
+
+static inline void
+fprr_runqueue_add(struct fprr_runqueue *rq, struct sl_thd_policy *t)
+{
+	int i = t->priority - 1;
+
+	ps_list_head_append_d(&rq->threads[i], t);
+	rq->prios[i / 32] |= 1U << (i % 32);
+	rq->summary       |= 1U << (i / 32);
+}
+
+/* Remove t, if it is on the run-queue */
+static inline void
+fprr_runqueue_rem(struct fprr_runqueue *rq, struct sl_thd_policy *t)
+{
+	int i = t->priority - 1;
+
+	ps_list_rem_d(t);
+	if (!ps_list_head_empty(&rq->threads[i])) return;
+	rq->prios[i / 32] &= ~(1U << (i % 32));
+	if (!rq->prios[i / 32]) rq->summary &= ~(1U << (i / 32));
+}
 
 /* No RR yet */
 void
@@ -19,30 +59,29 @@ sl_mod_execution(struct sl_thd_policy *t, cycles_t cycles)
 struct sl_thd_policy *
 sl_mod_schedule(void)
 {
-	int i;
+	struct fprr_runqueue *rq = fprr_runqueue();
 	struct sl_thd_policy *t;
+	int w, i;
 
-	for (i = 0 ; i < SL_FPRR_NPRIOS ; i++) {
-		if (ps_list_head_empty(&threads[cos_cpuid()][i])) continue;
-		t = ps_list_head_first_d(&threads[cos_cpuid()][i], struct sl_thd_policy);
-
-		/*
-		 * We want to move the selected thread to the back of the list.
-		 * Otherwise fprr won't be truly round robin
-		 */
-		ps_list_rem_d(t);
-		ps_list_head_append_d(&threads[cos_cpuid()][i], t);
+	if (unlikely(!rq->summary)) return NULL;
+	w = __builtin_ctz(rq->summary);
+	i = w * 32 + __builtin_ctz(rq->prios[w]);
+	t = ps_list_head_first_d(&rq->threads[i], struct sl_thd_policy);
 
-		return t;
-	}
+	/*
+	 * We want to move the selected thread to the back of the list.
+	 * Otherwise fprr won't be truly round robin
+	 */
+	ps_list_rem_d(t);
+	ps_list_head_append_d(&rq->threads[i], t);
 
-	return NULL;
+	return t;
 }
 
 void
 sl_mod_block(struct sl_thd_policy *t)
 {
-	ps_list_rem_d(t);
+	fprr_runqueue_rem(fprr_runqueue(), t);
 }
 
 void
@@ -50,14 +89,25 @@ sl_mod_wakeup(struct sl_thd_policy *t)
 {
 	assert(ps_list_singleton_d(t));
 
-	ps_list_head_append_d(&threads[cos_cpuid()][t->priority - 1], t);
+	fprr_runqueue_add(fprr_runqueue(), t);
 }
 
 void
 sl_mod_yield(struct sl_thd_policy *t, struct sl_thd_policy *yield_to)
 {
-	ps_list_rem_d(t);
-	ps_list_head_append_d(&threads[cos_cpuid()][t->priority - 1], t);
+	struct fprr_runqueue *rq = fprr_runqueue();
+
+	fprr_runqueue_rem(rq, t);
+	fprr_runqueue_add(rq, t);
+}
+
+int
+sl_mod_thd_peers(struct sl_thd_policy *t)
+{
+	struct ps_list_head *l = &fprr_runqueue()->threads[t->priority - 1];
+
+	return !ps_list_singleton_d(t) &&
+	       ps_list_head_first_d(l, struct sl_thd_policy) != ps_list_head_last_d(l, struct sl_thd_policy);
 }
 
 void
@@ -72,7 +122,7 @@ sl_mod_thd_create(struct sl_thd_policy *t)
 
 void
 sl_mod_thd_delete(struct sl_thd_policy *t)
-{ ps_list_rem_d(t); }
+{ fprr_runqueue_rem(fprr_runqueue(), t); }
 
 void
 sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned int v)
@@ -81,9 +131,10 @@ sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned
 	case SCHEDP_PRIO:
 	{
 		assert(v >= SL_FPRR_PRIO_HIGHEST && v <= SL_FPRR_PRIO_LOWEST);
-		ps_list_rem_d(t); /* if we're already on a list, and we're updating priority */
+		/* if we're already on a list, and we're updating priority */
+		fprr_runqueue_rem(fprr_runqueue(), t);
 		t->priority = v;
-		ps_list_head_append_d(&threads[cos_cpuid()][t->priority - 1], t);
+		fprr_runqueue_add(fprr_runqueue(), t);
 		sl_thd_setprio(sl_mod_thd_get(t), t->priority);
 
 		break;
@@ -98,6 +149,7 @@ sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned
 		break;
 	}
 	case SCHEDP_BUDGET:
+	case SCHEDP_DEADLINE: /* fixed priorities ignore deadlines */
 	{
 		break;
 	}
@@ -108,10 +160,11 @@ sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned
 void
 sl_mod_init(void)
 {
+	struct fprr_runqueue *rq = fprr_runqueue();
 	int i;
 
-	memset(threads[cos_cpuid()], 0, sizeof(struct ps_list_head) * SL_FPRR_NPRIOS);
+	memset(rq, 0, sizeof(struct fprr_runqueue));
 	for (i = 0 ; i < SL_FPRR_NPRIOS ; i++) {
-		ps_list_head_init(&threads[cos_cpuid()][i]);
+		ps_list_head_init(&rq->threads[i]);
 	}
 }
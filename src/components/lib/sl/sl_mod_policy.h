@@ -10,6 +10,10 @@ struct sl_thd_policy {
 	microsec_t     period_usec;
 	cycles_t       period;
 	struct ps_list list;
+	/* deadline-driven policies (edf) */
+	cycles_t       deadline;     /* absolute deadline of the current activation */
+	cycles_t       rel_deadline; /* 0 if the deadline is the end of the period */
+	int            deadline_idx; /* index in the deadline heap, 0 if not present */
 } CACHE_ALIGNED;
 
 static inline struct sl_thd *
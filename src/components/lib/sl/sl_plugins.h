@@ -46,6 +46,8 @@ struct sl_thd_policy *sl_mod_schedule(void);
 void sl_mod_block(struct sl_thd_policy *t);
 void sl_mod_wakeup(struct sl_thd_policy *t);
 void sl_mod_yield(struct sl_thd_policy *t, struct sl_thd_policy *tp);
+/* Does t share the processor round-robin with other runnable threads? */
+int  sl_mod_thd_peers(struct sl_thd_policy *t);
 
 void sl_mod_thd_create(struct sl_thd_policy *t);
 void sl_mod_thd_delete(struct sl_thd_policy *t);
@@ -20,6 +20,7 @@ static void sl_sched_loop_intern(int non_block) __attribute__((noreturn));
 extern struct sl_thd *sl_thd_alloc_init(struct cos_aep_info *aep, asndcap_t sndcap, sl_thd_property_t prps);
 extern int sl_xcpu_process_no_cs(void);
 extern void sl_xcpu_asnd_alloc(void);
+extern int sl_thd_deactivate(struct sl_thd *t);
 
 /*
  * These functions are removed from the inlined fast-paths of the
@@ -109,6 +110,29 @@ sl_timeout_remove(struct sl_thd *t)
 	t->timeout_idx = -1;
 }
 
+/*
+ * Deactivate the kernel thread, which frees its id, before its aep
+ * can be reused. If that fails, the thread stays in the graveyard to
+ * be reaped later.
+ */
+static int
+sl_thd_reap_no_cs(struct sl_thd *t)
+{
+	struct sl_global_cpu *g = sl__globals_cpu();
+	int ret;
+
+	ret = sl_thd_deactivate(t);
+	if (ret) {
+		t->graveyard_next = g->graveyard;
+		g->graveyard      = t;
+
+		return ret;
+	}
+	sl_thd_free_backend(sl_mod_thd_policy_get(t));
+
+	return 0;
+}
+
 void
 sl_thd_free_no_cs(struct sl_thd *t)
 {
@@ -120,14 +144,35 @@ sl_thd_free_no_cs(struct sl_thd *t)
         sl_thd_index_rem_backend(sl_mod_thd_policy_get(t));
         sl_mod_thd_delete(sl_mod_thd_policy_get(t));
         t->state = SL_THD_FREE;
-        /* TODO: add logic for the graveyard to delay this deallocation if t == current */
-        sl_thd_free_backend(sl_mod_thd_policy_get(t));
 
-        /* thread should not continue to run if it deletes itself. */
+        /*
+         * thread should not continue to run if it deletes itself, and
+         * can't deactivate itself: the scheduler thread reaps it.
+         */
         if (unlikely(t == ct)) {
+                struct sl_global_cpu *g = sl__globals_cpu();
+
+                t->graveyard_next = g->graveyard;
+                g->graveyard      = t;
                 while (1) sl_cs_exit_schedule();
                 /* FIXME: should never get here, but tcap mechanism can let a child scheduler run! */
         }
+        sl_thd_reap_no_cs(t);
+}
+
+static void
+sl_graveyard_reap_no_cs(void)
+{
+	struct sl_global_cpu *g = sl__globals_cpu();
+	struct sl_thd        *t, *next;
+
+	/* take the whole graveyard, so threads that fail to reap are only retried next time */
+	t            = g->graveyard;
+	g->graveyard = NULL;
+	for (; t; t = next) {
+		next = t->graveyard_next;
+		sl_thd_reap_no_cs(t);
+	}
 }
 
 static int
@@ -144,11 +189,11 @@ __sl_timeout_update_idx(void *e, int pos)
 static void
 sl_timeout_init(microsec_t period)
 {
-	assert(period >= SL_MIN_PERIOD_US);
+	assert(period == SL_TICKLESS || period >= SL_MIN_PERIOD_US);
 
-	sl_timeout_period(period);
 	memset(&timeout_heap[cos_cpuid()], 0, sizeof(struct timeout_heap));
 	heap_init(sl_timeout_heap(), SL_MAX_NUM_THDS, __sl_timeout_compare_min, __sl_timeout_update_idx);
+	sl_timeout_period(period);
 }
 
 /*
@@ -330,7 +375,9 @@ sl_thd_block_expiry(struct sl_thd *t)
 	sl_cs_enter();
 	if (!(t->properties & SL_THD_PROPERTY_OWN_TCAP)) {
 		assert(!t->rcv_suspended);
-		abs_timeout = sl__globals_cpu()->timeout_next;
+		abs_timeout = sl__globals_cpu()->timer_next;
+		/* tickless, without pending timeouts: retry after the minimum period */
+		if (!abs_timeout) abs_timeout = sl_now() + sl_usec2cyc(SL_MIN_PERIOD_US);
 	} else {
 		assert(t->period);
 		abs_timeout = t->last_replenish + t->period;
@@ -531,7 +578,8 @@ sl_timeout_period(microsec_t period)
 	cycles_t p = sl_usec2cyc(period);
 
 	sl__globals_cpu()->period = p;
-	sl_timeout_relative(p);
+	if (p) sl_timeout_relative(p);
+	else   sl_timeout_tickless_update();
 }
 
 /* engage space heater mode */
@@ -714,6 +762,7 @@ pending_events:
 		} while (pending > 0);
 
 		if (sl_cs_enter_sched()) continue;
+		if (unlikely(g->graveyard)) sl_graveyard_reap_no_cs();
 		/* If switch returns an inconsistency, we retry anyway */
 		sl_cs_exit_schedule_nospin();
 	}
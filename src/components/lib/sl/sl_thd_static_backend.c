@@ -11,35 +11,122 @@
 #include <cos_kernel_api.h>
 #include <cos_defkernel_api.h>
 
-static struct sl_thd_policy __sl_threads[NUM_CPU][SL_MAX_NUM_THDS];
+/*
+ * Each core's thread table is indexed by thread id, and grows in
+ * chunks of SL_THD_CHUNK_NENT threads that are allocated as threads
+ * with ids in their range are created, so lookups are O(1) through
+ * the chunk directory. The kernel recycles thread ids, and hands out
+ * the ids freed on a core to the threads next created on it, so the
+ * tables only grow to the number of threads alive at once.
+ *
+ * The aep info of a thread is allocated before its id is known, so
+ * they have their own chunks, and a freelist they are returned to
+ * when threads are freed. All of this is per-core, and protected by
+ * the core's scheduler critical section.
+ */
+#define SL_THD_CHUNK_ORDER 6
+#define SL_THD_CHUNK_NENT  (1 << SL_THD_CHUNK_ORDER)
+#define SL_THD_MAX_CHUNKS  ((SL_MAX_NUM_THDS + SL_THD_CHUNK_NENT - 1) / SL_THD_CHUNK_NENT)
+
+union sl_aep_mem {
+	struct cos_aep_info aep;
+	union sl_aep_mem   *next_free;
+};
+
+#define SL_AEP_CHUNK_NENT (PAGE_SIZE / sizeof(union sl_aep_mem))
+#define SL_AEP_MAX_CHUNKS ((SL_MAX_NUM_THDS + SL_AEP_CHUNK_NENT - 1) / SL_AEP_CHUNK_NENT)
+
+struct sl_thd_tbl {
+	struct sl_thd_policy *chunks[SL_THD_MAX_CHUNKS];
+	union sl_aep_mem     *aep_chunks[SL_AEP_MAX_CHUNKS];
+	unsigned int          aep_nchunks;
+	union sl_aep_mem     *aep_free;
+} CACHE_ALIGNED;
+
+static struct sl_thd_tbl __sl_thd_tbls[NUM_CPU];
 
-static struct cos_aep_info __sl_aep_infos[NUM_CPU][SL_MAX_NUM_THDS];
-static u32_t               __sl_aep_free_off[NUM_CPU];
+static inline struct sl_thd_tbl *
+sl_thd_tbl(void)
+{
+	return &__sl_thd_tbls[cos_cpuid()];
+}
+
+static struct sl_thd_policy *
+sl_thd_chunk_alloc(void)
+{
+	return cos_page_bump_allocn(cos_compinfo_get(cos_defcompinfo_curr_get()),
+	                            round_up_to_page(sizeof(struct sl_thd_policy) * SL_THD_CHUNK_NENT));
+}
 
 /* Default implementations of backend functions */
 struct sl_thd_policy *
 sl_thd_alloc_backend(thdid_t tid)
 {
-	assert(tid < SL_MAX_NUM_THDS);
+	struct sl_thd_tbl     *tbl = sl_thd_tbl();
+	struct sl_thd_policy **c, *t;
+
+	if (unlikely(tid >= SL_MAX_NUM_THDS)) return NULL;
+	c = &tbl->chunks[tid >> SL_THD_CHUNK_ORDER];
+	if (unlikely(!*c)) {
+		*c = sl_thd_chunk_alloc();
+		if (!*c) return NULL;
+	}
+	/* the id might be recycled from a freed thread */
+	t = &(*c)[tid & (SL_THD_CHUNK_NENT - 1)];
+	memset(t, 0, sizeof(struct sl_thd_policy));
 
-	return &(__sl_threads[cos_cpuid()][tid]);
+	return t;
 }
 
 struct cos_aep_info *
 sl_thd_alloc_aep_backend(void)
 {
-	struct cos_aep_info *aep = NULL;
+	struct sl_thd_tbl *tbl = sl_thd_tbl();
+	union sl_aep_mem  *chunk, *m;
+	unsigned int       i;
 
-	assert(__sl_aep_free_off[cos_cpuid()] < SL_MAX_NUM_THDS);
-	aep = &(__sl_aep_infos[cos_cpuid()][__sl_aep_free_off[cos_cpuid()]]);
-	ps_faa((unsigned long *)&(__sl_aep_free_off[cos_cpuid()]), 1);
+	if (unlikely(!tbl->aep_free)) {
+		if (tbl->aep_nchunks == SL_AEP_MAX_CHUNKS) return NULL;
+		chunk = cos_page_bump_alloc(cos_compinfo_get(cos_defcompinfo_curr_get()));
+		if (!chunk) return NULL;
 
-	return aep;
+		for (i = 0; i < SL_AEP_CHUNK_NENT; i++) {
+			chunk[i].next_free = (i == SL_AEP_CHUNK_NENT - 1) ? NULL : &chunk[i + 1];
+		}
+		tbl->aep_chunks[tbl->aep_nchunks++] = chunk;
+		tbl->aep_free = chunk;
+	}
+	m             = tbl->aep_free;
+	tbl->aep_free = m->next_free;
+	memset(&m->aep, 0, sizeof(struct cos_aep_info));
+
+	return &m->aep;
+}
+
+/* Not all aep infos are from the chunks (e.g. the scheduler thread's) */
+static int
+sl_aep_is_backend(struct sl_thd_tbl *tbl, struct cos_aep_info *aep)
+{
+	union sl_aep_mem *m = (union sl_aep_mem *)aep;
+	unsigned int      i;
+
+	for (i = 0; i < tbl->aep_nchunks; i++) {
+		if (m >= tbl->aep_chunks[i] && m < tbl->aep_chunks[i] + SL_AEP_CHUNK_NENT) return 1;
+	}
+
+	return 0;
 }
 
 void
 sl_thd_free_backend(struct sl_thd_policy *t)
-{ }
+{
+	struct sl_thd_tbl *tbl = sl_thd_tbl();
+	union sl_aep_mem  *m   = (union sl_aep_mem *)sl_thd_aepinfo(sl_mod_thd_get(t));
+
+	if (!m || !sl_aep_is_backend(tbl, &m->aep)) return;
+	m->next_free  = tbl->aep_free;
+	tbl->aep_free = m;
+}
 
 void
 sl_thd_index_add_backend(struct sl_thd_policy *t)
@@ -52,9 +139,13 @@ sl_thd_index_rem_backend(struct sl_thd_policy *t)
 struct sl_thd_policy *
 sl_thd_lookup_backend(thdid_t tid)
 {
-	assert(tid < SL_MAX_NUM_THDS);
+	struct sl_thd_policy *c;
+
+	if (unlikely(tid >= SL_MAX_NUM_THDS)) return NULL;
+	c = sl_thd_tbl()->chunks[tid >> SL_THD_CHUNK_ORDER];
+	if (unlikely(!c)) return NULL;
 
-	return &(__sl_threads[cos_cpuid()][tid]);
+	return &c[tid & (SL_THD_CHUNK_NENT - 1)];
 }
 
 void
@@ -62,7 +153,5 @@ sl_thd_init_backend(void)
 {
 	assert(SL_MAX_NUM_THDS <= MAX_NUM_THREADS);
 
-	memset(__sl_threads[cos_cpuid()], 0, sizeof(struct sl_thd_policy)*SL_MAX_NUM_THDS);
-	memset(__sl_aep_infos[cos_cpuid()], 0, sizeof(struct cos_aep_info)*SL_MAX_NUM_THDS);
-	__sl_aep_free_off[cos_cpuid()] = 0;
+	memset(sl_thd_tbl(), 0, sizeof(struct sl_thd_tbl));
 }
@@ -345,13 +345,14 @@ sl_thd_init_ext(struct cos_aep_info *aepthd, struct sl_thd *sched)
 struct sl_thd *
 sl_thd_retrieve(thdid_t tid)
 {
-	struct sl_thd       *t      = sl_mod_thd_get(sl_thd_lookup_backend(tid));
-	spdid_t              client = cos_inv_token();
-	thdid_t              itid   = 0;
-	struct sl_thd       *it     = NULL;
-	struct cos_aep_info  aep;
-
-	if (t && sl_thd_aepinfo(t)) return t;
+	struct sl_thd_policy *tp     = sl_thd_lookup_backend(tid);
+	struct sl_thd        *t      = tp ? sl_mod_thd_get(tp) : NULL;
+	spdid_t               client = cos_inv_token();
+	thdid_t               itid   = 0;
+	struct sl_thd        *it     = NULL;
+	struct cos_aep_info   aep;
+
+	if (t && sl_thd_aepinfo(t) && t->state != SL_THD_FREE) return t;
 	if (tid >= SL_MAX_NUM_THDS) return NULL;
 	assert(client);
 
@@ -386,6 +387,26 @@ sl_thd_retrieve(thdid_t tid)
 	return t;
 }
 
+/*
+ * The capmgr owns the kernel threads, so it frees them (and their
+ * ids). Threads it didn't create for us (e.g. initial threads) are
+ * refused, and stay allocated.
+ */
+int
+sl_thd_deactivate(struct sl_thd *t)
+{
+	struct cos_aep_info *aep = sl_thd_aepinfo(t);
+	int ret;
+
+	if (!aep || !aep->tid) return 0;
+	/* as in cos_thd_free, before the id can be reused */
+	cos_stack_release(aep->tid);
+	ret = capmgr_thd_free(aep->tid);
+	if (ret == -ENOENT) return 0;
+
+	return ret;
+}
+
 void
 sl_thd_free(struct sl_thd *t)
 {
@@ -88,7 +88,7 @@ sl_thd_alloc_no_cs(cos_thd_fn_t fn, void *data)
 	aep = sl_thd_alloc_aep_backend();
 	if (!aep) goto done;
 
-	aep->thd = cos_thd_alloc(ci, ci->comp_cap, fn, data);
+	aep->thd = cos_thd_alloc_kmem(ci, ci->comp_cap, fn, data, &aep->kmem);
 	if (!aep->thd) goto done;
 	aep->tid = cos_introspect(ci, aep->thd, THD_GET_TID);
 	if (!aep->tid) goto done;
@@ -321,7 +321,22 @@ done:
 struct sl_thd *
 sl_thd_retrieve(thdid_t tid)
 {
-	return sl_mod_thd_get(sl_thd_lookup_backend(tid));
+	struct sl_thd_policy *tp = sl_thd_lookup_backend(tid);
+
+	if (unlikely(!tp)) return NULL;
+
+	return sl_mod_thd_get(tp);
+}
+
+int
+sl_thd_deactivate(struct sl_thd *t)
+{
+	struct cos_aep_info *aep = sl_thd_aepinfo(t);
+
+	/* only the threads created in this component are known to be ours to free */
+	if (!aep || !aep->kmem) return 0;
+
+	return cos_thd_free(cos_compinfo_get(cos_defcompinfo_curr_get()), aep->thd, aep->kmem);
 }
 
 void
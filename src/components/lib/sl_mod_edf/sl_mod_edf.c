@@ -0,0 +1,281 @@
+#include <sl.h>
+#include <sl_consts.h>
+#include <sl_mod_policy.h>
+#include <sl_plugins.h>
+#include <heap.h>
+
+#define SL_EDF_PERIOD_US_MIN  SL_MIN_PERIOD_US
+
+/*
+ * Earliest deadline first. Threads with a window (SCHEDP_WINDOW) are
+ * kept in a heap ordered by their absolute deadline. Threads without
+ * one are background threads, scheduled round-robin only when no
+ * deadline thread is runnable.
+ *
+ * Threads with a window and a budget (SCHEDP_BUDGET) that own their
+ * tcap are sporadic servers. sl transfers the budget into the tcap
+ * when the thread's replenishment is due, the kernel preempts the
+ * thread when the tcap expires, and sl blocks the thread until its
+ * next replenishment. This policy decides *when* that is: a server
+ * that wakes up after its replenishment time starts a new activation
+ * with a full budget, and its next replenishment (and deadline) is a
+ * period after that activation. A server that wakes up before then
+ * continues with what is left of its budget, and its deadline.
+ *
+ * The tcap priority of each thread is its deadline (in usecs), so
+ * that kernel tcap preemption decisions agree with the schedule.
+ */
+struct edf_runqueue {
+	struct ps_list_head background;
+	struct heap         deadlines;
+	void               *data[SL_MAX_NUM_THDS + 1]; /* heap storage (1-indexed), must follow the heap */
+} CACHE_ALIGNED;
+
+static struct edf_runqueue runqueues[NUM_CPU] CACHE_ALIGNED;
+
+static inline struct edf_runqueue *
+edf_runqueue(void)
+{ return &runqueues[cos_cpuid()]; }
+
+/* is a's deadline earlier than b's? The signed difference handles wraparound. */
+static int
+edf_deadline_cmp(void *a, void *b)
+{
+	return (s64_t)(((struct sl_thd_policy *)a)->deadline - ((struct sl_thd_policy *)b)->deadline) < 0;
+}
+
+static void
+edf_deadline_update_idx(void *e, int pos)
+{ ((struct sl_thd_policy *)e)->deadline_idx = pos; }
+
+static inline tcap_prio_t
+edf_prio(struct sl_thd_policy *t)
+{
+	tcap_prio_t p;
+
+	if (!t->period) return TCAP_PRIO_MIN;
+
+	/* 48 bits of usecs wrap after ~8 years; stay above the background threads */
+	p = sl_cyc2usec(t->deadline);
+	if (p < TCAP_PRIO_MAX)  p = TCAP_PRIO_MAX;
+	if (p >= TCAP_PRIO_MIN) p = TCAP_PRIO_MIN - 1;
+
+	return p;
+}
+
+static inline int
+edf_is_server(struct sl_thd_policy *t)
+{
+	struct sl_thd *st = sl_mod_thd_get(t);
+
+	return t->period && st->budget && (st->properties & SL_THD_PROPERTY_OWN_TCAP);
+}
+
+/* Start a new activation of t at now */
+static void
+edf_activate(struct sl_thd_policy *t, cycles_t now)
+{
+	struct sl_thd *st = sl_mod_thd_get(t);
+
+	if (!t->period) return;
+	/*
+	 * sl replenishes the tcap when last_replenish + period has
+	 * passed, and then sets last_replenish to the start of the
+	 * current period, thus to now.
+	 */
+	if (edf_is_server(t)) st->last_replenish = now - t->period;
+	t->deadline = now + (t->rel_deadline ? t->rel_deadline : t->period);
+	sl_thd_setprio(st, edf_prio(t));
+}
+
+/* t was woken up: is this a new activation? */
+static void
+edf_release(struct sl_thd_policy *t, cycles_t now)
+{
+	struct sl_thd *st = sl_mod_thd_get(t);
+
+	if (edf_is_server(t)) {
+		if (st->last_replenish && now < st->last_replenish + t->period) return;
+	} else if (now < t->deadline) {
+		return;
+	}
+	edf_activate(t, now);
+}
+
+static inline void
+edf_runqueue_add(struct edf_runqueue *rq, struct sl_thd_policy *t)
+{
+	if (t->period) {
+		int ret = heap_add(&rq->deadlines, t);
+
+		assert(ret == 0);
+	} else {
+		ps_list_head_append_d(&rq->background, t);
+	}
+}
+
+/* Remove t, if it is on the run-queue */
+static inline void
+edf_runqueue_rem(struct edf_runqueue *rq, struct sl_thd_policy *t)
+{
+	if (t->deadline_idx) heap_remove(&rq->deadlines, t->deadline_idx);
+	ps_list_rem_d(t);
+}
+
+/*
+ * A periodic thread that overruns its deadline without blocking would
+ * keep its expired deadline, thus the earliest one, and starve every
+ * other periodic thread. Release it into the period that contains
+ * now, as its next wakeup would (servers are instead blocked by their
+ * tcap's expiry).
+ */
+static void
+edf_overruns_release(struct edf_runqueue *rq, cycles_t now)
+{
+	struct sl_thd_policy *t;
+
+	while ((t = heap_peek(&rq->deadlines)) && !edf_is_server(t) && (s64_t)(now - t->deadline) >= 0) {
+		do {
+			t->deadline += t->period;
+		} while ((s64_t)(now - t->deadline) >= 0);
+		sl_thd_setprio(sl_mod_thd_get(t), edf_prio(t));
+		heap_adjust(&rq->deadlines, t->deadline_idx);
+	}
+}
+
+/*
+ * Budget exhaustion is detected by the tcap: the kernel preempts the
+ * thread, and the next dispatch to it fails, which blocks it until
+ * its replenishment (sl_thd_block_expiry). Overruns are found when
+ * scheduling (edf_overruns_release).
+ */
+void
+sl_mod_execution(struct sl_thd_policy *t, cycles_t cycles)
+{ }
+
+struct sl_thd_policy *
+sl_mod_schedule(void)
+{
+	struct edf_runqueue  *rq = edf_runqueue();
+	struct sl_thd_policy *t;
+
+	edf_overruns_release(rq, sl_now());
+	t = heap_peek(&rq->deadlines);
+	if (t) return t;
+	if (unlikely(ps_list_head_empty(&rq->background))) return NULL;
+
+	t = ps_list_head_first_d(&rq->background, struct sl_thd_policy);
+	ps_list_rem_d(t);
+	ps_list_head_append_d(&rq->background, t);
+
+	return t;
+}
+
+void
+sl_mod_block(struct sl_thd_policy *t)
+{
+	edf_runqueue_rem(edf_runqueue(), t);
+}
+
+void
+sl_mod_wakeup(struct sl_thd_policy *t)
+{
+	assert(ps_list_singleton_d(t) && !t->deadline_idx);
+
+	edf_release(t, sl_now());
+	edf_runqueue_add(edf_runqueue(), t);
+}
+
+/* Yielding doesn't change a deadline, only the background round-robin order */
+void
+sl_mod_yield(struct sl_thd_policy *t, struct sl_thd_policy *yield_to)
+{
+	struct edf_runqueue *rq = edf_runqueue();
+
+	if (t->period) return;
+	edf_runqueue_rem(rq, t);
+	edf_runqueue_add(rq, t);
+}
+
+/* Deadlines order the periodic threads, only the background ones are round-robined */
+int
+sl_mod_thd_peers(struct sl_thd_policy *t)
+{
+	struct ps_list_head *l = &edf_runqueue()->background;
+
+	return !t->period && !ps_list_singleton_d(t) &&
+	       ps_list_head_first_d(l, struct sl_thd_policy) != ps_list_head_last_d(l, struct sl_thd_policy);
+}
+
+void
+sl_mod_thd_create(struct sl_thd_policy *t)
+{
+	t->priority     = TCAP_PRIO_MIN;
+	t->period       = 0;
+	t->period_usec  = 0;
+	t->deadline     = 0;
+	t->rel_deadline = 0;
+	t->deadline_idx = 0;
+	sl_thd_setprio(sl_mod_thd_get(t), edf_prio(t));
+	ps_list_init_d(t);
+}
+
+void
+sl_mod_thd_delete(struct sl_thd_policy *t)
+{ edf_runqueue_rem(edf_runqueue(), t); }
+
+void
+sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned int v)
+{
+	struct edf_runqueue *rq = edf_runqueue();
+
+	/* parameters can change which queue we're on, and our deadline */
+	edf_runqueue_rem(rq, t);
+
+	switch (type) {
+	case SCHEDP_PRIO:
+	{
+		/* the priority is derived from the deadline, but this makes us schedulable */
+		assert(v >= TCAP_PRIO_MAX);
+		break;
+	}
+	case SCHEDP_WINDOW:
+	{
+		assert(v >= SL_EDF_PERIOD_US_MIN);
+		t->period_usec = v;
+		t->period      = sl_usec2cyc(v);
+		edf_activate(t, sl_now());
+
+		break;
+	}
+	case SCHEDP_DEADLINE:
+	{
+		assert(v >= SL_EDF_PERIOD_US_MIN);
+		t->rel_deadline = sl_usec2cyc(v);
+		edf_activate(t, sl_now());
+
+		break;
+	}
+	case SCHEDP_BUDGET:
+	{
+		/* sl tracks the budget; a new one takes effect with a new activation */
+		assert(v);
+		edf_activate(t, sl_now());
+
+		break;
+	}
+	default: assert(0);
+	}
+
+	if (sl_thd_is_runnable(sl_mod_thd_get(t))) edf_runqueue_add(rq, t);
+}
+
+void
+sl_mod_init(void)
+{
+	struct edf_runqueue *rq = edf_runqueue();
+
+	memset(rq, 0, sizeof(struct edf_runqueue));
+	ps_list_head_init(&rq->background);
+	heap_init(&rq->deadlines, SL_MAX_NUM_THDS, edf_deadline_cmp, edf_deadline_update_idx);
+}
@@ -15,9 +15,15 @@
 #include "include/tcap.h"
 #include "include/chal/defs.h"
 #include "include/hw.h"
+#include "include/fpu.h"
 
 #define COS_DEFAULT_RET_CAP 0
 
+struct invstk_entry invstk_cache[NUM_CPU][THD_INVSTK_MAXSZ] CACHE_ALIGNED;
+u32_t asnd_gen;
+PERCPU_VAR(thdid_pool);
+unsigned long thdid_freemap[THDID_FREEMAP_WORDS];
+
 /*
  * TODO: switch to a dedicated TLB flush thread (in a separate
  * protection domain) to do this.
@@ -35,6 +41,31 @@ tlb_mandatory_flush(void *arg)
 	tlb_quiescence[get_cpuid()].last_mandatory_flush = t;
 }
 
+/*
+ * Timer interrupts flush the TLB every TLB_PERIODIC_FLUSH_US, so that
+ * unmapped frames quiesce (and can be reused) without explicit
+ * flushes. Everything unmapped before the oldest of the cores' last
+ * flushes has quiesced, which we cache in last_periodic_flush so that
+ * most checks only touch this core's cache-line.
+ */
+static void
+tlb_periodic_flush(void)
+{
+	struct tlb_quiescence *q = &tlb_quiescence[get_cpuid()];
+	u64_t                  now, oldest;
+	int                    i;
+
+	rdtscll(now);
+	if (now - q->last_mandatory_flush < (u64_t)TLB_PERIODIC_FLUSH_US * chal_cyc_usec()) return;
+	tlb_mandatory_flush(NULL);
+
+	oldest = q->last_mandatory_flush;
+	for (i = 0; i < NUM_CPU_COS; i++) {
+		if (tlb_quiescence[i].last_mandatory_flush < oldest) oldest = tlb_quiescence[i].last_mandatory_flush;
+	}
+	q->last_periodic_flush = oldest;
+}
+
 #define MAX_LEN 512
 extern char timer_detector[PAGE_SIZE] PAGE_ALIGNED;
 static inline int
@@ -331,6 +362,16 @@ cap_cpy(struct captbl *t, capid_t cap_to, capid_t capin_to, capid_t cap_from, ca
 		if (unlikely(!ctto)) return -ENOENT;
 		if (unlikely(ctto->type != cap_type)) return -EINVAL;
 		if (unlikely(((struct cap_pgtbl *)ctto)->refcnt_flags & CAP_MEM_FROZEN_FLAG)) return -EINVAL;
+
+		/* superpages are copied as a whole */
+		old_v = pgtbl_super_lkup(((struct cap_pgtbl *)ctfrom)->pgtbl, capin_from);
+		if (old_v) {
+			if ((capin_from | capin_to) & (SUPER_PAGE_SIZE - 1)) return -EINVAL;
+
+			return pgtbl_mapping_add(((struct cap_pgtbl *)ctto)->pgtbl, capin_to, old_v & PGTBL_FRAME_MASK,
+			                         old_v & PGTBL_FLAG_MASK);
+		}
+
 		f = pgtbl_lkup_pte(((struct cap_pgtbl *)ctfrom)->pgtbl, capin_from, &flags);
 		if (!f) return -ENOENT;
 		old_v = *f;
@@ -346,6 +387,76 @@ cap_cpy(struct captbl *t, capid_t cap_to, capid_t capin_to, capid_t cap_from, ca
 	return ret;
 }
 
+/*
+ * Copy the mappings for a range of up to npages pages from one pgtbl
+ * to another: the range analog of cap_cpy on pgtbls. At most
+ * PGTBL_CPY_RANGE_MAX mappings are copied to bound the time spent in
+ * the kernel, so user-level must loop over larger ranges.
+ *
+ * A superpage in the range is copied as a single mapping, thus must
+ * be superpage aligned in both pgtbls, and entirely within the range.
+ * The flags in flags_clear are removed from the copied mappings
+ * (e.g. PGTBL_WRITABLE to alias pages read-only).
+ *
+ * Returns the number of pages copied, or an error if the first page
+ * cannot be copied.
+ */
+static inline int
+cap_cpy_range(struct captbl *t, capid_t cap_to, vaddr_t addr_to, capid_t cap_from, vaddr_t addr_from,
+              unsigned long npages, u32_t flags_clear)
+{
+	struct cap_pgtbl *ctto, *ctfrom;
+	unsigned long     i, n;
+	int               ret = 0;
+
+	ctfrom = (struct cap_pgtbl *)captbl_lkup(t, cap_from);
+	if (unlikely(!ctfrom)) return -ENOENT;
+	if (unlikely(ctfrom->h.type != CAP_PGTBL)) return -EINVAL;
+	ctto = (struct cap_pgtbl *)captbl_lkup(t, cap_to);
+	if (unlikely(!ctto)) return -ENOENT;
+	if (unlikely(ctto->h.type != CAP_PGTBL)) return -EINVAL;
+	if (unlikely(ctto->refcnt_flags & CAP_MEM_FROZEN_FLAG)) return -EINVAL;
+	if (unlikely(npages == 0)) return -EINVAL;
+
+	for (i = 0, n = 0; i < npages && n < PGTBL_CPY_RANGE_MAX; n++) {
+		unsigned long *f, old_v;
+		u32_t          flags;
+
+		old_v = pgtbl_super_lkup(ctfrom->pgtbl, addr_from);
+		if (old_v) {
+			if ((addr_from | addr_to) & (SUPER_PAGE_SIZE - 1)) cos_throw(done, -EINVAL);
+			if (npages - i < SUPER_PAGE_NPAGES) cos_throw(done, -EINVAL);
+
+			ret = pgtbl_mapping_add(ctto->pgtbl, addr_to, old_v & PGTBL_FRAME_MASK,
+			                        old_v & PGTBL_FLAG_MASK & ~flags_clear);
+			if (ret) goto done;
+
+			i += SUPER_PAGE_NPAGES;
+			addr_from += SUPER_PAGE_SIZE;
+			addr_to += SUPER_PAGE_SIZE;
+			continue;
+		}
+
+		f = pgtbl_lkup_pte(ctfrom->pgtbl, addr_from, &flags);
+		if (!f) cos_throw(done, -ENOENT);
+		old_v = *f;
+
+		/* Cannot copy frame, or kernel entry. */
+		if ((old_v & PGTBL_COSFRAME) || !(old_v & PGTBL_USER)) cos_throw(done, -EPERM);
+		ret = pgtbl_mapping_add(ctto->pgtbl, addr_to, old_v & PGTBL_FRAME_MASK, flags & ~flags_clear);
+		if (ret) goto done;
+
+		i++;
+		addr_from += PAGE_SIZE;
+		addr_to += PAGE_SIZE;
+	}
+done:
+	/* partial progress is reported, and the error is returned by the next call */
+	if (i > 0) return i;
+
+	return ret;
+}
+
 static inline int
 cap_move(struct captbl *t, capid_t cap_to, capid_t capin_to, capid_t cap_from, capid_t capin_from)
 {
@@ -436,6 +547,7 @@ cap_thd_switch(struct pt_regs *regs, struct thread *curr, struct thread *next, s
 	}
 
 	thd_current_update(next, curr, cos_info);
+	fpu_switch(next);
 	if (likely(ci->pgtbl != next_ci->pgtbl)) pgtbl_update(next_ci->pgtbl);
 
 	/* Not sure of the trade-off here: Branch cost vs. segment register update */
@@ -682,12 +794,12 @@ cap_ipi_process(struct pt_regs *regs)
 	struct cos_cpu_local_info  *cos_info = cos_cpu_local_info();
 	struct IPI_receiving_rings *receiver_rings;
 	struct xcore_ring 	   *ring;
-	struct ipi_cap_data 	    data;
 	struct cap_arcv 	   *arcv;
 	struct thread 		   *thd_curr, *thd_next;
 	struct tcap 		   *tcap_curr, *tcap_next;
 	struct comp_info 	   *ci;
 	int                         i, scan_base;
+	u32_t                       j, n, total = 0;
 	unsigned long               ip, sp;
 
 	thd_curr       = thd_next = thd_current(cos_info);
@@ -699,29 +811,42 @@ cap_ipi_process(struct pt_regs *regs)
 	scan_base = receiver_rings->start;
 	receiver_rings->start = (receiver_rings->start + 1) % NUM_CPU;
 
-	/* We need to scan the entire buffer once. */
+	/*
+	 * Drain all of the source rings: senders only send an IPI
+	 * when their ring was empty, so this one interrupt is the
+	 * only notification of everything in the rings.
+	 */
 	for (i = 0; i < NUM_CPU; i++) {
 		struct thread *rcvthd  = NULL;
 		struct tcap   *rcvtcap = NULL;
 
 		ring = &receiver_rings->IPI_source[(scan_base + i) % NUM_CPU];
 
-		if (ring->sender == ring->receiver) continue;
-		while ((cos_ipi_ring_dequeue(ring, &data)) != 0) {
-			arcv = cos_ipi_arcv_get(&data);
-			assert(arcv);
+		while ((n = cos_ipi_ring_pending(ring)) != 0) {
+			for (j = 0; j < n; j++) {
+				struct ipi_cap_data *data = cos_ipi_ring_peek(ring, j);
 
-			rcvthd  = arcv->thd;
-			rcvtcap = rcvthd->rcvcap.rcvcap_tcap;
-			assert(rcvthd && rcvtcap);
+				arcv = cos_ipi_arcv_get(data);
+				assert(arcv);
 
-			/*
-			 * tcap_higher_prio (partial-order qualities) check for "highest" prio so far and the next
-			 * thread in the ring (dequeued item).
-			 */
-			thd_next = asnd_process(rcvthd, thd_next, rcvtcap, tcap_next, &tcap_next, 0, cos_info);
+				rcvthd  = arcv->thd;
+				rcvtcap = rcvthd->rcvcap.rcvcap_tcap;
+				assert(rcvthd && rcvtcap);
+				/* the asnds the sender coalesced while out of budget (asnd_process adds this one) */
+				thd_rcvcap_pending_add(rcvthd, data->cnt - 1);
+
+				/*
+				 * tcap_higher_prio (partial-order qualities) check for "highest" prio so far and the next
+				 * thread in the ring (dequeued item).
+				 */
+				thd_next = asnd_process(rcvthd, thd_next, rcvtcap, tcap_next, &tcap_next, 0, cos_info);
+			}
+			cos_ipi_ring_consume(ring, n);
+			total += n;
 		}
 	}
+	cos_ipi_stat_add(IPI_STAT_RCVD, 1);
+	cos_ipi_stat_add(IPI_STAT_DEQUEUED, total);
 
 	if (thd_next == thd_curr) return 1;
 	thd_curr->state |= THD_STATE_PREEMPTED;
@@ -882,6 +1007,8 @@ timer_process(struct pt_regs *regs)
 	assert(thd_curr && thd_curr->cpuid == get_cpuid());
 	comp = thd_invstk_current(thd_curr, &ip, &sp, cos_info);
 	assert(comp);
+	tlb_periodic_flush();
+	asnd_throttled_process();
 
 	return expended_process(regs, thd_curr, comp, cos_info, 1);
 }
@@ -1317,10 +1444,12 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 			break;
 		}
 		case CAPTBL_OP_ASNDACTIVATE: {
-			capid_t rcv_captbl = __userregs_get2(regs);
-			capid_t rcv_cap    = __userregs_get3(regs);
+			capid_t rcv_captbl = (__userregs_get2(regs) << 16) >> 16;
+			capid_t rcv_cap    = __userregs_get2(regs) >> 16;
+			u32_t   budget     = __userregs_get3(regs);
+			u32_t   period     = __userregs_get4(regs);
 
-			ret = asnd_activate(ct, cap, capin, rcv_captbl, rcv_cap, 0, 0);
+			ret = asnd_activate(ct, cap, capin, rcv_captbl, rcv_cap, budget, period);
 			break;
 		}
 		case CAPTBL_OP_ASNDDEACTIVATE: {
@@ -1380,6 +1509,16 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			break;
 		}
+		case CAPTBL_OP_SINV_BATCH: {
+			vaddr_t       addr = __userregs_get1(regs);
+			unsigned long n    = __userregs_get2(regs);
+
+			ret = sinv_batch_call(thd, ci, addr, n, regs, cos_info);
+			/* on success, registers are already set up for the upcall */
+			if (!ret) *thd_switch = 1;
+
+			break;
+		}
 		case CAPTBL_OP_HW_ACTIVATE: {
 			u32_t bitmap = __userregs_get2(regs);
 
@@ -1412,6 +1551,28 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			break;
 		}
+		case CAPTBL_OP_CPY_RANGE: {
+			capid_t       source_pt   = pt;
+			vaddr_t       source_addr = __userregs_get1(regs);
+			capid_t       dest_pt     = __userregs_get2(regs);
+			vaddr_t       dest_addr   = __userregs_get3(regs);
+			unsigned long npages      = __userregs_get4(regs);
+
+			ret = cap_cpy_range(ct, dest_pt, dest_addr, source_pt, source_addr, npages, 0);
+
+			break;
+		}
+		case CAPTBL_OP_CPY_RANGE_RO: {
+			capid_t       source_pt   = pt;
+			vaddr_t       source_addr = __userregs_get1(regs);
+			capid_t       dest_pt     = __userregs_get2(regs);
+			vaddr_t       dest_addr   = __userregs_get3(regs);
+			unsigned long npages      = __userregs_get4(regs);
+
+			ret = cap_cpy_range(ct, dest_pt, dest_addr, source_pt, source_addr, npages, PGTBL_WRITABLE);
+
+			break;
+		}
 		case CAPTBL_OP_MEMMOVE: {
 			/* Moves a mem frame to another pgtbl. Used to
 			 * grant frames to memory management
@@ -1452,6 +1613,16 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			break;
 		}
+		case CAPTBL_OP_MEMACTIVATE_SUPER: {
+			/* As above, for the contiguous frames of a superpage */
+			capid_t frame_cap = __userregs_get1(regs);
+			capid_t dest_pt   = __userregs_get2(regs);
+			vaddr_t vaddr     = __userregs_get3(regs);
+
+			ret = cap_memactivate_super(ct, (struct cap_pgtbl *)ch, frame_cap, dest_pt, vaddr);
+
+			break;
+		}
 		case CAPTBL_OP_MEMDEACTIVATE: {
 			vaddr_t      addr = __userregs_get1(regs);
 			livenessid_t lid  = __userregs_get2(regs);
@@ -1462,6 +1633,29 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 
 			break;
 		}
+		case CAPTBL_OP_MEM_QUIESCED: {
+			/* can the frame mapped at addr be reused without stale TLB entries? */
+			vaddr_t        addr = __userregs_get1(regs);
+			pgtbl_t        pt;
+			unsigned long *pte;
+			u32_t          flags, super;
+
+			if (((struct cap_pgtbl *)ch)->lvl) cos_throw(err, -EINVAL);
+			pt = ((struct cap_pgtbl *)ch)->pgtbl;
+
+			super = pgtbl_super_lkup(pt, addr);
+			if (super) {
+				ret = retypetbl_quiesced(
+				  (void *)((super & PGTBL_FRAME_MASK) + (addr & (SUPER_PAGE_SIZE - 1) & PGTBL_FRAME_MASK)));
+				break;
+			}
+			pte = pgtbl_lkup_pte(pt, addr, &flags);
+			if (!pte || (*pte & (PGTBL_PRESENT | PGTBL_COSFRAME)) != PGTBL_PRESENT) cos_throw(err, -EINVAL);
+
+			ret = retypetbl_quiesced((void *)(*pte & PGTBL_FRAME_MASK));
+
+			break;
+		}
 		case CAPTBL_OP_MEM_RETYPE2USER: {
 			vaddr_t frame_addr = __userregs_get1(regs);
 			paddr_t frame;
@@ -1700,6 +1894,18 @@ static int __attribute__((noinline)) composite_syscall_slowpath(struct pt_regs *
 			ret = 0;
 			break;
 		}
+		case CAPTBL_OP_HW_INVSTK_CACHE: {
+			unsigned long mode = __userregs_get1(regs);
+
+			ret = thd_invstk_cache_mode(thd, mode, cos_info);
+			break;
+		}
+		case CAPTBL_OP_HW_IPI_STATS: {
+			ipi_stat_t stat = __userregs_get1(regs);
+
+			ret = (int)cos_ipi_stat_get(stat);
+			break;
+		}
 		default:
 			goto err;
 		}
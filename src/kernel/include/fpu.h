@@ -1,24 +1,51 @@
 #ifndef FPU_H
 #define FPU_H
 
-#include "thread.h"
-
-#define FPU_DISABLED_MASK 0x8
+#include "per_cpu.h"
+#include "thd.h"
+
+#define FPU_DISABLED_MASK 0x8 /* cr0.TS: FPU instructions trap with device-not-available */
+#define FPU_CR0_MP (1 << 1)
+#define FPU_CR0_EM (1 << 2)
+#define FPU_CR4_OSFXSR (1 << 9)
+#define FPU_CR4_OSXMMEXCPT (1 << 10)
+#define FPU_CR4_OSXSAVE (1 << 18)
 #define FXSR (1 << 24)
 #define HAVE_SSE (1 << 25)
+/* cpuid.1:ecx */
+#define HAVE_XSAVE (1 << 26)
+#define HAVE_AVX (1 << 28)
+/* cpuid.(0xd, 1):eax */
+#define HAVE_XSAVEOPT (1 << 0)
+#define HAVE_XSAVEC (1 << 1)
+/* state components in xcr0, and the xsave header */
+#define XSTATE_X87 (1 << 0)
+#define XSTATE_SSE (1 << 1)
+#define XSTATE_AVX (1 << 2)
+#define XCOMP_BV_COMPACT (1ULL << 63)
 
 PERCPU_DECL(int, fpu_disabled);
 PERCPU_EXTERN(fpu_disabled);
 
-PERCPU_DECL(struct thread *, fpu_last_used);
-PERCPU_EXTERN(fpu_last_used);
-
 enum
 {
 	FPU_DISABLE = 0,
 	FPU_ENABLE  = 1
 };
 
+/*
+ * How the state is saved: the xsave variants only save the enabled
+ * components that are not in their initial configuration. xsaveopt
+ * also skips those that were not modified since the xrstor of the
+ * same area, and xsavec saves into the compacted format.
+ */
+typedef enum {
+	FPU_SAVE_FXSAVE,
+	FPU_SAVE_XSAVE,
+	FPU_SAVE_XSAVEOPT,
+	FPU_SAVE_XSAVEC
+} fpu_save_t;
+
 /* fucntions called outside */
 static inline int  fpu_init(void);
 static inline int  fpu_disabled_exception_handler(void);
@@ -39,6 +66,8 @@ static inline void          fpu_set(int);
 static inline int           fpu_get_info(void);
 static inline int           fpu_check_fxsr(void);
 static inline int           fpu_check_sse(void);
+static inline u32_t         fpu_xstate_mask(void);
+static inline fpu_save_t    fpu_save_type(void);
 
 #ifdef FPU_ENABLED
 static inline int
@@ -84,9 +113,60 @@ fpu_check_sse(void)
 	return sse_status;
 }
 
+static inline void
+fpu_cpuid(u32_t leaf, u32_t subleaf, u32_t *a, u32_t *b, u32_t *c, u32_t *d)
+{
+	asm volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(subleaf));
+}
+
+/* The state components we save: x87, SSE, and AVX if supported. 0 without xsave. */
+static inline u32_t
+fpu_xstate_mask(void)
+{
+	static u32_t mask = ~0;
+	u32_t        a, b, c, d;
+
+	if (unlikely(mask == (u32_t)~0)) {
+		fpu_cpuid(1, 0, &a, &b, &c, &d);
+		if (!(c & HAVE_XSAVE))   mask = 0;
+		else if (c & HAVE_AVX)   mask = XSTATE_X87 | XSTATE_SSE | XSTATE_AVX;
+		else                     mask = XSTATE_X87 | XSTATE_SSE;
+	}
+
+	return mask;
+}
+
+static inline fpu_save_t
+fpu_save_type(void)
+{
+	static int type = -1;
+	u32_t      a, b, c, d;
+
+	if (unlikely(type < 0)) {
+		type = FPU_SAVE_FXSAVE;
+		if (fpu_xstate_mask()) {
+			fpu_cpuid(0xd, 1, &a, &b, &c, &d);
+			/* prefer the modified optimization, then the compaction */
+			if (a & HAVE_XSAVEOPT)    type = FPU_SAVE_XSAVEOPT;
+			else if (a & HAVE_XSAVEC) type = FPU_SAVE_XSAVEC;
+			else                      type = FPU_SAVE_XSAVE;
+		}
+	}
+
+	return type;
+}
+
+static inline void
+fpu_xsetbv(u32_t xcr, u64_t val)
+{
+	asm volatile("xsetbv" : : "c"(xcr), "a"((u32_t)val), "d"((u32_t)(val >> 32)));
+}
+
 static inline int
 fpu_init(void)
 {
+	unsigned long cr0, cr4;
+	u32_t         a, b, c, d;
 #if FPU_SUPPORT_FXSR > 0
 	int fxsr = fpu_check_fxsr();
 	int fsse = fpu_check_sse();
@@ -106,6 +186,26 @@ fpu_init(void)
 	}
 #endif
 
+	/* use the FPU (not emulation), and trap on wait when it is disabled */
+	cr0 = (fpu_read_cr0() & ~FPU_CR0_EM) | FPU_CR0_MP;
+	asm volatile("mov %0, %%cr0" : : "r"(cr0));
+#if FPU_SUPPORT_FXSR > 0
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+	cr4 |= FPU_CR4_OSFXSR | FPU_CR4_OSXMMEXCPT;
+	if (fpu_xstate_mask()) cr4 |= FPU_CR4_OSXSAVE;
+	asm volatile("mov %0, %%cr4" : : "r"(cr4));
+
+	if (fpu_xstate_mask()) {
+		fpu_xsetbv(0, fpu_xstate_mask());
+		/* the size of the xsave area for the enabled components */
+		fpu_cpuid(0xd, 0, &a, &b, &c, &d);
+		if (b > __builtin_offsetof(struct cos_fpu, status)) {
+			printk("Core %d: xsave area of %d bytes is larger than struct cos_fpu.\n", get_cpuid(), b);
+			return -1;
+		}
+	}
+#endif
+
 	fpu_set(FPU_DISABLE);
 	*PERCPU_GET(fpu_disabled)  = 1;
 	*PERCPU_GET(fpu_last_used) = NULL;
@@ -115,19 +215,35 @@ fpu_init(void)
 	return 0;
 }
 
+/*
+ * The FPU is disabled unless the current thread's state is in it,
+ * so the first FPU instruction after switching to another thread
+ * traps here. Only then is the state of the thread that last used
+ * the FPU saved, and the current thread's restored.
+ */
 static inline int
 fpu_disabled_exception_handler(void)
 {
-	struct thread *curr_thd;
+	struct thread **last_used = PERCPU_GET(fpu_last_used);
+	struct thread  *curr_thd, *prev;
 
-	if ((curr_thd = cos_get_curr_thd()) == NULL) return 1;
+	if ((curr_thd = thd_current(cos_cpu_local_info())) == NULL) return 1;
 
 	assert(fpu_is_disabled());
+	fpu_enable();
+	/* read once: thd_deactivate on another core can clear it */
+	prev = *(struct thread * volatile *)last_used;
+	if (prev == curr_thd) return 0;
+
+	if (prev) fxsave(prev);
+	if (!fpu_thread_uses_fp(curr_thd)) {
+		fpu_thread_init(curr_thd);
+		curr_thd->fpu.status = 1;
+	}
+	fxrstor(curr_thd);
+	*last_used = curr_thd;
 
-	curr_thd->fpu.status = 1;
-	fpu_switch(curr_thd);
-
-	return 1;
+	return 0;
 }
 
 static inline void
@@ -138,42 +254,19 @@ fpu_thread_init(struct thread *thd)
 #if FPU_SUPPORT_SSE > 0
 	thd->fpu.mxcsr = 0x1f80;
 #endif
+	/* xstate_bv = 0: xrstor initializes all other components */
 	return;
 }
 
+/*
+ * Lazy switching: only enable the FPU if next's state is already in
+ * it. Otherwise, the state is switched if and when next uses the FPU.
+ */
 static inline int
 fpu_switch(struct thread *next)
 {
-	struct thread **last_used = PERCPU_GET(fpu_last_used);
-	/* if next thread doesn't use fpu, then we just disable the fpu */
-	if (!fpu_thread_uses_fp(next)) {
-		fpu_disable();
-		return 0;
-	}
-
-	fpu_enable();
-	/*
-	 * next thread uses fpu
-	 * if no thread used fpu before, then we set next thread as the fpu_last_used
-	 */
-	if (unlikely(*last_used == NULL)) goto store;
-
-	/*
-	 * next thread uses fpu
-	 * fpu_last_used exists
-	 * if fpu_last_used == next, then we simply re-enable the fpu for the thread
-	 */
-	if (*last_used == next) return 0;
-
-	/*
-	 * next thread uses fpu
-	 * fpu_last_used exists
-	 * if fpu_last_used != next, then we save current fpu states to fpu_last_used, restore next thread's fpu state
-	 */
-	fxsave(*last_used);
-store:
-	fxrstor(next);
-	*last_used = next;
+	if (*PERCPU_GET(fpu_last_used) == next) fpu_enable();
+	else                                     fpu_disable();
 
 	return 0;
 }
@@ -228,9 +321,13 @@ fpu_set(int status)
 {
 	unsigned long val, cr0;
 
+	if (status) {
+		/* clts is cheaper than writing cr0 */
+		asm volatile("clts");
+		return;
+	}
 	cr0 = fpu_read_cr0();
-	val = status ? (cr0 & ~FPU_DISABLED_MASK)
-	             : (cr0 | FPU_DISABLED_MASK); // ENABLE(status == 1) : DISABLE(status == 0)
+	val = cr0 | FPU_DISABLED_MASK;
 	asm volatile("mov %0, %%cr0" : : "r"(val));
 
 	return;
@@ -240,7 +337,21 @@ static inline void
 fxsave(struct thread *thd)
 {
 #if FPU_SUPPORT_FXSR > 0
-	asm volatile("fxsave %0" : "=m"(thd->fpu));
+	u32_t mask = fpu_xstate_mask();
+
+	switch (fpu_save_type()) {
+	case FPU_SAVE_XSAVEOPT:
+		asm volatile("xsaveopt %0" : "+m"(thd->fpu) : "a"(mask), "d"(0));
+		break;
+	case FPU_SAVE_XSAVEC:
+		asm volatile("xsavec %0" : "+m"(thd->fpu) : "a"(mask), "d"(0));
+		break;
+	case FPU_SAVE_XSAVE:
+		asm volatile("xsave %0" : "+m"(thd->fpu) : "a"(mask), "d"(0));
+		break;
+	default:
+		asm volatile("fxsave %0" : "=m"(thd->fpu));
+	}
 #else
 	asm volatile("fsave %0" : "=m"(thd->fpu));
 #endif
@@ -251,7 +362,11 @@ static inline void
 fxrstor(struct thread *thd)
 {
 #if FPU_SUPPORT_FXSR > 0
-	asm volatile("fxrstor %0" : : "m"(thd->fpu));
+	u32_t mask = fpu_xstate_mask();
+
+	/* xrstor handles both the standard and compacted formats */
+	if (mask) asm volatile("xrstor %0" : : "m"(thd->fpu), "a"(mask), "d"(0));
+	else      asm volatile("fxrstor %0" : : "m"(thd->fpu));
 #else
 	asm volatile("frstor %0" : : "m"(thd->fpu));
 #endif
@@ -334,6 +449,16 @@ fpu_check_sse(void)
 {
 	return 0;
 }
+static inline u32_t
+fpu_xstate_mask(void)
+{
+	return 0;
+}
+static inline fpu_save_t
+fpu_save_type(void)
+{
+	return FPU_SAVE_FXSAVE;
+}
 #endif
 
 #endif
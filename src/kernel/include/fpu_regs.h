@@ -2,6 +2,11 @@
 #define FPU_REGS_H
 
 
+/*
+ * The FPU/SIMD state of a thread. With XSAVE support, this is an
+ * XSAVE area: the legacy (fxsave) region, the xsave header, and the
+ * extended region for the AVX state, followed by our own data.
+ */
 struct cos_fpu {
 #ifdef FPU_ENABLED
 	u16_t cwd; /* Control Word */
@@ -35,8 +40,22 @@ struct cos_fpu {
 		u32_t padding1[12];
 		u32_t sw_reserved[12];
 	};
-	int status;
+
+	/* xsave header: the saved state components, and the format */
+	u64_t xstate_bv;
+	u64_t xcomp_bv;
+	u64_t xsave_reserved[6];
+
+	/* 16*16 bytes for the upper half of each YMM-reg (AVX) = 256 bytes: */
+	u32_t ymmh_space[64];
+
+	int status; /* has the thread used the FPU? */
 #endif
-} __attribute__((aligned(16)));
+} __attribute__((aligned(64)));
+
+/* The thread whose state is in the FPU, if any */
+struct thread;
+PERCPU_DECL(struct thread *, fpu_last_used);
+PERCPU_EXTERN(fpu_last_used);
 
 #endif
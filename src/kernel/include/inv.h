@@ -14,6 +14,7 @@
 
 #include "component.h"
 #include "thd.h"
+#include "retype_tbl.h"
 #include "chal/call_convention.h"
 
 struct cap_sinv {
@@ -30,16 +31,21 @@ struct cap_sret {
 
 struct cap_asnd {
 	struct cap_header h;
-	cpuid_t           cpuid, arcv_cpuid;
+	u16_t             cpuid, arcv_cpuid; /* cpuid_t, narrowed so that the asnd fits its slot */
 	u32_t             arcv_capid, arcv_epoch; /* identify receiver */
 	struct comp_info  comp_info;
 
-	/* deferrable server to rate-limit IPIs */
-	u32_t budget, period, replenish_amnt;
-	/* Following not used for now. */
-	/* u64_t replenish_time; 	   /\* time of last replenishment *\/ */
+	/* deferrable server to rate-limit IPIs: replenish_amnt asnds per period cycles */
+	u16_t budget, replenish_amnt;
+	u32_t period;
+	u64_t replenish_time; /* time of last replenishment */
+	u32_t gen;            /* unique to this asnd, even if its slot is reused */
+	unsigned long pending; /* asnds coalesced while out of budget, and the lock on both (word-aligned) */
 } __attribute__((packed));
 
+/* The source of the asnds' gens */
+extern u32_t asnd_gen;
+
 struct cap_arcv {
 	struct cap_header h;
 	struct comp_info  comp_info;
@@ -113,11 +119,110 @@ asnd_construct(struct cap_asnd *asndc, struct cap_arcv *arcvc, capid_t rcv_cap,
 	asndc->period         = period;
 	asndc->budget         = budget;
 	asndc->replenish_amnt = budget;
-	/* FIXME:  add rdtscll(asndc->replenish_time); */
+	asndc->pending        = 0;
+	asndc->gen            = (u32_t)cos_faa((int *)&asnd_gen, 1);
+	rdtscll(asndc->replenish_time);
 
 	return 0;
 }
 
+/*
+ * Deferrable server for cross-core asnds (0 period: unlimited). The
+ * budget is replenished once a period has passed since the last
+ * replenishment. Out of budget, asnds neither use the ring nor
+ * interrupt the receiving core: they are counted in pending, and
+ * delivered with the next asnd within budget, or by the timer once
+ * the budget is replenished (see asnd_throttled_process).
+ *
+ * An asnd capability can be used from any core, so its budget and
+ * pending asnds are only updated while holding ASND_PENDING_LOCKED,
+ * the high bit of pending.
+ */
+#define ASND_PENDING_LOCKED (1UL << 31)
+
+/* The capability is packed, but pending is at a word-aligned offset (see inv_init) */
+static inline unsigned long *
+asnd_pending_word(struct cap_asnd *asndc)
+{
+	return (unsigned long *)((char *)asndc + __builtin_offsetof(struct cap_asnd, pending));
+}
+
+static inline u32_t
+asnd_budget_lock(struct cap_asnd *asndc)
+{
+	unsigned long p;
+
+	while (1) {
+		p = asndc->pending & ~ASND_PENDING_LOCKED;
+		if (cos_cas(asnd_pending_word(asndc), p, p | ASND_PENDING_LOCKED) == CAS_SUCCESS) return p;
+	}
+}
+
+static inline void
+asnd_budget_unlock(struct cap_asnd *asndc, u32_t pending)
+{
+	cos_mem_fence();
+	asndc->pending = pending;
+}
+
+static inline u32_t
+asnd_pending(struct cap_asnd *asndc)
+{
+	return asndc->pending & ~ASND_PENDING_LOCKED;
+}
+
+/*
+ * Send n (1 for an asnd, 0 to only deliver the pending ones) asnds.
+ * Return the number of asnds that should be sent to the receiving
+ * core (including the pending ones), or 0 if they were coalesced. In
+ * that case, *throttled is set if they are the first pending asnds,
+ * which the timer should deliver.
+ */
+static inline u32_t
+asnd_budget_consume(struct cap_asnd *asndc, u32_t n, int *throttled)
+{
+	u64_t now;
+	u32_t p;
+
+	*throttled = 0;
+	if (likely(!asndc->period)) return n;
+
+	p = asnd_budget_lock(asndc) + n;
+	rdtscll(now);
+	if (now - asndc->replenish_time >= asndc->period) {
+		asndc->budget         = asndc->replenish_amnt;
+		asndc->replenish_time = now;
+	}
+	if (unlikely(asndc->budget == 0 || p == 0)) {
+		*throttled = (n && p == n);
+		asnd_budget_unlock(asndc, p);
+		return 0;
+	}
+	asndc->budget--;
+	asnd_budget_unlock(asndc, 0);
+
+	return p;
+}
+
+/*
+ * The asnds couldn't be sent after all: give back their budget, and
+ * make the pending ones pending again. Return 1 if they are the
+ * first pending asnds (as in asnd_budget_consume).
+ */
+static inline int
+asnd_budget_refund(struct cap_asnd *asndc, u32_t pending)
+{
+	u32_t p;
+
+	if (!asndc->period) return 0;
+
+	p = asnd_budget_lock(asndc);
+	asndc->budget++;
+	asnd_budget_unlock(asndc, p + pending);
+
+	return !p && pending;
+}
+
 static int
 asnd_activate(struct captbl *t, capid_t cap, capid_t capin, capid_t rcv_captbl, capid_t rcv_cap, u32_t budget,
               u32_t period)
@@ -127,6 +232,8 @@ asnd_activate(struct captbl *t, capid_t cap, capid_t capin, capid_t rcv_captbl,
 	struct cap_arcv *  arcvc;
 	int                ret;
 
+	if (unlikely(budget > 0xFFFF || (period && !budget))) return -EINVAL;
+
 	rcv_ct = (struct cap_captbl *)captbl_lkup(t, rcv_captbl);
 	if (unlikely(!rcv_ct || rcv_ct->h.type != CAP_CAPTBL)) return -EINVAL;
 
@@ -276,13 +383,15 @@ arcv_introspect(struct cap_arcv *r, unsigned long op, unsigned long *retval)
 
 /*
  * Invocation (call and return) fast path.  We want this to be as
- * optimized as possible.  The only two optimizations not yet
- * performed are 1) to cache the invocation stack pointer with the
- * thread id to avoid that cache-line access, and 2) to cache the
- * entire invocation stack on the kernel stack.  Option 1. represents
- * a more practical amount of caching.  Both require consistency
- * between the thread structure and the cached contents to be achieved
- * on context switches.
+ * optimized as possible.  Two levels of caching are available, and
+ * selected per-core with the invstk_cache_t mode: 1)
+ * INVSTK_CACHE_TOP caches the invocation stack pointer with the
+ * thread id (in the cos_cpu_local_info) to avoid that cache-line
+ * access, and 2) INVSTK_CACHE_FULL additionally caches the entire
+ * invocation stack in core-local memory.  Option 1. represents a more
+ * practical amount of caching.  Both require consistency between the
+ * thread structure and the cached contents which is achieved on
+ * context switches in thd_current_update.
  */
 
 static inline void
@@ -315,12 +424,139 @@ sinv_call(struct thread *thd, struct cap_sinv *sinvc, struct pt_regs *regs, stru
 
 	/* TODO: test this before pgtbl update...pre- vs. post-serialization */
 	__userregs_sinvupdate(regs);
-	__userregs_set(regs, thd->tid | (get_cpuid() << 16), sinvc->token,
-	               sinvc->entry_addr);
+	__userregs_set(regs, thd_invstk_thdid(thd, cos_info), sinvc->token, sinvc->entry_addr);
 
 	return;
 }
 
+/*
+ * Batched invocations.  A client passes an array of (sinv cap, args)
+ * descriptors, and the kernel invokes each of them in turn.  When a
+ * server returns from one invocation in the batch, instead of
+ * returning to the client, the kernel directly upcalls into the
+ * server of the next invocation.  Consecutive invocations of the
+ * same server thus avoid both the return to the client and the
+ * page-table switches.  The batch records the index of the client's
+ * invocation stack entry, so that the return path detects the
+ * returns to the batch from kernel state alone (the saved sp is the
+ * client's, thus untrusted).
+ */
+
+/* Start the invocation at index thd->inv_batch.curr, with pgtbl as the currently active page-table */
+static inline int
+__sinv_batch_next(struct thread *thd, struct comp_info *ci, struct pt_regs *regs, unsigned long ip, unsigned long sp,
+                  pgtbl_t pgtbl, struct cos_cpu_local_info *cos_info)
+{
+	struct inv_batch *         b = &thd->inv_batch;
+	struct cos_sinv_batch_ent *e = &b->ents[b->curr];
+	struct cap_sinv *          sinvc;
+
+	sinvc = (struct cap_sinv *)captbl_lkup(ci->captbl, e->sinv);
+	if (unlikely(!CAP_TYPECHK(sinvc, CAP_SINV) || !ltbl_isalive(&sinvc->comp_info.liveness))) {
+		e->rets[0] = -EINVAL;
+		return -EINVAL;
+	}
+	b->frame = curr_invstk_top(cos_info);
+	if (unlikely(thd_invstk_push(thd, &sinvc->comp_info, ip, sp, cos_info))) {
+		e->rets[0] = -ENOMEM;
+		return -ENOMEM;
+	}
+	if (sinvc->comp_info.pgtbl != pgtbl) pgtbl_update(sinvc->comp_info.pgtbl);
+	b->pgtbl = sinvc->comp_info.pgtbl;
+
+	__userregs_setinvargs(regs, e->args[0], e->args[1], e->args[2], e->args[3]);
+	__userregs_set(regs, thd_invstk_thdid(thd, cos_info), sinvc->token, sinvc->entry_addr);
+
+	return 0;
+}
+
+/* Release the reference on the frame holding the descriptors */
+static inline void
+__sinv_batch_end(struct inv_batch *b)
+{
+	void *pa = (void *)chal_va2pa((void *)round_to_page(b->ents));
+
+	while (retypetbl_deref(pa) == -ECASFAIL)
+		;
+	b->ents = NULL;
+}
+
+/*
+ * Begin a batch of n invocations described at the user-level address
+ * addr in the current component.  On success, the registers are set
+ * up to upcall into the first server.  The client receives the
+ * number of successfully completed invocations when the batch is
+ * done.  The kernel accesses the descriptors through its own mapping
+ * of their frame, so it holds a reference on the frame until the
+ * batch is done, which keeps the frame from being retyped (and
+ * reused) even if the client unmaps it meanwhile.
+ */
+static int
+sinv_batch_call(struct thread *thd, struct comp_info *ci, vaddr_t addr, unsigned long n, struct pt_regs *regs,
+                struct cos_cpu_local_info *cos_info)
+{
+	struct inv_batch *b = &thd->inv_batch;
+	unsigned long     off = addr & ~PAGE_MASK;
+	void *            page;
+	u32_t             flags;
+	int               ret;
+
+	if (unlikely(b->ents)) return -EBUSY;
+	if (unlikely(n == 0 || n > COS_SINV_BATCH_MAX)) return -EINVAL;
+	if (unlikely(off % sizeof(word_t) || off + n * sizeof(struct cos_sinv_batch_ent) > PAGE_SIZE)) return -EINVAL;
+
+	page = pgtbl_lkup(ci->pgtbl, round_to_page(addr), &flags);
+	if (unlikely(!page || (flags & (PGTBL_PRESENT | PGTBL_USER | PGTBL_WRITABLE))
+	                        != (PGTBL_PRESENT | PGTBL_USER | PGTBL_WRITABLE))) {
+		return -EINVAL;
+	}
+	ret = retypetbl_ref((void *)chal_va2pa(page));
+	if (unlikely(ret)) return ret;
+
+	b->ents = (struct cos_sinv_batch_ent *)((char *)page + off);
+	b->n    = n;
+	b->curr = 0;
+	ret     = __sinv_batch_next(thd, ci, regs, __userregs_getip(regs), __userregs_getsp(regs), ci->pgtbl, cos_info);
+	if (unlikely(ret)) __sinv_batch_end(b);
+
+	return ret;
+}
+
+/* Is the (popped) top of the invocation stack the client of an active batch? */
+static inline int
+sinv_batch_returning(struct thread *thd, struct cos_cpu_local_info *cos_info)
+{
+	struct inv_batch *b = &thd->inv_batch;
+
+	return b->ents && curr_invstk_top(cos_info) == b->frame;
+}
+
+/*
+ * A server returned from an invocation in the batch.  ci, ip and sp
+ * are those of the client that initiated the batch.
+ */
+static void
+sinv_batch_ret(struct thread *thd, struct comp_info *ci, struct pt_regs *regs, unsigned long ip, unsigned long sp,
+               struct cos_cpu_local_info *cos_info)
+{
+	struct inv_batch *         b = &thd->inv_batch;
+	struct cos_sinv_batch_ent *e;
+
+	assert(b->ents);
+	e          = &b->ents[b->curr];
+	e->rets[0] = __userregs_getinvret(regs);
+	e->rets[1] = __userregs_get2(regs);
+	e->rets[2] = __userregs_get3(regs);
+	b->curr++;
+
+	if (b->curr < b->n && !__sinv_batch_next(thd, ci, regs, ip, sp, b->pgtbl, cos_info)) return;
+
+	/* batch done, or the next invocation failed: return to the client */
+	__sinv_batch_end(b);
+	pgtbl_update(ci->pgtbl);
+	__userregs_set(regs, b->curr, sp, ip);
+}
+
 static inline void
 sret_ret(struct thread *thd, struct pt_regs *regs, struct cos_cpu_local_info *cos_info)
 {
@@ -340,6 +576,11 @@ sret_ret(struct thread *thd, struct pt_regs *regs, struct cos_cpu_local_info *co
 		return;
 	}
 
+	if (unlikely(sinv_batch_returning(thd, cos_info))) {
+		sinv_batch_ret(thd, ci, regs, ip, sp, cos_info);
+		return;
+	}
+
 	pgtbl_update(ci->pgtbl);
 	/* Set return sp and ip and function return value in eax */
 	__userregs_set(regs, __userregs_getinvret(regs), sp, ip);
@@ -359,6 +600,7 @@ inv_init(void)
 	assert(sizeof(struct cap_sinv) <= __captbl_cap2bytes(CAP_SINV));
 	assert(sizeof(struct cap_sret) <= __captbl_cap2bytes(CAP_SRET));
 	assert(sizeof(struct cap_asnd) <= __captbl_cap2bytes(CAP_ASND));
+	assert(__builtin_offsetof(struct cap_asnd, pending) % sizeof(unsigned long) == 0);
 	assert(sizeof(struct cap_arcv) <= __captbl_cap2bytes(CAP_ARCV));
 }
 
@@ -14,15 +14,16 @@
 #include "shared/cos_types.h"
 
 /*
- * Ring size should be power of 2
+ * Ring size is a power of 2, set by IPI_RING_ORDER (cos_config.h).
  * We have N*N rings (N= # of cpus).
  */
-#define IPI_RING_SIZE (16)
-#define IPI_RING_MASK (IPI_RING_SIZE - 1);
+#define IPI_RING_SIZE (1 << IPI_RING_ORDER)
+#define IPI_RING_MASK (IPI_RING_SIZE - 1)
 
 struct ipi_cap_data {
 	capid_t          arcv_capid;
 	capid_t          arcv_epoch;
+	u32_t            cnt; /* asnds delivered by this entry */
 	struct comp_info comp_info;
 };
 
@@ -50,20 +51,85 @@ struct IPI_receiving_rings {
 
 struct IPI_receiving_rings IPI_cap_dest[NUM_CPU] CACHE_ALIGNED;
 
+/* Per-core counters (ipi_stat_t), only updated by their own core */
+struct ipi_stats {
+	unsigned long cnt[IPI_STAT_NTYPES];
+} CACHE_ALIGNED;
+
+struct ipi_stats ipi_stats[NUM_CPU] CACHE_ALIGNED;
+
+static inline void
+cos_ipi_stat_add(ipi_stat_t s, unsigned long n)
+{
+	ipi_stats[get_cpuid()].cnt[s] += n;
+}
+
+/*
+ * The rate-limited asnds that have been coalesced on this core, and
+ * that the timer delivers once their budget is replenished (see
+ * asnd_throttled_process), as they might not be sent again. Past
+ * ASND_THROTTLED_MAX, the pending asnds are only delivered with the
+ * next asnd within budget. The capability might be deactivated, and
+ * its slot reused by another asnd, while it is in the list, so the
+ * entries record its gen, and are only used if it is unchanged.
+ */
+#define ASND_THROTTLED_MAX 32
+
+struct asnd_throttled {
+	struct {
+		struct cap_asnd *asnd;
+		u32_t            gen;
+	} ents[ASND_THROTTLED_MAX];
+	u32_t n;
+} CACHE_ALIGNED;
+
+struct asnd_throttled asnd_throttled[NUM_CPU] CACHE_ALIGNED;
+
+static inline void
+asnd_throttled_add(struct cap_asnd *asnd)
+{
+	struct asnd_throttled *t = &asnd_throttled[get_cpuid()];
+
+	if (unlikely(t->n == ASND_THROTTLED_MAX)) return;
+	t->ents[t->n].asnd  = asnd;
+	t->ents[t->n].gen   = asnd->gen;
+	t->n++;
+}
+
+static inline unsigned long
+cos_ipi_stat_get(ipi_stat_t s)
+{
+	if (unlikely(s >= IPI_STAT_NTYPES)) return 0;
+
+	return ipi_stats[get_cpuid()].cnt[s];
+}
+
+/*
+ * The receiver processes a batch of entries in place (the sender
+ * cannot reuse their slots until they are consumed), then consumes
+ * them all with a single update of receiver. The fence orders that
+ * update before the next read of sender, which pairs with the fence
+ * in cos_ipi_ring_enqueue: either the receiver sees a new entry, or
+ * the sender sees the ring drained, and sends an IPI.
+ */
 static inline u32_t
-cos_ipi_ring_dequeue(struct xcore_ring *ring, struct ipi_cap_data *ret)
+cos_ipi_ring_pending(struct xcore_ring *ring)
 {
-	/* printk("core %d ring : %x, sender %d, receiver %d\n", get_cpuid(), ring, ring->sender.tail,
-	 * ring->receiver.head); */
+	return (ring->sender - ring->receiver) & IPI_RING_MASK;
+}
 
-	if (ring->sender == ring->receiver) return 0;
-	memcpy(ret, &ring->ring[ring->receiver], sizeof(struct ipi_cap_data));
+static inline struct ipi_cap_data *
+cos_ipi_ring_peek(struct xcore_ring *ring, u32_t off)
+{
+	return &ring->ring[(ring->receiver + off) & IPI_RING_MASK];
+}
 
-	ring->receiver = (ring->receiver + 1) & IPI_RING_MASK;
+static inline void
+cos_ipi_ring_consume(struct xcore_ring *ring, u32_t n)
+{
+	ring->receiver = (ring->receiver + n) & IPI_RING_MASK;
 
 	cos_mem_fence();
-
-	return 1;
 }
 
 static inline struct cap_arcv *
@@ -89,8 +155,14 @@ process_ring(struct xcore_ring *ring)
 	return;
 }
 
+/*
+ * Return 1 if the ring was drained by the receiver before this entry
+ * (thus an IPI is required), 0 if the receiver is yet to process
+ * previous entries (thus will see this one), and -EBUSY if the ring
+ * is full.
+ */
 static inline int
-cos_ipi_ring_enqueue(u32_t dest, struct cap_asnd *asnd)
+cos_ipi_ring_enqueue(u32_t dest, struct cap_asnd *asnd, u32_t cnt)
 {
 	struct xcore_ring *  ring;
 	u32_t                tail;
@@ -108,26 +180,93 @@ cos_ipi_ring_enqueue(u32_t dest, struct cap_asnd *asnd)
 
 	data->arcv_capid = asnd->arcv_capid;
 	data->arcv_epoch = asnd->arcv_epoch;
+	data->cnt        = cnt;
 	memcpy(&data->comp_info, &asnd->comp_info, sizeof(struct comp_info));
 
 	ring->sender = delta;
 
 	cos_mem_fence();
 
-	return 0;
+	return ring->receiver == tail;
 }
 
+/*
+ * Only send an IPI when the ring goes from empty to non-empty: while
+ * there are pending entries, an IPI is already on its way, and its
+ * processing will drain this entry as well. The budget of the cnt
+ * asnds (n of which are new) has been taken, and is given back if
+ * the ring is full.
+ */
 static int
-cos_cap_send_ipi(int cpu, struct cap_asnd *asnd)
+cos_ipi_asnd_enqueue(int cpu, struct cap_asnd *asnd, u32_t cnt, u32_t n)
 {
 	int ret;
 
-	ret = cos_ipi_ring_enqueue(cpu, asnd);
-	if (unlikely(ret)) return ret;
+	ret = cos_ipi_ring_enqueue(cpu, asnd, cnt);
+	if (unlikely(ret < 0)) {
+		if (asnd_budget_refund(asnd, cnt - n)) asnd_throttled_add(asnd);
+		if (ret == -EBUSY) cos_ipi_stat_add(IPI_STAT_ENQ_FAIL, 1);
+		return ret;
+	}
+	if (!ret) {
+		cos_ipi_stat_add(IPI_STAT_COALESCED, 1);
+		return 0;
+	}
 
+	cos_ipi_stat_add(IPI_STAT_SENT, 1);
 	chal_send_ipi(cpu);
 
 	return 0;
 }
 
+/*
+ * Asnds beyond the asnd's rate-limit budget don't touch the ring at
+ * all (see asnd_budget_consume).
+ */
+static int
+cos_cap_send_ipi(int cpu, struct cap_asnd *asnd)
+{
+	u32_t cnt;
+	int   throttled;
+
+	cnt = asnd_budget_consume(asnd, 1, &throttled);
+	if (!cnt) {
+		if (throttled) asnd_throttled_add(asnd);
+		cos_ipi_stat_add(IPI_STAT_RATELIMIT, 1);
+		return 0;
+	}
+
+	return cos_ipi_asnd_enqueue(cpu, asnd, cnt, 1);
+}
+
+/*
+ * Called by the timer to deliver the asnds pending on the asnds
+ * throttled on this core, once their budget is replenished. An asnd
+ * is forgotten once its pending asnds are delivered (by whichever
+ * core), or if its capability was deactivated (or its slot reused).
+ */
+static void
+asnd_throttled_process(void)
+{
+	struct asnd_throttled *t = &asnd_throttled[get_cpuid()];
+	u32_t                  i = 0, cnt;
+	int                    throttled, retry;
+
+	while (i < t->n) {
+		struct cap_asnd *asnd = t->ents[i].asnd;
+
+		if (likely(asnd->h.type == CAP_ASND && asnd->gen == t->ents[i].gen)) {
+			cnt = asnd_budget_consume(asnd, 0, &throttled);
+			if (cnt) retry = cos_ipi_asnd_enqueue(asnd->arcv_cpuid, asnd, cnt, 0) != 0;
+			else     retry = asnd_pending(asnd) != 0;
+			if (retry) {
+				/* out of budget, or ring full: try again on the next tick */
+				i++;
+				continue;
+			}
+		}
+		t->ents[i] = t->ents[--t->n];
+	}
+}
+
 #endif /* IPI_CAP_H */
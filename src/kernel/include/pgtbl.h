@@ -47,8 +47,11 @@ typedef enum {
 #define PGTBL_DEPTH 2
 #define PGTBL_ORD 10
 
+/* Timer interrupts flush the TLB at most this often (see tlb_periodic_flush) */
+#define TLB_PERIODIC_FLUSH_US 1000
+
 struct tlb_quiescence {
-	/* Updated by timer. */
+	/* Updated by timer: the oldest of the cores' last flushes. */
 	u64_t last_periodic_flush;
 	/* Updated by tlb flush IPI. */
 	u64_t last_mandatory_flush;
@@ -83,9 +86,12 @@ __pgtbl_get(struct ert_intern *a, void *accum, int isleaf)
 static int
 __pgtbl_isnull(struct ert_intern *a, void *accum, int isleaf)
 {
-	(void)isleaf;
+	u32_t v = (u32_t)(a->next);
+
 	(void)accum;
-	return !(((u32_t)(a->next)) & (PGTBL_PRESENT | PGTBL_COSFRAME));
+	/* a superpage maps the memory directly: there is no pte page to walk */
+	if (!isleaf && (v & PGTBL_SUPER)) return 1;
+	return !(v & (PGTBL_PRESENT | PGTBL_COSFRAME));
 }
 static void
 __pgtbl_init(struct ert_intern *a, int isleaf)
@@ -137,6 +143,8 @@ __pgtbl_set(struct ert_intern *a, void *v, void *accum, int isleaf)
 	assert(!isleaf);
 
 	old = (u32_t)a->next;
+	/* never replace a superpage mapping with a pte page */
+	if (unlikely(old & PGTBL_SUPER)) return -EEXIST;
 	new = (u32_t)chal_va2pa((void *)((u32_t)v & PGTBL_FRAME_MASK)) | PGTBL_INTERN_DEF;
 
 	if (!cos_cas((unsigned long *)&a->next, old, new)) return -ECASFAIL;
@@ -182,10 +190,40 @@ pgtbl_init_pte(void *pte)
 	for (i = 0; i < (1 << PGTBL_ORD); i++) vals[i] = 0;
 }
 
+extern struct tlb_quiescence tlb_quiescence[NUM_CPU] CACHE_ALIGNED;
+
+int tlb_quiescence_check(u64_t timestamp);
+int tlb_quiescence_poll(u64_t timestamp);
+
+
+static inline int
+pgtbl_quie_check(u32_t orig_v)
+{
+	livenessid_t lid;
+	u64_t        ts;
+
+	if (orig_v & PGTBL_QUIESCENCE) {
+		lid = orig_v >> PGTBL_PAGEIDX_SHIFT;
+		/* An unmap happened at this vaddr before. We need to
+		 * make sure that all cores have done tlb flush before
+		 * creating new mapping. */
+		assert(lid < LTBL_ENTS);
+
+		if (ltbl_get_timestamp(lid, &ts)) return -EFAULT;
+		if (!tlb_quiescence_check(ts)) {
+			printk("kern tsc %llu, lid %d, last flush %llu\n", ts, lid,
+			       tlb_quiescence[get_cpuid()].last_periodic_flush);
+			return -EQUIESCENCE;
+		}
+	}
+
+	return 0;
+}
+
 static int
 pgtbl_intern_expand(pgtbl_t pt, u32_t addr, void *pte, u32_t flags)
 {
-	unsigned long accum = (unsigned long)flags;
+	unsigned long accum = (unsigned long)flags, *pgd;
 	int           ret;
 
 	/* NOTE: flags currently ignored. */
@@ -195,7 +233,13 @@ pgtbl_intern_expand(pgtbl_t pt, u32_t addr, void *pte, u32_t flags)
 	assert((PGTBL_FRAME_MASK & flags) == 0);
 
 	if (!pte) return -EINVAL;
-	ret = __pgtbl_expandn(pt, (unsigned long)(addr >> PGTBL_PAGEIDX_SHIFT), PGTBL_DEPTH, &accum, &pte, NULL);
+	/* the pgd entry maps a superpage */
+	pgd = __pgtbl_lkupan((pgtbl_t)((u32_t)pt | PGTBL_PRESENT), addr >> PGTBL_PAGEIDX_SHIFT, 1, &accum);
+	if (pgd && (*pgd & PGTBL_SUPER)) return -EEXIST;
+	/* ...or did, and the TLBs might still cache it */
+	if (pgd && (ret = pgtbl_quie_check(*pgd))) return ret;
+	accum = (unsigned long)flags;
+	ret   = __pgtbl_expandn(pt, (unsigned long)(addr >> PGTBL_PAGEIDX_SHIFT), PGTBL_DEPTH, &accum, &pte, NULL);
 	if (!ret && pte) return -EEXIST; /* no need to expand */
 	assert(!(ret && !pte));          /* error and used memory??? */
 
@@ -241,38 +285,60 @@ pgtbl_check_pgd_absent(pgtbl_t pt, u32_t addr)
 	return __pgtbl_isnull(pgtbl_get_pgd(pt, (u32_t)addr), 0, 0);
 }
 
-extern struct tlb_quiescence tlb_quiescence[NUM_CPU] CACHE_ALIGNED;
+/*
+ * The pgd entry for addr if it maps a user superpage, 0 otherwise.
+ * The kernel's superpages are not PGTBL_USER.
+ */
+static u32_t
+pgtbl_super_lkup(pgtbl_t pt, u32_t addr)
+{
+	struct ert_intern *pgd = pgtbl_get_pgd(pt, addr);
+	u32_t              v;
 
-int tlb_quiescence_check(u64_t timestamp);
+	if (!pgd) return 0;
+	v = (u32_t)pgd->next;
+	if ((v & (PGTBL_PRESENT | PGTBL_SUPER | PGTBL_USER)) != (PGTBL_PRESENT | PGTBL_SUPER | PGTBL_USER)) return 0;
 
+	return v;
+}
 
-static inline int
-pgtbl_quie_check(u32_t orig_v)
+/*
+ * Map the SUPER_PAGE_NPAGES frames starting at page with a single
+ * pgd entry. The pgd entry must not have a pte page, and each of the
+ * frames is referenced.
+ */
+static int
+pgtbl_super_mapping_add(pgtbl_t pt, u32_t addr, u32_t page, u32_t flags)
 {
-	livenessid_t lid;
-	u64_t        ts;
+	int                ret;
+	struct ert_intern *pgd;
+	u32_t              orig_v;
 
-	if (orig_v & PGTBL_QUIESCENCE) {
-		lid = orig_v >> PGTBL_PAGEIDX_SHIFT;
-		/* An unmap happened at this vaddr before. We need to
-		 * make sure that all cores have done tlb flush before
-		 * creating new mapping. */
-		assert(lid < LTBL_ENTS);
+	if ((addr | page) & (SUPER_PAGE_SIZE - 1)) return -EINVAL;
 
-		if (ltbl_get_timestamp(lid, &ts)) return -EFAULT;
-		if (!tlb_quiescence_check(ts)) {
-			printk("kern tsc %llu, lid %d, last flush %llu\n", ts, lid,
-			       tlb_quiescence[get_cpuid()].last_periodic_flush);
-			return -EQUIESCENCE;
-		}
-	}
+	pgd = pgtbl_get_pgd(pt, addr);
+	if (!pgd) return -ENOENT;
+	orig_v = (u32_t)(pgd->next);
 
-	return 0;
+	/* either a superpage, or a pte page is already here */
+	if (orig_v & PGTBL_PRESENT) return -EEXIST;
+	if (orig_v & PGTBL_COSFRAME) return -EPERM;
+
+	ret = pgtbl_quie_check(orig_v);
+	if (ret) return ret;
+
+	ret = retypetbl_ref_n((void *)page, SUPER_PAGE_NPAGES);
+	if (ret) return ret;
+
+	ret = __pgtbl_update_leaf(pgd, (void *)(page | flags | PGTBL_SUPER), orig_v);
+	if (ret) retypetbl_deref_n((void *)page, SUPER_PAGE_NPAGES);
+
+	return ret;
 }
 
 /*
  * this works on both kmem and regular user memory: the retypetbl_ref
- * works on both.
+ * works on both. PGTBL_SUPER in flags maps a superpage.
  */
 static int
 pgtbl_mapping_add(pgtbl_t pt, u32_t addr, u32_t page, u32_t flags)
@@ -285,6 +351,8 @@ pgtbl_mapping_add(pgtbl_t pt, u32_t addr, u32_t page, u32_t flags)
 	assert((PGTBL_FLAG_MASK & page) == 0);
 	assert((PGTBL_FRAME_MASK & flags) == 0);
 
+	if (flags & PGTBL_SUPER) return pgtbl_super_mapping_add(pt, addr, page, flags);
+
 	/* get the pte */
 	pte = (struct ert_intern *)__pgtbl_lkupan((pgtbl_t)((u32_t)pt | PGTBL_PRESENT), addr >> PGTBL_PAGEIDX_SHIFT,
 	                                          PGTBL_DEPTH, &accum);
@@ -399,6 +467,7 @@ pgtbl_mapping_del(pgtbl_t pt, u32_t addr, u32_t liv_id)
 	int                ret;
 	struct ert_intern *pte;
 	unsigned long      orig_v, accum = 0;
+	int                super;
 
 	assert(pt);
 	assert((PGTBL_FLAG_MASK & addr) == 0);
@@ -406,13 +475,31 @@ pgtbl_mapping_del(pgtbl_t pt, u32_t addr, u32_t liv_id)
 	/* In pgtbl, we have only 20bits for liv id. */
 	if (unlikely(liv_id >= (1 << (32 - PGTBL_PAGEIDX_SHIFT)))) return -EINVAL;
 
+	/* a superpage is only unmapped as a whole */
+	super = pgtbl_super_lkup(pt, addr) != 0;
+	if (unlikely(super && (addr & (SUPER_PAGE_SIZE - 1)))) return -EINVAL;
+
 	/* Liveness tracking of the unmapping VAS. */
 	ret = ltbl_timestamp_update(liv_id);
 	if (unlikely(ret)) goto done;
 
+	if (super) {
+		pte    = pgtbl_get_pgd(pt, addr);
+		orig_v = (u32_t)(pte->next);
+		/* raced with another unmap */
+		if ((orig_v & (PGTBL_PRESENT | PGTBL_SUPER)) != (PGTBL_PRESENT | PGTBL_SUPER)) return -EEXIST;
+
+		ret = __pgtbl_update_leaf(pte, (void *)((liv_id << PGTBL_PAGEIDX_SHIFT) | PGTBL_QUIESCENCE), orig_v);
+		if (ret) cos_throw(done, ret);
+
+		ret = retypetbl_deref_n((void *)(orig_v & PGTBL_FRAME_MASK), SUPER_PAGE_NPAGES);
+		goto done;
+	}
+
 	/* get the pte */
 	pte    = (struct ert_intern *)__pgtbl_lkupan((pgtbl_t)((u32_t)pt | PGTBL_PRESENT), addr >> PGTBL_PAGEIDX_SHIFT,
                                                   PGTBL_DEPTH, &accum);
+	if (!pte) return -ENOENT;
 	orig_v = (u32_t)(pte->next);
 	if (!(orig_v & PGTBL_PRESENT)) return -EEXIST;
 	if (orig_v & PGTBL_COSFRAME) return -EPERM;
@@ -518,10 +605,35 @@ extern unsigned long __cr3_contents;
 #define UPDATE_LINUX_MM_STRUCT
 #endif
 
+/*
+ * Unconditionally load the page-table, flushing all non-global TLB
+ * entries.  Only for use before the cos_cpu_local_info is
+ * initialized; use pgtbl_update otherwise.
+ */
+static inline void
+__pgtbl_load(pgtbl_t pt)
+{
+	asm volatile("mov %0, %%cr3" : : "r"(pt) : "memory");
+}
+
+/*
+ * Switch to the page-table pt.  Tagging TLB entries with an address
+ * space id (PCIDs) requires IA-32e paging, so on x86-32 every cr3
+ * load flushes the (non-global) TLB.  The best we can do is to avoid
+ * the flush when the page-table is already active on this core
+ * (e.g. invocations between components that share a page-table, or
+ * thread switches within a component).  This is safe w.r.t. TLB
+ * quiescence as the mappings are unchanged, and explicit flushes use
+ * chal_flush_tlb.
+ */
 static inline void
 pgtbl_update(pgtbl_t pt)
 {
-	asm volatile("mov %0, %%cr3" : : "r"(pt));
+	struct cos_cpu_local_info *cos_info = cos_cpu_local_info();
+
+	if (cos_info->curr_pgtbl == (unsigned long)pt) return;
+	cos_info->curr_pgtbl = (unsigned long)pt;
+	__pgtbl_load(pt);
 }
 
 /* vaddr -> kaddr */
@@ -587,6 +699,7 @@ pgtbl_init(void)
 }
 
 int cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr);
+int cap_memactivate_super(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr);
 int pgtbl_kmem_act(pgtbl_t pt, u32_t addr, unsigned long *kern_addr, unsigned long **pte);
 
 #endif /* PGTBL_H */
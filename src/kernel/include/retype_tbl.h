@@ -106,10 +106,14 @@ retypetbl_cas(u32_t *a, u32_t old, u32_t new)
 int retypetbl_retype2user(void *pa);
 int retypetbl_retype2kern(void *pa);
 int retypetbl_retype2frame(void *pa);
+int retypetbl_retype2user_n(void *pa, unsigned int npages);
 
 void retype_tbl_init(void);
 int  retypetbl_ref(void *pa);
 int  retypetbl_kern_ref(void *pa);
 int  retypetbl_deref(void *pa);
+int  retypetbl_ref_n(void *pa, unsigned int npages);
+int  retypetbl_deref_n(void *pa, unsigned int npages);
+int  retypetbl_quiesced(void *pa);
 
 #endif /* RETYPE_TBL_H */
@@ -52,14 +52,36 @@ struct pt_regs {
 #define MAX_SERVICE_DEPTH 31
 #define MAX_NUM_THREADS (64 * NUM_CPU)
 
-/* Stacks are 2 * page_size (expressed in words) */
+/* Stacks are a page by default, and can be made larger (for a whole component) */
+#ifndef MAX_STACK_SZ_BYTE_ORDER
 #define MAX_STACK_SZ_BYTE_ORDER 12
+#endif
 /* Stack size in bytes */
 #define COS_STACK_SZ (1 << MAX_STACK_SZ_BYTE_ORDER)
 /* Stack size in words */
 #define MAX_STACK_SZ (COS_STACK_SZ / 4)
 
-#define ALL_STACK_SZ (MAX_NUM_THREADS * MAX_STACK_SZ)
+/*
+ * Each component has a pool of COS_STACK_POOL_NSTACKS stacks for the
+ * threads executing in it, shared by all cores (see
+ * cos_asm_simple_stacks.h). It is sized by the number of threads
+ * expected in the component at once on each core, not by the number
+ * of threads, so define either for components with more concurrency.
+ * When the pool is empty, invocations of the component return
+ * -ENOMEM, but upcalls into it (e.g. threads created in it) fault.
+ * Freeing a thread only returns the stacks it holds in the component
+ * that frees it (see cos_thd_free): a thread freed while in other
+ * components holds their stacks until they cos_stack_release it.
+ */
+#ifndef COS_STACK_POOL_CORE_NSTACKS
+#define COS_STACK_POOL_CORE_NSTACKS 32
+#endif
+#ifndef COS_STACK_POOL_NSTACKS
+#define COS_STACK_POOL_NSTACKS (COS_STACK_POOL_CORE_NSTACKS * NUM_CPU)
+#endif
+#define COS_STACK_POOL_WORDS (COS_STACK_POOL_NSTACKS / 32)
+#define COS_STACK_POOL_CORE_WORDS (COS_STACK_POOL_WORDS / NUM_CPU)
+#define COS_STACK_POOL_SZ (COS_STACK_POOL_NSTACKS * COS_STACK_SZ)
 #define MAX_SPD_VAS_LOCATIONS 8
 
 /* a kludge:  should not use a tmp stack on a stack miss */
@@ -81,6 +103,9 @@ struct pt_regs {
 #define PGD_SIZE PGD_RANGE
 #define PGD_MASK (~(PGD_RANGE - 1))
 #define PGD_PER_PTBL 1024
+/* a user superpage is mapped by a single pgd entry */
+#define SUPER_PAGE_SIZE PGD_RANGE
+#define SUPER_PAGE_NPAGES (SUPER_PAGE_SIZE / PAGE_SIZE)
 
 /* For this family of macros, do NOT pass zero as the pow2 */
 #define round_to_pow2(x, pow2) (((unsigned long)(x)) & (~((pow2)-1)))
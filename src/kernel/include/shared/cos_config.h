@@ -53,8 +53,27 @@
 #define SCHED_PRINTOUT_PERIOD 100000
 #define COMPONENT_ASSERTIONS 1 // activate assertions in components?
 
+/*
+ * Default invocation stack caching mode (invstk_cache_t) on each
+ * core.  Can be changed at runtime with cos_hw_invstk_cache.
+ */
+#define INVSTK_CACHE_MODE INVSTK_CACHE_TOP
+
+/*
+ * Each core has a ring of asnd notifications from each other core,
+ * of 2^IPI_RING_ORDER entries. Asnds to a full ring fail with -EBUSY.
+ */
+#define IPI_RING_ORDER 6
+
+/*
+ * The maximum number of mappings CAPTBL_OP_CPY_RANGE copies before
+ * returning to user-level; bounds its non-preemptible execution.
+ */
+#define PGTBL_CPY_RANGE_MAX 256
+
 //#define FPU_ENABLED
 #define FPU_SUPPORT_FXSR 1 /* >0 : CPU supports FXSR. */
+#define FPU_SUPPORT_SSE 1  /* >0 : CPU supports SSE. */
 
 /* the CPU that does initialization for Composite */
 #define INIT_CORE 0
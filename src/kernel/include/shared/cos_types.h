@@ -75,7 +75,40 @@ typedef enum {
 	RCV_ALL_PENDING  = 1 << 1,
 } rcv_flags_t;
 
+/*
+ * How the kernel caches the invocation stack of the current thread
+ * on each core (see sinv_call/sret_ret).  Set per-core with
+ * CAPTBL_OP_HW_INVSTK_CACHE, and the boot-time default is
+ * INVSTK_CACHE_MODE in cos_config.h.
+ */
+typedef enum {
+	INVSTK_CACHE_NONE = 0, /* index into the thread's invocation stack */
+	INVSTK_CACHE_TOP,      /* cache a pointer to the top entry, and the thread id */
+	INVSTK_CACHE_FULL,     /* cache the entire invocation stack in core-local memory */
+	INVSTK_CACHE_NMODES,
+} invstk_cache_t;
+
+/*
+ * Per-core counters of the cross-core asnd (IPI) rings, read with
+ * CAPTBL_OP_HW_IPI_STATS.  The sender side counts are for asnds
+ * made on the core, the receiver side, for IPIs handled on it.
+ */
+typedef enum {
+	IPI_STAT_SENT = 0,  /* IPIs sent */
+	IPI_STAT_COALESCED, /* asnds notified by an IPI already in flight */
+	IPI_STAT_ENQ_FAIL,  /* asnds that failed as the ring was full */
+	IPI_STAT_RCVD,      /* IPIs handled */
+	IPI_STAT_DEQUEUED,  /* ring entries processed by IPI handling */
+	IPI_STAT_RATELIMIT, /* asnds coalesced as the asnd was out of budget */
+	IPI_STAT_NTYPES,
+} ipi_stat_t;
+
 #define BOOT_LIVENESS_ID_BASE 2
+/*
+ * The liveness id of user memory unmappings. Sharing it between all
+ * unmappings only makes the quiescence checks more conservative.
+ */
+#define MEM_UNMAP_LIVENESS_ID 1
 
 typedef enum {
 	CAPTBL_OP_CPY,
@@ -117,6 +150,7 @@ typedef enum {
 	CAPTBL_OP_TCAP_DELEGATE,
 	CAPTBL_OP_TCAP_MERGE,
 	CAPTBL_OP_TCAP_WAKEUP,
+	CAPTBL_OP_SINV_BATCH,
 
 	CAPTBL_OP_HW_ACTIVATE,
 	CAPTBL_OP_HW_DEACTIVATE,
@@ -126,6 +160,12 @@ typedef enum {
 	CAPTBL_OP_HW_CYC_USEC,
 	CAPTBL_OP_HW_CYC_THRESH,
 	CAPTBL_OP_HW_SHUTDOWN,
+	CAPTBL_OP_HW_INVSTK_CACHE,
+	CAPTBL_OP_HW_IPI_STATS,
+	CAPTBL_OP_CPY_RANGE,
+	CAPTBL_OP_MEMACTIVATE_SUPER,
+	CAPTBL_OP_MEM_QUIESCED,
+	CAPTBL_OP_CPY_RANGE_RO,
 } syscall_op_t;
 
 typedef enum {
@@ -161,6 +201,20 @@ typedef unsigned long capid_t;
 #define TCAP_RES_IS_INF(r) (r == TCAP_RES_INF)
 typedef capid_t tcap_t;
 
+/*
+ * A single synchronous invocation within a batch (see
+ * CAPTBL_OP_SINV_BATCH).  The arguments are passed as with a normal
+ * sinv, and the return values (as in cos_sinv_rets) are written back
+ * into rets.  A batch must reside within a single page.
+ */
+struct cos_sinv_batch_ent {
+	capid_t sinv;
+	word_t  args[4];
+	word_t  rets[3];
+};
+
+#define COS_SINV_BATCH_MAX (PAGE_SIZE / sizeof(struct cos_sinv_batch_ent))
+
 #define ARCV_NOTIF_DEPTH 8
 
 #define QUIESCENCE_CHECK(curr, past, quiescence_period) (((curr) - (past)) > (quiescence_period))
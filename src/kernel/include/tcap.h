@@ -52,6 +52,12 @@ struct tcap {
 	u8_t               ndelegs, curr_sched_off;
 	u16_t              cpuid;
 	tcap_prio_t        perm_prio;
+	/*
+	 * The priority key: bounds on the priorities in delegations,
+	 * next to the budget so that the common preemption decisions
+	 * in tcap_higher_prio needn't walk the delegations.
+	 */
+	tcap_prio_t prio_min, prio_max;
 
 	/*
 	 * Which chain of temporal capabilities resulted in this
@@ -90,6 +96,19 @@ tcap_sched_info(struct tcap *t)
 	return &t->delegations[t->curr_sched_off];
 }
 
+/* Recompute the priority key after the delegations change */
+static inline void
+tcap_prio_bounds(struct tcap *t)
+{
+	int i;
+
+	t->prio_min = t->prio_max = t->delegations[0].prio;
+	for (i = 1; i < t->ndelegs; i++) {
+		if (t->delegations[i].prio < t->prio_min) t->prio_min = t->delegations[i].prio;
+		if (t->delegations[i].prio > t->prio_max) t->prio_max = t->delegations[i].prio;
+	}
+}
+
 static inline void
 tcap_ref_take(struct tcap *t)
 {
@@ -171,6 +190,7 @@ tcap_consume(struct tcap *t, tcap_res_t cycles)
 			memcpy(&t->delegations[0], tcap_sched_info(t), sizeof(struct tcap_sched_info));
 			t->curr_sched_off = 0;
 		}
+		t->prio_min = t->prio_max = t->delegations[0].prio;
 	} else {
 		t->budget.cycles -= cycles;
 	}
@@ -193,8 +213,16 @@ tcap_expended(struct tcap *t)
 static inline void
 tcap_setprio(struct tcap *t, tcap_prio_t p)
 {
+	tcap_prio_t old;
+
 	assert(t);
+	old                      = tcap_sched_info(t)->prio;
 	tcap_sched_info(t)->prio = p;
+
+	/* only walk the delegations if the bound we're moving away from is lost */
+	if (p < t->prio_min) t->prio_min = p;
+	if (p > t->prio_max) t->prio_max = p;
+	if ((old == t->prio_min && p > old) || (old == t->prio_max && p < old)) tcap_prio_bounds(t);
 }
 
 static inline struct tcap *
@@ -283,6 +311,17 @@ tcap_higher_prio(struct tcap *a, struct tcap *c)
 	if (tcap_expended(a)) return 0;
 	if (unlikely(a == c)) return 1;
 
+	/*
+	 * The common cases don't need the walk: a's priority is at
+	 * least c's for any scheduler they might share, or they share
+	 * the root scheduler (the lowest uid, thus first) and it
+	 * prefers c.
+	 */
+	if (a->prio_max <= c->prio_min) return 1;
+	if (a->delegations[0].tcap_uid == c->delegations[0].tcap_uid
+	    && a->delegations[0].prio > c->delegations[0].prio)
+		return 0;
+
 	for (i = 0, j = 0; i < a->ndelegs && j < c->ndelegs;) {
 		/*
 		 * These cases are for the case where the tcaps don't
@@ -11,6 +11,7 @@
 #include "component.h"
 #include "cap_ops.h"
 #include "fpu_regs.h"
+#include "per_cpu.h"
 #include "chal/cpuid.h"
 #include "chal/call_convention.h"
 #include "pgtbl.h"
@@ -25,6 +26,13 @@ struct invstk_entry {
 
 #define THD_INVSTK_MAXSZ 32
 
+/*
+ * Core-local copy of the current thread's invocation stack, used in
+ * the INVSTK_CACHE_FULL mode.  It is written back to, and reloaded
+ * from, the thread structure on thread switches.
+ */
+extern struct invstk_entry invstk_cache[NUM_CPU][THD_INVSTK_MAXSZ];
+
 /*
  * This is the data structure embedded in threads that are associated
  * with an asynchronous receive end-point.  It tracks the reference
@@ -40,6 +48,18 @@ struct rcvcap_info {
 	struct thread *rcvcap_thd_notif; /* The parent rcvcap thread for notifications */
 };
 
+/*
+ * The state of a batch of synchronous invocations being made by a
+ * thread (see sinv_batch_call).  Only one batch can be active per
+ * thread.
+ */
+struct inv_batch {
+	struct cos_sinv_batch_ent *ents;  /* kernel address of the descriptors */
+	u16_t                      n, curr;
+	u16_t                      frame; /* invocation stack index of the client */
+	pgtbl_t                    pgtbl; /* page-table of the current invocation's server */
+};
+
 typedef enum {
 	THD_STATE_PREEMPTED = 1,
 	THD_STATE_RCVING    = 1 << 1, /* report to parent rcvcap that we're receiving */
@@ -60,6 +80,7 @@ struct thread {
 
 	/* TODO: same cache-line as the tid */
 	struct invstk_entry invstk[THD_INVSTK_MAXSZ];
+	struct inv_batch    inv_batch;
 
 	thd_state_t    state;
 	u32_t          tls;
@@ -107,25 +128,94 @@ thd_upcall_setup(struct thread *thd, u32_t entry_addr, int option, int arg1, int
 }
 
 /*
- * FIXME: We need global thread name space as we use thd_id to access
- * simple stacks. When we have low-level per comp stack free-list, we
- * don't have to use global thread id name space.
+ * Thread ids are recycled when threads are destroyed, so they stay
+ * in [1, MAX_NUM_THREADS) however many threads are created over the
+ * system's lifetime. Each core caches free ids in its own pool,
+ * which is only accessed by that core (with interrupts disabled), so
+ * the common case needs no atomic operations. An empty pool is
+ * refilled first with ids that have never been allocated
+ * (free_thd_id), then with a word's worth of the ids freed into the
+ * global bitmap, thdid_freemap. A core only keeps THDID_POOL_CACHED
+ * of the ids freed on it, and gives the rest to the bitmap, so few
+ * ids are stranded in the pools of the other cores when all of the
+ * never-allocated ones are used.
  *
- * Update: this is only partially true.  We should really just get rid
- * of this id in the kernel and replace it with a
+ * Ids are reused, so user-level must stop referring to a thread's id
+ * once it has deactivated the thread's last capability.
+ *
+ * FIXME: we should really just get rid of this id in the kernel and replace it with a
  * scheduler-configurable variable.  That variable can be the thread
  * id where appropriate, and some other (component-controlled)
  * principal id otherwise.  Given this, the allocator should be in the
  * scheduler, not here.
  */
-extern u32_t free_thd_id;
-static u32_t
+#define THDID_POOL_SZ 32 /* a bitmap word, for refills */
+#define THDID_POOL_CACHED (THDID_POOL_SZ / 2)
+#define THDID_FREEMAP_WORDS (MAX_NUM_THREADS / 32)
+
+struct thdid_pool {
+	u32_t   n;
+	thdid_t ids[THDID_POOL_SZ];
+};
+PERCPU_DECL(struct thdid_pool, thdid_pool);
+PERCPU_EXTERN(thdid_pool);
+
+extern u32_t         free_thd_id;
+extern unsigned long thdid_freemap[THDID_FREEMAP_WORDS];
+
+/* Move the ids of the first non-empty word of the bitmap into the (empty) pool */
+static void
+thdid_pool_refill(struct thdid_pool *p)
+{
+	unsigned long w;
+	int           i;
+
+	assert(p->n == 0);
+	for (i = 0; i < THDID_FREEMAP_WORDS && p->n == 0; i++) {
+		do {
+			w = thdid_freemap[i];
+		} while (w && cos_cas(&thdid_freemap[i], w, 0) != CAS_SUCCESS);
+
+		for (; w; w &= w - 1) p->ids[p->n++] = i * 32 + __builtin_ctzl(w);
+	}
+}
+
+/* Returns 0 if all ids are in use */
+static thdid_t
 thdid_alloc(void)
 {
-	/* FIXME: thd id address space management. */
-	if (unlikely(free_thd_id >= MAX_NUM_THREADS)) assert(0);
-	return cos_faa((int *)&free_thd_id, 1);
+	struct thdid_pool *p = PERCPU_GET(thdid_pool);
+	u32_t              id;
+
+	if (likely(p->n > 0)) return p->ids[--p->n];
+
+	if (free_thd_id < MAX_NUM_THREADS) {
+		id = cos_faa((int *)&free_thd_id, 1);
+		if (id < MAX_NUM_THREADS) return id;
+	}
+	thdid_pool_refill(p);
+	if (unlikely(p->n == 0)) return 0;
+
+	return p->ids[--p->n];
 }
+
+static void
+thdid_free(thdid_t id)
+{
+	struct thdid_pool *p = PERCPU_GET(thdid_pool);
+	unsigned long     *w = &thdid_freemap[id / 32];
+	unsigned long      old;
+
+	assert(id > 0 && id < MAX_NUM_THREADS);
+	if (likely(p->n < THDID_POOL_CACHED)) {
+		p->ids[p->n++] = id;
+		return;
+	}
+	do {
+		old = *w;
+	} while (cos_cas(w, old, old | (1UL << (id % 32))) != CAS_SUCCESS);
+}
+
 static void
 thd_rcvcap_take(struct thread *t)
 {
@@ -277,6 +367,12 @@ thd_rcvcap_pending_inc(struct thread *arcvt)
 	arcvt->rcvcap.pending++;
 }
 
+static void
+thd_rcvcap_pending_add(struct thread *arcvt, int n)
+{
+	arcvt->rcvcap.pending += n;
+}
+
 static int
 thd_rcvcap_pending_dec(struct thread *arcvt)
 {
@@ -311,13 +407,63 @@ thd_current(struct cos_cpu_local_info *cos_info)
 	return (struct thread *)(cos_info->curr_thd);
 }
 
+/*
+ * Commit the cached invocation stack state of the current thread,
+ * thd, back into its thread structure.
+ */
+static inline void
+thd_invstk_cache_commit(struct thread *thd, struct cos_cpu_local_info *cos_info)
+{
+	thd->invstk_top = cos_info->invstk_top;
+	if (cos_info->invstk_mode != INVSTK_CACHE_FULL) return;
+
+	memcpy(thd->invstk, invstk_cache[get_cpuid()], sizeof(struct invstk_entry) * (thd->invstk_top + 1));
+}
+
+/* Load the invocation stack state of thd, which is becoming the current thread, into the cache. */
+static inline void
+thd_invstk_cache_load(struct thread *thd, struct cos_cpu_local_info *cos_info)
+{
+	struct invstk_entry *base = thd->invstk;
+
+	cos_info->invstk_top = thd->invstk_top;
+	if (cos_info->invstk_mode == INVSTK_CACHE_NONE) return;
+
+	if (cos_info->invstk_mode == INVSTK_CACHE_FULL) {
+		base = invstk_cache[get_cpuid()];
+		memcpy(base, thd->invstk, sizeof(struct invstk_entry) * (thd->invstk_top + 1));
+	}
+	cos_info->invstk_curr  = &base[thd->invstk_top];
+	cos_info->invstk_thdid = thd->tid | (get_cpuid() << 16);
+}
+
 static inline void
 thd_current_update(struct thread *next, struct thread *prev, struct cos_cpu_local_info *cos_info)
 {
 	/* commit the cached data */
-	prev->invstk_top     = cos_info->invstk_top;
-	cos_info->invstk_top = next->invstk_top;
-	cos_info->curr_thd   = next;
+	thd_invstk_cache_commit(prev, cos_info);
+	thd_invstk_cache_load(next, cos_info);
+	cos_info->curr_thd = next;
+}
+
+/*
+ * Change the invocation stack caching mode on this core.  Only the
+ * current thread's invocation stack can be cached, so we commit it
+ * in the old mode, and reload it in the new one.  Returns the
+ * previous mode.
+ */
+static int
+thd_invstk_cache_mode(struct thread *curr, unsigned long mode, struct cos_cpu_local_info *cos_info)
+{
+	int prev = cos_info->invstk_mode;
+
+	if (mode >= INVSTK_CACHE_NMODES) return -EINVAL;
+
+	thd_invstk_cache_commit(curr, cos_info);
+	cos_info->invstk_mode = mode;
+	thd_invstk_cache_load(curr, cos_info);
+
+	return prev;
 }
 
 static inline struct thread *
@@ -344,17 +490,20 @@ thd_activate(struct captbl *t, capid_t cap, capid_t capin, struct thread *thd, c
 	compc = (struct cap_comp *)captbl_lkup(t, compcap);
 	if (unlikely(!compc || compc->h.type != CAP_COMP)) return -EINVAL;
 
+	thd->tid = thdid_alloc();
+	if (unlikely(!thd->tid)) return -ENOMEM;
 	tc = (struct cap_thd *)__cap_capactivate_pre(t, cap, capin, CAP_THD, &ret);
-	if (!tc) return ret;
+	if (!tc) {
+		thdid_free(thd->tid);
+		return ret;
+	}
 
 	/* initialize the thread */
 	memcpy(&(thd->invstk[0].comp_info), &compc->info, sizeof(struct comp_info));
 	thd->invstk[0].ip = thd->invstk[0].sp = 0;
-	thd->tid                              = thdid_alloc();
 	thd->refcnt                           = 1;
 	thd->invstk_top                       = 0;
 	thd->cpuid                            = get_cpuid();
-	assert(thd->tid <= MAX_NUM_THREADS);
 	thd_scheduler_set(thd, thd_current(cli));
 
 	thd_rcvcap_init(thd);
@@ -417,6 +566,14 @@ thd_deactivate(struct captbl *ct, struct cap_captbl *dest_ct, unsigned long capi
 	/* deactivation success */
 	if (thd->refcnt == 0) {
 		if (cli->next_ti.thd == thd) thd_next_thdinfo_update(cli, 0, 0, 0, 0);
+		/*
+		 * The thread's state in the FPU needn't be saved
+		 * anymore. Its core might be running, and switching
+		 * the FPU to another thread, so only clear the entry
+		 * if it is still this thread.
+		 */
+		cos_cas((unsigned long *)PERCPU_GET_TARGET(fpu_last_used, thd->cpuid), (unsigned long)thd, 0);
+		thdid_free(thd->tid);
 
 		/* move the kmem for the thread to a location
 		 * in a pagetable as COSFRAME */
@@ -478,7 +635,8 @@ thd_invstk_current(struct thread *curr_thd, unsigned long *ip, unsigned long *sp
 	/* curr_thd should be the current thread! We are using cached invstk_top. */
 	struct invstk_entry *curr;
 
-	curr = &curr_thd->invstk[curr_invstk_top(cos_info)];
+	if (cos_info->invstk_mode != INVSTK_CACHE_NONE) curr = cos_info->invstk_curr;
+	else                                            curr = &curr_thd->invstk[curr_invstk_top(cos_info)];
 	*ip  = curr->ip;
 	*sp  = curr->sp;
 
@@ -502,10 +660,16 @@ thd_invstk_push(struct thread *thd, struct comp_info *ci, unsigned long ip, unsi
 {
 	struct invstk_entry *top, *prev;
 
-	if (unlikely(curr_invstk_top(cos_info) >= THD_INVSTK_MAXSZ)) return -1;
+	if (unlikely(curr_invstk_top(cos_info) >= THD_INVSTK_MAXSZ - 1)) return -1;
 
-	prev = &thd->invstk[curr_invstk_top(cos_info)];
-	top  = &thd->invstk[curr_invstk_top(cos_info) + 1];
+	if (cos_info->invstk_mode != INVSTK_CACHE_NONE) {
+		prev                  = cos_info->invstk_curr;
+		top                   = prev + 1;
+		cos_info->invstk_curr = top;
+	} else {
+		prev = &thd->invstk[curr_invstk_top(cos_info)];
+		top  = &thd->invstk[curr_invstk_top(cos_info) + 1];
+	}
 	curr_invstk_inc(cos_info);
 	prev->ip = ip;
 	prev->sp = sp;
@@ -520,9 +684,21 @@ thd_invstk_pop(struct thread *thd, unsigned long *ip, unsigned long *sp, struct
 {
 	if (unlikely(curr_invstk_top(cos_info) == 0)) return NULL;
 	curr_invstk_dec(cos_info);
+	if (cos_info->invstk_mode != INVSTK_CACHE_NONE) {
+		cos_info->invstk_curr = (struct invstk_entry *)cos_info->invstk_curr - 1;
+	}
 	return thd_invstk_current(thd, ip, sp, cos_info);
 }
 
+/* The thread and cpu id passed to the component on invocation */
+static inline unsigned long
+thd_invstk_thdid(struct thread *thd, struct cos_cpu_local_info *cos_info)
+{
+	if (cos_info->invstk_mode != INVSTK_CACHE_NONE) return cos_info->invstk_thdid;
+
+	return thd->tid | (get_cpuid() << 16);
+}
+
 static inline void
 thd_preemption_state_update(struct thread *curr, struct thread *next, struct pt_regs *regs)
 {
@@ -552,8 +728,6 @@ thd_switch_update(struct thread *thd, struct pt_regs *regs, int issame)
 {
 	int preempt = 0;
 
-	/* TODO: check FPU */
-	/* fpu_save(thd); */
 	if (thd->state & THD_STATE_PREEMPTED) {
 		assert(!(thd->state & THD_STATE_RCVING));
 		thd->state &= ~THD_STATE_PREEMPTED;
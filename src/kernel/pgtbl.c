@@ -47,17 +47,34 @@ pgtbl_kmem_act(pgtbl_t pt, u32_t addr, unsigned long *kern_addr, unsigned long *
 	return 0;
 }
 
+/*
+ * Return 1 if quiescent past since input timestamp. 0 if not. Unlike
+ * tlb_quiescence_check, this is silent, as it is used for polling.
+ */
+int
+tlb_quiescence_poll(u64_t timestamp)
+{
+	int i;
+
+	if (timestamp <= tlb_quiescence[get_cpuid()].last_periodic_flush) return 1;
+	for (i = 0; i < NUM_CPU_COS; i++) {
+		if (timestamp > tlb_quiescence[i].last_mandatory_flush) return 0;
+	}
+
+	return 1;
+}
+
 /* Return 1 if quiescent past since input timestamp. 0 if not. */
 int
 tlb_quiescence_check(u64_t timestamp)
 {
 	int i, quiescent = 1;
 
-	/* Did timer interrupt (which does tlb flush
-	 * periodically) happen after unmap? The periodic
-	 * flush happens on all cpus, thus only need to check
-	 * the time stamp of the current core for that case
-	 * (assuming consistent time stamp counters). */
+	/* Did timer interrupts (which do tlb flushes
+	 * periodically) happen on all cores after unmap? The
+	 * current core's periodic time stamp is the oldest of
+	 * the cores' flushes, thus only need to check it for
+	 * that case (assuming consistent time stamp counters). */
 	if (timestamp > tlb_quiescence[get_cpuid()].last_periodic_flush) {
 		/* If no periodic flush done yet, did the
 		 * mandatory flush happen on all cores? */
@@ -108,6 +125,44 @@ cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capi
 	return ret;
 }
 
+/*
+ * Retype the SUPER_PAGE_NPAGES untyped frames at frame_cap to user
+ * memory, and map them as a superpage at vaddr in dest_pt. The
+ * frames must be physically contiguous, and superpage aligned.
+ */
+int
+cap_memactivate_super(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr)
+{
+	unsigned long *    pte, cosframe = 0, orig_v;
+	struct cap_header *dest_pt_h;
+	u32_t              flags;
+	unsigned int       i;
+	int                ret;
+
+	if (unlikely(pt->lvl || (pt->refcnt_flags & CAP_MEM_FROZEN_FLAG))) return -EINVAL;
+	if (unlikely(vaddr & (SUPER_PAGE_SIZE - 1))) return -EINVAL;
+
+	dest_pt_h = captbl_lkup(ct, dest_pt);
+	if (!dest_pt_h || dest_pt_h->type != CAP_PGTBL) return -EINVAL;
+	if (((struct cap_pgtbl *)dest_pt_h)->lvl) return -EINVAL;
+
+	for (i = 0; i < SUPER_PAGE_NPAGES; i++) {
+		pte = pgtbl_lkup_pte(pt->pgtbl, frame_cap + i * PAGE_SIZE, &flags);
+		if (!pte) return -EINVAL;
+		orig_v = *pte;
+
+		if (!(orig_v & PGTBL_COSFRAME) || (orig_v & PGTBL_COSKMEM)) return -EPERM;
+		if (i == 0) cosframe = orig_v & PGTBL_FRAME_MASK;
+		if ((orig_v & PGTBL_FRAME_MASK) != cosframe + i * PAGE_SIZE) return -EINVAL;
+	}
+	if (cosframe & (SUPER_PAGE_SIZE - 1)) return -EINVAL;
+
+	ret = retypetbl_retype2user_n((void *)cosframe, SUPER_PAGE_NPAGES);
+	if (ret) return ret;
+
+	return pgtbl_mapping_add(((struct cap_pgtbl *)dest_pt_h)->pgtbl, vaddr, cosframe, PGTBL_USER_DEF | PGTBL_SUPER);
+}
+
 int
 pgtbl_activate(struct captbl *t, unsigned long cap, unsigned long capin, pgtbl_t pgtbl, u32_t lvl)
 {
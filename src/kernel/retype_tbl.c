@@ -132,6 +132,31 @@ retypetbl_retype2kern(void *pa)
 
 /* implemented in pgtbl.c */
 int tlb_quiescence_check(u64_t unmap_time);
+int tlb_quiescence_poll(u64_t unmap_time);
+
+/*
+ * Have the TLBs of all cores been flushed since the last unmapping
+ * of the frame at pa? If so, the frame can be reused without stale
+ * TLB entries aliasing it. Returns 1 if so, 0 if not.
+ */
+int
+retypetbl_quiesced(void *pa)
+{
+	u32_t idx;
+	u64_t last_unmap = 0;
+	int   cpu;
+
+	PA_BOUNDARY_CHECK();
+
+	idx = GET_MEM_IDX(pa);
+	assert(idx < N_MEM_SETS);
+
+	for (cpu = 0; cpu < NUM_CPU; cpu++) {
+		if (last_unmap < retype_tbl[cpu].mem_set[idx].last_unmap) last_unmap = retype_tbl[cpu].mem_set[idx].last_unmap;
+	}
+
+	return tlb_quiescence_poll(last_unmap);
+}
 
 int
 retypetbl_retype2frame(void *pa)
@@ -220,6 +245,65 @@ restore_all:
 	return ret;
 }
 
+/*
+ * The _n variants operate on npages physically contiguous frames
+ * starting at pa (e.g. the frames backing a superpage). They are all
+ * or nothing: on failure, the frames already modified are restored.
+ */
+int
+retypetbl_retype2user_n(void *pa, unsigned int npages)
+{
+	unsigned int i;
+	int          ret;
+
+	for (i = 0; i < npages; i++) {
+		ret = retypetbl_retype2user((char *)pa + i * PAGE_SIZE);
+		if (ret) goto undo;
+	}
+
+	return 0;
+undo:
+	while (i-- > 0) retypetbl_retype2frame((char *)pa + i * PAGE_SIZE);
+
+	return ret;
+}
+
+int
+retypetbl_ref_n(void *pa, unsigned int npages)
+{
+	unsigned int i;
+	int          ret;
+
+	for (i = 0; i < npages; i++) {
+		ret = retypetbl_ref((char *)pa + i * PAGE_SIZE);
+		if (ret) goto undo;
+	}
+
+	return 0;
+undo:
+	while (i-- > 0) retypetbl_deref((char *)pa + i * PAGE_SIZE);
+
+	return ret;
+}
+
+int
+retypetbl_deref_n(void *pa, unsigned int npages)
+{
+	unsigned int i;
+	int          ret;
+
+	for (i = 0; i < npages; i++) {
+		ret = retypetbl_deref((char *)pa + i * PAGE_SIZE);
+		if (ret) goto undo;
+	}
+
+	return 0;
+undo:
+	while (i-- > 0) retypetbl_ref((char *)pa + i * PAGE_SIZE);
+
+	return ret;
+}
+
 void
 retype_tbl_init(void)
 {
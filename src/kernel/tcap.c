@@ -43,6 +43,8 @@ __tcap_init(struct tcap *t)
 	t->refcnt                  = 1;
 	t->arcv_ep                 = NULL;
 	t->perm_prio               = 0;
+	t->prio_min                = 0;
+	t->prio_max                = 0;
 	tcap_setprio(t, 0);
 	list_init(&t->active_list, t);
 }
@@ -63,6 +65,7 @@ tcap_delete(struct tcap *tcap)
 	memset(&tcap->budget, 0, sizeof(struct tcap_budget));
 	memset(tcap->delegations, 0, sizeof(struct tcap_sched_info) * TCAP_MAX_DELEGATIONS);
 	tcap->ndelegs = tcap->cpuid = tcap->curr_sched_off = tcap->perm_prio = 0;
+	tcap->prio_min = tcap->prio_max = 0;
 	if (cli->next_ti.tc == tcap) thd_next_thdinfo_update(cli, 0, 0, 0, 0);
 
 	return 0;
@@ -153,8 +156,8 @@ tcap_delegate(struct tcap *dst, struct tcap *src, tcap_res_t cycles, tcap_prio_t
 	d = tcap_sched_info(dst)->tcap_uid;
 	s = tcap_sched_info(src)->tcap_uid;
 	if (unlikely(dst == src)) {
-		tcap_sched_info(dst)->prio = prio;
-		dst->perm_prio             = prio;
+		tcap_setprio(dst, prio);
+		dst->perm_prio = prio;
 		return 0;
 	}
 	if (!prio) prio = tcap_sched_info(src)->prio;
@@ -199,6 +202,7 @@ tcap_delegate(struct tcap *dst, struct tcap *src, tcap_res_t cycles, tcap_prio_t
 	dst->curr_sched_off        = si;
 	dst->perm_prio             = prio;
 	tcap_sched_info(dst)->prio = prio;
+	tcap_prio_bounds(dst);
 	/*
 	 * TODO: Logic to differentiate between scheduler and non-scheduler tcaps!
 	 *       non-scheduler tcaps to have curr_sched_off set to their schedulers and no dedicated uids.
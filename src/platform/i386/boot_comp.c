@@ -52,6 +52,7 @@ kern_boot_thd(struct captbl *ct, void *thd_mem, void *tcap_mem, const cpuid_t cp
 	thd_next_thdinfo_update(cos_info, 0, 0, 0, 0);
 
 	thd_current_update(t, t, cos_info);
+	thd_invstk_cache_mode(t, INVSTK_CACHE_MODE, cos_info);
 	thd_scheduler_set(t, t);
 
 	ret = arcv_activate(ct, BOOT_CAPTBL_SELF_CT, BOOT_CAPTBL_SELF_INITRCV_BASE_CPU(cpu_id), BOOT_CAPTBL_SELF_COMP,
@@ -220,15 +221,15 @@ void
 kern_boot_comp(const cpuid_t cpu_id)
 {
 	int            ret = 0, nkmemptes;
-	unsigned int   i;
-	u8_t *         boot_comp_captbl;
+	unsigned int   i, utmem_sz, utmem_split;
+	u8_t *         boot_comp_captbl, *utmem;
 	pgtbl_t        pgtbl     = (pgtbl_t)chal_va2pa(&boot_comp_pgd), boot_vm_pgd;
 	u32_t          hw_bitmap = ~0;
 
 	assert(cpu_id >= 0);
 	if (NUM_CPU > 1 && cpu_id > 0) {
 		assert(glb_boot_ct);
-		pgtbl_update(pgtbl);
+		__pgtbl_load(pgtbl);
 		kern_boot_thd(glb_boot_ct, thd_mem[cpu_id], tcap_mem[cpu_id], cpu_id);
 		return;
 	}
@@ -296,10 +297,27 @@ kern_boot_comp(const cpuid_t cpu_id)
 	nkmemptes = boot_nptes(mem_utmem_end() - mem_boot_end());
 	boot_pgtbl_expand(glb_boot_ct, BOOT_CAPTBL_SELF_UNTYPED_PT, BOOT_CAPTBL_KM_PTE, "untyped memory",
 			  BOOT_MEM_KM_BASE, mem_utmem_end() - mem_boot_nalloc_end(nkmemptes));
+	/*
+	 * Superpages must be physically aligned, and are mapped at
+	 * aligned virtual addresses. Map the untyped memory from its
+	 * first physical superpage boundary at BOOT_MEM_KM_BASE (which
+	 * is superpage aligned), and the frames before that boundary
+	 * at the end, so that the aligned frames are at aligned offsets
+	 * in the untyped memory.
+	 */
+	utmem       = mem_boot_nalloc_end(nkmemptes);
+	utmem_sz    = mem_utmem_end() - utmem;
+	utmem_split = round_up_to_pgd_page(chal_va2pa(utmem)) - chal_va2pa(utmem);
+	if (utmem_split >= utmem_sz) utmem_split = 0;
 	ret = boot_pgtbl_mappings_add(glb_boot_ct, BOOT_CAPTBL_SELF_UNTYPED_PT, BOOT_CAPTBL_KM_PTE, "untyped memory",
-                                      mem_boot_nalloc_end(nkmemptes), BOOT_MEM_KM_BASE,
-                                      mem_utmem_end() - mem_boot_nalloc_end(nkmemptes), 0);
+                                      utmem + utmem_split, BOOT_MEM_KM_BASE, utmem_sz - utmem_split, 0);
 	assert(ret == 0);
+	if (utmem_split) {
+		ret = boot_pgtbl_mappings_add(glb_boot_ct, BOOT_CAPTBL_SELF_UNTYPED_PT, BOOT_CAPTBL_KM_PTE,
+		                              "untyped memory (below the first superpage)", utmem,
+		                              BOOT_MEM_KM_BASE + utmem_sz - utmem_split, utmem_split, 0);
+		assert(ret == 0);
+	}
 
 	printk("\tCapability table and page-table created.\n");
 
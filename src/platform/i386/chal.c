@@ -94,6 +94,7 @@ chal_init(void)
 	if (d & (1 << 9)) printk("apic ");
 	if (c & (1 << 21)) printk("x2apic ");
 	if (c & (1 << 24)) printk("tsc-deadline ");
+	if (c & (1 << 17)) printk("pcid ");
 	chal_cpuid(0x80000001, &a, &b, &c, &d);
 	if (d & (1 << 27)) printk("rdtscp ");
 	chal_cpuid(0x80000007, &a, &b, &c, &d);
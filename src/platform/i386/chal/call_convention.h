@@ -64,6 +64,15 @@ __userregs_sinvupdate(struct pt_regs *regs)
 	/* regs->di = regs->di; */
 	regs->bp = regs->dx;
 }
+/* Set the arguments as the server side of an invocation receives them */
+static inline void
+__userregs_setinvargs(struct pt_regs *regs, unsigned long a1, unsigned long a2, unsigned long a3, unsigned long a4)
+{
+	regs->bx = a1;
+	regs->si = a2;
+	regs->di = a3;
+	regs->bp = a4;
+}
 static inline int
 __userregs_get1(struct pt_regs *regs)
 {
@@ -61,6 +61,18 @@ struct cos_cpu_local_info {
 	 * things. (e.g. captbl, etc)
 	 */
 	int           invstk_top;
+	/*
+	 * Invocation stack caching (see invstk_cache_t).  When
+	 * enabled, invstk_curr points to the top entry of the current
+	 * thread's invocation stack, and invstk_thdid holds the
+	 * thread/cpu id passed to the invoked component.  Together,
+	 * these let the inv/ret path avoid the thread structure.
+	 */
+	int           invstk_mode;
+	void *        invstk_curr;
+	unsigned long invstk_thdid;
+	/* page-table currently loaded on this core (see pgtbl_update) */
+	unsigned long curr_pgtbl;
 	unsigned long epoch;
 	/***********************************************/
 	/*
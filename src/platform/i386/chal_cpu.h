@@ -54,7 +54,7 @@ chal_cpu_pgtbl_activate(pgtbl_t pgtbl)
 {
 	//	unsigned long cr0;
 
-	pgtbl_update(pgtbl);
+	__pgtbl_load(pgtbl);
 	/* asm volatile("mov %%cr0, %0" : "=r"(cr0)); */
 	/* cr0 |= CR0_PG; */
 	/* printk("cr0 = %x\n", cr0); */
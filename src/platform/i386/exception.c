@@ -1,5 +1,6 @@
 #include <pgtbl.h>
 #include <thd.h>
+#include <fpu.h>
 
 #include "kernel.h"
 #include "string.h"
@@ -78,6 +79,10 @@ invalid_opcode_fault_handler(struct pt_regs *regs)
 int
 device_not_avail_fault_handler(struct pt_regs *regs)
 {
+#ifdef FPU_ENABLED
+	/* lazy FPU switch: the current thread's first FPU use since it was switched to */
+	if (fpu_disabled_exception_handler() == 0) return 0;
+#endif
 	print_regs_state(regs);
 	die("FAULT: Device Not Available\n");
 
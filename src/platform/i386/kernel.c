@@ -10,6 +10,7 @@
 #include <retype_tbl.h>
 #include <component.h>
 #include <thd.h>
+#include <fpu.h>
 
 #define ADDR_STR_LEN 8
 
@@ -127,6 +128,7 @@ kmain(struct multiboot *mboot, u32_t mboot_magic, u32_t esp)
 	boot_state_transition(INIT_CPU, INIT_MEM_MAP);
 
 	chal_init();
+	fpu_init();
 	cap_init();
 	ltbl_init();
 	retype_tbl_init();
@@ -165,6 +167,7 @@ smp_kmain(void)
 	idt_init(cpu_id);
 
 	chal_cpu_init();
+	fpu_init();
 	kern_boot_comp(cpu_id);
 	lapic_init();
 
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+cp unit_edf_test.o llboot.o
+./cos_linker "llboot.o, :" ./gen_client_stub
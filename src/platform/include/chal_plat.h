@@ -11,6 +11,12 @@ chal_flush_cache(void)
 static inline void
 chal_flush_tlb_global(void)
 {
+	unsigned long cr4;
+
+	/* toggling PGE flushes all entries, including global ones */
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+	asm volatile("mov %0, %%cr4" : : "r"(cr4 & ~(1 << 7)) : "memory");
+	asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
 }
 static inline void
 chal_remote_tlb_flush(int target_cpu)
@@ -20,6 +26,10 @@ chal_remote_tlb_flush(int target_cpu)
 static inline void
 chal_flush_tlb(void)
 {
+	unsigned long cr3;
+
+	asm volatile("mov %%cr3, %0" : "=r"(cr3));
+	asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
 }
 
 #endif /* CHAL_PLAT_H */